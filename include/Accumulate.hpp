@@ -0,0 +1,66 @@
+// Copyright 2017 Netherlands Institute for Radio Astronomy (ASTRON)
+// Copyright 2017 Netherlands eScience Center
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+#include <cstdint>
+
+
+#pragma once
+
+namespace Dedispersion {
+
+// Add a contiguous run of input samples to a run of accumulators: accumulator[sample] += input[sample]
+template< typename I, typename L > void accumulate(const I * input, L * accumulator, const unsigned int nrSamples);
+// Vectorized for 8 bit input, the instruction set (AVX-512, AVX2, SSE4.1 or none) is selected at runtime
+template<> void accumulate< uint8_t, float >(const uint8_t * input, float * accumulator, const unsigned int nrSamples);
+// Add the same run of samples of several input rows to a run of accumulators, one row after the other: accumulator[sample] += rows[0][sample] + ... + rows[nrRows - 1][sample]
+// The accumulators are kept in registers over all the rows, and the result is identical to calling accumulate once per row.
+template< typename I, typename L > void accumulateRows(const I * const * rows, const unsigned int nrRows, L * accumulator, const unsigned int nrSamples);
+template<> void accumulateRows< uint8_t, float >(const uint8_t * const * rows, const unsigned int nrRows, float * accumulator, const unsigned int nrSamples);
+// Integer accumulators for 8 bit input: the adds are exact as long as the sums fit in the accumulator (see isIntermediateTypeLargeEnough()),
+// and twice (uint32_t) or four times (uint16_t) as many accumulators as for float fit in a vector register
+template<> void accumulate< uint8_t, uint16_t >(const uint8_t * input, uint16_t * accumulator, const unsigned int nrSamples);
+template<> void accumulateRows< uint8_t, uint16_t >(const uint8_t * const * rows, const unsigned int nrRows, uint16_t * accumulator, const unsigned int nrSamples);
+template<> void accumulate< uint8_t, uint32_t >(const uint8_t * input, uint32_t * accumulator, const unsigned int nrSamples);
+template<> void accumulateRows< uint8_t, uint32_t >(const uint8_t * const * rows, const unsigned int nrRows, uint32_t * accumulator, const unsigned int nrSamples);
+// Name of the instruction set used by the vectorized accumulate
+std::string getAccumulateInstructionSet();
+
+
+// Implementations
+template< typename I, typename L > inline void accumulate(const I * input, L * accumulator, const unsigned int nrSamples)
+{
+  for ( unsigned int sample = 0; sample < nrSamples; sample++ )
+  {
+    accumulator[sample] += static_cast< L >(input[sample]);
+  }
+}
+
+template< typename I, typename L > inline void accumulateRows(const I * const * rows, const unsigned int nrRows, L * accumulator, const unsigned int nrSamples)
+{
+  for ( unsigned int sample = 0; sample < nrSamples; sample++ )
+  {
+    L value = accumulator[sample];
+
+    for ( unsigned int row = 0; row < nrRows; row++ )
+    {
+      value += static_cast< L >(rows[row][sample]);
+    }
+    accumulator[sample] = value;
+  }
+}
+
+} // Dedispersion
+
@@ -0,0 +1,98 @@
+// Copyright 2017 Netherlands Institute for Radio Astronomy (ASTRON)
+// Copyright 2017 Netherlands eScience Center
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <vector>
+
+#include <Observation.hpp>
+#include <utils.hpp>
+
+
+#pragma once
+
+namespace Dedispersion {
+
+// Channels that are not zapped, compacted in increasing order, for every beam.
+// Built once per batch from the zapped channels, so that the kernels loop only over the active channels, without a branch per channel.
+// Each beam has a row of getRowLength() elements, copied as is to the OpenCL kernels:
+//   - nrSubbands + 1 offsets: the active channels of subband s are the ones in positions [offset[s], offset[s + 1]) of the list
+//   - the list of active channels
+class ActiveChannels {
+public:
+  // zappedChannels contains observation.getNrChannels(padding / sizeof(unsigned int)) elements, used for all the beams,
+  // or, if perBeam is true, that many elements for each of observation.getNrBeams() beams
+  ActiveChannels(const AstroData::Observation & observation, const std::vector< unsigned int > & zappedChannels, const unsigned int padding, const bool perBeam = false);
+  // Channels of the synthesized beams: a channel is active if it is active in the beam it is taken from
+  ActiveChannels(const AstroData::Observation & observation, const ActiveChannels & beams, const std::vector< unsigned int > & beamMapping, const unsigned int padding);
+  ~ActiveChannels();
+
+  // Get
+  unsigned int getNrBeams() const;
+  unsigned int getNrActiveChannels(const unsigned int beam) const;
+  unsigned int getNrActiveChannels(const unsigned int beam, const unsigned int subband) const;
+  // Position in getChannels(beam) of the first active channel of a subband
+  unsigned int getFirstChannel(const unsigned int beam, const unsigned int subband) const;
+  // Active channels of a beam, in increasing order
+  const unsigned int * getChannels(const unsigned int beam) const;
+  bool isActive(const unsigned int beam, const unsigned int channel) const;
+  unsigned int getRowLength() const;
+  // Contiguous rows, getNrBeams() rows of getRowLength() elements
+  const std::vector< unsigned int > & getRows() const;
+
+private:
+  void compact(const unsigned int beam, const std::vector< bool > & active);
+
+  unsigned int nrChannels;
+  unsigned int nrSubbands;
+  unsigned int rowLength;
+  std::vector< unsigned int > rows;
+};
+
+// Elements in the row of a beam
+unsigned int getActiveChannelsRowLength(const AstroData::Observation & observation, const unsigned int padding);
+
+inline unsigned int getActiveChannelsRowLength(const AstroData::Observation & observation, const unsigned int padding) {
+  return isa::utils::pad(observation.getNrSubbands() + 1 + observation.getNrChannels(), padding / sizeof(unsigned int));
+}
+
+inline unsigned int ActiveChannels::getNrBeams() const {
+  return rows.size() / rowLength;
+}
+
+inline unsigned int ActiveChannels::getNrActiveChannels(const unsigned int beam) const {
+  return rows[(beam * rowLength) + nrSubbands];
+}
+
+inline unsigned int ActiveChannels::getNrActiveChannels(const unsigned int beam, const unsigned int subband) const {
+  return rows[(beam * rowLength) + subband + 1] - rows[(beam * rowLength) + subband];
+}
+
+inline unsigned int ActiveChannels::getFirstChannel(const unsigned int beam, const unsigned int subband) const {
+  return rows[(beam * rowLength) + subband];
+}
+
+inline const unsigned int * ActiveChannels::getChannels(const unsigned int beam) const {
+  return rows.data() + (beam * rowLength) + nrSubbands + 1;
+}
+
+inline unsigned int ActiveChannels::getRowLength() const {
+  return rowLength;
+}
+
+inline const std::vector< unsigned int > & ActiveChannels::getRows() const {
+  return rows;
+}
+
+} // Dedispersion
+
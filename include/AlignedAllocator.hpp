@@ -0,0 +1,70 @@
+// Copyright 2017 Netherlands Institute for Radio Astronomy (ASTRON)
+// Copyright 2017 Netherlands eScience Center
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdlib>
+#include <cstddef>
+#include <new>
+
+
+#pragma once
+
+namespace Dedispersion {
+
+// Allocator for std::vector returning memory aligned to a cache line
+template< typename T, std::size_t Alignment = 64 > class AlignedAllocator {
+public:
+  typedef T value_type;
+  template< typename U > struct rebind {
+    typedef AlignedAllocator< U, Alignment > other;
+  };
+
+  AlignedAllocator() {}
+  template< typename U > AlignedAllocator(const AlignedAllocator< U, Alignment > &) {}
+
+  T * allocate(const std::size_t nrElements);
+  void deallocate(T * pointer, const std::size_t);
+};
+
+template< typename T, typename U, std::size_t Alignment > bool operator==(const AlignedAllocator< T, Alignment > &, const AlignedAllocator< U, Alignment > &);
+template< typename T, typename U, std::size_t Alignment > bool operator!=(const AlignedAllocator< T, Alignment > &, const AlignedAllocator< U, Alignment > &);
+
+
+// Implementations
+template< typename T, std::size_t Alignment > inline T * AlignedAllocator< T, Alignment >::allocate(const std::size_t nrElements) {
+  void * pointer = 0;
+
+  if ( nrElements == 0 ) {
+    return 0;
+  }
+  if ( posix_memalign(&pointer, Alignment, nrElements * sizeof(T)) != 0 ) {
+    throw std::bad_alloc();
+  }
+  return static_cast< T * >(pointer);
+}
+
+template< typename T, std::size_t Alignment > inline void AlignedAllocator< T, Alignment >::deallocate(T * pointer, const std::size_t) {
+  std::free(pointer);
+}
+
+template< typename T, typename U, std::size_t Alignment > inline bool operator==(const AlignedAllocator< T, Alignment > &, const AlignedAllocator< U, Alignment > &) {
+  return true;
+}
+
+template< typename T, typename U, std::size_t Alignment > inline bool operator!=(const AlignedAllocator< T, Alignment > &, const AlignedAllocator< U, Alignment > &) {
+  return false;
+}
+
+} // Dedispersion
+
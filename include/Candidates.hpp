@@ -0,0 +1,215 @@
+// Copyright 2017 Netherlands Institute for Radio Astronomy (ASTRON)
+// Copyright 2017 Netherlands eScience Center
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+#include <Observation.hpp>
+#include <ThreadPool.hpp>
+#include <DelayTable.hpp>
+#include <ActiveChannels.hpp>
+#include <DedispersionCPU.hpp>
+#include <Statistics.hpp>
+
+
+#pragma once
+
+namespace Dedispersion {
+
+// Boxcar filter above the threshold, in the dedispersed samples of a synthesized beam and DM
+struct Candidate {
+  unsigned int sBeam;
+  unsigned int dm;
+  // First sample of the boxcar
+  unsigned int sample;
+  unsigned int width;
+  float snr;
+};
+
+// Boxcar widths and threshold of the search, and noise of the dedispersed samples for every synthesized beam and DM, in the order sBeam * getNrDMs() + dm.
+// The SNR of a boxcar of width w is (sum of its w samples - w * mean) / (standardDeviation * sqrt(w)), with the mean and standard deviation of a single dedispersed sample.
+// The noise is an input of the search, e.g. measured on the previous batches; means are 0 and standard deviations 1 until set.
+// Only the best candidate of every window of nrSamplesPerWindow first samples of a DM is kept, the windows starting at the first sample of the batch.
+class BoxcarSearch {
+public:
+  BoxcarSearch(const std::vector< unsigned int > & widths, const float threshold, const unsigned int nrSynthesizedBeams, const unsigned int nrDMs, const unsigned int nrSamplesPerWindow = 1);
+  ~BoxcarSearch();
+
+  // Get
+  const std::vector< unsigned int > & getWidths() const;
+  unsigned int getMaxWidth() const;
+  float getThreshold() const;
+  unsigned int getNrDMs() const;
+  unsigned int getNrSamplesPerWindow() const;
+  float getMean(const unsigned int sBeam, const unsigned int dm) const;
+  float getStandardDeviation(const unsigned int sBeam, const unsigned int dm) const;
+  // Set
+  void setNoise(const unsigned int sBeam, const unsigned int dm, const float mean, const float standardDeviation);
+  // Mean and standard deviation of all the synthesized beams and DMs, e.g. of the previous batch
+  void setNoise(const Statistics & statistics);
+
+private:
+  std::vector< unsigned int > widths;
+  unsigned int maxWidth;
+  float threshold;
+  unsigned int nrDMs;
+  unsigned int nrSamplesPerWindow;
+  std::vector< float > means;
+  std::vector< float > standardDeviations;
+};
+
+// Dedispersion followed by the boxcar filters of search, applied to every tile while it is in cache: only the candidates are stored, not the dedispersed samples.
+// Every first sample of a DM gives at most one candidate, with the width of highest SNR, if that SNR is at least the threshold; boxcars that do not end inside the batch are not computed.
+// Of the candidates in a window of first samples, only the one of highest SNR is kept, the first one if more have the same SNR.
+// Tiles are computed with getMaxWidth() - 1 samples more than their size, so that the boxcars starting in a tile do not need the next one.
+// The candidates are sorted by synthesized beam, DM and sample; input and tiles are the same as dedispersion<I, L, O>.
+template< typename I, typename L > void dedispersionCandidates(ThreadPool & pool, const DedispersionConf & conf, AstroData::Observation & observation, const ActiveChannels & activeChannels, const std::vector<unsigned int> & beamMapping, const std::vector< I > & input, const BoxcarSearch & search, std::vector< Candidate > & candidates, const DelayTable & delays, const unsigned int padding, const uint8_t inputBits);
+template< typename I, typename L > void dedispersionCandidates(ThreadPool & pool, const DedispersionConf & conf, AstroData::Observation & observation, const ActiveChannels & activeChannels, const std::vector<unsigned int> & beamMapping, const InputWindow< I > & input, const BoxcarSearch & search, std::vector< Candidate > & candidates, const DelayTable & delays, const unsigned int padding, const uint8_t inputBits);
+// The same after both subbanding steps, as subbandDedispersion<I, L, O>; the DMs are the ones of the output of step two
+template< typename I, typename L > void subbandDedispersionCandidates(ThreadPool & pool, const DedispersionConf & conf, AstroData::Observation & observation, const ActiveChannels & activeChannels, const std::vector<unsigned int> & beamMapping, const std::vector< I > & input, const BoxcarSearch & search, std::vector< Candidate > & candidates, const DelayTable & delaysStepOne, const DelayTable & delaysStepTwo, const unsigned int padding, const uint8_t inputBits);
+template< typename I, typename L > void subbandDedispersionCandidates(ThreadPool & pool, const DedispersionConf & conf, AstroData::Observation & observation, const ActiveChannels & activeChannels, const std::vector<unsigned int> & beamMapping, const InputWindow< I > & input, const BoxcarSearch & search, std::vector< Candidate > & candidates, const DelayTable & delaysStepOne, const DelayTable & delaysStepTwo, const unsigned int padding, const uint8_t inputBits);
+// Boxcars starting in the first nrStartSamples samples of the DMs of a tile, with nrTileSamples samples per DM, and the best candidate of the windows in the tile; prefix is scratch memory
+template< typename L > void searchTile(const BoxcarSearch & search, const unsigned int sBeam, const unsigned int firstDM, const unsigned int nrTileDMs, const unsigned int firstSample, const unsigned int nrTileSamples, const unsigned int nrStartSamples, const L * accumulator, const unsigned int nrAccumulatorSamples, std::vector< double > & prefix, std::vector< Candidate > & candidates);
+// Candidates of all threads, in the order of dedispersionCandidates(), and the best candidate of the windows crossing more tiles
+void mergeCandidates(std::vector< std::vector< Candidate > > & threadCandidates, std::vector< Candidate > & candidates, const unsigned int nrSamplesPerWindow = 1);
+// True if the candidates are in the same window of the same synthesized beam and DM
+bool isSameWindow(const Candidate & first, const Candidate & second, const unsigned int nrSamplesPerWindow);
+
+
+// Implementations
+inline const std::vector< unsigned int > & BoxcarSearch::getWidths() const {
+  return widths;
+}
+
+inline unsigned int BoxcarSearch::getMaxWidth() const {
+  return maxWidth;
+}
+
+inline float BoxcarSearch::getThreshold() const {
+  return threshold;
+}
+
+inline unsigned int BoxcarSearch::getNrDMs() const {
+  return nrDMs;
+}
+
+inline unsigned int BoxcarSearch::getNrSamplesPerWindow() const {
+  return nrSamplesPerWindow;
+}
+
+inline float BoxcarSearch::getMean(const unsigned int sBeam, const unsigned int dm) const {
+  return means[(sBeam * nrDMs) + dm];
+}
+
+inline float BoxcarSearch::getStandardDeviation(const unsigned int sBeam, const unsigned int dm) const {
+  return standardDeviations[(sBeam * nrDMs) + dm];
+}
+
+inline bool isSameWindow(const Candidate & first, const Candidate & second, const unsigned int nrSamplesPerWindow) {
+  return (first.sBeam == second.sBeam) && (first.dm == second.dm) && ((first.sample / nrSamplesPerWindow) == (second.sample / nrSamplesPerWindow));
+}
+
+template< typename I, typename L > void dedispersionCandidates(ThreadPool & pool, const DedispersionConf & conf, AstroData::Observation & observation, const ActiveChannels & activeChannels, const std::vector<unsigned int> & beamMapping, const std::vector< I > & input, const BoxcarSearch & search, std::vector< Candidate > & candidates, const DelayTable & delays, const unsigned int padding, const uint8_t inputBits)
+{
+  dedispersionCandidates< I, L >(pool, conf, observation, activeChannels, beamMapping, getInputWindow(observation, input, padding, inputBits, false), search, candidates, delays, padding, inputBits);
+}
+
+template< typename I, typename L > void dedispersionCandidates(ThreadPool & pool, const DedispersionConf & conf, AstroData::Observation & observation, const ActiveChannels & activeChannels, const std::vector<unsigned int> & beamMapping, const InputWindow< I > & input, const BoxcarSearch & search, std::vector< Candidate > & candidates, const DelayTable & delays, const unsigned int padding, const uint8_t inputBits)
+{
+  std::vector< std::vector< Candidate > > threadCandidates(pool.getNrThreads());
+  std::vector< std::vector< double > > prefixes(pool.getNrThreads());
+
+  dedispersionTiles< I, L >(pool, conf, observation, activeChannels, beamMapping, input, delays, padding, inputBits, search.getMaxWidth() - 1, [&](const unsigned int sBeam, const unsigned int firstDM, const unsigned int nrTileDMs, const unsigned int firstSample, const unsigned int nrTileSamples, const L * accumulator, const unsigned int nrAccumulatorSamples, const unsigned int thread)
+  {
+    searchTile(search, sBeam, firstDM, nrTileDMs, firstSample, nrTileSamples, std::min(nrTileSamples, nrAccumulatorSamples - (search.getMaxWidth() - 1)), accumulator, nrAccumulatorSamples, prefixes[thread], threadCandidates[thread]);
+  });
+  mergeCandidates(threadCandidates, candidates, search.getNrSamplesPerWindow());
+}
+
+template< typename I, typename L > void subbandDedispersionCandidates(ThreadPool & pool, const DedispersionConf & conf, AstroData::Observation & observation, const ActiveChannels & activeChannels, const std::vector<unsigned int> & beamMapping, const std::vector< I > & input, const BoxcarSearch & search, std::vector< Candidate > & candidates, const DelayTable & delaysStepOne, const DelayTable & delaysStepTwo, const unsigned int padding, const uint8_t inputBits)
+{
+  subbandDedispersionCandidates< I, L >(pool, conf, observation, activeChannels, beamMapping, getInputWindow(observation, input, padding, inputBits, true), search, candidates, delaysStepOne, delaysStepTwo, padding, inputBits);
+}
+
+template< typename I, typename L > void subbandDedispersionCandidates(ThreadPool & pool, const DedispersionConf & conf, AstroData::Observation & observation, const ActiveChannels & activeChannels, const std::vector<unsigned int> & beamMapping, const InputWindow< I > & input, const BoxcarSearch & search, std::vector< Candidate > & candidates, const DelayTable & delaysStepOne, const DelayTable & delaysStepTwo, const unsigned int padding, const uint8_t inputBits)
+{
+  std::vector< std::vector< Candidate > > threadCandidates(pool.getNrThreads());
+  std::vector< std::vector< double > > prefixes(pool.getNrThreads());
+
+  subbandDedispersionTiles< I, L >(pool, conf, observation, activeChannels, beamMapping, input, delaysStepOne, delaysStepTwo, padding, inputBits, search.getMaxWidth() - 1, [&](const unsigned int sBeam, const unsigned int firstDM, const unsigned int nrTileDMs, const unsigned int firstSample, const unsigned int nrTileSamples, const L * accumulator, const unsigned int nrAccumulatorSamples, const unsigned int thread)
+  {
+    searchTile(search, sBeam, firstDM, nrTileDMs, firstSample, nrTileSamples, std::min(nrTileSamples, nrAccumulatorSamples - (search.getMaxWidth() - 1)), accumulator, nrAccumulatorSamples, prefixes[thread], threadCandidates[thread]);
+  });
+  mergeCandidates(threadCandidates, candidates, search.getNrSamplesPerWindow());
+}
+
+template< typename L > void searchTile(const BoxcarSearch & search, const unsigned int sBeam, const unsigned int firstDM, const unsigned int nrTileDMs, const unsigned int firstSample, const unsigned int nrTileSamples, const unsigned int nrStartSamples, const L * accumulator, const unsigned int nrAccumulatorSamples, std::vector< double > & prefix, std::vector< Candidate > & candidates)
+{
+  const std::vector< unsigned int > & widths = search.getWidths();
+
+  if ( prefix.size() < nrTileSamples + 1 )
+  {
+    prefix.resize(nrTileSamples + 1);
+  }
+  for ( unsigned int dm = 0; dm < nrTileDMs; dm++ )
+  {
+    const L * samples = accumulator + (dm * nrAccumulatorSamples);
+    const double mean = search.getMean(sBeam, firstDM + dm);
+    const double standardDeviation = search.getStandardDeviation(sBeam, firstDM + dm);
+
+    // The sum of a boxcar is the difference of two prefix sums
+    prefix[0] = 0.0;
+    for ( unsigned int sample = 0; sample < nrTileSamples; sample++ )
+    {
+      prefix[sample + 1] = prefix[sample] + static_cast< double >(samples[sample]);
+    }
+    for ( unsigned int sample = 0; sample < nrStartSamples; sample++ )
+    {
+      Candidate best = {sBeam, firstDM + dm, firstSample + sample, 0, 0.0f};
+
+      for ( auto width : widths )
+      {
+        if ( sample + width > nrTileSamples )
+        {
+          continue;
+        }
+        const float snr = static_cast< float >((prefix[sample + width] - prefix[sample] - (width * mean)) / (standardDeviation * std::sqrt(static_cast< double >(width))));
+
+        if ( (best.width == 0) || (snr > best.snr) )
+        {
+          best.width = width;
+          best.snr = snr;
+        }
+      }
+      if ( (best.width == 0) || (best.snr < search.getThreshold()) )
+      {
+        continue;
+      }
+      if ( candidates.empty() || !isSameWindow(candidates.back(), best, search.getNrSamplesPerWindow()) )
+      {
+        candidates.push_back(best);
+      }
+      else if ( best.snr > candidates.back().snr )
+      {
+        candidates.back() = best;
+      }
+    }
+  }
+}
+
+} // Dedispersion
+
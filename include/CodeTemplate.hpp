@@ -0,0 +1,48 @@
+// Copyright 2017 Netherlands Institute for Radio Astronomy (ASTRON)
+// Copyright 2017 Netherlands eScience Center
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+#include <vector>
+
+
+#pragma once
+
+namespace Dedispersion {
+
+// Template of generated code, parsed once in text and placeholders, e.g. <%NUM%>, and expanded in a single pass.
+// The expansion is the same as replacing every placeholder with isa::utils::replace(); an offset placeholder is added to an index,
+// as in "sample + <%OFFSET%>", and with value 0 " + <%OFFSET%>" is removed instead.
+class CodeTemplate {
+public:
+  // Placeholders are names, without <% and %>; other placeholders in code are text
+  CodeTemplate(const std::string & code, const std::vector< std::string > & placeholders, const std::vector< std::string > & offsets = std::vector< std::string >());
+  ~CodeTemplate();
+
+  // Append the code to output, with values in the order of the placeholders of the constructor
+  void expand(std::string & output, const std::vector< std::string > & values) const;
+
+private:
+  // Text followed by a placeholder; placeholder is -1 for the text at the end
+  struct Segment {
+    std::string text;
+    int placeholder;
+    bool offset;
+  };
+
+  std::vector< Segment > segments;
+};
+
+} // Dedispersion
+
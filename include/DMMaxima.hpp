@@ -0,0 +1,185 @@
+// Copyright 2017 Netherlands Institute for Radio Astronomy (ASTRON)
+// Copyright 2017 Netherlands eScience Center
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <vector>
+#include <cstdint>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+
+#include <Observation.hpp>
+#include <ThreadPool.hpp>
+#include <DelayTable.hpp>
+#include <ActiveChannels.hpp>
+#include <DedispersionCPU.hpp>
+
+
+#pragma once
+
+namespace Dedispersion {
+
+// Maximum over the DMs of every dedispersed sample of a batch, and the DM where it occurs, for every synthesized beam.
+// With subbanding, the DMs are the getNrDMs(true) * getNrDMs() DMs of the output of step two.
+// The kernels compute the DMs in blocks of nrThreadsD1 * nrItemsD1, and every block stores its own maximum of each sample in a partial;
+// the partials are the side buffers written by the kernels, and the getters reduce them, so that a batch is sBeams * samples instead of sBeams * DMs * samples.
+// Equal maxima are resolved to the lowest DM.
+class DMMaxima {
+public:
+  DMMaxima();
+  DMMaxima(const DedispersionConf & conf, const AstroData::Observation & observation, const bool subbanding);
+  ~DMMaxima();
+
+  // Get
+  unsigned int getNrPartials() const;
+  unsigned int getNrSamples() const;
+  float getMaximum(const unsigned int sBeam, const unsigned int sample) const;
+  unsigned int getDM(const unsigned int sBeam, const unsigned int sample) const;
+  // The side buffers, in the order (((sBeam * getNrPartials()) + partial) * getNrSamples()) + sample, of the same size as the buffers of the OpenCL kernels
+  std::vector< float > & getPartials();
+  const std::vector< float > & getPartials() const;
+  std::vector< unsigned int > & getPartialDMs();
+  const std::vector< unsigned int > & getPartialDMs() const;
+  // Set
+  void setPartial(const unsigned int sBeam, const unsigned int partial, const unsigned int sample, const float maximum, const unsigned int dm);
+
+private:
+  unsigned int getMaximumPartial(const unsigned int sBeam, const unsigned int sample) const;
+
+  unsigned int nrPartials;
+  unsigned int nrSamples;
+  std::vector< float > partials;
+  std::vector< unsigned int > partialDMs;
+};
+
+// Partials of every synthesized beam and sample, one for every block of DMs of the kernels
+unsigned int getNrDMMaximaPartials(const DedispersionConf & conf, const AstroData::Observation & observation, const bool subbanding);
+// The partials of maxima are the ones of the kernels of conf and observation
+bool isDMMaximaLayout(const DMMaxima & maxima, const DedispersionConf & conf, const AstroData::Observation & observation, const bool subbanding);
+// Dedispersion followed by the maximum over the DMs of every tile while it is in cache: only the partials of maxima are stored, not the dedispersed samples.
+// Input and tiles are the same as dedispersion<I, L, O>.
+template< typename I, typename L > void dedispersionDMMaxima(ThreadPool & pool, const DedispersionConf & conf, AstroData::Observation & observation, const ActiveChannels & activeChannels, const std::vector<unsigned int> & beamMapping, const std::vector< I > & input, DMMaxima & maxima, const DelayTable & delays, const unsigned int padding, const uint8_t inputBits);
+template< typename I, typename L > void dedispersionDMMaxima(ThreadPool & pool, const DedispersionConf & conf, AstroData::Observation & observation, const ActiveChannels & activeChannels, const std::vector<unsigned int> & beamMapping, const InputWindow< I > & input, DMMaxima & maxima, const DelayTable & delays, const unsigned int padding, const uint8_t inputBits);
+// The same after both subbanding steps, as subbandDedispersion<I, L, O>; the DMs are the ones of the output of step two
+template< typename I, typename L > void subbandDedispersionDMMaxima(ThreadPool & pool, const DedispersionConf & conf, AstroData::Observation & observation, const ActiveChannels & activeChannels, const std::vector<unsigned int> & beamMapping, const std::vector< I > & input, DMMaxima & maxima, const DelayTable & delaysStepOne, const DelayTable & delaysStepTwo, const unsigned int padding, const uint8_t inputBits);
+template< typename I, typename L > void subbandDedispersionDMMaxima(ThreadPool & pool, const DedispersionConf & conf, AstroData::Observation & observation, const ActiveChannels & activeChannels, const std::vector<unsigned int> & beamMapping, const InputWindow< I > & input, DMMaxima & maxima, const DelayTable & delaysStepOne, const DelayTable & delaysStepTwo, const unsigned int padding, const uint8_t inputBits);
+// Store the maxima of a tile of nrTileDMs DMs, starting at firstDM, in the partial of its block of DMs; the DMs of the tile are at a distance of nrAccumulatorSamples in accumulator
+template< typename L > void setDMMaximaPartial(DMMaxima & maxima, const AstroData::Observation & observation, const DedispersionConf & conf, const unsigned int sBeam, const unsigned int firstDM, const unsigned int nrTileDMs, const unsigned int firstSample, const unsigned int nrTileSamples, const L * accumulator, const unsigned int nrAccumulatorSamples);
+
+
+// Implementations
+inline unsigned int DMMaxima::getNrPartials() const {
+  return nrPartials;
+}
+
+inline unsigned int DMMaxima::getNrSamples() const {
+  return nrSamples;
+}
+
+inline std::vector< float > & DMMaxima::getPartials() {
+  return partials;
+}
+
+inline const std::vector< float > & DMMaxima::getPartials() const {
+  return partials;
+}
+
+inline std::vector< unsigned int > & DMMaxima::getPartialDMs() {
+  return partialDMs;
+}
+
+inline const std::vector< unsigned int > & DMMaxima::getPartialDMs() const {
+  return partialDMs;
+}
+
+inline void DMMaxima::setPartial(const unsigned int sBeam, const unsigned int partial, const unsigned int sample, const float maximum, const unsigned int dm) {
+  partials[(((sBeam * nrPartials) + partial) * nrSamples) + sample] = maximum;
+  partialDMs[(((sBeam * nrPartials) + partial) * nrSamples) + sample] = dm;
+}
+
+inline unsigned int getNrDMMaximaPartials(const DedispersionConf & conf, const AstroData::Observation & observation, const bool subbanding) {
+  const unsigned int nrDMsPerBlock = std::max(conf.getNrThreadsD1() * conf.getNrItemsD1(), 1u);
+  unsigned int nrPartials = (observation.getNrDMs() + nrDMsPerBlock - 1) / nrDMsPerBlock;
+
+  if ( subbanding ) {
+    nrPartials *= observation.getNrDMs(true);
+  }
+  return nrPartials;
+}
+
+inline bool isDMMaximaLayout(const DMMaxima & maxima, const DedispersionConf & conf, const AstroData::Observation & observation, const bool subbanding) {
+  return (maxima.getNrPartials() == getNrDMMaximaPartials(conf, observation, subbanding)) && (maxima.getNrSamples() == observation.getNrSamplesPerBatch() / observation.getDownsampling()) && (maxima.getPartials().size() == static_cast< size_t >(observation.getNrSynthesizedBeams()) * maxima.getNrPartials() * maxima.getNrSamples());
+}
+
+template< typename I, typename L > void dedispersionDMMaxima(ThreadPool & pool, const DedispersionConf & conf, AstroData::Observation & observation, const ActiveChannels & activeChannels, const std::vector<unsigned int> & beamMapping, const std::vector< I > & input, DMMaxima & maxima, const DelayTable & delays, const unsigned int padding, const uint8_t inputBits)
+{
+  dedispersionDMMaxima< I, L >(pool, conf, observation, activeChannels, beamMapping, getInputWindow(observation, input, padding, inputBits, false), maxima, delays, padding, inputBits);
+}
+
+template< typename I, typename L > void dedispersionDMMaxima(ThreadPool & pool, const DedispersionConf & conf, AstroData::Observation & observation, const ActiveChannels & activeChannels, const std::vector<unsigned int> & beamMapping, const InputWindow< I > & input, DMMaxima & maxima, const DelayTable & delays, const unsigned int padding, const uint8_t inputBits)
+{
+  if ( !isDMMaximaLayout(maxima, conf, observation, false) )
+  {
+    throw std::invalid_argument("The maxima do not match the observation and the configuration.");
+  }
+  dedispersionTiles< I, L >(pool, conf, observation, activeChannels, beamMapping, input, delays, padding, inputBits, 0, [&](const unsigned int sBeam, const unsigned int firstDM, const unsigned int nrTileDMs, const unsigned int firstSample, const unsigned int nrTileSamples, const L * accumulator, const unsigned int nrAccumulatorSamples, const unsigned int)
+  {
+    setDMMaximaPartial(maxima, observation, conf, sBeam, firstDM, nrTileDMs, firstSample, nrTileSamples, accumulator, nrAccumulatorSamples);
+  });
+}
+
+template< typename I, typename L > void subbandDedispersionDMMaxima(ThreadPool & pool, const DedispersionConf & conf, AstroData::Observation & observation, const ActiveChannels & activeChannels, const std::vector<unsigned int> & beamMapping, const std::vector< I > & input, DMMaxima & maxima, const DelayTable & delaysStepOne, const DelayTable & delaysStepTwo, const unsigned int padding, const uint8_t inputBits)
+{
+  subbandDedispersionDMMaxima< I, L >(pool, conf, observation, activeChannels, beamMapping, getInputWindow(observation, input, padding, inputBits, true), maxima, delaysStepOne, delaysStepTwo, padding, inputBits);
+}
+
+template< typename I, typename L > void subbandDedispersionDMMaxima(ThreadPool & pool, const DedispersionConf & conf, AstroData::Observation & observation, const ActiveChannels & activeChannels, const std::vector<unsigned int> & beamMapping, const InputWindow< I > & input, DMMaxima & maxima, const DelayTable & delaysStepOne, const DelayTable & delaysStepTwo, const unsigned int padding, const uint8_t inputBits)
+{
+  if ( !isDMMaximaLayout(maxima, conf, observation, true) )
+  {
+    throw std::invalid_argument("The maxima do not match the observation and the configuration.");
+  }
+  subbandDedispersionTiles< I, L >(pool, conf, observation, activeChannels, beamMapping, input, delaysStepOne, delaysStepTwo, padding, inputBits, 0, [&](const unsigned int sBeam, const unsigned int firstDM, const unsigned int nrTileDMs, const unsigned int firstSample, const unsigned int nrTileSamples, const L * accumulator, const unsigned int nrAccumulatorSamples, const unsigned int)
+  {
+    setDMMaximaPartial(maxima, observation, conf, sBeam, firstDM, nrTileDMs, firstSample, nrTileSamples, accumulator, nrAccumulatorSamples);
+  });
+}
+
+template< typename L > inline void setDMMaximaPartial(DMMaxima & maxima, const AstroData::Observation & observation, const DedispersionConf & conf, const unsigned int sBeam, const unsigned int firstDM, const unsigned int nrTileDMs, const unsigned int firstSample, const unsigned int nrTileSamples, const L * accumulator, const unsigned int nrAccumulatorSamples)
+{
+  // With subbanding, every subbanding DM has its own blocks of DMs
+  const unsigned int nrDMTiles = (observation.getNrDMs() + getNrDMsPerTile(conf) - 1) / getNrDMsPerTile(conf);
+  const unsigned int partial = ((firstDM / observation.getNrDMs()) * nrDMTiles) + ((firstDM % observation.getNrDMs()) / getNrDMsPerTile(conf));
+
+  for ( unsigned int sample = 0; sample < nrTileSamples; sample++ )
+  {
+    float maximum = -std::numeric_limits< float >::infinity();
+    unsigned int maximumDM = firstDM;
+
+    for ( unsigned int dm = 0; dm < nrTileDMs; dm++ )
+    {
+      const float value = static_cast< float >(accumulator[(dm * nrAccumulatorSamples) + sample]);
+
+      if ( value > maximum )
+      {
+        maximum = value;
+        maximumDM = firstDM + dm;
+      }
+    }
+    maxima.setPartial(sBeam, partial, firstSample + sample, maximum, maximumDM);
+  }
+}
+
+} // Dedispersion
+
@@ -18,6 +18,7 @@
 #include <map>
 #include <fstream>
 #include <cstdint>
+#include <limits>
 
 #include <OpenCLTypes.hpp>
 #include <Kernel.hpp>
@@ -25,6 +26,10 @@
 #include <utils.hpp>
 #include <Bits.hpp>
 #include <Platform.hpp>
+#include <ActiveChannels.hpp>
+#include <OutputFormat.hpp>
+#include <InputLayout.hpp>
+#include <DelayTable.hpp>
 
 
 #pragma once
@@ -56,17 +61,75 @@ private:
 typedef std::map< std::string, std::map< unsigned int, Dedispersion::DedispersionConf * > * > tunedDedispersionConf;
 
 // Sequential
+// The references zap the same channels in every beam, with one flag per channel in zappedChannels;
+// per beam zapping is only supported by the kernels that take the rows of an ActiveChannels (see ActiveChannels.hpp)
 template< typename I, typename L, typename O > void dedispersion(AstroData::Observation & observation, const std::vector<unsigned int> & zappedChannels, const std::vector<unsigned int> & beamMapping, const std::vector< I > & input, std::vector< O > & output, const std::vector< float > & shifts, const unsigned int padding, const uint8_t inputBits);
 template< typename I, typename L, typename O > void subbandDedispersionStepOne(AstroData::Observation & observation, const std::vector<unsigned int> & zappedChannels, const std::vector< I > & input, std::vector< O > & output, const std::vector< float > & shifts, const unsigned int padding, const uint8_t inputBits);
 template< typename I, typename L, typename O > void subbandDedispersionStepTwo(AstroData::Observation & observation, const std::vector<unsigned int> & beamMapping, const std::vector< I > & input, std::vector< O > & output, const std::vector< float > & shifts, const unsigned int padding);
+// Add every observation.getDownsampling() samples of a dispersed batch with the raw time resolution, as the kernels with fused downsampling do;
+// the output has the layout of an input of type L with 8 or more bits per sample, and can be dedispersed by the templates above
+template< typename I, typename L > void downsample(AstroData::Observation & observation, const std::vector< I > & input, std::vector< L > & output, const unsigned int padding, const uint8_t inputBits, const bool subbanding);
 // OpenCL
-template< typename I, typename O > std::string * getDedispersionOpenCL(const DedispersionConf & conf, const unsigned int padding, const uint8_t inputBits, const std::string & inputDataType, const std::string & intermediateDataType, const std::string & outputDataType, const AstroData::Observation & observation, std::vector< float > & shifts);
-template< typename I, typename O > std::string * getSubbandDedispersionStepOneOpenCL(const DedispersionConf & conf, const unsigned int padding, const uint8_t inputBits, const std::string & inputDataType, const std::string & intermediateDataType, const std::string & outputDataType, const AstroData::Observation & observation, std::vector< float > & shifts);
-template< typename I > std::string * getSubbandDedispersionStepTwoOpenCL(const DedispersionConf & conf, const unsigned int padding, const std::string & inputDataType, const AstroData::Observation & observation, std::vector< float > & shifts);
+// The kernels read the delay of every DM and channel from a __global buffer holding delays.getTable(), the argument after the active channels (single step and step one)
+// or after the beam mapping (step two); delays is the DelayTable of the kernel's step, so that the host and the device apply the same delays
+// With downsample, the input has the raw time resolution and every sample read by the kernel is the sum of observation.getDownsampling() raw samples, added while loading;
+// the dispersed batch then counts raw samples, while delays, output and work-items stay at the downsampled resolution
+// With an outputFormat other than Float, the single step and step two kernels store the output in that format (see OutputFormat.hpp), padded to its own size;
+// the integer formats take two more arguments after the others, the offsets and the scales of an OutputScaling
+// With statistics, the single step and step two kernels take a last argument, the float partials of a Statistics (see Statistics.hpp): every work-item adds the samples it stores,
+// and the work-items of a work-group are added in local memory to the partial of its block of samples
+// With dmMaxima, the single step and step two kernels do not store the dedispersed samples: output holds the float partials of a DMMaxima (see DMMaxima.hpp), the maximum of every sample
+// over the DMs of a work-group, and a last argument outputDMs the DMs of the maxima; outputFormat is then ignored
+// With a layout, the single step and step one kernels read the input in that layout (see InputLayout.hpp): time-major input is transposed by the loads, without a copy;
+// the default layout generates the same code as without it
+template< typename I, typename O > std::string * getDedispersionOpenCL(const DedispersionConf & conf, const unsigned int padding, const uint8_t inputBits, const std::string & inputDataType, const std::string & intermediateDataType, const std::string & outputDataType, const AstroData::Observation & observation, const DelayTable & delays, const bool downsample = false, const OutputFormat outputFormat = OutputFormat::Float, const bool statistics = false, const bool dmMaxima = false, const InputLayout & layout = InputLayout());
+template< typename I, typename O > std::string * getSubbandDedispersionStepOneOpenCL(const DedispersionConf & conf, const unsigned int padding, const uint8_t inputBits, const std::string & inputDataType, const std::string & intermediateDataType, const std::string & outputDataType, const AstroData::Observation & observation, const DelayTable & delays, const bool downsample = false, const InputLayout & layout = InputLayout());
+template< typename I > std::string * getSubbandDedispersionStepTwoOpenCL(const DedispersionConf & conf, const unsigned int padding, const std::string & inputDataType, const AstroData::Observation & observation, const DelayTable & delays, const OutputFormat outputFormat = OutputFormat::Float, const bool statistics = false, const bool dmMaxima = false);
+// Statistics code of the kernels: declarations of the sums of a work-item, statement adding value to the sums of DM item <%DM_NUM%>,
+// and reduction of a work-group storing its partials; row is the row of the DM of item 0 in the partials, and nrPartials the partials of a row
+std::string getStatisticsDefinitionsOpenCL(const DedispersionConf & conf);
+std::string getStatisticsSumOpenCL(const std::string & intermediateDataType, const std::string & value);
+std::string getStatisticsStoreOpenCL(const DedispersionConf & conf, const std::string & row, const unsigned int nrPartials);
+// DM maxima code of the kernels: declarations of the maxima of a work-item, statement comparing value, of DM dm, with the maximum of sample item <%NUM%>,
+// and reduction of a work-group storing its partials; row is the row of the partial of the work-group, and nrSamples the samples of a row
+std::string getDMMaximaDefinitionsOpenCL(const DedispersionConf & conf);
+std::string getDMMaximaCompareOpenCL(const std::string & intermediateDataType, const std::string & value, const std::string & dm);
+std::string getDMMaximaStoreOpenCL(const DedispersionConf & conf, const std::string & row, const unsigned int nrSamples);
+// Kernel code from the templates of a kernel: <%DEFS%>, <%DEFS_SHIFT%>, <%UNROLLED_LOOP%> and <%STORES%> of code are the definitions, shifts, unrolled loop and stores
+// of every sample item <%NUM%>, DM item <%DM_NUM%> and unrolled channel <%UNROLL%> of conf; storeDefinitions and storeReductions are added before and after the stores
+std::string * expandDedispersionOpenCL(const DedispersionConf & conf, const std::string & code, const std::string & defTemplate, const std::string & defShiftTemplate, const std::string & unrolledTemplate, const std::string & shiftTemplate, const std::string & sumTemplate, const std::string & storeTemplate, const std::string & storeDefinitions, const std::string & storeReductions);
 void readTunedDedispersionConf(tunedDedispersionConf & tunedDedispersion, const std::string & dedispersionFilename);
+// Split batches mode: the input is a ring of blocks, each block holding getNrSamplesPerBatch() samples, also when subbanding, laid out as beam * channel * samples.
+// A dispersed batch starts at the beginning of a block, firstBlock, and continues in the next blocks, wrapping around the end of the ring;
+// every new batch is written over the oldest block, so only new samples are transferred.
+unsigned int getNrInputBlocks(const AstroData::Observation & observation, const bool subbanding);
+// Elements of a channel in a block
+template< typename I > unsigned int getNrInputBlockSamplesPerChannel(const AstroData::Observation & observation, const unsigned int padding, const uint8_t inputBits);
+// Largest value of a dedispersed sample: every channel, and every raw sample of a downsampled sample, at the largest input value
+uint64_t getMaxDedispersedValue(const AstroData::Observation & observation, const uint8_t inputBits);
+// An integer intermediate type, e.g. uint16_t or uint32_t with 8 bit input, is exact but the kernels do not check for overflow, so it has to hold getMaxDedispersedValue()
+template< typename L > bool isIntermediateTypeLargeEnough(const AstroData::Observation & observation, const uint8_t inputBits);
 
 
 // Implementations
+template< typename I > inline unsigned int getNrInputBlockSamplesPerChannel(const AstroData::Observation & observation, const unsigned int padding, const uint8_t inputBits)
+{
+  if ( inputBits >= 8 )
+  {
+    return isa::utils::pad(observation.getNrSamplesPerBatch(), padding / sizeof(I));
+  }
+  return isa::utils::pad(observation.getNrSamplesPerBatch() / (8 / inputBits), padding / sizeof(I));
+}
+
+template< typename L > inline bool isIntermediateTypeLargeEnough(const AstroData::Observation & observation, const uint8_t inputBits)
+{
+  if ( !std::numeric_limits< L >::is_integer )
+  {
+    return true;
+  }
+  return getMaxDedispersedValue(observation, inputBits) <= static_cast< uint64_t >(std::numeric_limits< L >::max());
+}
+
 template< typename I, typename L, typename O > void dedispersion(AstroData::Observation & observation, const std::vector<unsigned int> & zappedChannels, const std::vector<unsigned int> & beamMapping, const std::vector< I > & input, std::vector< O > & output, const std::vector< float > & shifts, const unsigned int padding, const uint8_t inputBits)
 {
   for ( unsigned int sBeam = 0; sBeam < observation.getNrSynthesizedBeams(); sBeam++ )
@@ -79,7 +142,6 @@ template< typename I, typename L, typename O > void dedispersion(AstroData::Obse
         for ( unsigned int channel = 0; channel < observation.getNrChannels(); channel++ )
         {
           unsigned int shift = static_cast< unsigned int >((observation.getFirstDM() + (dm * observation.getDMStep())) * shifts[channel]);
-          // TODO: zapping should be per beam
           if ( zappedChannels[channel] != 0 )
           {
             // If a channel is zapped, skip it
@@ -93,12 +155,8 @@ template< typename I, typename L, typename O > void dedispersion(AstroData::Obse
           {
             unsigned int byte = (sample + shift) / (8 / inputBits);
             uint8_t firstBit = ((sample + shift) % (8 / inputBits)) * inputBits;
-            char value = 0;
-            char buffer = input[(beamMapping[(sBeam * observation.getNrChannels(padding / sizeof(unsigned int))) + channel]) + (channel * isa::utils::pad(observation.getNrSamplesPerDispersedBatch() / (8 / inputBits), padding / sizeof(I))) + byte];
-            for ( uint8_t bit = 0; bit < inputBits; bit++ )
-            {
-              isa::utils::setBit(value, isa::utils::getBit(buffer, firstBit + bit), bit);
-            }
+            uint8_t buffer = input[(beamMapping[(sBeam * observation.getNrChannels(padding / sizeof(unsigned int))) + channel] * observation.getNrChannels() * isa::utils::pad(observation.getNrSamplesPerDispersedBatch() / (8 / inputBits), padding / sizeof(I))) + (channel * isa::utils::pad(observation.getNrSamplesPerDispersedBatch() / (8 / inputBits), padding / sizeof(I))) + byte];
+            char value = (buffer >> firstBit) & ((1 << inputBits) - 1);
             dedispersedSample += static_cast< L >(value);
           }
         }
@@ -136,16 +194,12 @@ template< typename I, typename L, typename O > void subbandDedispersionStepOne(A
             {
               unsigned int byte = (sample + shift) / (8 / inputBits);
               uint8_t firstBit = ((sample + shift) % (8 / inputBits)) * inputBits;
-              char value = 0;
-              char buffer = input[(beam * observation.getNrChannels() * isa::utils::pad(observation.getNrSamplesPerDispersedBatch(true) / (8 / inputBits), padding / sizeof(I))) + (channel * isa::utils::pad(observation.getNrSamplesPerDispersedBatch(true) / (8 / inputBits), padding / sizeof(I))) + byte];
-              for ( uint8_t bit = 0; bit < inputBits; bit++ )
-              {
-                isa::utils::setBit(value, isa::utils::getBit(buffer, firstBit + bit), bit);
-              }
+              uint8_t buffer = input[(beam * observation.getNrChannels() * isa::utils::pad(observation.getNrSamplesPerDispersedBatch(true) / (8 / inputBits), padding / sizeof(I))) + (channel * isa::utils::pad(observation.getNrSamplesPerDispersedBatch(true) / (8 / inputBits), padding / sizeof(I))) + byte];
+              char value = (buffer >> firstBit) & ((1 << inputBits) - 1);
               dedispersedSample += static_cast< L >(value);
             }
           }
-          output[(beam * observation.getNrDMs(true) * observation.getNrSubbands() * isa::utils::pad(observation.getNrSamplesPerBatch(true) / (8 / inputBits), padding / sizeof(O))) + (dm * observation.getNrSubbands() * isa::utils::pad(observation.getNrSamplesPerBatch(true) / (8 / inputBits), padding / sizeof(O))) + (subband * isa::utils::pad(observation.getNrSamplesPerBatch(true) / (8 / inputBits), padding / sizeof(O))) + sample] = static_cast< O >(dedispersedSample);
+          output[(beam * observation.getNrDMs(true) * observation.getNrSubbands() * isa::utils::pad(observation.getNrSamplesPerBatch(true) / observation.getDownsampling(), padding / sizeof(O))) + (dm * observation.getNrSubbands() * isa::utils::pad(observation.getNrSamplesPerBatch(true) / observation.getDownsampling(), padding / sizeof(O))) + (subband * isa::utils::pad(observation.getNrSamplesPerBatch(true) / observation.getDownsampling(), padding / sizeof(O))) + sample] = static_cast< O >(dedispersedSample);
         }
       }
     }
@@ -175,6 +229,36 @@ template< typename I, typename L, typename O > void subbandDedispersionStepTwo(A
   }
 }
 
+template< typename I, typename L > void downsample(AstroData::Observation & observation, const std::vector< I > & input, std::vector< L > & output, const unsigned int padding, const uint8_t inputBits, const bool subbanding)
+{
+  for ( unsigned int beam = 0; beam < observation.getNrBeams(); beam++ )
+  {
+    for ( unsigned int channel = 0; channel < observation.getNrChannels(); channel++ )
+    {
+      for ( unsigned int sample = 0; sample < observation.getNrSamplesPerDispersedBatch(subbanding) / observation.getDownsampling(); sample++ )
+      {
+        L downsampledSample = static_cast< L >(0);
+        for ( unsigned int rawSample = sample * observation.getDownsampling(); rawSample < (sample + 1) * observation.getDownsampling(); rawSample++ )
+        {
+          if ( inputBits >= 8 )
+          {
+            downsampledSample += static_cast< L >(input[(beam * observation.getNrChannels() * isa::utils::pad(observation.getNrSamplesPerDispersedBatch(subbanding), padding / sizeof(I))) + (channel * isa::utils::pad(observation.getNrSamplesPerDispersedBatch(subbanding), padding / sizeof(I))) + rawSample]);
+          }
+          else
+          {
+            unsigned int byte = rawSample / (8 / inputBits);
+            uint8_t firstBit = (rawSample % (8 / inputBits)) * inputBits;
+            uint8_t buffer = input[(beam * observation.getNrChannels() * isa::utils::pad(observation.getNrSamplesPerDispersedBatch(subbanding) / (8 / inputBits), padding / sizeof(I))) + (channel * isa::utils::pad(observation.getNrSamplesPerDispersedBatch(subbanding) / (8 / inputBits), padding / sizeof(I))) + byte];
+            char value = (buffer >> firstBit) & ((1 << inputBits) - 1);
+            downsampledSample += static_cast< L >(value);
+          }
+        }
+        output[(beam * observation.getNrChannels() * isa::utils::pad(observation.getNrSamplesPerDispersedBatch(subbanding), padding / sizeof(L))) + (channel * isa::utils::pad(observation.getNrSamplesPerDispersedBatch(subbanding), padding / sizeof(L))) + sample] = downsampledSample;
+      }
+    }
+  }
+}
+
 inline bool DedispersionConf::getSplitBatches() const {
   return splitBatches;
 }
@@ -199,33 +283,59 @@ inline void DedispersionConf::setUnroll(unsigned int unroll) {
   this->unroll = unroll;
 }
 
-// TODO: splitBatches mode
-template< typename I, typename O > std::string * getDedispersionOpenCL(const DedispersionConf & conf, const unsigned int padding, const uint8_t inputBits, const std::string & inputDataType, const std::string & intermediateDataType, const std::string & outputDataType, const AstroData::Observation & observation, std::vector< float > & shifts)
+template< typename I, typename O > std::string * getDedispersionOpenCL(const DedispersionConf & conf, const unsigned int padding, const uint8_t inputBits, const std::string & inputDataType, const std::string & intermediateDataType, const std::string & outputDataType, const AstroData::Observation & observation, const DelayTable & delays, const bool downsample, const OutputFormat outputFormat, const bool statistics, const bool dmMaxima, const InputLayout & layout)
 {
   std::string * code = new std::string();
   std::string sum_sTemplate = std::string();
   std::string unrolled_sTemplate = std::string();
-  std::string firstDM_s = std::to_string(observation.getFirstDM());
-  if ( firstDM_s.find(".") == std::string::npos ) {
-    firstDM_s.append(".0f");
-  } else {
-    firstDM_s.append("f");
-  }
-  std::string DMStep_s = std::to_string(observation.getDMStep());
-  if ( DMStep_s.find(".") == std::string::npos ) {
-    DMStep_s.append(".0f");
-  } else {
-    DMStep_s.append("f");
-  }
+  // The delays of a DM are a row of the DelayTable
+  std::string nrDelayChannels_s = std::to_string(delays.getNrPaddedChannels());
   std::string nrTotalSamplesPerBlock_s = std::to_string(conf.getNrThreadsD0() * conf.getNrItemsD0());
   std::string nrTotalDMsPerBlock_s = std::to_string(conf.getNrThreadsD1() * conf.getNrItemsD1());
+  std::string activeChannelsRow_s = std::to_string(getActiveChannelsRowLength(observation, padding));
   std::string nrTotalThreads_s = std::to_string(conf.getNrThreadsD0() * conf.getNrThreadsD1());
+  // Input layout: samples of a channel and channels of a sample, in a dispersed batch and in a block of the ring
+  unsigned int nrInputSamplesPerChannel = isa::utils::pad(observation.getNrSamplesPerDispersedBatch(), padding / sizeof(I));
+  unsigned int nrBlockSamplesPerChannel = getNrInputBlockSamplesPerChannel< I >(observation, padding, inputBits);
+  if ( layout.getOrdering() == InputOrdering::TimeMajor ) {
+    nrInputSamplesPerChannel = observation.getNrSamplesPerDispersedBatch();
+    nrBlockSamplesPerChannel = observation.getNrSamplesPerBatch();
+  }
+  unsigned int nrInputChannelsPerSample = getNrInputChannelsPerSample< I >(observation, padding);
+  std::string inputBeam_s = "beamMapping[((firstSynthesizedBeam + sBeam) * " + std::to_string(observation.getNrChannels(padding / sizeof(unsigned int))) + ") + channel]";
+  // Split batches: block of a sample in the ring, and position of the sample in its block
+  std::string nrBlocks_s = std::to_string(getNrInputBlocks(observation, false));
+  std::string nrSamplesPerBlock_s = std::to_string(observation.getNrSamplesPerBatch());
+  std::string nrElementsPerBlock_s = std::to_string(observation.getNrBeams() * getNrInputBeamElements(layout, observation.getNrChannels(), nrInputChannelsPerSample, nrBlockSamplesPerChannel));
+  // Fused downsampling: input sample inputSample_s is added to the sample being loaded with load_s
+  std::string downsampling_s = std::to_string(observation.getDownsampling());
+  std::string inputSample_s;
+  std::string load_s;
+  // Reduced output: type of the output buffer, and offsets and scales of the integer formats
+  std::string outputType_s = getOutputFormatName(outputFormat, outputDataType);
+  std::string scalingArguments_s;
+  if ( dmMaxima ) {
+    outputType_s = "float";
+  } else if ( (outputFormat == OutputFormat::UShort) || (outputFormat == OutputFormat::UChar) ) {
+    scalingArguments_s = ", __global const float * restrict const offsets, __global const float * restrict const scales";
+  }
+  // Statistics: partials of the sums and sums of squares of the output
+  std::string statisticsArguments_s;
+  if ( statistics ) {
+    statisticsArguments_s = ", __global float * restrict const statistics";
+  }
+  // DM maxima: DMs of the maxima stored in output
+  std::string dmMaximaArguments_s;
+  if ( dmMaxima ) {
+    dmMaximaArguments_s = ", __global unsigned int * restrict const outputDMs";
+  }
 
   // Begin kernel's template
   if ( conf.getLocalMem() ) {
     if ( conf.getSplitBatches() ) {
+      *code = "__kernel void dedispersion(__global const " + inputDataType + " * restrict const input, __global " + outputType_s + " * restrict const output, __global const unsigned int * const restrict beamMapping, __constant const unsigned int * restrict const activeChannels, __global const unsigned int * restrict const delays, const unsigned int firstSynthesizedBeam, const unsigned int firstBlock" + scalingArguments_s + statisticsArguments_s + dmMaximaArguments_s + ") {\n";
     } else {
-      *code = "__kernel void dedispersion(__global const " + inputDataType + " * restrict const input, __global " + outputDataType + " * restrict const output, __global const unsigned int * const restrict beamMapping, __constant const unsigned int * restrict const zappedChannels, __constant const float * restrict const shifts, const unsigned int firstSynthesizedBeam) {\n";
+      *code = "__kernel void dedispersion(__global const " + inputDataType + " * restrict const input, __global " + outputType_s + " * restrict const output, __global const unsigned int * const restrict beamMapping, __constant const unsigned int * restrict const activeChannels, __global const unsigned int * restrict const delays, const unsigned int firstSynthesizedBeam" + scalingArguments_s + statisticsArguments_s + dmMaximaArguments_s + ") {\n";
     }
     *code +=  "unsigned int dm = (get_group_id(1) * " + nrTotalDMsPerBlock_s + ") + get_local_id(1);\n"
       "unsigned int sample = (get_group_id(0) * " + nrTotalSamplesPerBlock_s + ") + get_local_id(0);\n"
@@ -233,15 +343,24 @@ template< typename I, typename O > std::string * getDedispersionOpenCL(const Ded
       "unsigned int inShMem = 0;\n"
       "unsigned int inGlMem = 0;\n"
       "<%DEFS%>"
-      "__local " + intermediateDataType + " buffer[" + std::to_string((conf.getNrThreadsD0() * conf.getNrItemsD0()) + static_cast< unsigned int >(shifts[0] * (observation.getFirstDM() + ((conf.getNrThreadsD1() * conf.getNrItemsD1()) * observation.getDMStep())))) + "];\n";
+      "__local " + intermediateDataType + " buffer[" + std::to_string((conf.getNrThreadsD0() * conf.getNrItemsD0()) + delays.getMaxDelayDifference(conf.getNrThreadsD1() * conf.getNrItemsD1())) + "];\n";
     if ( inputBits < 8 ) {
       *code += inputDataType + " bitsBuffer;\n"
         "unsigned int byte = 0;\n"
         "uchar firstBit = 0;\n"
         + inputDataType + " interBuffer;\n";
     }
+    if ( conf.getSplitBatches() ) {
+      *code += "unsigned int block = 0;\n";
+    }
+    if ( downsample ) {
+      *code += intermediateDataType + " downsampledSample = 0;\n";
+    }
     *code += "\n"
-      "for ( unsigned int channel = 0; channel < " + std::to_string(observation.getNrChannels()) + "; channel += " + std::to_string(conf.getUnroll()) + " ) {\n"
+      "unsigned int channel = 0;\n"
+      "const unsigned int channelsRow = ((firstSynthesizedBeam + sBeam) * " + activeChannelsRow_s + ") + " + std::to_string(observation.getNrSubbands() + 1) + ";\n"
+      "const unsigned int lastPosition = activeChannels[((firstSynthesizedBeam + sBeam) * " + activeChannelsRow_s + ") + " + std::to_string(observation.getNrSubbands()) + "];\n"
+      "for ( unsigned int position = activeChannels[(firstSynthesizedBeam + sBeam) * " + activeChannelsRow_s + "]; position < lastPosition; position += " + std::to_string(conf.getUnroll()) + " ) {\n"
       "unsigned int minShift = 0;\n"
       "<%DEFS_SHIFT%>"
       "unsigned int diffShift = 0;\n"
@@ -250,45 +369,70 @@ template< typename I, typename O > std::string * getDedispersionOpenCL(const Ded
       "}\n"
       "<%STORES%>"
       "}";
-    unrolled_sTemplate = "if ( zappedChannels[channel + <%UNROLL%>] == 0 ) {\n"
-      "minShift = convert_uint_rtz(shifts[channel + <%UNROLL%>] * (" + firstDM_s + " + ((get_group_id(1) * " + nrTotalDMsPerBlock_s + ") * " + DMStep_s + ")));\n"
+    unrolled_sTemplate = "if ( (position + <%UNROLL%>) < lastPosition ) {\n"
+      "channel = activeChannels[channelsRow + position + <%UNROLL%>];\n"
+      "minShift = delays[((get_group_id(1) * " + nrTotalDMsPerBlock_s + ") * " + nrDelayChannels_s + ") + channel];\n"
       "<%SHIFTS%>"
-      "diffShift = convert_uint_rtz(shifts[channel + <%UNROLL%>] * (" + firstDM_s + " + (((get_group_id(1) * " + nrTotalDMsPerBlock_s + ") + " + std::to_string((conf.getNrThreadsD1() * conf.getNrItemsD1()) - 1) + ") * " + DMStep_s + "))) - minShift;\n"
+      "diffShift = delays[(((get_group_id(1) * " + nrTotalDMsPerBlock_s + ") + " + std::to_string((conf.getNrThreadsD1() * conf.getNrItemsD1()) - 1) + ") * " + nrDelayChannels_s + ") + channel] - minShift;\n"
       "\n"
       "inShMem = (get_local_id(1) * " + std::to_string(conf.getNrThreadsD0()) + ") + get_local_id(0);\n";
-    if ( conf.getSplitBatches() ) {
+    unrolled_sTemplate += "inGlMem = ((get_group_id(0) * " + nrTotalSamplesPerBlock_s + ") + inShMem) + minShift;\n";
+    unrolled_sTemplate += "while ( (inShMem < (" + nrTotalSamplesPerBlock_s + " + diffShift) && (inGlMem < " + std::to_string(observation.getNrSamplesPerDispersedBatch() / observation.getDownsampling()) + ")) ) {\n";
+    if ( downsample ) {
+      inputSample_s = "rawSample";
+      load_s = "downsampledSample += ";
+      unrolled_sTemplate += "downsampledSample = 0;\n"
+        "for ( unsigned int rawSample = inGlMem * " + downsampling_s + "; rawSample < (inGlMem + 1) * " + downsampling_s + "; rawSample++ ) {\n";
     } else {
-      unrolled_sTemplate += "inGlMem = ((get_group_id(0) * " + nrTotalSamplesPerBlock_s + ") + inShMem) + minShift;\n";
+      inputSample_s = "inGlMem";
+      load_s = "buffer[inShMem] = ";
     }
-    unrolled_sTemplate += "while ( (inShMem < (" + nrTotalSamplesPerBlock_s + " + diffShift) && (inGlMem < " + std::to_string(observation.getNrSamplesPerDispersedBatch() / observation.getDownsampling()) + ")) ) {\n";
     if ( (inputDataType == intermediateDataType) && (inputBits >= 8) ) {
       if ( conf.getSplitBatches() ) {
+        unrolled_sTemplate += "block = (" + inputSample_s + " / " + nrSamplesPerBlock_s + ") + firstBlock;\n"
+          "if ( block >= " + nrBlocks_s + " ) {\n"
+          "block -= " + nrBlocks_s + ";\n"
+          "}\n"
+          + load_s + "input[(block * " + nrElementsPerBlock_s + ") + " + getInputIndexOpenCL(layout, observation.getNrChannels(), nrInputChannelsPerSample, nrBlockSamplesPerChannel, inputBeam_s, "(" + inputSample_s + " % " + nrSamplesPerBlock_s + ")") + "];\n";
       } else {
-        unrolled_sTemplate += "buffer[inShMem] = input[(beamMapping[((firstSynthesizedBeam + sBeam) * " + std::to_string(observation.getNrChannels(padding / sizeof(unsigned int))) + ") + (channel + <%UNROLL%>)] * " + std::to_string(observation.getNrChannels() * isa::utils::pad(observation.getNrSamplesPerDispersedBatch(), padding / sizeof(I))) + ") + ((channel + <%UNROLL%>) * " + std::to_string(isa::utils::pad(observation.getNrSamplesPerDispersedBatch(), padding / sizeof(I))) + ") + inGlMem];\n";
+        unrolled_sTemplate += load_s + "input[" + getInputIndexOpenCL(layout, observation.getNrChannels(), nrInputChannelsPerSample, nrInputSamplesPerChannel, inputBeam_s, inputSample_s) + "];\n";
       }
     } else if ( inputBits < 8 ) {
       if ( conf.getSplitBatches() ) {
+        unrolled_sTemplate += "block = (" + inputSample_s + " / " + nrSamplesPerBlock_s + ") + firstBlock;\n"
+          "if ( block >= " + nrBlocks_s + " ) {\n"
+          "block -= " + nrBlocks_s + ";\n"
+          "}\n"
+          "byte = ((" + inputSample_s + " % " + nrSamplesPerBlock_s + ") / " + std::to_string(8 / inputBits) + ");\n"
+          "firstBit = ((" + inputSample_s + " % " + std::to_string(8 / inputBits) + ") * " + std::to_string(static_cast< unsigned int >(inputBits)) + ");\n"
+          "bitsBuffer = input[(block * " + nrElementsPerBlock_s + ") + " + getInputIndexOpenCL(layout, observation.getNrChannels(), nrInputChannelsPerSample, nrBlockSamplesPerChannel, inputBeam_s, "byte") + "];\n";
       } else {
-        unrolled_sTemplate += "interBuffer = 0;\n"
-          "byte = (inGlMem / " + std::to_string(8 / inputBits) + ");\n"
-          "firstBit = ((inGlMem % " + std::to_string(8 / inputBits) + ") * " + std::to_string(static_cast< unsigned int >(inputBits)) + ");\n"
-          "bitsBuffer = input[((channel + <%UNROLL%>) * " + std::to_string(isa::utils::pad(observation.getNrSamplesPerDispersedBatch() / (8 / inputBits), padding / sizeof(I))) + ") + byte];\n";
-      }
-      for ( unsigned int bit = 0; bit < inputBits; bit++ ) {
-        unrolled_sTemplate += isa::OpenCL::setBit("interBuffer", isa::OpenCL::getBit("bitsBuffer", "firstBit + " + std::to_string(bit)), std::to_string(bit));
+        unrolled_sTemplate += "byte = (" + inputSample_s + " / " + std::to_string(8 / inputBits) + ");\n"
+          "firstBit = ((" + inputSample_s + " % " + std::to_string(8 / inputBits) + ") * " + std::to_string(static_cast< unsigned int >(inputBits)) + ");\n"
+          "bitsBuffer = input[" + getInputIndexOpenCL(layout, observation.getNrChannels(), nrInputChannelsPerSample, isa::utils::pad(observation.getNrSamplesPerDispersedBatch() / (8 / inputBits), padding / sizeof(I)), inputBeam_s, "byte") + "];\n";
       }
       if ( inputDataType == "char" || inputDataType == "uchar" ) {
-        for ( unsigned int bit = inputBits; bit < 8; bit++ ) {
-          unrolled_sTemplate += isa::OpenCL::setBit("interBuffer", isa::OpenCL::getBit("bitsBuffer", "firstBit + " + std::to_string(inputBits - 1)), std::to_string(bit));
-        }
+        // The most significant bit of the sample is extended to the whole byte
+        unrolled_sTemplate += "interBuffer = ((((bitsBuffer >> firstBit) & " + std::to_string((1 << inputBits) - 1) + ") ^ " + std::to_string(1 << (inputBits - 1)) + ") - " + std::to_string(1 << (inputBits - 1)) + ");\n";
+      } else {
+        unrolled_sTemplate += "interBuffer = ((bitsBuffer >> firstBit) & " + std::to_string((1 << inputBits) - 1) + ");\n";
       }
-      unrolled_sTemplate += "buffer[inShMem] = convert_" + intermediateDataType + "(interBuffer);\n";
+      unrolled_sTemplate += load_s + "convert_" + intermediateDataType + "(interBuffer);\n";
     } else {
       if ( conf.getSplitBatches() ) {
+        unrolled_sTemplate += "block = (" + inputSample_s + " / " + nrSamplesPerBlock_s + ") + firstBlock;\n"
+          "if ( block >= " + nrBlocks_s + " ) {\n"
+          "block -= " + nrBlocks_s + ";\n"
+          "}\n"
+          + load_s + "convert_" + intermediateDataType + "(input[(block * " + nrElementsPerBlock_s + ") + " + getInputIndexOpenCL(layout, observation.getNrChannels(), nrInputChannelsPerSample, nrBlockSamplesPerChannel, inputBeam_s, "(" + inputSample_s + " % " + nrSamplesPerBlock_s + ")") + "]);\n";
       } else {
-        unrolled_sTemplate += "buffer[inShMem] = convert_" + intermediateDataType + "(input[(beamMapping[((firstSynthesizedBeam + sBeam) * " + std::to_string(observation.getNrChannels(padding / sizeof(unsigned int))) + ") + (channel + <%UNROLL%>)] * " + std::to_string(observation.getNrChannels() * isa::utils::pad(observation.getNrSamplesPerDispersedBatch(), padding / sizeof(I))) + ") + ((channel + <%UNROLL%>) * " + std::to_string(isa::utils::pad(observation.getNrSamplesPerDispersedBatch(), padding / sizeof(I))) + ") + inGlMem]);\n";
+        unrolled_sTemplate += load_s + "convert_" + intermediateDataType + "(input[" + getInputIndexOpenCL(layout, observation.getNrChannels(), nrInputChannelsPerSample, nrInputSamplesPerChannel, inputBeam_s, inputSample_s) + "]);\n";
       }
     }
+    if ( downsample ) {
+      unrolled_sTemplate += "}\n"
+        "buffer[inShMem] = downsampledSample;\n";
+    }
     unrolled_sTemplate += "inShMem += " + nrTotalThreads_s + ";\n"
       "inGlMem += " + nrTotalThreads_s + ";\n"
       "}\n"
@@ -309,8 +453,9 @@ template< typename I, typename O > std::string * getDedispersionOpenCL(const Ded
     }
   } else {
     if ( conf.getSplitBatches() ) {
+      *code = "__kernel void dedispersion(__global const " + inputDataType + " * restrict const input, __global " + outputType_s + " * restrict const output, __global const unsigned int * restrict const beamMapping, __constant const unsigned int * restrict const activeChannels, __global const unsigned int * restrict const delays, const unsigned int firstSynthesizedBeam, const unsigned int firstBlock" + scalingArguments_s + statisticsArguments_s + dmMaximaArguments_s + ") {\n";
     } else {
-      *code = "__kernel void dedispersion(__global const " + inputDataType + " * restrict const input, __global " + outputDataType + " * restrict const output, __global const unsigned int * restrict const beamMapping,  __constant const unsigned int * restrict const zappedChannels, __constant const float * restrict const shifts, const unsigned int firstSynthesizedBeam) {\n";
+      *code = "__kernel void dedispersion(__global const " + inputDataType + " * restrict const input, __global " + outputType_s + " * restrict const output, __global const unsigned int * restrict const beamMapping,  __constant const unsigned int * restrict const activeChannels, __global const unsigned int * restrict const delays, const unsigned int firstSynthesizedBeam" + scalingArguments_s + statisticsArguments_s + dmMaximaArguments_s + ") {\n";
     }
     *code += "unsigned int dm = (get_group_id(1) * " + nrTotalDMsPerBlock_s + ") + get_local_id(1);\n"
       "unsigned int sample = (get_group_id(0) * " + nrTotalSamplesPerBlock_s + ") + get_local_id(0);\n"
@@ -322,250 +467,173 @@ template< typename I, typename O > std::string * getDedispersionOpenCL(const Ded
         "uchar firstBit = 0;\n"
         + inputDataType + " interBuffer;\n";
     }
+    if ( conf.getSplitBatches() ) {
+      *code += "unsigned int block = 0;\n";
+    }
+    if ( downsample ) {
+      *code += intermediateDataType + " downsampledSample = 0;\n";
+    }
     *code += "\n"
-      "for ( unsigned int channel = 0; channel < " + std::to_string(observation.getNrChannels()) + "; channel += " + std::to_string(conf.getUnroll()) + " ) {\n"
+      "unsigned int channel = 0;\n"
+      "const unsigned int channelsRow = ((firstSynthesizedBeam + sBeam) * " + activeChannelsRow_s + ") + " + std::to_string(observation.getNrSubbands() + 1) + ";\n"
+      "const unsigned int lastPosition = activeChannels[((firstSynthesizedBeam + sBeam) * " + activeChannelsRow_s + ") + " + std::to_string(observation.getNrSubbands()) + "];\n"
+      "for ( unsigned int position = activeChannels[(firstSynthesizedBeam + sBeam) * " + activeChannelsRow_s + "]; position < lastPosition; position += " + std::to_string(conf.getUnroll()) + " ) {\n"
       "<%DEFS_SHIFT%>"
       "<%UNROLLED_LOOP%>"
       "}\n"
       "<%STORES%>"
       "}";
-    unrolled_sTemplate = "if ( zappedChannels[channel + <%UNROLL%>] == 0 ) {\n"
+    unrolled_sTemplate = "if ( (position + <%UNROLL%>) < lastPosition ) {\n"
+      "channel = activeChannels[channelsRow + position + <%UNROLL%>];\n"
       "<%SHIFTS%>"
       "\n"
       "<%SUMS%>"
       "}\n"
       "\n";
+    if ( ((observation.getNrSamplesPerBatch() / observation.getDownsampling()) % (conf.getNrThreadsD0() * conf.getNrItemsD0())) != 0 ) {
+      sum_sTemplate += "if ( (sample + <%OFFSET%>) < " + std::to_string(observation.getNrSamplesPerBatch() / observation.getDownsampling()) + " ) {\n";
+    }
+    if ( downsample ) {
+      inputSample_s = "rawSample";
+      load_s = "downsampledSample += ";
+      sum_sTemplate += "downsampledSample = 0;\n"
+        "for ( unsigned int rawSample = (sample + <%OFFSET%> + shiftDM<%DM_NUM%>) * " + downsampling_s + "; rawSample < (sample + <%OFFSET%> + shiftDM<%DM_NUM%> + 1) * " + downsampling_s + "; rawSample++ ) {\n";
+    } else {
+      inputSample_s = "(sample + <%OFFSET%> + shiftDM<%DM_NUM%>)";
+      load_s = "dedispersedSample<%NUM%>DM<%DM_NUM%> += ";
+    }
     if ( (inputDataType == intermediateDataType) && (inputBits >= 8) ) {
       if ( conf.getSplitBatches() ) {
+        sum_sTemplate += "block = (" + inputSample_s + " / " + nrSamplesPerBlock_s + ") + firstBlock;\n"
+          "if ( block >= " + nrBlocks_s + " ) {\n"
+          "block -= " + nrBlocks_s + ";\n"
+          "}\n"
+          + load_s + "input[(block * " + nrElementsPerBlock_s + ") + " + getInputIndexOpenCL(layout, observation.getNrChannels(), nrInputChannelsPerSample, nrBlockSamplesPerChannel, inputBeam_s, "(" + inputSample_s + " % " + nrSamplesPerBlock_s + ")") + "];\n";
       } else {
-        if ( ((observation.getNrSamplesPerBatch() / observation.getDownsampling()) % (conf.getNrThreadsD0() * conf.getNrItemsD0())) != 0 ) {
-          sum_sTemplate += "if ( (sample + <%OFFSET%>) < " + std::to_string(observation.getNrSamplesPerBatch() / observation.getDownsampling()) + " ) {\n";
-        }
-        sum_sTemplate = "dedispersedSample<%NUM%>DM<%DM_NUM%> += input[(beamMapping[((firstSynthesizedBeam + sBeam) * " + std::to_string(observation.getNrChannels(padding / sizeof(unsigned int))) + ") + (channel + <%UNROLL%>)] * " + std::to_string(observation.getNrChannels() * isa::utils::pad(observation.getNrSamplesPerDispersedBatch(), padding / sizeof(I))) + ") + ((channel + <%UNROLL%>) * " + std::to_string(isa::utils::pad(observation.getNrSamplesPerDispersedBatch(), padding / sizeof(I))) + ") + (sample + <%OFFSET%> + shiftDM<%DM_NUM%>)];\n";
-        if ( ((observation.getNrSamplesPerBatch() / observation.getDownsampling()) % (conf.getNrThreadsD0() * conf.getNrItemsD0())) != 0 ) {
-          sum_sTemplate += "}\n";
-        }
+        sum_sTemplate += load_s + "input[" + getInputIndexOpenCL(layout, observation.getNrChannels(), nrInputChannelsPerSample, nrInputSamplesPerChannel, inputBeam_s, inputSample_s) + "];\n";
       }
     } else if ( inputBits < 8 ) {
       if ( conf.getSplitBatches() ) {
+        sum_sTemplate += "block = (" + inputSample_s + " / " + nrSamplesPerBlock_s + ") + firstBlock;\n"
+          "if ( block >= " + nrBlocks_s + " ) {\n"
+          "block -= " + nrBlocks_s + ";\n"
+          "}\n"
+          "byte = (" + inputSample_s + " % " + nrSamplesPerBlock_s + ") / " + std::to_string(8 / inputBits) + ";\n"
+          "firstBit = (" + inputSample_s + " % " + std::to_string(8 / inputBits) + ") * " + std::to_string(static_cast< unsigned int >(inputBits)) + ";\n"
+          "bitsBuffer = input[(block * " + nrElementsPerBlock_s + ") + " + getInputIndexOpenCL(layout, observation.getNrChannels(), nrInputChannelsPerSample, nrBlockSamplesPerChannel, inputBeam_s, "byte") + "];\n";
       } else {
-        if ( (observation.getNrSamplesPerBatch() % (conf.getNrThreadsD0() * conf.getNrItemsD0())) != 0 ) {
-          sum_sTemplate += "if ( (sample + <%OFFSET%>) < " + std::to_string(observation.getNrSamplesPerBatch()) + " ) {\n";
-        }
-        sum_sTemplate += "interBuffer = 0;\n"
-          "byte = (sample + <%OFFSET%> + shiftDM<%DM_NUM%>) / " + std::to_string(8 / inputBits) + ";\n"
-          "firstBit = ((sample + <%OFFSET%> + shiftDM<%DM_NUM%>) % " + std::to_string(8 / inputBits) + ") * " + std::to_string(static_cast< unsigned int >(inputBits)) + ";\n"
-          "bitsBuffer = input[((channel + <%UNROLL%>) * " + std::to_string(isa::utils::pad(observation.getNrSamplesPerDispersedBatch() / (8 / inputBits), padding / sizeof(I))) + ") + byte];\n";
-      }
-      for ( unsigned int bit = 0; bit < inputBits; bit++ ) {
-        sum_sTemplate += isa::OpenCL::setBit("interBuffer", isa::OpenCL::getBit("bitsBuffer", "firstBit + " + std::to_string(bit)), std::to_string(bit));
+        sum_sTemplate += "byte = " + inputSample_s + " / " + std::to_string(8 / inputBits) + ";\n"
+          "firstBit = (" + inputSample_s + " % " + std::to_string(8 / inputBits) + ") * " + std::to_string(static_cast< unsigned int >(inputBits)) + ";\n"
+          "bitsBuffer = input[" + getInputIndexOpenCL(layout, observation.getNrChannels(), nrInputChannelsPerSample, isa::utils::pad(observation.getNrSamplesPerDispersedBatch() / (8 / inputBits), padding / sizeof(I)), inputBeam_s, "byte") + "];\n";
       }
       if ( inputDataType == "char" || inputDataType == "uchar" ) {
-        for ( unsigned int bit = inputBits; bit < 8; bit++ ) {
-          sum_sTemplate += isa::OpenCL::setBit("interBuffer", isa::OpenCL::getBit("bitsBuffer", "firstBit + " + std::to_string(inputBits - 1)), std::to_string(bit));
-        }
-      }
-      sum_sTemplate += "dedispersedSample<%NUM%>DM<%DM_NUM%> += convert_" + intermediateDataType + "(interBuffer);\n";
-      if ( (observation.getNrSamplesPerBatch() % (conf.getNrThreadsD0() * conf.getNrItemsD0())) != 0 ) {
-        sum_sTemplate += "}\n";
+        // The most significant bit of the sample is extended to the whole byte
+        sum_sTemplate += "interBuffer = ((((bitsBuffer >> firstBit) & " + std::to_string((1 << inputBits) - 1) + ") ^ " + std::to_string(1 << (inputBits - 1)) + ") - " + std::to_string(1 << (inputBits - 1)) + ");\n";
+      } else {
+        sum_sTemplate += "interBuffer = ((bitsBuffer >> firstBit) & " + std::to_string((1 << inputBits) - 1) + ");\n";
       }
+      sum_sTemplate += load_s + "convert_" + intermediateDataType + "(interBuffer);\n";
     } else {
       if ( conf.getSplitBatches() ) {
+        sum_sTemplate += "block = (" + inputSample_s + " / " + nrSamplesPerBlock_s + ") + firstBlock;\n"
+          "if ( block >= " + nrBlocks_s + " ) {\n"
+          "block -= " + nrBlocks_s + ";\n"
+          "}\n"
+          + load_s + "convert_" + intermediateDataType + "(input[(block * " + nrElementsPerBlock_s + ") + " + getInputIndexOpenCL(layout, observation.getNrChannels(), nrInputChannelsPerSample, nrBlockSamplesPerChannel, inputBeam_s, "(" + inputSample_s + " % " + nrSamplesPerBlock_s + ")") + "]);\n";
       } else {
-        if ( ((observation.getNrSamplesPerBatch() / observation.getDownsampling()) % (conf.getNrThreadsD0() * conf.getNrItemsD0())) != 0 ) {
-          sum_sTemplate += "if ( (sample + <%OFFSET%>) < " + std::to_string(observation.getNrSamplesPerBatch()) + " ) {\n";
-        }
-        sum_sTemplate += "dedispersedSample<%NUM%>DM<%DM_NUM%> += convert_" + intermediateDataType + "(input[(beamMapping[((firstSynthesizedBeam + sBeam) * " + std::to_string(observation.getNrChannels(padding / sizeof(unsigned int))) + ") + (channel + <%UNROLL%>)] * " + std::to_string(observation.getNrChannels() * isa::utils::pad(observation.getNrSamplesPerDispersedBatch(), padding / sizeof(I))) + ") + ((channel + <%UNROLL%>) * " + std::to_string(isa::utils::pad(observation.getNrSamplesPerDispersedBatch(), padding / sizeof(I))) + ") + (sample + <%OFFSET%> + shiftDM<%DM_NUM%>)]);\n";
-        if ( ((observation.getNrSamplesPerBatch() / observation.getDownsampling()) % (conf.getNrThreadsD0() * conf.getNrItemsD0())) != 0 ) {
-          sum_sTemplate += "}\n";
-        }
+        sum_sTemplate += load_s + "convert_" + intermediateDataType + "(input[" + getInputIndexOpenCL(layout, observation.getNrChannels(), nrInputChannelsPerSample, nrInputSamplesPerChannel, inputBeam_s, inputSample_s) + "]);\n";
       }
     }
+    if ( downsample ) {
+      sum_sTemplate += "}\n"
+        "dedispersedSample<%NUM%>DM<%DM_NUM%> += downsampledSample;\n";
+    }
+    if ( ((observation.getNrSamplesPerBatch() / observation.getDownsampling()) % (conf.getNrThreadsD0() * conf.getNrItemsD0())) != 0 ) {
+      sum_sTemplate += "}\n";
+    }
   }
   std::string def_sTemplate = intermediateDataType + " dedispersedSample<%NUM%>DM<%DM_NUM%> = 0;\n";
   std::string defsShiftTemplate = "unsigned int shiftDM<%DM_NUM%> = 0;\n";
   std::string shiftsTemplate;
   if ( conf.getLocalMem() ) {
-    shiftsTemplate = "shiftDM<%DM_NUM%> = convert_uint_rtz(shifts[channel + <%UNROLL%>] * (" + firstDM_s + " + ((dm + <%DM_OFFSET%>) * " + DMStep_s + "))) - minShift;\n";
+    shiftsTemplate = "shiftDM<%DM_NUM%> = delays[((dm + <%DM_OFFSET%>) * " + nrDelayChannels_s + ") + channel] - minShift;\n";
   } else {
-    shiftsTemplate = "shiftDM<%DM_NUM%> = convert_uint_rtz(shifts[channel + <%UNROLL%>] * (" + firstDM_s + " + ((dm + <%DM_OFFSET%>) * " + DMStep_s + ")));\n";
+    shiftsTemplate = "shiftDM<%DM_NUM%> = delays[((dm + <%DM_OFFSET%>) * " + nrDelayChannels_s + ") + channel];\n";
+  }
+  // The reduced formats are padded to their own size
+  unsigned int nrOutputSamplesPadded = isa::utils::pad(observation.getNrSamplesPerBatch() / observation.getDownsampling(), padding / sizeof(I));
+  if ( outputFormat != OutputFormat::Float ) {
+    nrOutputSamplesPadded = isa::utils::pad(observation.getNrSamplesPerBatch() / observation.getDownsampling(), padding / getOutputFormatSize< O >(outputFormat));
   }
   std::string store_sTemplate;
   if ( ((observation.getNrSamplesPerBatch() / observation.getDownsampling()) % (conf.getNrThreadsD0() * conf.getNrItemsD0())) != 0 ) {
     store_sTemplate += "if ( sample + <%OFFSET%> < " + std::to_string(observation.getNrSamplesPerBatch() / observation.getDownsampling()) + " ) {\n";
   }
-  if ( intermediateDataType == outputDataType ) {
-    store_sTemplate += "output[(sBeam * " + std::to_string(observation.getNrDMs() * isa::utils::pad(observation.getNrSamplesPerBatch() / observation.getDownsampling(), padding / sizeof(I))) + ") + ((dm + <%DM_OFFSET%>) * " + std::to_string(isa::utils::pad(observation.getNrSamplesPerBatch() / observation.getDownsampling(), padding / sizeof(I))) + ") + (sample + <%OFFSET%>)] = dedispersedSample<%NUM%>DM<%DM_NUM%>;\n";
+  if ( dmMaxima ) {
+    store_sTemplate += getDMMaximaCompareOpenCL(intermediateDataType, "dedispersedSample<%NUM%>DM<%DM_NUM%>", "dm + <%DM_OFFSET%>");
   } else {
-    store_sTemplate += "output[(sBeam * " + std::to_string(observation.getNrDMs() * isa::utils::pad(observation.getNrSamplesPerBatch() / observation.getDownsampling(), padding / sizeof(I))) + ") + ((dm + <%DM_OFFSET%>) * " + std::to_string(isa::utils::pad(observation.getNrSamplesPerBatch() / observation.getDownsampling(), padding / sizeof(I))) + ") + (sample + <%OFFSET%>)] = convert_" + outputDataType + "(dedispersedSample<%NUM%>DM<%DM_NUM%>);\n";
+    store_sTemplate += getOutputStoreOpenCL(outputFormat, intermediateDataType, outputDataType, "(sBeam * " + std::to_string(observation.getNrDMs() * nrOutputSamplesPadded) + ") + ((dm + <%DM_OFFSET%>) * " + std::to_string(nrOutputSamplesPadded) + ") + (sample + <%OFFSET%>)", "dedispersedSample<%NUM%>DM<%DM_NUM%>", "((firstSynthesizedBeam + sBeam) * " + std::to_string(observation.getNrDMs()) + ") + dm + <%DM_OFFSET%>");
+  }
+  if ( statistics ) {
+    store_sTemplate += getStatisticsSumOpenCL(intermediateDataType, "dedispersedSample<%NUM%>DM<%DM_NUM%>");
   }
   if ( ((observation.getNrSamplesPerBatch() / observation.getDownsampling()) % (conf.getNrThreadsD0() * conf.getNrItemsD0())) != 0 ) {
     store_sTemplate += "}\n";
   }
   // End kernel's template
 
-  std::string * def_s =  new std::string();
-  std::string * defsShift_s = new std::string();
-  std::string * unrolled_s = new std::string();
-  std::string * store_s =  new std::string();
-
-  for ( unsigned int dm = 0; dm < conf.getNrItemsD1(); dm++ ) {
-    std::string dm_s = std::to_string(dm);
-    std::string * temp_s = 0;
-
-    temp_s = isa::utils::replace(&defsShiftTemplate, "<%DM_NUM%>", dm_s);
-    defsShift_s->append(*temp_s);
-    delete temp_s;
+  std::string storeDefinitions;
+  std::string storeReductions;
+  if ( dmMaxima ) {
+    storeDefinitions += getDMMaximaDefinitionsOpenCL(conf);
   }
-  for ( unsigned int sample = 0; sample < conf.getNrItemsD0(); sample++ ) {
-    std::string sample_s = std::to_string(sample);
-    std::string offset_s = std::to_string(sample * conf.getNrThreadsD0());
-    std::string * def_sDM =  new std::string();
-    std::string * store_sDM =  new std::string();
-
-    for ( unsigned int dm = 0; dm < conf.getNrItemsD1(); dm++ ) {
-      std::string dm_s = std::to_string(dm);
-      std::string * temp_s = 0;
-
-      temp_s = isa::utils::replace(&def_sTemplate, "<%DM_NUM%>", dm_s);
-      def_sDM->append(*temp_s);
-      delete temp_s;
-      temp_s = isa::utils::replace(&store_sTemplate, "<%DM_NUM%>", dm_s);
-      if ( dm == 0 ) {
-        std::string empty_s;
-        temp_s = isa::utils::replace(temp_s, " + <%DM_OFFSET%>", empty_s, true);
-      } else {
-        std::string offset_s = std::to_string(dm * conf.getNrThreadsD1());
-        temp_s = isa::utils::replace(temp_s, "<%DM_OFFSET%>", offset_s, true);
-      }
-      store_sDM->append(*temp_s);
-      delete temp_s;
-    }
-    def_sDM = isa::utils::replace(def_sDM, "<%NUM%>", sample_s, true);
-    def_s->append(*def_sDM);
-    delete def_sDM;
-    store_sDM = isa::utils::replace(store_sDM, "<%NUM%>", sample_s, true);
-    if ( sample * conf.getNrThreadsD0() == 0 ) {
-      std::string empty_s;
-      store_sDM = isa::utils::replace(store_sDM, " + <%OFFSET%>", empty_s, true);
-    } else {
-      store_sDM = isa::utils::replace(store_sDM, "<%OFFSET%>", offset_s, true);
-    }
-    store_s->append(*store_sDM);
-    delete store_sDM;
+  if ( statistics ) {
+    storeDefinitions += getStatisticsDefinitionsOpenCL(conf);
+    storeReductions += getStatisticsStoreOpenCL(conf, "(sBeam * " + std::to_string(observation.getNrDMs()) + ") + dm", ((observation.getNrSamplesPerBatch() / observation.getDownsampling()) + (conf.getNrThreadsD0() * conf.getNrItemsD0()) - 1) / (conf.getNrThreadsD0() * conf.getNrItemsD0()));
   }
-  for ( unsigned int loop = 0; loop < conf.getUnroll(); loop++ ) {
-    std::string loop_s = std::to_string(loop);
-    std::string * temp_s = 0;
-    std::string * shifts_s = new std::string();
-    std::string * sums_s = new std::string();
-
-    if ( loop == 0 ) {
-      std::string empty_s;
-      temp_s = isa::utils::replace(&unrolled_sTemplate, " + <%UNROLL%>", empty_s);
-    } else {
-      temp_s = isa::utils::replace(&unrolled_sTemplate, "<%UNROLL%>", loop_s);
-    }
-    unrolled_s->append(*temp_s);
-    delete temp_s;
-    for ( unsigned int dm = 0; dm < conf.getNrItemsD1(); dm++ ) {
-      std::string dm_s = std::to_string(dm);
-
-      temp_s = isa::utils::replace(&shiftsTemplate, "<%DM_NUM%>", dm_s);
-      if ( dm == 0 ) {
-        std::string empty_s;
-        temp_s = isa::utils::replace(temp_s, " + <%DM_OFFSET%>", empty_s, true);
-      } else {
-        std::string offset_s = std::to_string(dm * conf.getNrThreadsD1());
-        temp_s = isa::utils::replace(temp_s, "<%DM_OFFSET%>", offset_s, true);
-      }
-      if ( loop == 0 ) {
-        std::string empty_s;
-        temp_s = isa::utils::replace(temp_s, " + <%UNROLL%>", empty_s, true);
-      } else {
-        temp_s = isa::utils::replace(temp_s, "<%UNROLL%>", loop_s, true);
-      }
-      shifts_s->append(*temp_s);
-      delete temp_s;
-    }
-    unrolled_s = isa::utils::replace(unrolled_s, "<%SHIFTS%>", *shifts_s, true);
-    delete shifts_s;
-    for ( unsigned int sample = 0; sample < conf.getNrItemsD0(); sample++ ) {
-      std::string sample_s = std::to_string(sample);
-      std::string offset_s = std::to_string(sample * conf.getNrThreadsD0());
-      std::string * sumsDM_s = new std::string();
-
-      for ( unsigned int dm = 0; dm < conf.getNrItemsD1(); dm++ ) {
-        std::string dm_s = std::to_string(dm);
-
-        temp_s = isa::utils::replace(&sum_sTemplate, "<%DM_NUM%>", dm_s);
-        if ( loop == 0 ) {
-          std::string empty_s;
-          temp_s = isa::utils::replace(temp_s, " + <%UNROLL%>", empty_s, true);
-        } else {
-          temp_s = isa::utils::replace(temp_s, "<%UNROLL%>", loop_s, true);
-        }
-        sumsDM_s->append(*temp_s);
-        delete temp_s;
-      }
-      sumsDM_s = isa::utils::replace(sumsDM_s, "<%NUM%>", sample_s, true);
-      if ( sample * conf.getNrThreadsD0() == 0 ) {
-        std::string empty_s;
-        sumsDM_s = isa::utils::replace(sumsDM_s, " + <%OFFSET%>", empty_s, true);
-      } else {
-        sumsDM_s = isa::utils::replace(sumsDM_s, "<%OFFSET%>", offset_s, true);
-      }
-      sums_s->append(*sumsDM_s);
-      delete sumsDM_s;
-    }
-    unrolled_s = isa::utils::replace(unrolled_s, "<%SUMS%>", *sums_s, true);
-    if ( conf.getUnroll() == 0 ) {
-      std::string empty_s;
-      unrolled_s = isa::utils::replace(unrolled_s, " + <%UNROLL%>", empty_s, true);
-    } else {
-      unrolled_s = isa::utils::replace(unrolled_s, "<%UNROLL%>", loop_s, true);
-    }
-    delete sums_s;
+  if ( dmMaxima ) {
+    storeReductions += getDMMaximaStoreOpenCL(conf, "(sBeam * " + std::to_string(observation.getNrDMs() / (conf.getNrThreadsD1() * conf.getNrItemsD1())) + ") + get_group_id(1)", observation.getNrSamplesPerBatch() / observation.getDownsampling());
   }
-  code = isa::utils::replace(code, "<%DEFS%>", *def_s, true);
-  code = isa::utils::replace(code, "<%DEFS_SHIFT%>", *defsShift_s, true);
-  code = isa::utils::replace(code, "<%UNROLLED_LOOP%>", *unrolled_s, true);
-  code = isa::utils::replace(code, "<%STORES%>", *store_s, true);
-  delete def_s;
-  delete defsShift_s;
-  delete unrolled_s;
-  delete store_s;
+  std::string * kernel = expandDedispersionOpenCL(conf, *code, def_sTemplate, defsShiftTemplate, unrolled_sTemplate, shiftsTemplate, sum_sTemplate, store_sTemplate, storeDefinitions, storeReductions);
 
-  return code;
+  delete code;
+  return kernel;
 }
 
-// TODO: splitBatches mode
-template< typename I, typename O > std::string * getSubbandDedispersionStepOneOpenCL(const DedispersionConf & conf, const unsigned int padding, const uint8_t inputBits, const std::string & inputDataType, const std::string & intermediateDataType, const std::string & outputDataType, const AstroData::Observation & observation, std::vector< float > & shifts)
+template< typename I, typename O > std::string * getSubbandDedispersionStepOneOpenCL(const DedispersionConf & conf, const unsigned int padding, const uint8_t inputBits, const std::string & inputDataType, const std::string & intermediateDataType, const std::string & outputDataType, const AstroData::Observation & observation, const DelayTable & delays, const bool downsample, const InputLayout & layout)
 {
   std::string * code = new std::string();
   std::string sum_sTemplate = std::string();
   std::string unrolled_sTemplate = std::string();
-  std::string firstDM_s = std::to_string(observation.getFirstDM(true));
-  if ( firstDM_s.find(".") == std::string::npos ) {
-    firstDM_s.append(".0f");
-  } else {
-    firstDM_s.append("f");
-  }
-  std::string DMStep_s = std::to_string(observation.getDMStep(true));
-  if ( DMStep_s.find(".") == std::string::npos ) {
-    DMStep_s.append(".0f");
-  } else {
-    DMStep_s.append("f");
-  }
+  // The delays of a DM are a row of the DelayTable
+  std::string nrDelayChannels_s = std::to_string(delays.getNrPaddedChannels());
   std::string nrTotalSamplesPerBlock_s = std::to_string(conf.getNrThreadsD0() * conf.getNrItemsD0());
   std::string nrTotalDMsPerBlock_s = std::to_string(conf.getNrThreadsD1() * conf.getNrItemsD1());
+  std::string activeChannelsRow_s = std::to_string(getActiveChannelsRowLength(observation, padding));
   std::string nrTotalThreads_s = std::to_string(conf.getNrThreadsD0() * conf.getNrThreadsD1());
+  // Input layout: samples of a channel and channels of a sample, in a dispersed batch and in a block of the ring
+  unsigned int nrInputSamplesPerChannel = isa::utils::pad(observation.getNrSamplesPerDispersedBatch(true), padding / sizeof(I));
+  unsigned int nrBlockSamplesPerChannel = getNrInputBlockSamplesPerChannel< I >(observation, padding, inputBits);
+  if ( layout.getOrdering() == InputOrdering::TimeMajor ) {
+    nrInputSamplesPerChannel = observation.getNrSamplesPerDispersedBatch(true);
+    nrBlockSamplesPerChannel = observation.getNrSamplesPerBatch();
+  }
+  unsigned int nrInputChannelsPerSample = getNrInputChannelsPerSample< I >(observation, padding);
+  // Split batches: block of a sample in the ring, and position of the sample in its block
+  std::string nrBlocks_s = std::to_string(getNrInputBlocks(observation, true));
+  std::string nrSamplesPerBlock_s = std::to_string(observation.getNrSamplesPerBatch());
+  std::string nrElementsPerBlock_s = std::to_string(observation.getNrBeams() * getNrInputBeamElements(layout, observation.getNrChannels(), nrInputChannelsPerSample, nrBlockSamplesPerChannel));
+  // Fused downsampling: input sample inputSample_s is added to the sample being loaded with load_s
+  std::string downsampling_s = std::to_string(observation.getDownsampling());
+  std::string inputSample_s;
+  std::string load_s;
 
   // Begin kernel's template
   if ( conf.getLocalMem() ) {
     if ( conf.getSplitBatches() ) {
+      *code = "__kernel void dedispersionStepOne(__global const " + inputDataType + " * restrict const input, __global " + outputDataType + " * restrict const output, __constant const unsigned int * restrict const activeChannels, __global const unsigned int * restrict const delays, const unsigned int firstBlock) {\n";
     } else {
-      *code = "__kernel void dedispersionStepOne(__global const " + inputDataType + " * restrict const input, __global " + outputDataType + " * restrict const output, __constant const uchar * restrict const zappedChannels, __constant const float * restrict const shifts) {\n";
+      *code = "__kernel void dedispersionStepOne(__global const " + inputDataType + " * restrict const input, __global " + outputDataType + " * restrict const output, __constant const unsigned int * restrict const activeChannels, __global const unsigned int * restrict const delays) {\n";
     }
     *code += "unsigned int beam = get_group_id(2) / " + std::to_string(observation.getNrSubbands())  + ";\n"
       "unsigned int dm = (get_group_id(1) * " + nrTotalDMsPerBlock_s + ") + get_local_id(1);\n"
@@ -574,15 +642,24 @@ template< typename I, typename O > std::string * getSubbandDedispersionStepOneOp
       "unsigned int inShMem = 0;\n"
       "unsigned int inGlMem = 0;\n"
       "<%DEFS%>"
-      "__local " + intermediateDataType + " buffer[" + std::to_string((conf.getNrThreadsD0() * conf.getNrItemsD0()) + static_cast< unsigned int >(shifts[0] * (observation.getFirstDM(true) + ((conf.getNrThreadsD1() * conf.getNrItemsD1()) * observation.getDMStep(true))))) + "];\n";
+      "__local " + intermediateDataType + " buffer[" + std::to_string((conf.getNrThreadsD0() * conf.getNrItemsD0()) + delays.getMaxDelayDifference(conf.getNrThreadsD1() * conf.getNrItemsD1())) + "];\n";
     if ( inputBits < 8 ) {
       *code += inputDataType + " bitsBuffer;\n"
         "unsigned int byte = 0;\n"
         "uchar firstBit = 0;\n"
         + inputDataType + " interBuffer;\n";
     }
+    if ( conf.getSplitBatches() ) {
+      *code += "unsigned int block = 0;\n";
+    }
+    if ( downsample ) {
+      *code += intermediateDataType + " downsampledSample = 0;\n";
+    }
     *code += "\n"
-      "for ( unsigned int channel = subband * " + std::to_string(observation.getNrChannelsPerSubband()) + "; channel < (subband + 1) * " + std::to_string(observation.getNrChannelsPerSubband()) + "; channel += " + std::to_string(conf.getUnroll()) + " ) {\n"
+      "unsigned int channel = 0;\n"
+      "const unsigned int channelsRow = (beam * " + activeChannelsRow_s + ") + " + std::to_string(observation.getNrSubbands() + 1) + ";\n"
+      "const unsigned int lastPosition = activeChannels[(beam * " + activeChannelsRow_s + ") + subband + 1];\n"
+      "for ( unsigned int position = activeChannels[(beam * " + activeChannelsRow_s + ") + subband]; position < lastPosition; position += " + std::to_string(conf.getUnroll()) + " ) {\n"
       "unsigned int minShift = 0;\n"
       "<%DEFS_SHIFT%>"
       "unsigned int diffShift = 0;\n"
@@ -591,45 +668,70 @@ template< typename I, typename O > std::string * getSubbandDedispersionStepOneOp
       "}\n"
       "<%STORES%>"
       "}";
-    unrolled_sTemplate = "if ( zappedChannels[channel + <%UNROLL%>] == 0 ) {\n"
-      "minShift = convert_uint_rtz(shifts[channel + <%UNROLL%>] * (" + firstDM_s + " + ((get_group_id(1) * " + nrTotalDMsPerBlock_s + ") * " + DMStep_s + ")));\n"
+    unrolled_sTemplate = "if ( (position + <%UNROLL%>) < lastPosition ) {\n"
+      "channel = activeChannels[channelsRow + position + <%UNROLL%>];\n"
+      "minShift = delays[((get_group_id(1) * " + nrTotalDMsPerBlock_s + ") * " + nrDelayChannels_s + ") + channel];\n"
       "<%SHIFTS%>"
-      "diffShift = convert_uint_rtz(shifts[channel + <%UNROLL%>] * (" + firstDM_s + " + (((get_group_id(1) * " + nrTotalDMsPerBlock_s + ") + " + std::to_string((conf.getNrThreadsD1() * conf.getNrItemsD1()) - 1) + ") * " + DMStep_s + "))) - minShift;\n"
+      "diffShift = delays[(((get_group_id(1) * " + nrTotalDMsPerBlock_s + ") + " + std::to_string((conf.getNrThreadsD1() * conf.getNrItemsD1()) - 1) + ") * " + nrDelayChannels_s + ") + channel] - minShift;\n"
       "\n"
       "inShMem = (get_local_id(1) * " + std::to_string(conf.getNrThreadsD0()) + ") + get_local_id(0);\n";
-    if ( conf.getSplitBatches() ) {
+    unrolled_sTemplate += "inGlMem = ((get_group_id(0) * " + nrTotalSamplesPerBlock_s + ") + inShMem) + minShift;\n";
+    unrolled_sTemplate += "while ( (inShMem < (" + nrTotalSamplesPerBlock_s + " + diffShift) && (inGlMem < " + std::to_string(observation.getNrSamplesPerDispersedBatch(true) / observation.getDownsampling()) + ")) ) {\n";
+    if ( downsample ) {
+      inputSample_s = "rawSample";
+      load_s = "downsampledSample += ";
+      unrolled_sTemplate += "downsampledSample = 0;\n"
+        "for ( unsigned int rawSample = inGlMem * " + downsampling_s + "; rawSample < (inGlMem + 1) * " + downsampling_s + "; rawSample++ ) {\n";
     } else {
-      unrolled_sTemplate += "inGlMem = ((get_group_id(0) * " + nrTotalSamplesPerBlock_s + ") + inShMem) + minShift;\n";
+      inputSample_s = "inGlMem";
+      load_s = "buffer[inShMem] = ";
     }
-    unrolled_sTemplate += "while ( (inShMem < (" + nrTotalSamplesPerBlock_s + " + diffShift) && (inGlMem < " + std::to_string(observation.getNrSamplesPerDispersedBatch(true) / observation.getDownsampling()) + ")) ) {\n";
     if ( (inputDataType == intermediateDataType) && (inputBits >= 8) ) {
       if ( conf.getSplitBatches() ) {
+        unrolled_sTemplate += "block = (" + inputSample_s + " / " + nrSamplesPerBlock_s + ") + firstBlock;\n"
+          "if ( block >= " + nrBlocks_s + " ) {\n"
+          "block -= " + nrBlocks_s + ";\n"
+          "}\n"
+          + load_s + "input[(block * " + nrElementsPerBlock_s + ") + " + getInputIndexOpenCL(layout, observation.getNrChannels(), nrInputChannelsPerSample, nrBlockSamplesPerChannel, "beam", "(" + inputSample_s + " % " + nrSamplesPerBlock_s + ")") + "];\n";
       } else {
-        unrolled_sTemplate += "buffer[inShMem] = input[(beam * " + std::to_string(observation.getNrChannels() * isa::utils::pad(observation.getNrSamplesPerDispersedBatch(true), padding / sizeof(I))) + ") + ((channel + <%UNROLL%>) * " + std::to_string(isa::utils::pad(observation.getNrSamplesPerDispersedBatch(true), padding / sizeof(I))) + ") + inGlMem];\n";
+        unrolled_sTemplate += load_s + "input[" + getInputIndexOpenCL(layout, observation.getNrChannels(), nrInputChannelsPerSample, nrInputSamplesPerChannel, "beam", inputSample_s) + "];\n";
       }
     } else if ( inputBits < 8 ) {
       if ( conf.getSplitBatches() ) {
+        unrolled_sTemplate += "block = (" + inputSample_s + " / " + nrSamplesPerBlock_s + ") + firstBlock;\n"
+          "if ( block >= " + nrBlocks_s + " ) {\n"
+          "block -= " + nrBlocks_s + ";\n"
+          "}\n"
+          "byte = ((" + inputSample_s + " % " + nrSamplesPerBlock_s + ") / " + std::to_string(8 / inputBits) + ");\n"
+          "firstBit = ((" + inputSample_s + " % " + std::to_string(8 / inputBits) + ") * " + std::to_string(static_cast< unsigned int >(inputBits)) + ");\n"
+          "bitsBuffer = input[(block * " + nrElementsPerBlock_s + ") + " + getInputIndexOpenCL(layout, observation.getNrChannels(), nrInputChannelsPerSample, nrBlockSamplesPerChannel, "beam", "byte") + "];\n";
       } else {
-        unrolled_sTemplate += "interBuffer = 0;\n"
-          "byte = (inGlMem / " + std::to_string(8 / inputBits) + ");\n"
-          "firstBit = ((inGlMem % " + std::to_string(8 / inputBits) + ") * " + std::to_string(static_cast< unsigned int >(inputBits)) + ");\n"
-          "bitsBuffer = input[(beam * " + std::to_string(observation.getNrChannels() * isa::utils::pad(observation.getNrSamplesPerDispersedBatch(true) / (8 / inputBits), padding / sizeof(I))) + ") + ((channel + <%UNROLL%>) * " + std::to_string(isa::utils::pad(observation.getNrSamplesPerDispersedBatch(true) / (8 / inputBits), padding / sizeof(I))) + ") + byte];\n";
-      }
-      for ( unsigned int bit = 0; bit < inputBits; bit++ ) {
-        unrolled_sTemplate += isa::OpenCL::setBit("interBuffer", isa::OpenCL::getBit("bitsBuffer", "firstBit + " + std::to_string(bit)), std::to_string(bit));
+        unrolled_sTemplate += "byte = (" + inputSample_s + " / " + std::to_string(8 / inputBits) + ");\n"
+          "firstBit = ((" + inputSample_s + " % " + std::to_string(8 / inputBits) + ") * " + std::to_string(static_cast< unsigned int >(inputBits)) + ");\n"
+          "bitsBuffer = input[" + getInputIndexOpenCL(layout, observation.getNrChannels(), nrInputChannelsPerSample, isa::utils::pad(observation.getNrSamplesPerDispersedBatch(true) / (8 / inputBits), padding / sizeof(I)), "beam", "byte") + "];\n";
       }
       if ( inputDataType == "char" || inputDataType == "uchar" ) {
-        for ( unsigned int bit = inputBits; bit < 8; bit++ ) {
-          unrolled_sTemplate += isa::OpenCL::setBit("interBuffer", isa::OpenCL::getBit("bitsBuffer", "firstBit + " + std::to_string(inputBits - 1)), std::to_string(bit));
-        }
+        // The most significant bit of the sample is extended to the whole byte
+        unrolled_sTemplate += "interBuffer = ((((bitsBuffer >> firstBit) & " + std::to_string((1 << inputBits) - 1) + ") ^ " + std::to_string(1 << (inputBits - 1)) + ") - " + std::to_string(1 << (inputBits - 1)) + ");\n";
+      } else {
+        unrolled_sTemplate += "interBuffer = ((bitsBuffer >> firstBit) & " + std::to_string((1 << inputBits) - 1) + ");\n";
       }
-      unrolled_sTemplate += "buffer[inShMem] = convert_" + intermediateDataType + "(interBuffer);\n";
+      unrolled_sTemplate += load_s + "convert_" + intermediateDataType + "(interBuffer);\n";
     } else {
       if ( conf.getSplitBatches() ) {
+        unrolled_sTemplate += "block = (" + inputSample_s + " / " + nrSamplesPerBlock_s + ") + firstBlock;\n"
+          "if ( block >= " + nrBlocks_s + " ) {\n"
+          "block -= " + nrBlocks_s + ";\n"
+          "}\n"
+          + load_s + "convert_" + intermediateDataType + "(input[(block * " + nrElementsPerBlock_s + ") + " + getInputIndexOpenCL(layout, observation.getNrChannels(), nrInputChannelsPerSample, nrBlockSamplesPerChannel, "beam", "(" + inputSample_s + " % " + nrSamplesPerBlock_s + ")") + "]);\n";
       } else {
-        unrolled_sTemplate += "buffer[inShMem] = convert_" + intermediateDataType + "(input[(beam * " + std::to_string(observation.getNrChannels() * isa::utils::pad(observation.getNrSamplesPerDispersedBatch(true), padding / sizeof(I))) + ") + ((channel + <%UNROLL%>) * " + std::to_string(isa::utils::pad(observation.getNrSamplesPerDispersedBatch(true), padding / sizeof(I))) + ") + inGlMem]);\n";
+        unrolled_sTemplate += load_s + "convert_" + intermediateDataType + "(input[" + getInputIndexOpenCL(layout, observation.getNrChannels(), nrInputChannelsPerSample, nrInputSamplesPerChannel, "beam", inputSample_s) + "]);\n";
       }
     }
+    if ( downsample ) {
+      unrolled_sTemplate += "}\n"
+        "buffer[inShMem] = downsampledSample;\n";
+    }
     unrolled_sTemplate += "inShMem += " + nrTotalThreads_s + ";\n"
       "inGlMem += " + nrTotalThreads_s + ";\n"
       "}\n"
@@ -650,8 +752,9 @@ template< typename I, typename O > std::string * getSubbandDedispersionStepOneOp
     }
   } else {
     if ( conf.getSplitBatches() ) {
+      *code = "__kernel void dedispersionStepOne(__global const " + inputDataType + " * restrict const input, __global " + outputDataType + " * restrict const output, __constant const unsigned int * restrict const activeChannels, __global const unsigned int * restrict const delays, const unsigned int firstBlock) {\n";
     } else {
-      *code = "__kernel void dedispersionStepOne(__global const " + inputDataType + " * restrict const input, __global " + outputDataType + " * restrict const output, __constant const unsigned int * restrict const zappedChannels, __constant const float * restrict const shifts) {\n";
+      *code = "__kernel void dedispersionStepOne(__global const " + inputDataType + " * restrict const input, __global " + outputDataType + " * restrict const output, __constant const unsigned int * restrict const activeChannels, __global const unsigned int * restrict const delays) {\n";
     }
     *code += "unsigned int beam = get_group_id(2) / " + std::to_string(observation.getNrSubbands()) + ";\n"
       "unsigned int dm = (get_group_id(1) * " + nrTotalDMsPerBlock_s + ") + get_local_id(1);\n"
@@ -664,73 +767,98 @@ template< typename I, typename O > std::string * getSubbandDedispersionStepOneOp
         "uchar firstBit = 0;\n"
         + inputDataType + " interBuffer;\n";
     }
+    if ( conf.getSplitBatches() ) {
+      *code += "unsigned int block = 0;\n";
+    }
+    if ( downsample ) {
+      *code += intermediateDataType + " downsampledSample = 0;\n";
+    }
     *code += "\n"
-      "for ( unsigned int channel = subband * " + std::to_string(observation.getNrChannelsPerSubband()) + "; channel < (subband + 1) * " + std::to_string(observation.getNrChannelsPerSubband()) + "; channel += " + std::to_string(conf.getUnroll()) + " ) {\n"
+      "unsigned int channel = 0;\n"
+      "const unsigned int channelsRow = (beam * " + activeChannelsRow_s + ") + " + std::to_string(observation.getNrSubbands() + 1) + ";\n"
+      "const unsigned int lastPosition = activeChannels[(beam * " + activeChannelsRow_s + ") + subband + 1];\n"
+      "for ( unsigned int position = activeChannels[(beam * " + activeChannelsRow_s + ") + subband]; position < lastPosition; position += " + std::to_string(conf.getUnroll()) + " ) {\n"
       "<%DEFS_SHIFT%>"
       "<%UNROLLED_LOOP%>"
       "}\n"
       "<%STORES%>"
       "}";
-    unrolled_sTemplate = "if ( zappedChannels[channel + <%UNROLL%>] == 0 ) {\n"
+    unrolled_sTemplate = "if ( (position + <%UNROLL%>) < lastPosition ) {\n"
+      "channel = activeChannels[channelsRow + position + <%UNROLL%>];\n"
       "<%SHIFTS%>"
       "\n"
       "<%SUMS%>"
       "}\n"
       "\n";
+    if ( ((observation.getNrSamplesPerBatch(true) / observation.getDownsampling()) % (conf.getNrThreadsD0() * conf.getNrItemsD0())) != 0 ) {
+      sum_sTemplate += "if ( (sample + <%OFFSET%>) < " + std::to_string(observation.getNrSamplesPerBatch(true) / observation.getDownsampling()) + " ) {\n";
+    }
+    if ( downsample ) {
+      inputSample_s = "rawSample";
+      load_s = "downsampledSample += ";
+      sum_sTemplate += "downsampledSample = 0;\n"
+        "for ( unsigned int rawSample = (sample + <%OFFSET%> + shiftDM<%DM_NUM%>) * " + downsampling_s + "; rawSample < (sample + <%OFFSET%> + shiftDM<%DM_NUM%> + 1) * " + downsampling_s + "; rawSample++ ) {\n";
+    } else {
+      inputSample_s = "(sample + <%OFFSET%> + shiftDM<%DM_NUM%>)";
+      load_s = "dedispersedSample<%NUM%>DM<%DM_NUM%> += ";
+    }
     if ( (inputDataType == intermediateDataType) && (inputBits >= 8) ) {
       if ( conf.getSplitBatches() ) {
+        sum_sTemplate += "block = (" + inputSample_s + " / " + nrSamplesPerBlock_s + ") + firstBlock;\n"
+          "if ( block >= " + nrBlocks_s + " ) {\n"
+          "block -= " + nrBlocks_s + ";\n"
+          "}\n"
+          + load_s + "input[(block * " + nrElementsPerBlock_s + ") + " + getInputIndexOpenCL(layout, observation.getNrChannels(), nrInputChannelsPerSample, nrBlockSamplesPerChannel, "beam", "(" + inputSample_s + " % " + nrSamplesPerBlock_s + ")") + "];\n";
       } else {
-        if ( ((observation.getNrSamplesPerBatch(true) / observation.getDownsampling()) % (conf.getNrThreadsD0() * conf.getNrItemsD0())) != 0 ) {
-          sum_sTemplate += "if ( (sample + <%OFFSET%>) < " + std::to_string(observation.getNrSamplesPerBatch(true) / observation.getDownsampling()) + " ) {\n";
-        }
-        sum_sTemplate += "dedispersedSample<%NUM%>DM<%DM_NUM%> += input[(beam * " + std::to_string(observation.getNrChannels() * isa::utils::pad(observation.getNrSamplesPerDispersedBatch(true), padding / sizeof(I))) + ") + ((channel + <%UNROLL%>) * " + std::to_string(isa::utils::pad(observation.getNrSamplesPerDispersedBatch(true), padding / sizeof(I))) + ") + (sample + <%OFFSET%> + shiftDM<%DM_NUM%>)];\n";
-        if ( ((observation.getNrSamplesPerBatch(true) / observation.getDownsampling()) % (conf.getNrThreadsD0() * conf.getNrItemsD0())) != 0 ) {
-          sum_sTemplate += "}\n";
-        }
+        sum_sTemplate += load_s + "input[" + getInputIndexOpenCL(layout, observation.getNrChannels(), nrInputChannelsPerSample, nrInputSamplesPerChannel, "beam", inputSample_s) + "];\n";
       }
     } else if ( inputBits < 8 ) {
       if ( conf.getSplitBatches() ) {
+        sum_sTemplate += "block = (" + inputSample_s + " / " + nrSamplesPerBlock_s + ") + firstBlock;\n"
+          "if ( block >= " + nrBlocks_s + " ) {\n"
+          "block -= " + nrBlocks_s + ";\n"
+          "}\n"
+          "byte = (" + inputSample_s + " % " + nrSamplesPerBlock_s + ") / " + std::to_string(8 / inputBits) + ";\n"
+          "firstBit = (" + inputSample_s + " % " + std::to_string(8 / inputBits) + ") * " + std::to_string(static_cast< unsigned int >(inputBits)) + ";\n"
+          "bitsBuffer = input[(block * " + nrElementsPerBlock_s + ") + " + getInputIndexOpenCL(layout, observation.getNrChannels(), nrInputChannelsPerSample, nrBlockSamplesPerChannel, "beam", "byte") + "];\n";
       } else {
-        if ( (observation.getNrSamplesPerBatch(true) % (conf.getNrThreadsD0() * conf.getNrItemsD0())) != 0 ) {
-          sum_sTemplate += "if ( (sample + <%OFFSET%>) < " + std::to_string(observation.getNrSamplesPerBatch(true)) + " ) {\n";
-        }
-        sum_sTemplate += "interBuffer = 0;\n"
-          "byte = (sample + <%OFFSET%> + shiftDM<%DM_NUM%>) / " + std::to_string(8 / inputBits) + ";\n"
-          "firstBit = ((sample + <%OFFSET%> + shiftDM<%DM_NUM%>) % " + std::to_string(8 / inputBits) + ") * " + std::to_string(static_cast< unsigned int >(inputBits)) + ";\n"
-          "bitsBuffer = input[(beam * " + std::to_string(observation.getNrChannels() * isa::utils::pad(observation.getNrSamplesPerDispersedBatch(true) / (8 / inputBits), padding / sizeof(I))) + ") + ((channel + <%UNROLL%>) * " + std::to_string(isa::utils::pad(observation.getNrSamplesPerDispersedBatch(true) / (8 / inputBits), padding / sizeof(I))) + ") + byte];\n";
-      }
-      for ( unsigned int bit = 0; bit < inputBits; bit++ ) {
-        sum_sTemplate += isa::OpenCL::setBit("interBuffer", isa::OpenCL::getBit("bitsBuffer", "firstBit + " + std::to_string(bit)), std::to_string(bit));
+        sum_sTemplate += "byte = " + inputSample_s + " / " + std::to_string(8 / inputBits) + ";\n"
+          "firstBit = (" + inputSample_s + " % " + std::to_string(8 / inputBits) + ") * " + std::to_string(static_cast< unsigned int >(inputBits)) + ";\n"
+          "bitsBuffer = input[" + getInputIndexOpenCL(layout, observation.getNrChannels(), nrInputChannelsPerSample, isa::utils::pad(observation.getNrSamplesPerDispersedBatch(true) / (8 / inputBits), padding / sizeof(I)), "beam", "byte") + "];\n";
       }
       if ( inputDataType == "char" || inputDataType == "uchar" ) {
-        for ( unsigned int bit = inputBits; bit < 8; bit++ ) {
-          sum_sTemplate += isa::OpenCL::setBit("interBuffer", isa::OpenCL::getBit("bitsBuffer", "firstBit + " + std::to_string(inputBits - 1)), std::to_string(bit));
-        }
-      }
-      sum_sTemplate += "dedispersedSample<%NUM%>DM<%DM_NUM%> += convert_" + intermediateDataType + "(interBuffer);\n";
-      if ( (observation.getNrSamplesPerBatch(true) % (conf.getNrThreadsD0() * conf.getNrItemsD0())) != 0 ) {
-        sum_sTemplate += "}\n";
+        // The most significant bit of the sample is extended to the whole byte
+        sum_sTemplate += "interBuffer = ((((bitsBuffer >> firstBit) & " + std::to_string((1 << inputBits) - 1) + ") ^ " + std::to_string(1 << (inputBits - 1)) + ") - " + std::to_string(1 << (inputBits - 1)) + ");\n";
+      } else {
+        sum_sTemplate += "interBuffer = ((bitsBuffer >> firstBit) & " + std::to_string((1 << inputBits) - 1) + ");\n";
       }
+      sum_sTemplate += load_s + "convert_" + intermediateDataType + "(interBuffer);\n";
     } else {
       if ( conf.getSplitBatches() ) {
+        sum_sTemplate += "block = (" + inputSample_s + " / " + nrSamplesPerBlock_s + ") + firstBlock;\n"
+          "if ( block >= " + nrBlocks_s + " ) {\n"
+          "block -= " + nrBlocks_s + ";\n"
+          "}\n"
+          + load_s + "convert_" + intermediateDataType + "(input[(block * " + nrElementsPerBlock_s + ") + " + getInputIndexOpenCL(layout, observation.getNrChannels(), nrInputChannelsPerSample, nrBlockSamplesPerChannel, "beam", "(" + inputSample_s + " % " + nrSamplesPerBlock_s + ")") + "]);\n";
       } else {
-        if ( ((observation.getNrSamplesPerBatch(true) / observation.getDownsampling()) % (conf.getNrThreadsD0() * conf.getNrItemsD0())) != 0 ) {
-          sum_sTemplate += "if ( (sample + <%OFFSET%>) < " + std::to_string(observation.getNrSamplesPerBatch(true) / observation.getDownsampling() ) + " ) {\n";
-        }
-        sum_sTemplate += "dedispersedSample<%NUM%>DM<%DM_NUM%> += convert_" + intermediateDataType + "(input[(beam * " + std::to_string(observation.getNrChannels() * isa::utils::pad(observation.getNrSamplesPerDispersedBatch(true), padding / sizeof(I))) + ") + ((channel + <%UNROLL%>) * " + std::to_string(isa::utils::pad(observation.getNrSamplesPerDispersedBatch(true), padding / sizeof(I))) + ") + (sample + <%OFFSET%> + shiftDM<%DM_NUM%>)]);\n";
-        if ( ((observation.getNrSamplesPerBatch(true) / observation.getDownsampling()) % (conf.getNrThreadsD0() * conf.getNrItemsD0())) != 0 ) {
-          sum_sTemplate += "}\n";
-        }
+        sum_sTemplate += load_s + "convert_" + intermediateDataType + "(input[" + getInputIndexOpenCL(layout, observation.getNrChannels(), nrInputChannelsPerSample, nrInputSamplesPerChannel, "beam", inputSample_s) + "]);\n";
       }
     }
+    if ( downsample ) {
+      sum_sTemplate += "}\n"
+        "dedispersedSample<%NUM%>DM<%DM_NUM%> += downsampledSample;\n";
+    }
+    if ( ((observation.getNrSamplesPerBatch(true) / observation.getDownsampling()) % (conf.getNrThreadsD0() * conf.getNrItemsD0())) != 0 ) {
+      sum_sTemplate += "}\n";
+    }
   }
   std::string def_sTemplate = intermediateDataType + " dedispersedSample<%NUM%>DM<%DM_NUM%> = 0;\n";
   std::string defsShiftTemplate = "unsigned int shiftDM<%DM_NUM%> = 0;\n";
   std::string shiftsTemplate;
   if ( conf.getLocalMem() ) {
-    shiftsTemplate = "shiftDM<%DM_NUM%> = convert_uint_rtz(shifts[channel + <%UNROLL%>] * (" + firstDM_s + " + ((dm + <%DM_OFFSET%>) * " + DMStep_s + "))) - minShift;\n";
+    shiftsTemplate = "shiftDM<%DM_NUM%> = delays[((dm + <%DM_OFFSET%>) * " + nrDelayChannels_s + ") + channel] - minShift;\n";
   } else {
-    shiftsTemplate = "shiftDM<%DM_NUM%> = convert_uint_rtz(shifts[channel + <%UNROLL%>] * (" + firstDM_s + " + ((dm + <%DM_OFFSET%>) * " + DMStep_s + ")));\n";
+    shiftsTemplate = "shiftDM<%DM_NUM%> = delays[((dm + <%DM_OFFSET%>) * " + nrDelayChannels_s + ") + channel];\n";
   }
   std::string store_sTemplate;
   if ( ((observation.getNrSamplesPerBatch(true) / observation.getDownsampling()) % (conf.getNrThreadsD0() * conf.getNrItemsD0())) != 0 ) {
@@ -746,164 +874,43 @@ template< typename I, typename O > std::string * getSubbandDedispersionStepOneOp
   }
   // End kernel's template
 
-  std::string * def_s =  new std::string();
-  std::string * defsShift_s = new std::string();
-  std::string * unrolled_s = new std::string();
-  std::string * store_s =  new std::string();
+  std::string * kernel = expandDedispersionOpenCL(conf, *code, def_sTemplate, defsShiftTemplate, unrolled_sTemplate, shiftsTemplate, sum_sTemplate, store_sTemplate, std::string(), std::string());
 
-  for ( unsigned int dm = 0; dm < conf.getNrItemsD1(); dm++ ) {
-    std::string dm_s = std::to_string(dm);
-    std::string * temp_s = 0;
-
-    temp_s = isa::utils::replace(&defsShiftTemplate, "<%DM_NUM%>", dm_s);
-    defsShift_s->append(*temp_s);
-    delete temp_s;
-  }
-  for ( unsigned int sample = 0; sample < conf.getNrItemsD0(); sample++ ) {
-    std::string sample_s = std::to_string(sample);
-    std::string offset_s = std::to_string(sample * conf.getNrThreadsD0());
-    std::string * def_sDM =  new std::string();
-    std::string * store_sDM =  new std::string();
-
-    for ( unsigned int dm = 0; dm < conf.getNrItemsD1(); dm++ ) {
-      std::string dm_s = std::to_string(dm);
-      std::string * temp_s = 0;
-
-      temp_s = isa::utils::replace(&def_sTemplate, "<%DM_NUM%>", dm_s);
-      def_sDM->append(*temp_s);
-      delete temp_s;
-      temp_s = isa::utils::replace(&store_sTemplate, "<%DM_NUM%>", dm_s);
-      if ( dm == 0 ) {
-        std::string empty_s;
-        temp_s = isa::utils::replace(temp_s, " + <%DM_OFFSET%>", empty_s, true);
-      } else {
-        std::string offset_s = std::to_string(dm * conf.getNrThreadsD1());
-        temp_s = isa::utils::replace(temp_s, "<%DM_OFFSET%>", offset_s, true);
-      }
-      store_sDM->append(*temp_s);
-      delete temp_s;
-    }
-    def_sDM = isa::utils::replace(def_sDM, "<%NUM%>", sample_s, true);
-    def_s->append(*def_sDM);
-    delete def_sDM;
-    store_sDM = isa::utils::replace(store_sDM, "<%NUM%>", sample_s, true);
-    if ( sample * conf.getNrThreadsD0() == 0 ) {
-      std::string empty_s;
-      store_sDM = isa::utils::replace(store_sDM, " + <%OFFSET%>", empty_s, true);
-    } else {
-      store_sDM = isa::utils::replace(store_sDM, "<%OFFSET%>", offset_s, true);
-    }
-    store_s->append(*store_sDM);
-    delete store_sDM;
-  }
-  for ( unsigned int loop = 0; loop < conf.getUnroll(); loop++ ) {
-    std::string loop_s = std::to_string(loop);
-    std::string * temp_s = 0;
-    std::string * shifts_s = new std::string();
-    std::string * sums_s = new std::string();
-
-    if ( loop == 0 ) {
-      std::string empty_s;
-      temp_s = isa::utils::replace(&unrolled_sTemplate, " + <%UNROLL%>", empty_s);
-    } else {
-      temp_s = isa::utils::replace(&unrolled_sTemplate, "<%UNROLL%>", loop_s);
-    }
-    unrolled_s->append(*temp_s);
-    delete temp_s;
-    for ( unsigned int dm = 0; dm < conf.getNrItemsD1(); dm++ ) {
-      std::string dm_s = std::to_string(dm);
-
-      temp_s = isa::utils::replace(&shiftsTemplate, "<%DM_NUM%>", dm_s);
-      if ( dm == 0 ) {
-        std::string empty_s;
-        temp_s = isa::utils::replace(temp_s, " + <%DM_OFFSET%>", empty_s, true);
-      } else {
-        std::string offset_s = std::to_string(dm * conf.getNrThreadsD1());
-        temp_s = isa::utils::replace(temp_s, "<%DM_OFFSET%>", offset_s, true);
-      }
-      if ( loop == 0 ) {
-        std::string empty_s;
-        temp_s = isa::utils::replace(temp_s, " + <%UNROLL%>", empty_s, true);
-      } else {
-        temp_s = isa::utils::replace(temp_s, "<%UNROLL%>", loop_s, true);
-      }
-      shifts_s->append(*temp_s);
-      delete temp_s;
-    }
-    unrolled_s = isa::utils::replace(unrolled_s, "<%SHIFTS%>", *shifts_s, true);
-    delete shifts_s;
-    for ( unsigned int sample = 0; sample < conf.getNrItemsD0(); sample++ ) {
-      std::string sample_s = std::to_string(sample);
-      std::string offset_s = std::to_string(sample * conf.getNrThreadsD0());
-      std::string * sumsDM_s = new std::string();
-
-      for ( unsigned int dm = 0; dm < conf.getNrItemsD1(); dm++ ) {
-        std::string dm_s = std::to_string(dm);
-
-        temp_s = isa::utils::replace(&sum_sTemplate, "<%DM_NUM%>", dm_s);
-        if ( loop == 0 ) {
-          std::string empty_s;
-          temp_s = isa::utils::replace(temp_s, " + <%UNROLL%>", empty_s, true);
-        } else {
-          temp_s = isa::utils::replace(temp_s, "<%UNROLL%>", loop_s, true);
-        }
-        sumsDM_s->append(*temp_s);
-        delete temp_s;
-      }
-      sumsDM_s = isa::utils::replace(sumsDM_s, "<%NUM%>", sample_s, true);
-      if ( sample * conf.getNrThreadsD0() == 0 ) {
-        std::string empty_s;
-        sumsDM_s = isa::utils::replace(sumsDM_s, " + <%OFFSET%>", empty_s, true);
-      } else {
-        sumsDM_s = isa::utils::replace(sumsDM_s, "<%OFFSET%>", offset_s, true);
-      }
-      sums_s->append(*sumsDM_s);
-      delete sumsDM_s;
-    }
-    unrolled_s = isa::utils::replace(unrolled_s, "<%SUMS%>", *sums_s, true);
-    if ( conf.getUnroll() == 0 ) {
-      std::string empty_s;
-      unrolled_s = isa::utils::replace(unrolled_s, " + <%UNROLL%>", empty_s, true);
-    } else {
-      unrolled_s = isa::utils::replace(unrolled_s, "<%UNROLL%>", loop_s, true);
-    }
-    delete sums_s;
-  }
-  code = isa::utils::replace(code, "<%DEFS%>", *def_s, true);
-  code = isa::utils::replace(code, "<%DEFS_SHIFT%>", *defsShift_s, true);
-  code = isa::utils::replace(code, "<%UNROLLED_LOOP%>", *unrolled_s, true);
-  code = isa::utils::replace(code, "<%STORES%>", *store_s, true);
-  delete def_s;
-  delete defsShift_s;
-  delete unrolled_s;
-  delete store_s;
-
-  return code;
+  delete code;
+  return kernel;
 }
 
-template< typename I > std::string * getSubbandDedispersionStepTwoOpenCL(const DedispersionConf & conf, const unsigned int padding, const std::string & inputDataType, const AstroData::Observation & observation, std::vector< float > & shifts)
+template< typename I > std::string * getSubbandDedispersionStepTwoOpenCL(const DedispersionConf & conf, const unsigned int padding, const std::string & inputDataType, const AstroData::Observation & observation, const DelayTable & delays, const OutputFormat outputFormat, const bool statistics, const bool dmMaxima)
 {
   std::string * code = new std::string();
   std::string unrolled_sTemplate = std::string();
-  std::string firstDM_s = std::to_string(observation.getFirstDM());
-  if ( firstDM_s.find(".") == std::string::npos ) {
-    firstDM_s.append(".0f");
-  } else {
-    firstDM_s.append("f");
-  }
-  std::string DMStep_s = std::to_string(observation.getDMStep());
-  if ( DMStep_s.find(".") == std::string::npos ) {
-    DMStep_s.append(".0f");
-  } else {
-    DMStep_s.append("f");
-  }
+  // The delays of a DM are a row of the DelayTable
+  std::string nrDelayChannels_s = std::to_string(delays.getNrPaddedChannels());
   std::string nrTotalSamplesPerBlock_s = std::to_string(conf.getNrThreadsD0() * conf.getNrItemsD0());
   std::string nrTotalDMsPerBlock_s = std::to_string(conf.getNrThreadsD1() * conf.getNrItemsD1());
   std::string nrTotalThreads_s = std::to_string(conf.getNrThreadsD0() * conf.getNrThreadsD1());
+  // Reduced output: type of the output buffer, and offsets and scales of the integer formats
+  std::string outputType_s = getOutputFormatName(outputFormat, inputDataType);
+  std::string scalingArguments_s;
+  if ( dmMaxima ) {
+    outputType_s = "float";
+  } else if ( (outputFormat == OutputFormat::UShort) || (outputFormat == OutputFormat::UChar) ) {
+    scalingArguments_s = ", __global const float * restrict const offsets, __global const float * restrict const scales";
+  }
+  // Statistics: partials of the sums and sums of squares of the output
+  std::string statisticsArguments_s;
+  if ( statistics ) {
+    statisticsArguments_s = ", __global float * restrict const statistics";
+  }
+  // DM maxima: DMs of the maxima stored in output
+  std::string dmMaximaArguments_s;
+  if ( dmMaxima ) {
+    dmMaximaArguments_s = ", __global unsigned int * restrict const outputDMs";
+  }
 
   // Begin kernel's template
   if ( conf.getLocalMem() ) {
-    *code = "__kernel void dedispersionStepTwo(__global const " + inputDataType + " * restrict const input, __global " + inputDataType + " * restrict const output, __constant const unsigned int * const restrict beamMapping, __constant const float * restrict const shifts, const unsigned int firstSynthesizedBeam) {\n"
+    *code = "__kernel void dedispersionStepTwo(__global const " + inputDataType + " * restrict const input, __global " + outputType_s + " * restrict const output, __constant const unsigned int * const restrict beamMapping, __global const unsigned int * restrict const delays, const unsigned int firstSynthesizedBeam" + scalingArguments_s + statisticsArguments_s + dmMaximaArguments_s + ") {\n"
       "unsigned int sBeam = (get_group_id(2) / " + std::to_string(observation.getNrDMs(true)) + ");\n"
       "unsigned int firstStepDM = get_group_id(2) % " + std::to_string(observation.getNrDMs(true)) + ";\n"
       "unsigned int dm = (get_group_id(1) * " + nrTotalDMsPerBlock_s + ") + get_local_id(1);\n"
@@ -911,7 +918,7 @@ template< typename I > std::string * getSubbandDedispersionStepTwoOpenCL(const D
       "unsigned int inShMem = 0;\n"
       "unsigned int inGlMem = 0;\n"
       "<%DEFS%>"
-      "__local " + inputDataType + " buffer[" + std::to_string((conf.getNrThreadsD0() * conf.getNrItemsD0()) + static_cast< unsigned int >(shifts[0] * (observation.getFirstDM() + ((conf.getNrThreadsD1() * conf.getNrItemsD1()) * observation.getDMStep())))) + "];\n"
+      "__local " + inputDataType + " buffer[" + std::to_string((conf.getNrThreadsD0() * conf.getNrItemsD0()) + delays.getMaxDelayDifference(conf.getNrThreadsD1() * conf.getNrItemsD1())) + "];\n"
       "\n"
       "for ( unsigned int channel = 0; channel < " + std::to_string(observation.getNrSubbands()) + "; channel += " + std::to_string(conf.getUnroll()) + " ) {\n"
       "unsigned int minShift = 0;\n"
@@ -922,9 +929,9 @@ template< typename I > std::string * getSubbandDedispersionStepTwoOpenCL(const D
       "}\n"
       "<%STORES%>"
       "}";
-    unrolled_sTemplate = "minShift = convert_uint_rtz(shifts[channel + <%UNROLL%>] * (" + firstDM_s + " + ((get_group_id(1) * " + nrTotalDMsPerBlock_s + ") * " + DMStep_s + ")));\n"
+    unrolled_sTemplate = "minShift = delays[((get_group_id(1) * " + nrTotalDMsPerBlock_s + ") * " + nrDelayChannels_s + ") + channel + <%UNROLL%>];\n"
       "<%SHIFTS%>"
-      "diffShift = convert_uint_rtz(shifts[channel + <%UNROLL%>] * (" + firstDM_s + " + (((get_group_id(1) * " + nrTotalDMsPerBlock_s + ") + " + std::to_string((conf.getNrThreadsD1() * conf.getNrItemsD1()) - 1) + ") * " + DMStep_s + "))) - minShift;\n"
+      "diffShift = delays[(((get_group_id(1) * " + nrTotalDMsPerBlock_s + ") + " + std::to_string((conf.getNrThreadsD1() * conf.getNrItemsD1()) - 1) + ") * " + nrDelayChannels_s + ") + channel + <%UNROLL%>] - minShift;\n"
       "\n"
       "inShMem = (get_local_id(1) * " + std::to_string(conf.getNrThreadsD0()) + ") + get_local_id(0);\n"
       "inGlMem = ((get_group_id(0) * " + nrTotalSamplesPerBlock_s + ") + inShMem) + minShift;\n"
@@ -941,7 +948,7 @@ template< typename I > std::string * getSubbandDedispersionStepTwoOpenCL(const D
       unrolled_sTemplate += "barrier(CLK_LOCAL_MEM_FENCE);\n";
     }
   } else {
-    *code = "__kernel void dedispersionStepTwo(__global const " + inputDataType + " * restrict const input, __global " + inputDataType + " * restrict const output, __constant const unsigned int * restrict const beamMapping, __constant const float * restrict const shifts, const unsigned int firstSynthesizedBeam) {\n"
+    *code = "__kernel void dedispersionStepTwo(__global const " + inputDataType + " * restrict const input, __global " + outputType_s + " * restrict const output, __constant const unsigned int * restrict const beamMapping, __global const unsigned int * restrict const delays, const unsigned int firstSynthesizedBeam" + scalingArguments_s + statisticsArguments_s + dmMaximaArguments_s + ") {\n"
       "unsigned int sBeam = get_group_id(2) / " + std::to_string(observation.getNrDMs(true)) + ";\n"
       "unsigned int firstStepDM = get_group_id(2) % " + std::to_string(observation.getNrDMs(true)) + ";\n"
       "unsigned int dm = (get_group_id(1) * " + nrTotalDMsPerBlock_s + ") + get_local_id(1);\n"
@@ -964,10 +971,10 @@ template< typename I > std::string * getSubbandDedispersionStepTwoOpenCL(const D
   std::string shiftsTemplate;
   std::string sum_sTemplate;
   if ( conf.getLocalMem() ) {
-    shiftsTemplate = "shiftDM<%DM_NUM%> = convert_uint_rtz(shifts[channel + <%UNROLL%>] * (" + firstDM_s + " + ((dm + <%DM_OFFSET%>) * " + DMStep_s + "))) - minShift;\n";
+    shiftsTemplate = "shiftDM<%DM_NUM%> = delays[((dm + <%DM_OFFSET%>) * " + nrDelayChannels_s + ") + channel + <%UNROLL%>] - minShift;\n";
     sum_sTemplate = "dedispersedSample<%NUM%>DM<%DM_NUM%> += buffer[(get_local_id(0) + <%OFFSET%>) + shiftDM<%DM_NUM%>];\n";
   } else {
-    shiftsTemplate = "shiftDM<%DM_NUM%> = convert_uint_rtz(shifts[channel + <%UNROLL%>] * (" + firstDM_s + " + ((dm + <%DM_OFFSET%>) * " + DMStep_s + ")));\n";
+    shiftsTemplate = "shiftDM<%DM_NUM%> = delays[((dm + <%DM_OFFSET%>) * " + nrDelayChannels_s + ") + channel + <%UNROLL%>];\n";
     if ( ((observation.getNrSamplesPerBatch() / observation.getDownsampling()) % (conf.getNrThreadsD0() * conf.getNrItemsD0())) != 0 ) {
       sum_sTemplate += "if ( (sample + <%OFFSET%>) < " + std::to_string(observation.getNrSamplesPerBatch() / observation.getDownsampling()) + " ) {\n";
     }
@@ -976,149 +983,44 @@ template< typename I > std::string * getSubbandDedispersionStepTwoOpenCL(const D
       sum_sTemplate += "}\n";
     }
   }
+  // The reduced formats are padded to their own size
+  unsigned int nrOutputSamplesPadded = isa::utils::pad(observation.getNrSamplesPerBatch() / observation.getDownsampling(), padding / sizeof(I));
+  if ( outputFormat != OutputFormat::Float ) {
+    nrOutputSamplesPadded = isa::utils::pad(observation.getNrSamplesPerBatch() / observation.getDownsampling(), padding / getOutputFormatSize< I >(outputFormat));
+  }
   std::string store_sTemplate;
   if ( ((observation.getNrSamplesPerBatch() / observation.getDownsampling()) % (conf.getNrThreadsD0() * conf.getNrItemsD0())) != 0 ) {
     store_sTemplate += "if ( (sample + <%OFFSET%>) < " + std::to_string(observation.getNrSamplesPerBatch() / observation.getDownsampling()) + " ) {\n";
   }
-  store_sTemplate += "output[(sBeam * " + std::to_string(observation.getNrDMs(true) * observation.getNrDMs() * isa::utils::pad(observation.getNrSamplesPerBatch() / observation.getDownsampling(), padding / sizeof(I))) + ") + (firstStepDM * " + std::to_string(observation.getNrDMs() * isa::utils::pad(observation.getNrSamplesPerBatch() / observation.getDownsampling(), padding / sizeof(I))) + ") + ((dm + <%DM_OFFSET%>) * " + std::to_string(isa::utils::pad(observation.getNrSamplesPerBatch() / observation.getDownsampling(), padding / sizeof(I))) + ") + (sample + <%OFFSET%>)] = dedispersedSample<%NUM%>DM<%DM_NUM%>;\n";
+  if ( dmMaxima ) {
+    store_sTemplate += getDMMaximaCompareOpenCL(inputDataType, "dedispersedSample<%NUM%>DM<%DM_NUM%>", "(firstStepDM * " + std::to_string(observation.getNrDMs()) + ") + dm + <%DM_OFFSET%>");
+  } else {
+    store_sTemplate += getOutputStoreOpenCL(outputFormat, inputDataType, inputDataType, "(sBeam * " + std::to_string(observation.getNrDMs(true) * observation.getNrDMs() * nrOutputSamplesPadded) + ") + (firstStepDM * " + std::to_string(observation.getNrDMs() * nrOutputSamplesPadded) + ") + ((dm + <%DM_OFFSET%>) * " + std::to_string(nrOutputSamplesPadded) + ") + (sample + <%OFFSET%>)", "dedispersedSample<%NUM%>DM<%DM_NUM%>", "((firstSynthesizedBeam + sBeam) * " + std::to_string(observation.getNrDMs(true) * observation.getNrDMs()) + ") + (firstStepDM * " + std::to_string(observation.getNrDMs()) + ") + dm + <%DM_OFFSET%>");
+  }
+  if ( statistics ) {
+    store_sTemplate += getStatisticsSumOpenCL(inputDataType, "dedispersedSample<%NUM%>DM<%DM_NUM%>");
+  }
   if ( ((observation.getNrSamplesPerBatch() / observation.getDownsampling()) % (conf.getNrThreadsD0() * conf.getNrItemsD0())) != 0 ) {
     store_sTemplate += "}\n";
   }
   // End kernel's template
 
-  std::string * def_s =  new std::string();
-  std::string * defsShift_s = new std::string();
-  std::string * unrolled_s = new std::string();
-  std::string * store_s =  new std::string();
-
-  for ( unsigned int dm = 0; dm < conf.getNrItemsD1(); dm++ ) {
-    std::string dm_s = std::to_string(dm);
-    std::string * temp_s = 0;
-
-    temp_s = isa::utils::replace(&defsShiftTemplate, "<%DM_NUM%>", dm_s);
-    defsShift_s->append(*temp_s);
-    delete temp_s;
+  std::string storeDefinitions;
+  std::string storeReductions;
+  if ( dmMaxima ) {
+    storeDefinitions += getDMMaximaDefinitionsOpenCL(conf);
   }
-  for ( unsigned int sample = 0; sample < conf.getNrItemsD0(); sample++ ) {
-    std::string sample_s = std::to_string(sample);
-    std::string offset_s = std::to_string(sample * conf.getNrThreadsD0());
-    std::string * def_sDM =  new std::string();
-    std::string * store_sDM =  new std::string();
-
-    for ( unsigned int dm = 0; dm < conf.getNrItemsD1(); dm++ ) {
-      std::string dm_s = std::to_string(dm);
-      std::string * temp_s = 0;
-
-      temp_s = isa::utils::replace(&def_sTemplate, "<%DM_NUM%>", dm_s);
-      def_sDM->append(*temp_s);
-      delete temp_s;
-      temp_s = isa::utils::replace(&store_sTemplate, "<%DM_NUM%>", dm_s);
-      if ( dm == 0 ) {
-        std::string empty_s;
-        temp_s = isa::utils::replace(temp_s, " + <%DM_OFFSET%>", empty_s, true);
-      } else {
-        std::string offset_s = std::to_string(dm * conf.getNrThreadsD1());
-        temp_s = isa::utils::replace(temp_s, "<%DM_OFFSET%>", offset_s, true);
-      }
-      store_sDM->append(*temp_s);
-      delete temp_s;
-    }
-    def_sDM = isa::utils::replace(def_sDM, "<%NUM%>", sample_s, true);
-    def_s->append(*def_sDM);
-    delete def_sDM;
-    store_sDM = isa::utils::replace(store_sDM, "<%NUM%>", sample_s, true);
-    if ( sample * conf.getNrThreadsD0() == 0 ) {
-      std::string empty_s;
-      store_sDM = isa::utils::replace(store_sDM, " + <%OFFSET%>", empty_s, true);
-    } else {
-      store_sDM = isa::utils::replace(store_sDM, "<%OFFSET%>", offset_s, true);
-    }
-    store_s->append(*store_sDM);
-    delete store_sDM;
+  if ( statistics ) {
+    storeDefinitions += getStatisticsDefinitionsOpenCL(conf);
+    storeReductions += getStatisticsStoreOpenCL(conf, "(sBeam * " + std::to_string(observation.getNrDMs(true) * observation.getNrDMs()) + ") + (firstStepDM * " + std::to_string(observation.getNrDMs()) + ") + dm", ((observation.getNrSamplesPerBatch() / observation.getDownsampling()) + (conf.getNrThreadsD0() * conf.getNrItemsD0()) - 1) / (conf.getNrThreadsD0() * conf.getNrItemsD0()));
   }
-  for ( unsigned int loop = 0; loop < conf.getUnroll(); loop++ ) {
-    std::string loop_s = std::to_string(loop);
-    std::string * temp_s = 0;
-    std::string * shifts_s = new std::string();
-    std::string * sums_s = new std::string();
-
-    if ( loop == 0 ) {
-      std::string empty_s;
-      temp_s = isa::utils::replace(&unrolled_sTemplate, " + <%UNROLL%>", empty_s);
-    } else {
-      temp_s = isa::utils::replace(&unrolled_sTemplate, "<%UNROLL%>", loop_s);
-    }
-    unrolled_s->append(*temp_s);
-    delete temp_s;
-    for ( unsigned int dm = 0; dm < conf.getNrItemsD1(); dm++ ) {
-      std::string dm_s = std::to_string(dm);
-
-      temp_s = isa::utils::replace(&shiftsTemplate, "<%DM_NUM%>", dm_s);
-      if ( dm == 0 ) {
-        std::string empty_s;
-        temp_s = isa::utils::replace(temp_s, " + <%DM_OFFSET%>", empty_s, true);
-      } else {
-        std::string offset_s = std::to_string(dm * conf.getNrThreadsD1());
-        temp_s = isa::utils::replace(temp_s, "<%DM_OFFSET%>", offset_s, true);
-      }
-      if ( loop == 0 ) {
-        std::string empty_s;
-        temp_s = isa::utils::replace(temp_s, " + <%UNROLL%>", empty_s, true);
-      } else {
-        temp_s = isa::utils::replace(temp_s, "<%UNROLL%>", loop_s, true);
-      }
-      shifts_s->append(*temp_s);
-      delete temp_s;
-    }
-    unrolled_s = isa::utils::replace(unrolled_s, "<%SHIFTS%>", *shifts_s, true);
-    delete shifts_s;
-    for ( unsigned int sample = 0; sample < conf.getNrItemsD0(); sample++ ) {
-      std::string sample_s = std::to_string(sample);
-      std::string offset_s = std::to_string(sample * conf.getNrThreadsD0());
-      std::string * sumsDM_s = new std::string();
-
-      for ( unsigned int dm = 0; dm < conf.getNrItemsD1(); dm++ ) {
-        std::string dm_s = std::to_string(dm);
-
-        temp_s = isa::utils::replace(&sum_sTemplate, "<%DM_NUM%>", dm_s);
-        if ( loop == 0 ) {
-          std::string empty_s;
-          temp_s = isa::utils::replace(temp_s, " + <%UNROLL%>", empty_s, true);
-        } else {
-          temp_s = isa::utils::replace(temp_s, "<%UNROLL%>", loop_s, true);
-        }
-        sumsDM_s->append(*temp_s);
-        delete temp_s;
-      }
-      sumsDM_s = isa::utils::replace(sumsDM_s, "<%NUM%>", sample_s, true);
-      if ( sample * conf.getNrThreadsD0() == 0 ) {
-        std::string empty_s;
-        sumsDM_s = isa::utils::replace(sumsDM_s, " + <%OFFSET%>", empty_s, true);
-      } else {
-        sumsDM_s = isa::utils::replace(sumsDM_s, "<%OFFSET%>", offset_s, true);
-      }
-      sums_s->append(*sumsDM_s);
-      delete sumsDM_s;
-    }
-    unrolled_s = isa::utils::replace(unrolled_s, "<%SUMS%>", *sums_s, true);
-    if ( conf.getUnroll() == 0 ) {
-      std::string empty_s;
-      unrolled_s = isa::utils::replace(unrolled_s, " + <%UNROLL%>", empty_s, true);
-    } else {
-      unrolled_s = isa::utils::replace(unrolled_s, "<%UNROLL%>", loop_s, true);
-    }
-    delete sums_s;
+  if ( dmMaxima ) {
+    storeReductions += getDMMaximaStoreOpenCL(conf, "(((sBeam * " + std::to_string(observation.getNrDMs(true)) + ") + firstStepDM) * " + std::to_string(observation.getNrDMs() / (conf.getNrThreadsD1() * conf.getNrItemsD1())) + ") + get_group_id(1)", observation.getNrSamplesPerBatch() / observation.getDownsampling());
   }
-  code = isa::utils::replace(code, "<%DEFS%>", *def_s, true);
-  code = isa::utils::replace(code, "<%DEFS_SHIFT%>", *defsShift_s, true);
-  code = isa::utils::replace(code, "<%UNROLLED_LOOP%>", *unrolled_s, true);
-  code = isa::utils::replace(code, "<%STORES%>", *store_s, true);
-  delete def_s;
-  delete defsShift_s;
-  delete unrolled_s;
-  delete store_s;
+  std::string * kernel = expandDedispersionOpenCL(conf, *code, def_sTemplate, defsShiftTemplate, unrolled_sTemplate, shiftsTemplate, sum_sTemplate, store_sTemplate, storeDefinitions, storeReductions);
 
-  return code;
+  delete code;
+  return kernel;
 }
 
 } // Dedispersion
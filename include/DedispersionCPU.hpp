@@ -0,0 +1,832 @@
+// Copyright 2017 Netherlands Institute for Radio Astronomy (ASTRON)
+// Copyright 2017 Netherlands eScience Center
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+
+#include <Observation.hpp>
+#include <utils.hpp>
+#include <Dedispersion.hpp>
+#include <ThreadPool.hpp>
+#include <Accumulate.hpp>
+#include <DelayTable.hpp>
+#include <ActiveChannels.hpp>
+#include <Unpack.hpp>
+#include <Statistics.hpp>
+#include <InputLayout.hpp>
+
+
+#pragma once
+
+namespace Dedispersion {
+
+// Input rows read by the CPU kernels: a row of nrSamplesPerChannel elements for every beam and channel, and sample 0 of the batch is sample firstSample of a row.
+// If nrBlocks is not 0, the input is a ring of blocks as in split batches mode (see getNrInputBlocks()): every block has its own rows, holds nrSamplesPerBlock samples
+// of each row and nrElementsPerBlock elements, firstSample counts from the beginning of the first block, and the samples wrap around the end of the ring.
+// If downsampling is more than 1, the rows have the raw time resolution and every sample read by the kernels is the sum of downsampling raw samples, added while loading;
+// downsampling must then be observation.getDownsampling(), and firstSample and the samples of the rows count raw samples.
+// If nrChannelsPerSample is not 0, the input is time-major (see InputLayout.hpp): a beam holds nrSamplesPerChannel rows of nrChannelsPerSample elements, one for every channel,
+// so the samples of a channel are nrChannelsPerSample elements apart; time-major input needs at least 8 bits per sample. With reversedFrequency, channel 0 is the last one in memory.
+template< typename I > struct InputWindow {
+  const I * data;
+  unsigned int nrSamplesPerChannel;
+  unsigned int firstSample;
+  unsigned int nrBlocks;
+  unsigned int nrSamplesPerBlock;
+  unsigned int nrElementsPerBlock;
+  unsigned int downsampling;
+  unsigned int nrChannelsPerSample;
+  bool reversedFrequency;
+};
+
+// Parallel CPU
+// Same output as the sequential templates in Dedispersion.hpp, with the work split over the threads of a pool.
+// The delays are read from a DelayTable computed for the matching step, instead of from the shifts.
+// The zapped channels are skipped by looping over an ActiveChannels list: of the synthesized beams for dedispersion, of the beams for the subbanding kernels.
+// The output is divided in tiles of DMs and samples, the size of a tile is taken from the DedispersionConf:
+//   - samples per tile: nrThreadsD0 * nrItemsD0
+//   - DMs per tile: nrThreadsD1 * nrItemsD1
+//   - channels (or subbands) per block: unroll
+// Each block of channels is added to all the DMs of a tile while its input rows are in cache; the shifted rows of a block are added in one pass over the accumulators, so that the inner loop is vectorized and the accumulators stay in registers (see Accumulate.hpp).
+// Input with less than 8 bits per sample is unpacked once per tile and block of channels, and then added like 8 bit input (see Unpack.hpp).
+// Time-major input is transposed the same way: the strided samples of a block of channels are gathered once per tile, and then added like channel-major input.
+// The kernels taking a vector read a whole dispersed batch; the ones taking an InputWindow can also read the ring of blocks of split batches mode (see StreamingDedispersion.hpp),
+// and raw resolution input: the raw samples of a block of channels are then added to a run of L samples once per tile, and the runs are added like the unpacked ones.
+// The dedispersed samples are stored in the format of scaling, with O of the size of the format (e.g. uint16_t for Half and UShort, uint8_t for UChar; see OutputFormat.hpp).
+// If statistics is not nullptr, the sums and sums of squares of the dedispersed samples, before the conversion to the output format, are stored in its partials while the tiles are in cache (see Statistics.hpp).
+template< typename I, typename L, typename O > void dedispersion(ThreadPool & pool, const DedispersionConf & conf, AstroData::Observation & observation, const ActiveChannels & activeChannels, const std::vector<unsigned int> & beamMapping, const std::vector< I > & input, std::vector< O > & output, const DelayTable & delays, const unsigned int padding, const uint8_t inputBits, const OutputScaling & scaling = OutputScaling(), Statistics * statistics = nullptr);
+template< typename I, typename L, typename O > void dedispersion(ThreadPool & pool, const DedispersionConf & conf, AstroData::Observation & observation, const ActiveChannels & activeChannels, const std::vector<unsigned int> & beamMapping, const InputWindow< I > & input, std::vector< O > & output, const DelayTable & delays, const unsigned int padding, const uint8_t inputBits, const OutputScaling & scaling = OutputScaling(), Statistics * statistics = nullptr);
+template< typename I, typename L, typename O > void subbandDedispersionStepOne(ThreadPool & pool, const DedispersionConf & conf, AstroData::Observation & observation, const ActiveChannels & activeChannels, const std::vector< I > & input, std::vector< O > & output, const DelayTable & delays, const unsigned int padding, const uint8_t inputBits);
+template< typename I, typename L, typename O > void subbandDedispersionStepOne(ThreadPool & pool, const DedispersionConf & conf, AstroData::Observation & observation, const ActiveChannels & activeChannels, const InputWindow< I > & input, std::vector< O > & output, const DelayTable & delays, const unsigned int padding, const uint8_t inputBits);
+template< typename I, typename L, typename O > void subbandDedispersionStepTwo(ThreadPool & pool, const DedispersionConf & conf, AstroData::Observation & observation, const std::vector<unsigned int> & beamMapping, const std::vector< I > & input, std::vector< O > & output, const DelayTable & delays, const unsigned int padding, const OutputScaling & scaling = OutputScaling(), Statistics * statistics = nullptr);
+// Both subbanding steps, one subbanding DM and one segment of samples at a time: the output of step one for a segment is consumed by step two before the next one is computed.
+// The intermediate buffer holds beams * subbands * the samples of a segment of step two tiles, with the largest delay of step two, instead of the whole batch of every subbanding DM;
+// output is the same as subbandDedispersionStepOne followed by subbandDedispersionStepTwo with L as the intermediate type.
+template< typename I, typename L, typename O > void subbandDedispersion(ThreadPool & pool, const DedispersionConf & conf, AstroData::Observation & observation, const ActiveChannels & activeChannels, const std::vector<unsigned int> & beamMapping, const std::vector< I > & input, std::vector< O > & output, const DelayTable & delaysStepOne, const DelayTable & delaysStepTwo, const unsigned int padding, const uint8_t inputBits, const OutputScaling & scaling = OutputScaling(), Statistics * statistics = nullptr);
+template< typename I, typename L, typename O > void subbandDedispersion(ThreadPool & pool, const DedispersionConf & conf, AstroData::Observation & observation, const ActiveChannels & activeChannels, const std::vector<unsigned int> & beamMapping, const InputWindow< I > & input, std::vector< O > & output, const DelayTable & delaysStepOne, const DelayTable & delaysStepTwo, const unsigned int padding, const uint8_t inputBits, const OutputScaling & scaling = OutputScaling(), Statistics * statistics = nullptr);
+// Tiles of dedispersion() and subbandDedispersion(), each computed with nrHaloSamples samples more than the tile size, up to the end of the batch.
+// Every tile is passed to store(sBeam, firstDM, nrTileDMs, firstSample, nrTileSamples, accumulator, nrAccumulatorSamples, thread), with the DMs of the tile at a distance of nrAccumulatorSamples in accumulator;
+// the DMs of subbandDedispersionTiles() are the ones of the output of step two.
+template< typename I, typename L, typename S > void dedispersionTiles(ThreadPool & pool, const DedispersionConf & conf, AstroData::Observation & observation, const ActiveChannels & activeChannels, const std::vector<unsigned int> & beamMapping, const InputWindow< I > & input, const DelayTable & delays, const unsigned int padding, const uint8_t inputBits, const unsigned int nrHaloSamples, const S & store);
+template< typename I, typename L, typename S > void subbandDedispersionTiles(ThreadPool & pool, const DedispersionConf & conf, AstroData::Observation & observation, const ActiveChannels & activeChannels, const std::vector<unsigned int> & beamMapping, const InputWindow< I > & input, const DelayTable & delaysStepOne, const DelayTable & delaysStepTwo, const unsigned int padding, const uint8_t inputBits, const unsigned int nrHaloSamples, const S & store);
+// Tile sizes of the CPU kernels
+unsigned int getNrSamplesPerTile(const DedispersionConf & conf);
+unsigned int getNrDMsPerTile(const DedispersionConf & conf);
+unsigned int getNrChannelsPerBlock(const DedispersionConf & conf);
+// Add nrSamples samples of a channel packed with less than 8 bits per sample, starting at firstSample, to a run of accumulators
+template< typename I, typename L > void accumulatePacked(const I * channel, const unsigned int firstSample, L * accumulator, const unsigned int nrSamples, const uint8_t inputBits);
+// Window over a batch stored in a vector, as read by the kernels taking a vector; the vector taking kernels read the default layout, the others the layout of their window
+template< typename I > InputWindow< I > getInputWindow(const AstroData::Observation & observation, const std::vector< I > & input, const unsigned int padding, const uint8_t inputBits, const bool subbanding, const InputLayout & layout = InputLayout());
+// Window over the ring of blocks of split batches mode, stored in a vector, with the dispersed batch starting in firstBlock
+template< typename I > InputWindow< I > getSplitBatchesWindow(const AstroData::Observation & observation, const std::vector< I > & input, const unsigned int firstBlock, const unsigned int padding, const uint8_t inputBits, const bool subbanding, const InputLayout & layout = InputLayout());
+// First element of a channel row of a beam
+template< typename I > const I * getInputChannel(const InputWindow< I > & input, const AstroData::Observation & observation, const unsigned int beam, const unsigned int channel);
+// Run of nrSamples samples of a channel row, from a sample of the batch; a run that crosses the end of a block, or of time-major input, is copied to scratch
+template< typename I > const I * getInputRun(const InputWindow< I > & input, const I * channel, const unsigned int sample, const unsigned int nrSamples, I * scratch);
+// Copy the run of nrSamples samples of a time-major channel, from a sample of the batch, to samples, across the blocks of a ring; returns samples
+template< typename I > const I * gatherInput(const InputWindow< I > & input, const I * channel, const unsigned int sample, const unsigned int nrSamples, I * samples);
+// unpack() a run of samples of a channel row, from a sample of the batch, across the blocks of a ring
+template< typename I > void unpackInput(const InputWindow< I > & input, const I * channel, const unsigned int sample, I * samples, const unsigned int nrSamples, const uint8_t inputBits);
+// Copy a run of samples of a channel row to samples: unpackInput() with less than 8 bits per sample, the run of getInputRun() otherwise
+template< typename I > void loadInput(const InputWindow< I > & input, const I * channel, const unsigned int sample, I * samples, const unsigned int nrSamples, const uint8_t inputBits);
+// Run of nrSamples downsampled samples of a raw resolution channel row, from a downsampled sample of the batch; every sample is the sum, in L, of input.downsampling raw samples
+template< typename I, typename L > void downsampleInput(const InputWindow< I > & input, const I * channel, const unsigned int sample, L * samples, const unsigned int nrSamples, const uint8_t inputBits);
+
+
+// Implementations
+inline unsigned int getNrSamplesPerTile(const DedispersionConf & conf)
+{
+  return std::max(conf.getNrThreadsD0() * conf.getNrItemsD0(), 1u);
+}
+
+inline unsigned int getNrDMsPerTile(const DedispersionConf & conf)
+{
+  return std::max(conf.getNrThreadsD1() * conf.getNrItemsD1(), 1u);
+}
+
+inline unsigned int getNrChannelsPerBlock(const DedispersionConf & conf)
+{
+  return std::max(conf.getUnroll(), 1u);
+}
+
+template< typename I, typename L > inline void accumulatePacked(const I * channel, const unsigned int firstSample, L * accumulator, const unsigned int nrSamples, const uint8_t inputBits)
+{
+  const unsigned int nrSamplesPerChunk = 1024;
+  I samples[nrSamplesPerChunk];
+
+  for ( unsigned int sample = 0; sample < nrSamples; sample += nrSamplesPerChunk )
+  {
+    const unsigned int nrChunkSamples = std::min(nrSamplesPerChunk, nrSamples - sample);
+
+    unpack(channel, firstSample + sample, samples, nrChunkSamples, inputBits);
+    accumulate(samples, accumulator + sample, nrChunkSamples);
+  }
+}
+
+template< typename I > inline InputWindow< I > getInputWindow(const AstroData::Observation & observation, const std::vector< I > & input, const unsigned int padding, const uint8_t inputBits, const bool subbanding, const InputLayout & layout)
+{
+  InputWindow< I > window = {input.data(), 0, 0, 0, 0, 0, 1, 0, layout.getReversedFrequency()};
+
+  if ( layout.getOrdering() == InputOrdering::TimeMajor )
+  {
+    if ( inputBits < 8 )
+    {
+      throw std::invalid_argument("Time-major input needs at least 8 bits per sample.");
+    }
+    window.nrSamplesPerChannel = observation.getNrSamplesPerDispersedBatch(subbanding);
+    window.nrChannelsPerSample = getNrInputChannelsPerSample< I >(observation, padding);
+  }
+  else if ( inputBits >= 8 )
+  {
+    window.nrSamplesPerChannel = isa::utils::pad(observation.getNrSamplesPerDispersedBatch(subbanding), padding / sizeof(I));
+  }
+  else
+  {
+    window.nrSamplesPerChannel = isa::utils::pad(observation.getNrSamplesPerDispersedBatch(subbanding) / (8 / inputBits), padding / sizeof(I));
+  }
+  return window;
+}
+
+template< typename I > inline InputWindow< I > getSplitBatchesWindow(const AstroData::Observation & observation, const std::vector< I > & input, const unsigned int firstBlock, const unsigned int padding, const uint8_t inputBits, const bool subbanding, const InputLayout & layout)
+{
+  const unsigned int nrSamplesPerChannel = getNrInputBlockSamplesPerChannel< I >(observation, padding, inputBits);
+  InputWindow< I > window = {input.data(), nrSamplesPerChannel, firstBlock * observation.getNrSamplesPerBatch(), getNrInputBlocks(observation, subbanding), observation.getNrSamplesPerBatch(), observation.getNrBeams() * observation.getNrChannels() * nrSamplesPerChannel, 1, 0, layout.getReversedFrequency()};
+
+  if ( layout.getOrdering() == InputOrdering::TimeMajor )
+  {
+    if ( inputBits < 8 )
+    {
+      throw std::invalid_argument("Time-major input needs at least 8 bits per sample.");
+    }
+    window.nrSamplesPerChannel = observation.getNrSamplesPerBatch();
+    window.nrChannelsPerSample = getNrInputChannelsPerSample< I >(observation, padding);
+    window.nrElementsPerBlock = observation.getNrBeams() * window.nrSamplesPerChannel * window.nrChannelsPerSample;
+  }
+  return window;
+}
+
+template< typename I > inline const I * getInputChannel(const InputWindow< I > & input, const AstroData::Observation & observation, const unsigned int beam, const unsigned int channel)
+{
+  const unsigned int row = input.reversedFrequency ? observation.getNrChannels() - 1 - channel : channel;
+
+  if ( input.nrChannelsPerSample > 0 )
+  {
+    return input.data + (beam * input.nrSamplesPerChannel * input.nrChannelsPerSample) + row;
+  }
+  return input.data + (beam * observation.getNrChannels() * input.nrSamplesPerChannel) + (row * input.nrSamplesPerChannel);
+}
+
+template< typename I > inline const I * getInputRun(const InputWindow< I > & input, const I * channel, const unsigned int sample, const unsigned int nrSamples, I * scratch)
+{
+  if ( input.nrChannelsPerSample > 0 )
+  {
+    return gatherInput(input, channel, sample, nrSamples, scratch);
+  }
+  if ( input.nrBlocks == 0 )
+  {
+    return channel + input.firstSample + sample;
+  }
+  const unsigned int nrRingSamples = input.nrBlocks * input.nrSamplesPerBlock;
+  unsigned int position = (input.firstSample + sample) % nrRingSamples;
+
+  if ( (position % input.nrSamplesPerBlock) + nrSamples <= input.nrSamplesPerBlock )
+  {
+    return channel + ((position / input.nrSamplesPerBlock) * input.nrElementsPerBlock) + (position % input.nrSamplesPerBlock);
+  }
+  for ( unsigned int copied = 0; copied < nrSamples; )
+  {
+    const I * block = channel + ((position / input.nrSamplesPerBlock) * input.nrElementsPerBlock);
+    const unsigned int nrBlockSamples = std::min(nrSamples - copied, input.nrSamplesPerBlock - (position % input.nrSamplesPerBlock));
+
+    std::copy(block + (position % input.nrSamplesPerBlock), block + (position % input.nrSamplesPerBlock) + nrBlockSamples, scratch + copied);
+    copied += nrBlockSamples;
+    position = (position + nrBlockSamples) % nrRingSamples;
+  }
+  return scratch;
+}
+
+template< typename I > inline const I * gatherInput(const InputWindow< I > & input, const I * channel, const unsigned int sample, const unsigned int nrSamples, I * samples)
+{
+  if ( input.nrBlocks == 0 )
+  {
+    const I * row = channel + ((input.firstSample + sample) * input.nrChannelsPerSample);
+
+    for ( unsigned int item = 0; item < nrSamples; item++ )
+    {
+      samples[item] = row[item * input.nrChannelsPerSample];
+    }
+    return samples;
+  }
+  const unsigned int nrRingSamples = input.nrBlocks * input.nrSamplesPerBlock;
+  unsigned int position = (input.firstSample + sample) % nrRingSamples;
+
+  for ( unsigned int gathered = 0; gathered < nrSamples; )
+  {
+    const I * row = channel + ((position / input.nrSamplesPerBlock) * input.nrElementsPerBlock) + ((position % input.nrSamplesPerBlock) * input.nrChannelsPerSample);
+    const unsigned int nrBlockSamples = std::min(nrSamples - gathered, input.nrSamplesPerBlock - (position % input.nrSamplesPerBlock));
+
+    for ( unsigned int item = 0; item < nrBlockSamples; item++ )
+    {
+      samples[gathered + item] = row[item * input.nrChannelsPerSample];
+    }
+    gathered += nrBlockSamples;
+    position = (position + nrBlockSamples) % nrRingSamples;
+  }
+  return samples;
+}
+
+template< typename I > inline void unpackInput(const InputWindow< I > & input, const I * channel, const unsigned int sample, I * samples, const unsigned int nrSamples, const uint8_t inputBits)
+{
+  if ( input.nrBlocks == 0 )
+  {
+    unpack(channel, input.firstSample + sample, samples, nrSamples, inputBits);
+    return;
+  }
+  const unsigned int nrRingSamples = input.nrBlocks * input.nrSamplesPerBlock;
+  unsigned int position = (input.firstSample + sample) % nrRingSamples;
+
+  for ( unsigned int unpacked = 0; unpacked < nrSamples; )
+  {
+    const unsigned int nrBlockSamples = std::min(nrSamples - unpacked, input.nrSamplesPerBlock - (position % input.nrSamplesPerBlock));
+
+    unpack(channel + ((position / input.nrSamplesPerBlock) * input.nrElementsPerBlock), position % input.nrSamplesPerBlock, samples + unpacked, nrBlockSamples, inputBits);
+    unpacked += nrBlockSamples;
+    position = (position + nrBlockSamples) % nrRingSamples;
+  }
+}
+
+template< typename I > inline void loadInput(const InputWindow< I > & input, const I * channel, const unsigned int sample, I * samples, const unsigned int nrSamples, const uint8_t inputBits)
+{
+  if ( inputBits < 8 )
+  {
+    unpackInput(input, channel, sample, samples, nrSamples, inputBits);
+    return;
+  }
+  const I * run = getInputRun(input, channel, sample, nrSamples, samples);
+
+  if ( run != samples )
+  {
+    std::copy(run, run + nrSamples, samples);
+  }
+}
+
+template< typename I, typename L > inline void downsampleInput(const InputWindow< I > & input, const I * channel, const unsigned int sample, L * samples, const unsigned int nrSamples, const uint8_t inputBits)
+{
+  const unsigned int nrRawSamplesPerChunk = 1024;
+  const unsigned int nrRawSamples = nrSamples * input.downsampling;
+  I rawSamples[nrRawSamplesPerChunk];
+
+  // The raw samples are added in order, as in the generated kernels
+  std::fill(samples, samples + nrSamples, static_cast< L >(0));
+  for ( unsigned int rawSample = 0; rawSample < nrRawSamples; rawSample += nrRawSamplesPerChunk )
+  {
+    const unsigned int nrChunkSamples = std::min(nrRawSamplesPerChunk, nrRawSamples - rawSample);
+    const I * chunk = rawSamples;
+
+    if ( inputBits >= 8 )
+    {
+      chunk = getInputRun(input, channel, (sample * input.downsampling) + rawSample, nrChunkSamples, rawSamples);
+    }
+    else
+    {
+      unpackInput(input, channel, (sample * input.downsampling) + rawSample, rawSamples, nrChunkSamples, inputBits);
+    }
+    for ( unsigned int item = 0; item < nrChunkSamples; item++ )
+    {
+      samples[(rawSample + item) / input.downsampling] += static_cast< L >(chunk[item]);
+    }
+  }
+}
+
+template< typename I, typename L, typename O > void dedispersion(ThreadPool & pool, const DedispersionConf & conf, AstroData::Observation & observation, const ActiveChannels & activeChannels, const std::vector<unsigned int> & beamMapping, const std::vector< I > & input, std::vector< O > & output, const DelayTable & delays, const unsigned int padding, const uint8_t inputBits, const OutputScaling & scaling, Statistics * statistics)
+{
+  dedispersion< I, L, O >(pool, conf, observation, activeChannels, beamMapping, getInputWindow(observation, input, padding, inputBits, false), output, delays, padding, inputBits, scaling, statistics);
+}
+
+template< typename I, typename L, typename O > void dedispersion(ThreadPool & pool, const DedispersionConf & conf, AstroData::Observation & observation, const ActiveChannels & activeChannels, const std::vector<unsigned int> & beamMapping, const InputWindow< I > & input, std::vector< O > & output, const DelayTable & delays, const unsigned int padding, const uint8_t inputBits, const OutputScaling & scaling, Statistics * statistics)
+{
+  if ( !isOutputType< O >(scaling.getFormat()) )
+  {
+    throw std::invalid_argument("The output type does not match the output format.");
+  }
+  if ( (statistics != nullptr) && !isStatisticsLayout(*statistics, conf, observation, false) )
+  {
+    throw std::invalid_argument("The statistics do not match the observation and the configuration.");
+  }
+
+  const unsigned int nrSamplesPadded = isa::utils::pad(observation.getNrSamplesPerBatch() / observation.getDownsampling(), padding / sizeof(O));
+
+  dedispersionTiles< I, L >(pool, conf, observation, activeChannels, beamMapping, input, delays, padding, inputBits, 0, [&](const unsigned int sBeam, const unsigned int firstDM, const unsigned int nrTileDMs, const unsigned int firstSample, const unsigned int nrTileSamples, const L * accumulator, const unsigned int nrAccumulatorSamples, const unsigned int)
+  {
+    for ( unsigned int dm = 0; dm < nrTileDMs; dm++ )
+    {
+      const float offset = scaling.getOffset(sBeam, firstDM + dm);
+      const float scale = scaling.getScale(sBeam, firstDM + dm);
+
+      for ( unsigned int sample = 0; sample < nrTileSamples; sample++ )
+      {
+        output[(sBeam * observation.getNrDMs() * nrSamplesPadded) + ((firstDM + dm) * nrSamplesPadded) + firstSample + sample] = convertOutput< L, O >(accumulator[(dm * nrAccumulatorSamples) + sample], scaling.getFormat(), offset, scale);
+      }
+      if ( statistics != nullptr )
+      {
+        setStatisticsPartial(*statistics, sBeam, firstDM + dm, firstSample / getNrSamplesPerTile(conf), accumulator + (dm * nrAccumulatorSamples), nrTileSamples);
+      }
+    }
+  });
+}
+
+template< typename I, typename L, typename S > void dedispersionTiles(ThreadPool & pool, const DedispersionConf & conf, AstroData::Observation & observation, const ActiveChannels & activeChannels, const std::vector<unsigned int> & beamMapping, const InputWindow< I > & input, const DelayTable & delays, const unsigned int padding, const uint8_t inputBits, const unsigned int nrHaloSamples, const S & store)
+{
+  if ( !isIntermediateTypeLargeEnough< L >(observation, inputBits) )
+  {
+    throw std::invalid_argument("The intermediate type is too small for the number of channels and the input bits.");
+  }
+
+  const unsigned int nrSamples = observation.getNrSamplesPerBatch() / observation.getDownsampling();
+  const unsigned int nrSamplesPerTile = std::min(getNrSamplesPerTile(conf), nrSamples);
+  const unsigned int nrAccumulatorSamples = nrSamplesPerTile + nrHaloSamples;
+  const unsigned int nrDMsPerTile = std::min(getNrDMsPerTile(conf), observation.getNrDMs());
+  const unsigned int nrChannelsPerBlock = getNrChannelsPerBlock(conf);
+  const unsigned int nrSampleTiles = (nrSamples + nrSamplesPerTile - 1) / nrSamplesPerTile;
+  const unsigned int nrDMTiles = (observation.getNrDMs() + nrDMsPerTile - 1) / nrDMsPerTile;
+  std::vector< std::vector< L > > accumulators(pool.getNrThreads(), std::vector< L >(nrDMsPerTile * nrAccumulatorSamples));
+  std::vector< std::vector< const I * > > rows(pool.getNrThreads(), std::vector< const I * >(nrChannelsPerBlock));
+  // Unpacked, or transposed if time-major, samples of a block of channels, for all the DMs of a tile; otherwise the runs of a DM that wrap around the end of a ring
+  const bool staged = (inputBits < 8) || (input.nrChannelsPerSample > 0);
+  unsigned int nrUnpackedSamplesPerChannel = 0;
+  // Downsampled samples of a block of channels, for all the DMs of a tile
+  unsigned int nrDownsampledSamplesPerChannel = 0;
+  if ( input.downsampling > 1 )
+  {
+    nrDownsampledSamplesPerChannel = nrAccumulatorSamples + delays.getMaxDelay();
+  }
+  else if ( staged )
+  {
+    nrUnpackedSamplesPerChannel = nrAccumulatorSamples + delays.getMaxDelay();
+  }
+  else if ( input.nrBlocks > 0 )
+  {
+    nrUnpackedSamplesPerChannel = nrAccumulatorSamples;
+  }
+  std::vector< std::vector< I > > unpacked(pool.getNrThreads(), std::vector< I >(nrChannelsPerBlock * nrUnpackedSamplesPerChannel));
+  std::vector< std::vector< L > > downsampled(pool.getNrThreads(), std::vector< L >(nrChannelsPerBlock * nrDownsampledSamplesPerChannel));
+  std::vector< std::vector< const L * > > downsampledRows(pool.getNrThreads(), std::vector< const L * >(nrChannelsPerBlock));
+
+  pool.parallelFor(observation.getNrSynthesizedBeams() * nrDMTiles * nrSampleTiles, [&](const unsigned int item, const unsigned int thread)
+  {
+    const unsigned int sBeam = item / (nrDMTiles * nrSampleTiles);
+    const unsigned int firstDM = ((item / nrSampleTiles) % nrDMTiles) * nrDMsPerTile;
+    const unsigned int firstSample = (item % nrSampleTiles) * nrSamplesPerTile;
+    const unsigned int nrTileDMs = std::min(firstDM + nrDMsPerTile, observation.getNrDMs()) - firstDM;
+    const unsigned int nrTileSamples = std::min(firstSample + nrAccumulatorSamples, nrSamples) - firstSample;
+    L * accumulator = accumulators[thread].data();
+    const I ** tileRows = rows[thread].data();
+    I * unpackedSamples = unpacked[thread].data();
+    L * downsampledSamples = downsampled[thread].data();
+    const L ** downsampledTileRows = downsampledRows[thread].data();
+    const unsigned int * firstDMDelays = delays.getDelays(firstDM);
+    const unsigned int * lastDMDelays = delays.getDelays(firstDM + nrTileDMs - 1);
+    const unsigned int * channels = activeChannels.getChannels(sBeam);
+    const unsigned int nrActiveChannels = activeChannels.getNrActiveChannels(sBeam);
+
+    std::fill(accumulator, accumulator + (nrDMsPerTile * nrAccumulatorSamples), static_cast< L >(0));
+    // Every DM receives the channels in the same order as in the sequential code, so every sum is bit-identical
+    for ( unsigned int firstPosition = 0; firstPosition < nrActiveChannels; firstPosition += nrChannelsPerBlock )
+    {
+      const unsigned int lastPosition = std::min(firstPosition + nrChannelsPerBlock, nrActiveChannels);
+
+      if ( input.downsampling > 1 )
+      {
+        // Delays grow with the DM, so the tile uses the samples from the delay of its first DM to the delay of its last DM plus the tile
+        for ( unsigned int position = firstPosition; position < lastPosition; position++ )
+        {
+          const unsigned int channel = channels[position];
+          const I * channelData = getInputChannel(input, observation, beamMapping[(sBeam * observation.getNrChannels(padding / sizeof(unsigned int))) + channel], channel);
+
+          downsampleInput(input, channelData, firstSample + firstDMDelays[channel], downsampledSamples + ((position - firstPosition) * nrDownsampledSamplesPerChannel), nrTileSamples + (lastDMDelays[channel] - firstDMDelays[channel]), inputBits);
+        }
+        for ( unsigned int dm = 0; dm < nrTileDMs; dm++ )
+        {
+          const unsigned int * dmDelays = delays.getDelays(firstDM + dm);
+
+          for ( unsigned int position = firstPosition; position < lastPosition; position++ )
+          {
+            downsampledTileRows[position - firstPosition] = downsampledSamples + ((position - firstPosition) * nrDownsampledSamplesPerChannel) + (dmDelays[channels[position]] - firstDMDelays[channels[position]]);
+          }
+          accumulateRows(downsampledTileRows, lastPosition - firstPosition, accumulator + (dm * nrAccumulatorSamples), nrTileSamples);
+        }
+        continue;
+      }
+      if ( staged )
+      {
+        // Delays grow with the DM, so the tile uses the samples from the delay of its first DM to the delay of its last DM plus the tile
+        for ( unsigned int position = firstPosition; position < lastPosition; position++ )
+        {
+          const unsigned int channel = channels[position];
+          const I * channelData = getInputChannel(input, observation, beamMapping[(sBeam * observation.getNrChannels(padding / sizeof(unsigned int))) + channel], channel);
+
+          loadInput(input, channelData, firstSample + firstDMDelays[channel], unpackedSamples + ((position - firstPosition) * nrUnpackedSamplesPerChannel), nrTileSamples + (lastDMDelays[channel] - firstDMDelays[channel]), inputBits);
+        }
+      }
+      for ( unsigned int dm = 0; dm < nrTileDMs; dm++ )
+      {
+        const unsigned int * dmDelays = delays.getDelays(firstDM + dm);
+
+        for ( unsigned int position = firstPosition; position < lastPosition; position++ )
+        {
+          const unsigned int channel = channels[position];
+
+          if ( !staged )
+          {
+            const I * channelData = getInputChannel(input, observation, beamMapping[(sBeam * observation.getNrChannels(padding / sizeof(unsigned int))) + channel], channel);
+            tileRows[position - firstPosition] = getInputRun(input, channelData, firstSample + dmDelays[channel], nrTileSamples, unpackedSamples + ((position - firstPosition) * nrUnpackedSamplesPerChannel));
+          }
+          else
+          {
+            tileRows[position - firstPosition] = unpackedSamples + ((position - firstPosition) * nrUnpackedSamplesPerChannel) + (dmDelays[channel] - firstDMDelays[channel]);
+          }
+        }
+        accumulateRows(tileRows, lastPosition - firstPosition, accumulator + (dm * nrAccumulatorSamples), nrTileSamples);
+      }
+    }
+    store(sBeam, firstDM, nrTileDMs, firstSample, nrTileSamples, accumulator, nrAccumulatorSamples, thread);
+  });
+}
+
+template< typename I, typename L, typename O > void subbandDedispersionStepOne(ThreadPool & pool, const DedispersionConf & conf, AstroData::Observation & observation, const ActiveChannels & activeChannels, const std::vector< I > & input, std::vector< O > & output, const DelayTable & delays, const unsigned int padding, const uint8_t inputBits)
+{
+  subbandDedispersionStepOne< I, L, O >(pool, conf, observation, activeChannels, getInputWindow(observation, input, padding, inputBits, true), output, delays, padding, inputBits);
+}
+
+template< typename I, typename L, typename O > void subbandDedispersionStepOne(ThreadPool & pool, const DedispersionConf & conf, AstroData::Observation & observation, const ActiveChannels & activeChannels, const InputWindow< I > & input, std::vector< O > & output, const DelayTable & delays, const unsigned int padding, const uint8_t inputBits)
+{
+  if ( !isIntermediateTypeLargeEnough< L >(observation, inputBits) )
+  {
+    throw std::invalid_argument("The intermediate type is too small for the number of channels and the input bits.");
+  }
+
+  const unsigned int nrSamples = observation.getNrSamplesPerBatch(true) / observation.getDownsampling();
+  // The output is unpacked, with the rows of the OpenCL kernel and of the input of step two, for any number of input bits
+  const unsigned int nrSamplesPadded = isa::utils::pad(nrSamples, padding / sizeof(O));
+  const unsigned int nrSamplesPerTile = std::min(getNrSamplesPerTile(conf), nrSamples);
+  const unsigned int nrDMsPerTile = std::min(getNrDMsPerTile(conf), observation.getNrDMs(true));
+  const unsigned int nrChannelsPerBlock = getNrChannelsPerBlock(conf);
+  const unsigned int nrSampleTiles = (nrSamples + nrSamplesPerTile - 1) / nrSamplesPerTile;
+  const unsigned int nrDMTiles = (observation.getNrDMs(true) + nrDMsPerTile - 1) / nrDMsPerTile;
+  std::vector< std::vector< L > > accumulators(pool.getNrThreads(), std::vector< L >(nrDMsPerTile * nrSamplesPerTile));
+  std::vector< std::vector< const I * > > rows(pool.getNrThreads(), std::vector< const I * >(nrChannelsPerBlock));
+  // Unpacked, or transposed if time-major, samples of a block of channels, for all the DMs of a tile; otherwise the runs of a DM that wrap around the end of a ring
+  const bool staged = (inputBits < 8) || (input.nrChannelsPerSample > 0);
+  unsigned int nrUnpackedSamplesPerChannel = 0;
+  // Downsampled samples of a block of channels, for all the DMs of a tile
+  unsigned int nrDownsampledSamplesPerChannel = 0;
+  if ( input.downsampling > 1 )
+  {
+    nrDownsampledSamplesPerChannel = nrSamplesPerTile + delays.getMaxDelay();
+  }
+  else if ( staged )
+  {
+    nrUnpackedSamplesPerChannel = nrSamplesPerTile + delays.getMaxDelay();
+  }
+  else if ( input.nrBlocks > 0 )
+  {
+    nrUnpackedSamplesPerChannel = nrSamplesPerTile;
+  }
+  std::vector< std::vector< I > > unpacked(pool.getNrThreads(), std::vector< I >(nrChannelsPerBlock * nrUnpackedSamplesPerChannel));
+  std::vector< std::vector< L > > downsampled(pool.getNrThreads(), std::vector< L >(nrChannelsPerBlock * nrDownsampledSamplesPerChannel));
+  std::vector< std::vector< const L * > > downsampledRows(pool.getNrThreads(), std::vector< const L * >(nrChannelsPerBlock));
+
+  pool.parallelFor(observation.getNrBeams() * observation.getNrSubbands() * nrDMTiles * nrSampleTiles, [&](const unsigned int item, const unsigned int thread)
+  {
+    const unsigned int beam = item / (observation.getNrSubbands() * nrDMTiles * nrSampleTiles);
+    const unsigned int subband = (item / (nrDMTiles * nrSampleTiles)) % observation.getNrSubbands();
+    const unsigned int firstDM = ((item / nrSampleTiles) % nrDMTiles) * nrDMsPerTile;
+    const unsigned int firstSample = (item % nrSampleTiles) * nrSamplesPerTile;
+    const unsigned int nrTileDMs = std::min(firstDM + nrDMsPerTile, observation.getNrDMs(true)) - firstDM;
+    const unsigned int nrTileSamples = std::min(firstSample + nrSamplesPerTile, nrSamples) - firstSample;
+    const unsigned int subbandFirstPosition = activeChannels.getFirstChannel(beam, subband);
+    const unsigned int subbandLastPosition = subbandFirstPosition + activeChannels.getNrActiveChannels(beam, subband);
+    const unsigned int * channels = activeChannels.getChannels(beam);
+    L * accumulator = accumulators[thread].data();
+    const I ** tileRows = rows[thread].data();
+    I * unpackedSamples = unpacked[thread].data();
+    L * downsampledSamples = downsampled[thread].data();
+    const L ** downsampledTileRows = downsampledRows[thread].data();
+    const unsigned int * firstDMDelays = delays.getDelays(firstDM);
+    const unsigned int * lastDMDelays = delays.getDelays(firstDM + nrTileDMs - 1);
+
+    std::fill(accumulator, accumulator + (nrDMsPerTile * nrSamplesPerTile), static_cast< L >(0));
+    for ( unsigned int firstPosition = subbandFirstPosition; firstPosition < subbandLastPosition; firstPosition += nrChannelsPerBlock )
+    {
+      const unsigned int lastPosition = std::min(firstPosition + nrChannelsPerBlock, subbandLastPosition);
+
+      if ( input.downsampling > 1 )
+      {
+        // Delays grow with the DM, so the tile uses the samples from the delay of its first DM to the delay of its last DM plus the tile
+        for ( unsigned int position = firstPosition; position < lastPosition; position++ )
+        {
+          const unsigned int channel = channels[position];
+          const I * channelData = getInputChannel(input, observation, beam, channel);
+
+          downsampleInput(input, channelData, firstSample + firstDMDelays[channel], downsampledSamples + ((position - firstPosition) * nrDownsampledSamplesPerChannel), nrTileSamples + (lastDMDelays[channel] - firstDMDelays[channel]), inputBits);
+        }
+        for ( unsigned int dm = 0; dm < nrTileDMs; dm++ )
+        {
+          const unsigned int * dmDelays = delays.getDelays(firstDM + dm);
+
+          for ( unsigned int position = firstPosition; position < lastPosition; position++ )
+          {
+            downsampledTileRows[position - firstPosition] = downsampledSamples + ((position - firstPosition) * nrDownsampledSamplesPerChannel) + (dmDelays[channels[position]] - firstDMDelays[channels[position]]);
+          }
+          accumulateRows(downsampledTileRows, lastPosition - firstPosition, accumulator + (dm * nrSamplesPerTile), nrTileSamples);
+        }
+        continue;
+      }
+      if ( staged )
+      {
+        // Delays grow with the DM, so the tile uses the samples from the delay of its first DM to the delay of its last DM plus the tile
+        for ( unsigned int position = firstPosition; position < lastPosition; position++ )
+        {
+          const unsigned int channel = channels[position];
+          const I * channelData = getInputChannel(input, observation, beam, channel);
+
+          loadInput(input, channelData, firstSample + firstDMDelays[channel], unpackedSamples + ((position - firstPosition) * nrUnpackedSamplesPerChannel), nrTileSamples + (lastDMDelays[channel] - firstDMDelays[channel]), inputBits);
+        }
+      }
+      for ( unsigned int dm = 0; dm < nrTileDMs; dm++ )
+      {
+        const unsigned int * dmDelays = delays.getDelays(firstDM + dm);
+
+        for ( unsigned int position = firstPosition; position < lastPosition; position++ )
+        {
+          const unsigned int channel = channels[position];
+
+          if ( !staged )
+          {
+            const I * channelData = getInputChannel(input, observation, beam, channel);
+            tileRows[position - firstPosition] = getInputRun(input, channelData, firstSample + dmDelays[channel], nrTileSamples, unpackedSamples + ((position - firstPosition) * nrUnpackedSamplesPerChannel));
+          }
+          else
+          {
+            tileRows[position - firstPosition] = unpackedSamples + ((position - firstPosition) * nrUnpackedSamplesPerChannel) + (dmDelays[channel] - firstDMDelays[channel]);
+          }
+        }
+        accumulateRows(tileRows, lastPosition - firstPosition, accumulator + (dm * nrSamplesPerTile), nrTileSamples);
+      }
+    }
+    for ( unsigned int dm = 0; dm < nrTileDMs; dm++ )
+    {
+      for ( unsigned int sample = 0; sample < nrTileSamples; sample++ )
+      {
+        output[(beam * observation.getNrDMs(true) * observation.getNrSubbands() * nrSamplesPadded) + ((firstDM + dm) * observation.getNrSubbands() * nrSamplesPadded) + (subband * nrSamplesPadded) + firstSample + sample] = static_cast< O >(accumulator[(dm * nrSamplesPerTile) + sample]);
+      }
+    }
+  });
+}
+
+template< typename I, typename L, typename O > void subbandDedispersionStepTwo(ThreadPool & pool, const DedispersionConf & conf, AstroData::Observation & observation, const std::vector<unsigned int> & beamMapping, const std::vector< I > & input, std::vector< O > & output, const DelayTable & delays, const unsigned int padding, const OutputScaling & scaling, Statistics * statistics)
+{
+  if ( !isOutputType< O >(scaling.getFormat()) )
+  {
+    throw std::invalid_argument("The output type does not match the output format.");
+  }
+  if ( (statistics != nullptr) && !isStatisticsLayout(*statistics, conf, observation, true) )
+  {
+    throw std::invalid_argument("The statistics do not match the observation and the configuration.");
+  }
+
+  const unsigned int nrSamples = observation.getNrSamplesPerBatch() / observation.getDownsampling();
+  const unsigned int nrSamplesPadded = isa::utils::pad(nrSamples, padding / sizeof(O));
+  const unsigned int nrSamplesPerSubband = isa::utils::pad(observation.getNrSamplesPerBatch(true) / observation.getDownsampling(), padding / sizeof(I));
+  const unsigned int nrSamplesPerTile = std::min(getNrSamplesPerTile(conf), nrSamples);
+  const unsigned int nrDMsPerTile = std::min(getNrDMsPerTile(conf), observation.getNrDMs());
+  const unsigned int nrSubbandsPerBlock = getNrChannelsPerBlock(conf);
+  const unsigned int nrSampleTiles = (nrSamples + nrSamplesPerTile - 1) / nrSamplesPerTile;
+  const unsigned int nrDMTiles = (observation.getNrDMs() + nrDMsPerTile - 1) / nrDMsPerTile;
+  std::vector< std::vector< L > > accumulators(pool.getNrThreads(), std::vector< L >(nrDMsPerTile * nrSamplesPerTile));
+  std::vector< std::vector< const I * > > rows(pool.getNrThreads(), std::vector< const I * >(nrSubbandsPerBlock));
+
+  pool.parallelFor(observation.getNrSynthesizedBeams() * observation.getNrDMs(true) * nrDMTiles * nrSampleTiles, [&](const unsigned int item, const unsigned int thread)
+  {
+    const unsigned int sBeam = item / (observation.getNrDMs(true) * nrDMTiles * nrSampleTiles);
+    const unsigned int firstStepDM = (item / (nrDMTiles * nrSampleTiles)) % observation.getNrDMs(true);
+    const unsigned int firstDM = ((item / nrSampleTiles) % nrDMTiles) * nrDMsPerTile;
+    const unsigned int firstSample = (item % nrSampleTiles) * nrSamplesPerTile;
+    const unsigned int nrTileDMs = std::min(firstDM + nrDMsPerTile, observation.getNrDMs()) - firstDM;
+    const unsigned int nrTileSamples = std::min(firstSample + nrSamplesPerTile, nrSamples) - firstSample;
+    L * accumulator = accumulators[thread].data();
+    const I ** tileRows = rows[thread].data();
+
+    std::fill(accumulator, accumulator + (nrDMsPerTile * nrSamplesPerTile), static_cast< L >(0));
+    for ( unsigned int firstSubband = 0; firstSubband < observation.getNrSubbands(); firstSubband += nrSubbandsPerBlock )
+    {
+      const unsigned int lastSubband = std::min(firstSubband + nrSubbandsPerBlock, observation.getNrSubbands());
+
+      for ( unsigned int dm = 0; dm < nrTileDMs; dm++ )
+      {
+        const unsigned int * dmDelays = delays.getDelays(firstDM + dm);
+        unsigned int nrRows = 0;
+
+        for ( unsigned int subband = firstSubband; subband < lastSubband; subband++ )
+        {
+          const I * subbandData = input.data() + (beamMapping[(sBeam * observation.getNrSubbands(padding / sizeof(unsigned int))) + subband] * observation.getNrDMs(true) * observation.getNrSubbands() * nrSamplesPerSubband) + (firstStepDM * observation.getNrSubbands() * nrSamplesPerSubband) + (subband * nrSamplesPerSubband);
+          tileRows[nrRows++] = subbandData + firstSample + dmDelays[subband];
+        }
+        accumulateRows(tileRows, nrRows, accumulator + (dm * nrSamplesPerTile), nrTileSamples);
+      }
+    }
+    for ( unsigned int dm = 0; dm < nrTileDMs; dm++ )
+    {
+      const float offset = scaling.getOffset(sBeam, (firstStepDM * observation.getNrDMs()) + firstDM + dm);
+      const float scale = scaling.getScale(sBeam, (firstStepDM * observation.getNrDMs()) + firstDM + dm);
+
+      for ( unsigned int sample = 0; sample < nrTileSamples; sample++ )
+      {
+        output[(sBeam * (observation.getNrDMs(true) * observation.getNrDMs()) * nrSamplesPadded) + (((firstStepDM * observation.getNrDMs()) + firstDM + dm) * nrSamplesPadded) + firstSample + sample] = convertOutput< L, O >(accumulator[(dm * nrSamplesPerTile) + sample], scaling.getFormat(), offset, scale);
+      }
+      if ( statistics != nullptr )
+      {
+        setStatisticsPartial(*statistics, sBeam, (firstStepDM * observation.getNrDMs()) + firstDM + dm, firstSample / getNrSamplesPerTile(conf), accumulator + (dm * nrSamplesPerTile), nrTileSamples);
+      }
+    }
+  });
+}
+
+template< typename I, typename L, typename O > void subbandDedispersion(ThreadPool & pool, const DedispersionConf & conf, AstroData::Observation & observation, const ActiveChannels & activeChannels, const std::vector<unsigned int> & beamMapping, const std::vector< I > & input, std::vector< O > & output, const DelayTable & delaysStepOne, const DelayTable & delaysStepTwo, const unsigned int padding, const uint8_t inputBits, const OutputScaling & scaling, Statistics * statistics)
+{
+  subbandDedispersion< I, L, O >(pool, conf, observation, activeChannels, beamMapping, getInputWindow(observation, input, padding, inputBits, true), output, delaysStepOne, delaysStepTwo, padding, inputBits, scaling, statistics);
+}
+
+template< typename I, typename L, typename O > void subbandDedispersion(ThreadPool & pool, const DedispersionConf & conf, AstroData::Observation & observation, const ActiveChannels & activeChannels, const std::vector<unsigned int> & beamMapping, const InputWindow< I > & input, std::vector< O > & output, const DelayTable & delaysStepOne, const DelayTable & delaysStepTwo, const unsigned int padding, const uint8_t inputBits, const OutputScaling & scaling, Statistics * statistics)
+{
+  if ( !isOutputType< O >(scaling.getFormat()) )
+  {
+    throw std::invalid_argument("The output type does not match the output format.");
+  }
+  if ( (statistics != nullptr) && !isStatisticsLayout(*statistics, conf, observation, true) )
+  {
+    throw std::invalid_argument("The statistics do not match the observation and the configuration.");
+  }
+
+  const unsigned int nrSamplesPadded = isa::utils::pad(observation.getNrSamplesPerBatch() / observation.getDownsampling(), padding / sizeof(O));
+
+  subbandDedispersionTiles< I, L >(pool, conf, observation, activeChannels, beamMapping, input, delaysStepOne, delaysStepTwo, padding, inputBits, 0, [&](const unsigned int sBeam, const unsigned int firstDM, const unsigned int nrTileDMs, const unsigned int firstSample, const unsigned int nrTileSamples, const L * accumulator, const unsigned int nrAccumulatorSamples, const unsigned int)
+  {
+    for ( unsigned int dm = 0; dm < nrTileDMs; dm++ )
+    {
+      const float offset = scaling.getOffset(sBeam, firstDM + dm);
+      const float scale = scaling.getScale(sBeam, firstDM + dm);
+
+      for ( unsigned int sample = 0; sample < nrTileSamples; sample++ )
+      {
+        output[(sBeam * (observation.getNrDMs(true) * observation.getNrDMs()) * nrSamplesPadded) + ((firstDM + dm) * nrSamplesPadded) + firstSample + sample] = convertOutput< L, O >(accumulator[(dm * nrAccumulatorSamples) + sample], scaling.getFormat(), offset, scale);
+      }
+      if ( statistics != nullptr )
+      {
+        setStatisticsPartial(*statistics, sBeam, firstDM + dm, firstSample / getNrSamplesPerTile(conf), accumulator + (dm * nrAccumulatorSamples), nrTileSamples);
+      }
+    }
+  });
+}
+
+template< typename I, typename L, typename S > void subbandDedispersionTiles(ThreadPool & pool, const DedispersionConf & conf, AstroData::Observation & observation, const ActiveChannels & activeChannels, const std::vector<unsigned int> & beamMapping, const InputWindow< I > & input, const DelayTable & delaysStepOne, const DelayTable & delaysStepTwo, const unsigned int padding, const uint8_t inputBits, const unsigned int nrHaloSamples, const S & store)
+{
+  if ( !isIntermediateTypeLargeEnough< L >(observation, inputBits) )
+  {
+    throw std::invalid_argument("The intermediate type is too small for the number of channels and the input bits.");
+  }
+
+  const unsigned int nrSamplesStepOne = observation.getNrSamplesPerBatch(true) / observation.getDownsampling();
+  const unsigned int nrSamplesStepTwo = observation.getNrSamplesPerBatch() / observation.getDownsampling();
+  const unsigned int nrChannelsPerBlock = getNrChannelsPerBlock(conf);
+  const unsigned int nrSamplesPerTileStepOne = std::min(getNrSamplesPerTile(conf), nrSamplesStepOne);
+  const unsigned int nrSamplesPerTile = std::min(getNrSamplesPerTile(conf), nrSamplesStepTwo);
+  const unsigned int nrAccumulatorSamples = nrSamplesPerTile + nrHaloSamples;
+  const unsigned int nrDMsPerTile = std::min(getNrDMsPerTile(conf), observation.getNrDMs());
+  const unsigned int nrSampleTiles = (nrSamplesStepTwo + nrSamplesPerTile - 1) / nrSamplesPerTile;
+  const unsigned int nrDMTiles = (observation.getNrDMs() + nrDMsPerTile - 1) / nrDMsPerTile;
+  // A segment of step two tiles reads the output of step one up to the halo and the largest delay of step two after its end;
+  // these samples are computed again by the next segment, so a segment has at least four times as many samples, or the whole batch
+  const unsigned int nrOverlapSamples = nrHaloSamples + delaysStepTwo.getMaxDelay();
+  const unsigned int nrTilesPerSegment = std::min(std::max(((4 * nrOverlapSamples) + nrSamplesPerTile - 1) / nrSamplesPerTile, 1u), nrSampleTiles);
+  const unsigned int nrSamplesPerSegment = nrTilesPerSegment * nrSamplesPerTile;
+  const unsigned int nrSegments = (nrSampleTiles + nrTilesPerSegment - 1) / nrTilesPerSegment;
+  const unsigned int nrSamplesPerSubband = isa::utils::pad(std::min(nrSamplesPerSegment + nrOverlapSamples, nrSamplesStepOne), padding / sizeof(L));
+  std::vector< L > subbandedData(observation.getNrBeams() * observation.getNrSubbands() * nrSamplesPerSubband);
+  std::vector< std::vector< L > > accumulators(pool.getNrThreads(), std::vector< L >(nrDMsPerTile * nrAccumulatorSamples));
+  std::vector< std::vector< const I * > > channelRows(pool.getNrThreads(), std::vector< const I * >(nrChannelsPerBlock));
+  std::vector< std::vector< I > > unpacked(pool.getNrThreads(), std::vector< I >(((inputBits < 8) || (input.nrBlocks > 0) || (input.nrChannelsPerSample > 0)) ? nrChannelsPerBlock * nrSamplesPerTileStepOne : 0));
+  std::vector< std::vector< L > > downsampled(pool.getNrThreads(), std::vector< L >((input.downsampling > 1) ? nrChannelsPerBlock * nrSamplesPerTileStepOne : 0));
+  std::vector< std::vector< const L * > > subbandRows(pool.getNrThreads(), std::vector< const L * >(nrChannelsPerBlock));
+
+  for ( unsigned int segment = 0; segment < observation.getNrDMs(true) * nrSegments; segment++ )
+  {
+    const unsigned int firstStepDM = segment / nrSegments;
+    const unsigned int firstSegmentTile = (segment % nrSegments) * nrTilesPerSegment;
+    const unsigned int firstSegmentSample = firstSegmentTile * nrSamplesPerTile;
+    const unsigned int nrSegmentTiles = std::min(firstSegmentTile + nrTilesPerSegment, nrSampleTiles) - firstSegmentTile;
+    const unsigned int nrSegmentSamplesStepOne = std::min(firstSegmentSample + nrSamplesPerSegment + nrOverlapSamples, nrSamplesStepOne) - firstSegmentSample;
+    const unsigned int nrSegmentTilesStepOne = (nrSegmentSamplesStepOne + nrSamplesPerTileStepOne - 1) / nrSamplesPerTileStepOne;
+    const unsigned int * dmDelaysStepOne = delaysStepOne.getDelays(firstStepDM);
+
+    // Step one, with the samples of the segment from its first sample
+    pool.parallelFor(observation.getNrBeams() * observation.getNrSubbands() * nrSegmentTilesStepOne, [&](const unsigned int item, const unsigned int thread)
+    {
+      const unsigned int beam = item / (observation.getNrSubbands() * nrSegmentTilesStepOne);
+      const unsigned int subband = (item / nrSegmentTilesStepOne) % observation.getNrSubbands();
+      const unsigned int firstSample = (item % nrSegmentTilesStepOne) * nrSamplesPerTileStepOne;
+      const unsigned int nrTileSamples = std::min(firstSample + nrSamplesPerTileStepOne, nrSegmentSamplesStepOne) - firstSample;
+      const unsigned int subbandFirstPosition = activeChannels.getFirstChannel(beam, subband);
+      const unsigned int subbandLastPosition = subbandFirstPosition + activeChannels.getNrActiveChannels(beam, subband);
+      const unsigned int * channels = activeChannels.getChannels(beam);
+      L * accumulator = subbandedData.data() + (((beam * observation.getNrSubbands()) + subband) * nrSamplesPerSubband) + firstSample;
+      const I ** tileRows = channelRows[thread].data();
+      I * unpackedSamples = unpacked[thread].data();
+      L * downsampledSamples = downsampled[thread].data();
+      const L ** downsampledTileRows = subbandRows[thread].data();
+
+      std::fill(accumulator, accumulator + nrTileSamples, static_cast< L >(0));
+      for ( unsigned int firstPosition = subbandFirstPosition; firstPosition < subbandLastPosition; firstPosition += nrChannelsPerBlock )
+      {
+        const unsigned int lastPosition = std::min(firstPosition + nrChannelsPerBlock, subbandLastPosition);
+
+        if ( input.downsampling > 1 )
+        {
+          for ( unsigned int position = firstPosition; position < lastPosition; position++ )
+          {
+            const unsigned int channel = channels[position];
+            const I * channelData = getInputChannel(input, observation, beam, channel);
+
+            downsampleInput(input, channelData, firstSegmentSample + firstSample + dmDelaysStepOne[channel], downsampledSamples + ((position - firstPosition) * nrSamplesPerTileStepOne), nrTileSamples, inputBits);
+            downsampledTileRows[position - firstPosition] = downsampledSamples + ((position - firstPosition) * nrSamplesPerTileStepOne);
+          }
+          accumulateRows(downsampledTileRows, lastPosition - firstPosition, accumulator, nrTileSamples);
+          continue;
+        }
+        for ( unsigned int position = firstPosition; position < lastPosition; position++ )
+        {
+          const unsigned int channel = channels[position];
+          const I * channelData = getInputChannel(input, observation, beam, channel);
+
+          if ( inputBits >= 8 )
+          {
+            tileRows[position - firstPosition] = getInputRun(input, channelData, firstSegmentSample + firstSample + dmDelaysStepOne[channel], nrTileSamples, unpackedSamples + ((position - firstPosition) * nrSamplesPerTileStepOne));
+          }
+          else
+          {
+            unpackInput(input, channelData, firstSegmentSample + firstSample + dmDelaysStepOne[channel], unpackedSamples + ((position - firstPosition) * nrSamplesPerTileStepOne), nrTileSamples, inputBits);
+            tileRows[position - firstPosition] = unpackedSamples + ((position - firstPosition) * nrSamplesPerTileStepOne);
+          }
+        }
+        accumulateRows(tileRows, lastPosition - firstPosition, accumulator, nrTileSamples);
+      }
+    });
+    // Step two
+    pool.parallelFor(observation.getNrSynthesizedBeams() * nrDMTiles * nrSegmentTiles, [&](const unsigned int item, const unsigned int thread)
+    {
+      const unsigned int sBeam = item / (nrDMTiles * nrSegmentTiles);
+      const unsigned int firstDM = ((item / nrSegmentTiles) % nrDMTiles) * nrDMsPerTile;
+      const unsigned int firstSample = firstSegmentSample + ((item % nrSegmentTiles) * nrSamplesPerTile);
+      const unsigned int nrTileDMs = std::min(firstDM + nrDMsPerTile, observation.getNrDMs()) - firstDM;
+      const unsigned int nrTileSamples = std::min(firstSample + nrAccumulatorSamples, nrSamplesStepTwo) - firstSample;
+      L * accumulator = accumulators[thread].data();
+      const L ** tileRows = subbandRows[thread].data();
+
+      std::fill(accumulator, accumulator + (nrDMsPerTile * nrAccumulatorSamples), static_cast< L >(0));
+      for ( unsigned int firstSubband = 0; firstSubband < observation.getNrSubbands(); firstSubband += nrChannelsPerBlock )
+      {
+        const unsigned int lastSubband = std::min(firstSubband + nrChannelsPerBlock, observation.getNrSubbands());
+
+        for ( unsigned int dm = 0; dm < nrTileDMs; dm++ )
+        {
+          const unsigned int * dmDelays = delaysStepTwo.getDelays(firstDM + dm);
+          unsigned int nrRows = 0;
+
+          for ( unsigned int subband = firstSubband; subband < lastSubband; subband++ )
+          {
+            const L * subbandData = subbandedData.data() + (((beamMapping[(sBeam * observation.getNrSubbands(padding / sizeof(unsigned int))) + subband] * observation.getNrSubbands()) + subband) * nrSamplesPerSubband);
+            tileRows[nrRows++] = subbandData + (firstSample - firstSegmentSample) + dmDelays[subband];
+          }
+          accumulateRows(tileRows, nrRows, accumulator + (dm * nrAccumulatorSamples), nrTileSamples);
+        }
+      }
+      store(sBeam, (firstStepDM * observation.getNrDMs()) + firstDM, nrTileDMs, firstSample, nrTileSamples, accumulator, nrAccumulatorSamples, thread);
+    });
+  }
+}
+
+} // Dedispersion
@@ -0,0 +1,97 @@
+// Copyright 2017 Netherlands Institute for Radio Astronomy (ASTRON)
+// Copyright 2017 Netherlands eScience Center
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <vector>
+
+#include <Observation.hpp>
+#include <utils.hpp>
+#include <AlignedAllocator.hpp>
+
+
+#pragma once
+
+namespace Dedispersion {
+
+// Which of the dedispersion kernels the delays are computed for
+enum class DedispersionStep {
+  SingleStep,
+  StepOne,
+  StepTwo
+};
+
+// Integer delay, in samples, of every (DM, channel) pair.
+// Rows are padded to a multiple of the padding and of the 64 byte cache line, and the table is stored contiguously so that it can be copied to an OpenCL buffer as is.
+// For step one the channels are the input channels and the delays are relative to the last channel of each subband;
+// for step two the channels are the subbands.
+class DelayTable {
+public:
+  // Size, in bytes, of a cache line, and alignment of the table
+  static const unsigned int cacheLine = 64;
+
+  // shifts is the output of getShifts (single step and step one) or getShiftsStepTwo (step two)
+  DelayTable(const AstroData::Observation & observation, const std::vector< float > & shifts, const unsigned int padding, const DedispersionStep step = DedispersionStep::SingleStep);
+  ~DelayTable();
+
+  // Get
+  unsigned int getNrDMs() const;
+  unsigned int getNrChannels() const;
+  unsigned int getNrPaddedChannels() const;
+  unsigned int getDelay(const unsigned int dm, const unsigned int channel) const;
+  const unsigned int * getDelays(const unsigned int dm) const;
+  // Largest delay in the table; a batch needs this many samples on top of the samples to dedisperse
+  unsigned int getMaxDelay() const;
+  // Largest difference, in any channel, between the delays of the last and first DM of a block of nrDMsPerBlock DMs; the samples a block of DMs reads on top of its own
+  unsigned int getMaxDelayDifference(const unsigned int nrDMsPerBlock) const;
+  // Contiguous table, getNrDMs() rows of getNrPaddedChannels() elements
+  const std::vector< unsigned int, AlignedAllocator< unsigned int, cacheLine > > & getTable() const;
+
+private:
+  unsigned int nrDMs;
+  unsigned int nrChannels;
+  unsigned int nrPaddedChannels;
+  unsigned int maxDelay;
+  std::vector< unsigned int, AlignedAllocator< unsigned int, cacheLine > > table;
+};
+
+inline unsigned int DelayTable::getNrDMs() const {
+  return nrDMs;
+}
+
+inline unsigned int DelayTable::getNrChannels() const {
+  return nrChannels;
+}
+
+inline unsigned int DelayTable::getNrPaddedChannels() const {
+  return nrPaddedChannels;
+}
+
+inline unsigned int DelayTable::getDelay(const unsigned int dm, const unsigned int channel) const {
+  return table[(dm * nrPaddedChannels) + channel];
+}
+
+inline const unsigned int * DelayTable::getDelays(const unsigned int dm) const {
+  return table.data() + (dm * nrPaddedChannels);
+}
+
+inline unsigned int DelayTable::getMaxDelay() const {
+  return maxDelay;
+}
+
+inline const std::vector< unsigned int, AlignedAllocator< unsigned int, DelayTable::cacheLine > > & DelayTable::getTable() const {
+  return table;
+}
+
+} // Dedispersion
+
@@ -0,0 +1,218 @@
+// Copyright 2017 Netherlands Institute for Radio Astronomy (ASTRON)
+// Copyright 2017 Netherlands eScience Center
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+
+#include <Observation.hpp>
+#include <utils.hpp>
+#include <ThreadPool.hpp>
+#include <Accumulate.hpp>
+#include <DelayTable.hpp>
+#include <ActiveChannels.hpp>
+#include <DedispersionCPU.hpp>
+
+
+#pragma once
+
+namespace Dedispersion {
+
+// A node of the FDMT holds, for a range of adjacent channels, the sums over every integer delay across the range
+struct FDMTNode {
+  // Channels [firstChannel, lastChannel], lastChannel has the highest frequency
+  unsigned int firstChannel;
+  unsigned int lastChannel;
+  // Delays and samples computed for the node
+  unsigned int nrDelays;
+  unsigned int nrSamples;
+  // Position of the node in the buffer of its stage, and of its first delay in the delays of the stage
+  unsigned int firstElement;
+  unsigned int firstDelay;
+  // Nodes of the previous stage added to compute this node; without a high node, the node is a copy of the low one
+  unsigned int low;
+  unsigned int high;
+  bool merge;
+  // Fractions of a delay across the node that are inside the high node, between the two nodes, and inside the low node
+  float highRatio;
+  float offsetRatio;
+  float lowRatio;
+};
+
+// Fast Dispersion Measure Transform (Zackay & Ofek), treating every channel as a point at its frequency.
+// Stage 0 contains the channels; every stage then merges pairs of adjacent nodes, until one node covers the whole band.
+// The split of a delay between the two halves of a node follows the ratios of the shifts of their channels.
+// The output of a DM is the row of the last node with the delay of the lowest channel, as in the single step DelayTable.
+class FDMTPlan {
+public:
+  FDMTPlan(const AstroData::Observation & observation, const std::vector< float > & shifts, const DelayTable & delays);
+  ~FDMTPlan();
+
+  // Get
+  unsigned int getNrStages() const;
+  const std::vector< FDMTNode > & getNodes(const unsigned int stage) const;
+  // Total number of delays and elements of a stage
+  unsigned int getNrDelays(const unsigned int stage) const;
+  unsigned int getNrElements(const unsigned int stage) const;
+  // Delay across the band used for a DM
+  unsigned int getDMDelay(const unsigned int dm) const;
+  // Delays applied to each channel for a delay across the band
+  std::vector< unsigned int > getChannelDelays(const unsigned int delay) const;
+  // Maximum absolute difference, in samples, between the delays applied by the FDMT and the ones of brute force dedispersion, for each DM
+  std::vector< unsigned int > getDelayErrors() const;
+
+private:
+  void getChannelDelays(const unsigned int stage, const unsigned int node, const unsigned int delay, const unsigned int offset, std::vector< unsigned int > & channelDelays) const;
+
+  std::vector< std::vector< FDMTNode > > stages;
+  std::vector< unsigned int > nrDelays;
+  std::vector< unsigned int > nrElements;
+  std::vector< unsigned int > dmDelays;
+  DelayTable delays;
+};
+
+// Same input, output and layout as dedispersion<I, L, O>
+template< typename I, typename L, typename O > void fdmt(ThreadPool & pool, const FDMTPlan & plan, AstroData::Observation & observation, const ActiveChannels & activeChannels, const std::vector<unsigned int> & beamMapping, const std::vector< I > & input, std::vector< O > & output, const unsigned int padding, const uint8_t inputBits, const OutputScaling & scaling = OutputScaling());
+// Split of a delay across a node
+unsigned int getFDMTDelay(const unsigned int delay, const float ratio);
+
+
+// Implementations
+inline unsigned int FDMTPlan::getNrStages() const {
+  return stages.size();
+}
+
+inline const std::vector< FDMTNode > & FDMTPlan::getNodes(const unsigned int stage) const {
+  return stages[stage];
+}
+
+inline unsigned int FDMTPlan::getNrDelays(const unsigned int stage) const {
+  return nrDelays[stage];
+}
+
+inline unsigned int FDMTPlan::getNrElements(const unsigned int stage) const {
+  return nrElements[stage];
+}
+
+inline unsigned int FDMTPlan::getDMDelay(const unsigned int dm) const {
+  return dmDelays[dm];
+}
+
+inline unsigned int getFDMTDelay(const unsigned int delay, const float ratio)
+{
+  return static_cast< unsigned int >((delay * ratio) + 0.5f);
+}
+
+template< typename I, typename L, typename O > void fdmt(ThreadPool & pool, const FDMTPlan & plan, AstroData::Observation & observation, const ActiveChannels & activeChannels, const std::vector<unsigned int> & beamMapping, const std::vector< I > & input, std::vector< O > & output, const unsigned int padding, const uint8_t inputBits, const OutputScaling & scaling)
+{
+  if ( !isOutputType< O >(scaling.getFormat()) )
+  {
+    throw std::invalid_argument("The output type does not match the output format.");
+  }
+  if ( !isIntermediateTypeLargeEnough< L >(observation, inputBits) )
+  {
+    throw std::invalid_argument("The intermediate type is too small for the number of channels and the input bits.");
+  }
+
+  const unsigned int nrSamples = observation.getNrSamplesPerBatch() / observation.getDownsampling();
+  const unsigned int nrSamplesPadded = isa::utils::pad(nrSamples, padding / sizeof(O));
+  unsigned int nrSamplesPerChannel = 0;
+  if ( inputBits >= 8 )
+  {
+    nrSamplesPerChannel = isa::utils::pad(observation.getNrSamplesPerDispersedBatch(), padding / sizeof(I));
+  }
+  else
+  {
+    nrSamplesPerChannel = isa::utils::pad(observation.getNrSamplesPerDispersedBatch() / (8 / inputBits), padding / sizeof(I));
+  }
+  const unsigned int lastStage = plan.getNrStages() - 1;
+  std::vector< L > previous;
+  std::vector< L > current;
+
+  for ( unsigned int sBeam = 0; sBeam < observation.getNrSynthesizedBeams(); sBeam++ )
+  {
+    // Stage 0: copy the channels of the beam, zapped channels and samples after the end of the batch are 0
+    current.resize(plan.getNrElements(0));
+    pool.parallelFor(observation.getNrChannels(), [&](const unsigned int channel, const unsigned int)
+    {
+      const FDMTNode & node = plan.getNodes(0)[channel];
+      L * row = current.data() + node.firstElement;
+
+      std::fill(row, row + node.nrSamples, static_cast< L >(0));
+      if ( !activeChannels.isActive(sBeam, channel) )
+      {
+        return;
+      }
+      const I * channelData = input.data() + (beamMapping[(sBeam * observation.getNrChannels(padding / sizeof(unsigned int))) + channel] * observation.getNrChannels() * nrSamplesPerChannel) + (channel * nrSamplesPerChannel);
+      const unsigned int nrInputSamples = std::min(node.nrSamples, observation.getNrSamplesPerDispersedBatch());
+      if ( inputBits >= 8 )
+      {
+        accumulate(channelData, row, nrInputSamples);
+      }
+      else
+      {
+        accumulatePacked(channelData, 0, row, nrInputSamples, inputBits);
+      }
+    });
+    for ( unsigned int stage = 1; stage <= lastStage; stage++ )
+    {
+      const std::vector< FDMTNode > & nodes = plan.getNodes(stage);
+      const std::vector< FDMTNode > & previousNodes = plan.getNodes(stage - 1);
+
+      std::swap(previous, current);
+      current.resize(plan.getNrElements(stage));
+      pool.parallelFor(plan.getNrDelays(stage), [&](const unsigned int item, const unsigned int)
+      {
+        const unsigned int nodeIndex = std::upper_bound(nodes.begin(), nodes.end(), item, [](const unsigned int value, const FDMTNode & node) { return value < node.firstDelay; }) - nodes.begin() - 1;
+        const FDMTNode & node = nodes[nodeIndex];
+        const unsigned int delay = item - node.firstDelay;
+        const FDMTNode & low = previousNodes[node.low];
+        L * sum = current.data() + node.firstElement + (delay * node.nrSamples);
+
+        if ( !node.merge )
+        {
+          const L * lowRow = previous.data() + low.firstElement + (delay * low.nrSamples);
+
+          std::copy(lowRow, lowRow + node.nrSamples, sum);
+          return;
+        }
+        const FDMTNode & high = previousNodes[node.high];
+        const L * highRow = previous.data() + high.firstElement + (getFDMTDelay(delay, node.highRatio) * high.nrSamples);
+        const L * lowRow = previous.data() + low.firstElement + (getFDMTDelay(delay, node.lowRatio) * low.nrSamples) + getFDMTDelay(delay, node.offsetRatio);
+
+        for ( unsigned int sample = 0; sample < node.nrSamples; sample++ )
+        {
+          sum[sample] = highRow[sample] + lowRow[sample];
+        }
+      });
+    }
+    pool.parallelFor(observation.getNrDMs(), [&](const unsigned int dm, const unsigned int)
+    {
+      const FDMTNode & node = plan.getNodes(lastStage)[0];
+      const L * row = current.data() + node.firstElement + (plan.getDMDelay(dm) * node.nrSamples);
+      const float offset = scaling.getOffset(sBeam, dm);
+      const float scale = scaling.getScale(sBeam, dm);
+
+      for ( unsigned int sample = 0; sample < nrSamples; sample++ )
+      {
+        output[(sBeam * observation.getNrDMs() * nrSamplesPadded) + (dm * nrSamplesPadded) + sample] = convertOutput< L, O >(row[sample], scaling.getFormat(), offset, scale);
+      }
+    });
+  }
+}
+
+} // Dedispersion
+
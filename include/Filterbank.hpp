@@ -0,0 +1,132 @@
+// Copyright 2017 Netherlands Institute for Radio Astronomy (ASTRON)
+// Copyright 2017 Netherlands eScience Center
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+#include <cstdint>
+#include <stdexcept>
+
+#include <Observation.hpp>
+#include <InputLayout.hpp>
+#include <DedispersionCPU.hpp>
+
+
+#pragma once
+
+namespace Dedispersion {
+
+// Format of the samples of a filterbank file
+struct FilterbankHeader {
+  unsigned int nrChannels;
+  unsigned int nrBits;
+  unsigned int nrIFs;
+  double samplingTime;
+  // Frequency of the first channel in the file, and distance to the next one: negative in descending frequency order
+  double firstFrequency;
+  double channelBandwidth;
+  // Bytes before the first sample
+  uint64_t headerSize;
+};
+
+// Read-only memory map of a SIGPROC filterbank file, or of a raw dump of samples without a header; both are time-major, a row of channels for every sample.
+// A batch is a view of the mapping, read in place by the CPU kernels or by an OpenCL buffer; the pages are read by the kernel of the operating system on the first access,
+// the mapping is advised as sequential, and prefetch() and release() move the readahead along with the batches.
+class Filterbank {
+public:
+  // SIGPROC filterbank file, in the format of its header
+  Filterbank(const std::string & fileName);
+  // Raw dump, in the format of the observation: channels, frequencies and sampling time, and inputBits bits per sample; in descending frequency order with reversedFrequency
+  Filterbank(const std::string & fileName, const AstroData::Observation & observation, const uint8_t inputBits, const bool reversedFrequency = false);
+  Filterbank(const Filterbank & filterbank) = delete;
+  Filterbank & operator=(const Filterbank & filterbank) = delete;
+  ~Filterbank();
+
+  // Get
+  const FilterbankHeader & getHeader() const;
+  uint64_t getNrSamples() const;
+  // Bytes of the row of a sample
+  unsigned int getNrBytesPerSample() const;
+  // First byte of the row of sample
+  const uint8_t * getSamples(const uint64_t sample) const;
+  // Time-major, with reversed frequency if the channels are in descending frequency order
+  InputLayout getLayout() const;
+  // Channels, frequencies and sampling time of the file; the subbands of the observation are not changed
+  void setObservation(AstroData::Observation & observation) const;
+  // Advise that the rows of nrSamples samples from sample are needed soon, or not anymore
+  void prefetch(const uint64_t sample, const uint64_t nrSamples) const;
+  void release(const uint64_t sample, const uint64_t nrSamples) const;
+
+private:
+  void map(const std::string & fileName);
+  void readHeader();
+  void advise(const uint64_t sample, const uint64_t nrSamples, const int advice) const;
+
+  uint8_t * data;
+  uint64_t size;
+  FilterbankHeader header;
+};
+
+// Window over a batch of a filterbank, for the parallel CPU kernels (see DedispersionCPU.hpp): the dispersed batch starts at sample batch * observation.getNrSamplesPerBatch() of the file,
+// and is read in place as the input of a single beam; the following batch is prefetched
+template< typename I > InputWindow< I > getFilterbankWindow(const Filterbank & filterbank, const AstroData::Observation & observation, const uint64_t batch, const bool subbanding);
+
+
+// Implementations
+inline const FilterbankHeader & Filterbank::getHeader() const {
+  return header;
+}
+
+inline uint64_t Filterbank::getNrSamples() const {
+  return (size - header.headerSize) / getNrBytesPerSample();
+}
+
+inline unsigned int Filterbank::getNrBytesPerSample() const {
+  return (header.nrIFs * header.nrChannels * header.nrBits) / 8;
+}
+
+inline const uint8_t * Filterbank::getSamples(const uint64_t sample) const {
+  return data + header.headerSize + (sample * getNrBytesPerSample());
+}
+
+inline InputLayout Filterbank::getLayout() const {
+  return InputLayout(InputOrdering::TimeMajor, header.channelBandwidth < 0.0);
+}
+
+template< typename I > inline InputWindow< I > getFilterbankWindow(const Filterbank & filterbank, const AstroData::Observation & observation, const uint64_t batch, const bool subbanding)
+{
+  const uint64_t firstSample = batch * observation.getNrSamplesPerBatch();
+
+  if ( filterbank.getHeader().nrBits != (8 * sizeof(I)) )
+  {
+    throw std::invalid_argument("The samples of the filterbank do not match the input type.");
+  }
+  if ( (filterbank.getHeader().headerSize % sizeof(I)) != 0 )
+  {
+    throw std::invalid_argument("The samples of the filterbank are not aligned to the input type.");
+  }
+  if ( (observation.getNrBeams() != 1) || (filterbank.getHeader().nrChannels != observation.getNrChannels()) )
+  {
+    throw std::invalid_argument("A filterbank holds the channels of a single beam.");
+  }
+  if ( firstSample + observation.getNrSamplesPerDispersedBatch(subbanding) > filterbank.getNrSamples() )
+  {
+    throw std::invalid_argument("The batch is not in the filterbank.");
+  }
+  filterbank.prefetch(firstSample + observation.getNrSamplesPerDispersedBatch(subbanding), observation.getNrSamplesPerBatch());
+  // The window starts at the batch, so that its offsets stay small in files of any length
+  return InputWindow< I >{reinterpret_cast< const I * >(filterbank.getSamples(firstSample)), observation.getNrSamplesPerDispersedBatch(subbanding), 0, 0, 0, 0, 1, filterbank.getHeader().nrChannels, filterbank.getLayout().getReversedFrequency()};
+}
+
+} // Dedispersion
+
@@ -0,0 +1,102 @@
+// Copyright 2017 Netherlands Institute for Radio Astronomy (ASTRON)
+// Copyright 2017 Netherlands eScience Center
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+#include <cstdint>
+
+#include <Observation.hpp>
+#include <utils.hpp>
+
+
+#pragma once
+
+namespace Dedispersion {
+
+// Order of the input of a beam:
+//   - ChannelMajor: channel * samples, every channel row padded; the layout of all the kernels without an InputLayout
+//   - TimeMajor: samples * channels, every sample row padded, i.e. the channels of a sample are contiguous, as written by most beamformers
+enum class InputOrdering {ChannelMajor, TimeMajor};
+
+// Layout of the input read by the kernels, selected at runtime.
+// With reversed frequency the channels are stored in descending frequency order: channel 0 of the observation is the last one in memory.
+// Only the reads of the input change; channels are numbered as in the observation everywhere else (beam mapping, active channels, delays).
+// Time-major input needs at least 8 bits per sample.
+class InputLayout {
+public:
+  // Channel-major, ascending frequency
+  InputLayout();
+  InputLayout(const InputOrdering ordering, const bool reversedFrequency);
+  ~InputLayout();
+
+  // Get
+  InputOrdering getOrdering() const;
+  bool getReversedFrequency() const;
+  // Channel-major and ascending frequency, the same kernels as without a layout
+  bool isDefault() const;
+  // Set
+  void setOrdering(const InputOrdering ordering);
+  void setReversedFrequency(const bool reversed);
+
+private:
+  InputOrdering ordering;
+  bool reversedFrequency;
+};
+
+// Parse "channel" or "time"
+InputOrdering getInputOrdering(const std::string & name);
+// Elements of a sample row of time-major input
+template< typename I > unsigned int getNrInputChannelsPerSample(const AstroData::Observation & observation, const unsigned int padding);
+// Elements of a beam, with rows of nrSamplesPerChannel elements if channel-major, or nrSamplesPerChannel rows of nrChannelsPerSample elements if time-major
+unsigned int getNrInputBeamElements(const InputLayout & layout, const unsigned int nrChannels, const unsigned int nrChannelsPerSample, const unsigned int nrSamplesPerChannel);
+// OpenCL expression of the position in memory of the variable channel
+std::string getInputChannelOpenCL(const InputLayout & layout, const unsigned int nrChannels);
+// OpenCL index of sample of the variable channel in the input of beam, with the rows of getNrInputBeamElements()
+std::string getInputIndexOpenCL(const InputLayout & layout, const unsigned int nrChannels, const unsigned int nrChannelsPerSample, const unsigned int nrSamplesPerChannel, const std::string & beam, const std::string & sample);
+
+
+// Implementations
+inline InputOrdering InputLayout::getOrdering() const {
+  return ordering;
+}
+
+inline bool InputLayout::getReversedFrequency() const {
+  return reversedFrequency;
+}
+
+inline bool InputLayout::isDefault() const {
+  return (ordering == InputOrdering::ChannelMajor) && !reversedFrequency;
+}
+
+inline void InputLayout::setOrdering(const InputOrdering ordering) {
+  this->ordering = ordering;
+}
+
+inline void InputLayout::setReversedFrequency(const bool reversed) {
+  reversedFrequency = reversed;
+}
+
+template< typename I > inline unsigned int getNrInputChannelsPerSample(const AstroData::Observation & observation, const unsigned int padding) {
+  return isa::utils::pad(observation.getNrChannels(), padding / sizeof(I));
+}
+
+inline unsigned int getNrInputBeamElements(const InputLayout & layout, const unsigned int nrChannels, const unsigned int nrChannelsPerSample, const unsigned int nrSamplesPerChannel) {
+  if ( layout.getOrdering() == InputOrdering::TimeMajor ) {
+    return nrSamplesPerChannel * nrChannelsPerSample;
+  }
+  return nrChannels * nrSamplesPerChannel;
+}
+
+} // Dedispersion
+
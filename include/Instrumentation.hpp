@@ -0,0 +1,125 @@
+// Copyright 2017 Netherlands Institute for Radio Astronomy (ASTRON)
+// Copyright 2017 Netherlands eScience Center
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include <OpenCLTypes.hpp>
+#include <Observation.hpp>
+
+
+#pragma once
+
+namespace Dedispersion {
+
+// Stages of the processing of a batch:
+//   - Input: reading, waiting for, or preparing the input on the host
+//   - HostToDevice, Kernel, DeviceToHost: transfers and kernels of OpenCL devices
+//   - CPU: dedispersion and post-processing on the host
+enum class Stage {Input, HostToDevice, Kernel, DeviceToHost, CPU};
+const unsigned int nrStages = 5;
+
+// Counters of a stage: calls, time in nanoseconds, and bytes and operations of all the calls
+struct StageCounters {
+  uint64_t nrCalls;
+  uint64_t time;
+  uint64_t minTime;
+  uint64_t maxTime;
+  uint64_t nrBytes;
+  uint64_t nrOperations;
+};
+
+// Per-stage timers and counters of a pipeline.
+// The counters are atomic, so the stages can be added from different threads; a disabled Instrumentation ignores every call,
+// and a StageTimer on a disabled, or null, Instrumentation does not read the clock, so the instrumentation can stay in the hot path.
+class Instrumentation {
+public:
+  Instrumentation(const bool enabled = true);
+  ~Instrumentation();
+
+  // Get
+  bool isEnabled() const;
+  StageCounters getCounters(const Stage stage) const;
+  // Set
+  void setEnabled(const bool enabled);
+  // Add a call of a stage lasting time nanoseconds
+  void add(const Stage stage, const uint64_t time, const uint64_t nrBytes = 0, const uint64_t nrOperations = 0);
+  // Add the device time of the command of a completed event, from CL_PROFILING_COMMAND_START to CL_PROFILING_COMMAND_END;
+  // the queue needs CL_QUEUE_PROFILING_ENABLE, otherwise nothing is added and the return value is false
+  bool add(const Stage stage, const cl::Event & event, const uint64_t nrBytes = 0, const uint64_t nrOperations = 0);
+  void reset();
+  // Snapshot of the counters, one line per stage with time in seconds, GB/s and GFLOP/s, or as JSON with time in nanoseconds
+  std::string print() const;
+  std::string printJSON() const;
+
+private:
+  bool enabled;
+  std::array< std::atomic< uint64_t >, nrStages > nrCalls;
+  std::array< std::atomic< uint64_t >, nrStages > time;
+  std::array< std::atomic< uint64_t >, nrStages > minTime;
+  std::array< std::atomic< uint64_t >, nrStages > maxTime;
+  std::array< std::atomic< uint64_t >, nrStages > nrBytes;
+  std::array< std::atomic< uint64_t >, nrStages > nrOperations;
+};
+
+// Times its scope as a call of a stage of instrumentation
+class StageTimer {
+public:
+  StageTimer(Instrumentation * instrumentation, const Stage stage, const uint64_t nrBytes = 0, const uint64_t nrOperations = 0);
+  StageTimer(const StageTimer & timer) = delete;
+  StageTimer & operator=(const StageTimer & timer) = delete;
+  ~StageTimer();
+
+private:
+  Instrumentation * instrumentation;
+  Stage stage;
+  uint64_t nrBytes;
+  uint64_t nrOperations;
+  std::chrono::steady_clock::time_point start;
+};
+
+std::string getStageName(const Stage stage);
+// Operations of a dedispersed batch, counted as in DedispersionTuning: both steps with subbanding
+uint64_t getNrDedispersionOperations(const AstroData::Observation & observation, const bool subbanding);
+
+
+// Implementations
+inline bool Instrumentation::isEnabled() const {
+  return enabled;
+}
+
+inline void Instrumentation::setEnabled(const bool enabled) {
+  this->enabled = enabled;
+}
+
+inline StageTimer::StageTimer(Instrumentation * instrumentation, const Stage stage, const uint64_t nrBytes, const uint64_t nrOperations) : instrumentation(instrumentation), stage(stage), nrBytes(nrBytes), nrOperations(nrOperations) {
+  if ( (instrumentation != nullptr) && instrumentation->isEnabled() ) {
+    start = std::chrono::steady_clock::now();
+  } else {
+    this->instrumentation = nullptr;
+  }
+}
+
+inline StageTimer::~StageTimer() {
+  if ( instrumentation != nullptr ) {
+    instrumentation->add(stage, std::chrono::duration_cast< std::chrono::nanoseconds >(std::chrono::steady_clock::now() - start).count(), nrBytes, nrOperations);
+  }
+}
+
+} // Dedispersion
+
@@ -0,0 +1,82 @@
+// Copyright 2017 Netherlands Institute for Radio Astronomy (ASTRON)
+// Copyright 2017 Netherlands eScience Center
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <atomic>
+
+#include <OpenCLTypes.hpp>
+#include <Kernel.hpp>
+
+
+#pragma once
+
+namespace Dedispersion {
+
+// On-disk cache of compiled OpenCL kernels.
+// An entry contains the CL_PROGRAM_BINARIES of a kernel and its key: the kernel name, the generated source, the device name,
+// the driver and OpenCL versions, and the build options; the file name is a hash of the key, and the key is compared in full
+// when the entry is read, so a different source or driver compiles the kernel again and replaces the entry.
+// compile() can be called from more than one thread at the same time.
+class KernelCache {
+public:
+  // An empty directory disables the cache; the directory is created if it does not exist
+  KernelCache(const std::string & directory = std::string());
+  KernelCache(const KernelCache & cache);
+  ~KernelCache();
+
+  KernelCache & operator=(const KernelCache & cache);
+
+  // Get
+  bool isEnabled() const;
+  const std::string & getDirectory() const;
+  uint64_t getNrHits() const;
+  uint64_t getNrMisses() const;
+  // Same as isa::OpenCL::compile(), but the program is created from the binary of the cache when possible;
+  // the binary of a kernel compiled from source is written in the cache, and a failed build throws isa::OpenCL::OpenCLError with its build log
+  cl::Kernel * compile(const std::string & name, const std::string & code, const std::string & options, cl::Context & context, cl::Device & device);
+
+private:
+  std::string directory;
+  std::atomic< uint64_t > nrHits;
+  std::atomic< uint64_t > nrMisses;
+};
+
+// Key of a kernel in the cache
+std::string getKernelCacheKey(const std::string & name, const std::string & code, const std::string & options, const cl::Device & device);
+// 64 bit FNV-1a hash
+uint64_t getHash(const std::string & text);
+
+
+// Implementations
+inline bool KernelCache::isEnabled() const {
+  return !directory.empty();
+}
+
+inline const std::string & KernelCache::getDirectory() const {
+  return directory;
+}
+
+inline uint64_t KernelCache::getNrHits() const {
+  return nrHits;
+}
+
+inline uint64_t KernelCache::getNrMisses() const {
+  return nrMisses;
+}
+
+} // Dedispersion
+
@@ -0,0 +1,79 @@
+// Copyright 2017 Netherlands Institute for Radio Astronomy (ASTRON)
+// Copyright 2017 Netherlands eScience Center
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <vector>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+
+#include <OpenCLTypes.hpp>
+
+
+#pragma once
+
+namespace Dedispersion {
+
+// Kernels compiled ahead of their use by a pool of host threads, and returned in order.
+// At most depth kernels are compiled, or being compiled, and not yet returned, so the memory does not grow with the number of items.
+// The kernels are compiled in the context captured by compile, that must outlive the pipeline.
+class KernelPipeline {
+public:
+  // Kernels of the items in [first, nrItems); compile(item) returns the kernel of an item, and is called from the threads of the pipeline.
+  // With 0 threads the kernels are compiled in the calling thread, in next().
+  KernelPipeline(const unsigned int first, const unsigned int nrItems, const std::function< cl::Kernel * (const unsigned int) > & compile, const unsigned int nrThreads = 0, const unsigned int depth = 1);
+  // Waits for the kernels being compiled, and deletes the kernels not returned
+  ~KernelPipeline();
+
+  // Get
+  unsigned int getNrThreads() const;
+  unsigned int getDepth() const;
+  // Kernel of the next item, waiting for it to be compiled; the exception thrown by compile() for the item is thrown here.
+  // The caller owns the kernel; not called more than nrItems - first times.
+  cl::Kernel * next();
+
+private:
+  struct Result {
+    cl::Kernel * kernel;
+    std::exception_ptr error;
+  };
+
+  void worker();
+
+  std::function< cl::Kernel * (const unsigned int) > compile;
+  unsigned int nrItems;
+  unsigned int depth;
+  unsigned int nextItem;
+  unsigned int nextResult;
+  std::vector< std::thread > workers;
+  std::map< unsigned int, Result > results;
+  std::mutex lock;
+  std::condition_variable compiled;
+  std::condition_variable taken;
+  bool stop;
+};
+
+inline unsigned int KernelPipeline::getNrThreads() const {
+  return workers.size();
+}
+
+inline unsigned int KernelPipeline::getDepth() const {
+  return depth;
+}
+
+} // Dedispersion
+
@@ -0,0 +1,190 @@
+// Copyright 2017 Netherlands Institute for Radio Astronomy (ASTRON)
+// Copyright 2017 Netherlands eScience Center
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+
+
+#pragma once
+
+namespace Dedispersion {
+
+// Format of the dedispersed output, selected at runtime:
+//   - Float: the output type of the kernels, converted from the intermediate type as without a format
+//   - Half: IEEE 754 half precision, 2 bytes, rounded to the nearest even value (vstore_half in OpenCL)
+//   - UShort, UChar: (value - offset) * scale, rounded to the nearest even integer and saturated, with an offset and a scale for every synthesized beam and DM
+enum class OutputFormat {Float, Half, UShort, UChar};
+
+// Offsets and scales of the integer formats, for every synthesized beam and DM, in the order sBeam * getNrDMs() + dm.
+// With subbanding, the DMs are the getNrDMs(true) * getNrDMs() DMs of the output of step two.
+// The rows are copied as is to the OpenCL kernels; the default scaling is for Float output, without offsets and scales.
+class OutputScaling {
+public:
+  OutputScaling();
+  // Offsets are 0 and scales 1, until set by setRange()
+  OutputScaling(const OutputFormat format, const unsigned int nrSynthesizedBeams, const unsigned int nrDMs);
+  ~OutputScaling();
+
+  // Get
+  OutputFormat getFormat() const;
+  unsigned int getNrDMs() const;
+  float getOffset(const unsigned int sBeam, const unsigned int dm) const;
+  float getScale(const unsigned int sBeam, const unsigned int dm) const;
+  const std::vector< float > & getOffsets() const;
+  const std::vector< float > & getScales() const;
+  // Set
+  void setScaling(const unsigned int sBeam, const unsigned int dm, const float offset, const float scale);
+  // Map the values between minimum and maximum of a DM to the whole range of the format
+  void setRange(const unsigned int sBeam, const unsigned int dm, const float minimum, const float maximum);
+
+private:
+  OutputFormat format;
+  unsigned int nrDMs;
+  std::vector< float > offsets;
+  std::vector< float > scales;
+};
+
+// Parse "float", "half", "ushort" or "uchar"
+OutputFormat getOutputFormat(const std::string & name);
+// OpenCL type of the output buffer, or outputDataType for Float
+std::string getOutputFormatName(const OutputFormat format, const std::string & outputDataType);
+// Bytes per output sample, or sizeof(O) for Float
+template< typename O > unsigned int getOutputFormatSize(const OutputFormat format);
+// Largest integer of UShort and UChar
+float getOutputFormatMaximum(const OutputFormat format);
+// A host type O can hold the format: 2 bytes for Half and UShort, 1 byte for UChar
+template< typename O > bool isOutputType(const OutputFormat format);
+// OpenCL statement storing value, of intermediateDataType, in output[index]; row is the index of the offset and the scale of the integer formats
+std::string getOutputStoreOpenCL(const OutputFormat format, const std::string & intermediateDataType, const std::string & outputDataType, const std::string & index, const std::string & value, const std::string & row);
+// Half precision bits of a float, rounded to the nearest even value
+uint16_t floatToHalf(const float value);
+// Conversion of a dedispersed sample, as done by the kernels
+template< typename L, typename O > O convertOutput(const L value, const OutputFormat format, const float offset, const float scale);
+
+
+// Implementations
+inline OutputFormat OutputScaling::getFormat() const {
+  return format;
+}
+
+inline unsigned int OutputScaling::getNrDMs() const {
+  return nrDMs;
+}
+
+inline float OutputScaling::getOffset(const unsigned int sBeam, const unsigned int dm) const {
+  if ( offsets.empty() ) {
+    return 0.0f;
+  }
+  return offsets[(sBeam * nrDMs) + dm];
+}
+
+inline float OutputScaling::getScale(const unsigned int sBeam, const unsigned int dm) const {
+  if ( scales.empty() ) {
+    return 1.0f;
+  }
+  return scales[(sBeam * nrDMs) + dm];
+}
+
+inline const std::vector< float > & OutputScaling::getOffsets() const {
+  return offsets;
+}
+
+inline const std::vector< float > & OutputScaling::getScales() const {
+  return scales;
+}
+
+template< typename O > inline unsigned int getOutputFormatSize(const OutputFormat format) {
+  switch ( format ) {
+    case OutputFormat::Half:
+    case OutputFormat::UShort:
+      return sizeof(uint16_t);
+    case OutputFormat::UChar:
+      return sizeof(uint8_t);
+    default:
+      return sizeof(O);
+  }
+}
+
+inline float getOutputFormatMaximum(const OutputFormat format) {
+  if ( format == OutputFormat::UChar ) {
+    return 255.0f;
+  }
+  return 65535.0f;
+}
+
+template< typename O > inline bool isOutputType(const OutputFormat format) {
+  return (format == OutputFormat::Float) || (sizeof(O) == getOutputFormatSize< O >(format));
+}
+
+inline uint16_t floatToHalf(const float value) {
+  uint32_t bits = 0;
+  std::memcpy(&bits, &value, sizeof(float));
+  const uint16_t sign = (bits >> 16) & 0x8000;
+  const uint32_t magnitude = bits & 0x7FFFFFFF;
+
+  if ( magnitude >= 0x7F800000 ) {
+    // Infinity and NaN
+    return sign | 0x7C00 | ((magnitude > 0x7F800000) ? 0x0200 : 0);
+  } else if ( magnitude >= 0x477FF000 ) {
+    // Rounds to a value larger than 65504
+    return sign | 0x7C00;
+  } else if ( magnitude < 0x38800000 ) {
+    // Subnormal half, in units of 2^-24
+    const unsigned int shift = 126 - (magnitude >> 23);
+
+    if ( shift > 24 ) {
+      return sign;
+    }
+    const uint32_t mantissa = (magnitude & 0x007FFFFF) | 0x00800000;
+    const uint32_t remainder = mantissa & ((1u << shift) - 1);
+    uint16_t half = mantissa >> shift;
+
+    if ( (remainder > (1u << (shift - 1))) || ((remainder == (1u << (shift - 1))) && ((half & 1) != 0)) ) {
+      half++;
+    }
+    return sign | half;
+  }
+  // Rebias the exponent from 127 to 15, and round the 13 bits of the mantissa that do not fit
+  const uint32_t remainder = magnitude & 0x1FFF;
+  uint16_t half = (magnitude - 0x38000000) >> 13;
+
+  if ( (remainder > 0x1000) || ((remainder == 0x1000) && ((half & 1) != 0)) ) {
+    half++;
+  }
+  return sign | half;
+}
+
+template< typename L, typename O > inline O convertOutput(const L value, const OutputFormat format, const float offset, const float scale) {
+  if ( format == OutputFormat::Float ) {
+    return static_cast< O >(value);
+  } else if ( format == OutputFormat::Half ) {
+    return static_cast< O >(floatToHalf(static_cast< float >(value)));
+  }
+  const float scaled = std::nearbyint((static_cast< float >(value) - offset) * scale);
+
+  // Saturate, NaN included, as convert_*_sat_rte
+  if ( !(scaled > 0.0f) ) {
+    return static_cast< O >(0);
+  } else if ( scaled > getOutputFormatMaximum(format) ) {
+    return static_cast< O >(getOutputFormatMaximum(format));
+  }
+  return static_cast< O >(scaled);
+}
+
+} // Dedispersion
+
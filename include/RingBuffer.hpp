@@ -0,0 +1,173 @@
+// Copyright 2017 Netherlands Institute for Radio Astronomy (ASTRON)
+// Copyright 2017 Netherlands eScience Center
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+#include <sstream>
+#include <cstdint>
+#include <stdexcept>
+
+#include <Observation.hpp>
+#include <InputLayout.hpp>
+#include <DedispersionCPU.hpp>
+
+
+#pragma once
+
+namespace Dedispersion {
+
+// Ring buffer in POSIX shared memory, between a writer and a reader process on the same machine, in the spirit of a PSRDADA ring:
+// an ASCII header of "KEY value" lines, written once, followed by a ring of data blocks of the same size.
+// Every block is written and read in place; two process-shared semaphores count the free and the full blocks, so that a full ring blocks the writer (backpressure)
+// or, if the writer can not wait, makes it drop the block, and the blocks written, released and dropped are counted in the shared memory.
+// A data block is a block of the input of split batches mode (see getNrInputBlocks()): the samples of one batch, in the layout of the reader.
+const unsigned int nrRingHeaderBytes = 4096;
+
+struct RingControl;
+
+// Creates the ring, and removes it when destroyed
+class RingWriter {
+public:
+  RingWriter(const std::string & name, const unsigned int nrBlocks, const uint64_t nrBytesPerBlock, const std::string & header);
+  RingWriter(const RingWriter & writer) = delete;
+  RingWriter & operator=(const RingWriter & writer) = delete;
+  ~RingWriter();
+
+  // Get
+  unsigned int getNrBlocks() const;
+  uint64_t getNrBytesPerBlock() const;
+  uint64_t getNrWrittenBlocks() const;
+  uint64_t getNrDroppedBlocks() const;
+  // Blocks written and not yet released by the reader
+  uint64_t getOccupancy() const;
+  // Next free block, waiting for the reader to release one if the ring is full;
+  // without wait, a full ring drops the block and returns nullptr
+  uint8_t * getBlock(const bool wait = true);
+  // Hand the block of getBlock() to the reader
+  void commit();
+  // No more blocks; the reader gets the blocks already written
+  void close();
+
+private:
+  std::string name;
+  RingControl * control;
+  uint8_t * data;
+  uint64_t size;
+};
+
+// Attaches to the ring of a writer
+class RingReader {
+public:
+  RingReader(const std::string & name);
+  RingReader(const RingReader & reader) = delete;
+  RingReader & operator=(const RingReader & reader) = delete;
+  ~RingReader();
+
+  // Get
+  unsigned int getNrBlocks() const;
+  uint64_t getNrBytesPerBlock() const;
+  const std::string & getHeader() const;
+  // Value of a key of the header
+  template< typename T > T getHeaderValue(const std::string & key) const;
+  uint64_t getNrWrittenBlocks() const;
+  uint64_t getNrDroppedBlocks() const;
+  uint64_t getOccupancy() const;
+  // Data blocks, and position in the ring of the first block held by the reader
+  const uint8_t * getData() const;
+  unsigned int getFirstBlock() const;
+  unsigned int getNrAcquiredBlocks() const;
+  // Hold nrBlocks consecutive blocks, from the first one, waiting for the writer; false at the end of the data
+  bool acquire(const unsigned int nrBlocks);
+  // Give the first block back to the writer; the next one becomes the first
+  void release();
+
+private:
+  RingControl * control;
+  const uint8_t * data;
+  uint64_t size;
+  std::string header;
+  uint64_t nrAcquiredBlocks;
+  uint64_t nrReleasedBlocks;
+};
+
+// Header of a ring with the input of an observation: beams, channels, frequencies, sampling time, samples per batch (one block), bits per sample, padding and layout
+std::string getRingHeader(const AstroData::Observation & observation, const unsigned int padding, const uint8_t inputBits, const InputLayout & layout);
+// Observation, padding and layout of the header of a ring; the subbands and DMs of the observation are not changed
+void setObservation(const RingReader & reader, AstroData::Observation & observation, unsigned int & padding, InputLayout & layout);
+// Bytes of a block of the input of an observation, in a layout
+template< typename I > uint64_t getNrRingBlockBytes(const AstroData::Observation & observation, const unsigned int padding, const uint8_t inputBits, const InputLayout & layout);
+// Window over the blocks held by the reader, for the parallel CPU kernels (see DedispersionCPU.hpp): the dispersed batch starts in the first block, and the samples wrap around the end of the ring;
+// the reader has to hold getNrInputBlocks() blocks
+template< typename I > InputWindow< I > getRingWindow(const RingReader & reader, const AstroData::Observation & observation, const unsigned int padding, const uint8_t inputBits, const InputLayout & layout);
+
+
+// Implementations
+inline const std::string & RingReader::getHeader() const {
+  return header;
+}
+
+template< typename T > inline T RingReader::getHeaderValue(const std::string & key) const {
+  std::istringstream lines(header);
+  std::string line;
+
+  while ( std::getline(lines, line) ) {
+    std::istringstream fields(line);
+    std::string lineKey;
+    T value;
+
+    if ( (fields >> lineKey) && (lineKey == key) && (fields >> value) ) {
+      return value;
+    }
+  }
+  throw std::invalid_argument("The ring header has no " + key + ".");
+}
+
+inline const uint8_t * RingReader::getData() const {
+  return data;
+}
+
+inline unsigned int RingReader::getFirstBlock() const {
+  return nrReleasedBlocks % getNrBlocks();
+}
+
+inline unsigned int RingReader::getNrAcquiredBlocks() const {
+  return nrAcquiredBlocks - nrReleasedBlocks;
+}
+
+template< typename I > inline uint64_t getNrRingBlockBytes(const AstroData::Observation & observation, const unsigned int padding, const uint8_t inputBits, const InputLayout & layout)
+{
+  if ( layout.getOrdering() == InputOrdering::TimeMajor )
+  {
+    return static_cast< uint64_t >(observation.getNrBeams()) * getNrInputBeamElements(layout, observation.getNrChannels(), getNrInputChannelsPerSample< I >(observation, padding), observation.getNrSamplesPerBatch()) * sizeof(I);
+  }
+  return static_cast< uint64_t >(observation.getNrBeams()) * observation.getNrChannels() * getNrInputBlockSamplesPerChannel< I >(observation, padding, inputBits) * sizeof(I);
+}
+
+template< typename I > inline InputWindow< I > getRingWindow(const RingReader & reader, const AstroData::Observation & observation, const unsigned int padding, const uint8_t inputBits, const InputLayout & layout)
+{
+  if ( reader.getNrBytesPerBlock() < getNrRingBlockBytes< I >(observation, padding, inputBits, layout) )
+  {
+    throw std::invalid_argument("The blocks of the ring do not hold a batch.");
+  }
+  // The rows of a split batches window, over the blocks of the shared ring
+  InputWindow< I > window = getSplitBatchesWindow(observation, std::vector< I >(), reader.getFirstBlock(), padding, inputBits, false, layout);
+
+  window.data = reinterpret_cast< const I * >(reader.getData());
+  window.nrBlocks = reader.getNrBlocks();
+  window.nrElementsPerBlock = reader.getNrBytesPerBlock() / sizeof(I);
+  return window;
+}
+
+} // Dedispersion
+
@@ -0,0 +1,122 @@
+// Copyright 2017 Netherlands Institute for Radio Astronomy (ASTRON)
+// Copyright 2017 Netherlands eScience Center
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include <Observation.hpp>
+#include <Dedispersion.hpp>
+
+
+#pragma once
+
+namespace Dedispersion {
+
+// Sums and sums of squares of the dedispersed samples of a batch, for every synthesized beam and DM in the order sBeam * getNrDMs() + dm.
+// With subbanding, the DMs are the getNrDMs(true) * getNrDMs() DMs of the output of step two.
+// Every DM has one partial for each block of nrThreadsD0 * nrItemsD0 samples of the kernels, a pair of float (sum, sum of squares);
+// the partials are the side buffer written by the kernels, and are added in double precision by the getters.
+class Statistics {
+public:
+  Statistics();
+  Statistics(const DedispersionConf & conf, const AstroData::Observation & observation, const bool subbanding);
+  ~Statistics();
+
+  // Get
+  unsigned int getNrDMs() const;
+  unsigned int getNrPartials() const;
+  unsigned int getNrSamples() const;
+  double getSum(const unsigned int sBeam, const unsigned int dm) const;
+  double getSumOfSquares(const unsigned int sBeam, const unsigned int dm) const;
+  float getMean(const unsigned int sBeam, const unsigned int dm) const;
+  float getStandardDeviation(const unsigned int sBeam, const unsigned int dm) const;
+  // The side buffer, in the order ((((sBeam * getNrDMs()) + dm) * getNrPartials()) + partial) * 2, of the same size as the buffer of the OpenCL kernels
+  std::vector< float > & getPartials();
+  const std::vector< float > & getPartials() const;
+  // Set
+  void setPartial(const unsigned int sBeam, const unsigned int dm, const unsigned int partial, const float sum, const float sumOfSquares);
+
+private:
+  unsigned int nrDMs;
+  unsigned int nrPartials;
+  unsigned int nrSamples;
+  std::vector< float > partials;
+};
+
+// Partials of every DM, one for every block of samples of the kernels
+unsigned int getNrStatisticsPartials(const DedispersionConf & conf, const AstroData::Observation & observation);
+// The partials of statistics are the ones of the kernels of conf and observation
+bool isStatisticsLayout(const Statistics & statistics, const DedispersionConf & conf, const AstroData::Observation & observation, const bool subbanding);
+// Store the sum and the sum of squares of a block of nrSamples dedispersed samples in a partial, adding the samples in double precision
+template< typename L > void setStatisticsPartial(Statistics & statistics, const unsigned int sBeam, const unsigned int dm, const unsigned int partial, const L * samples, const unsigned int nrSamples);
+
+
+// Implementations
+inline unsigned int Statistics::getNrDMs() const {
+  return nrDMs;
+}
+
+inline unsigned int Statistics::getNrPartials() const {
+  return nrPartials;
+}
+
+inline unsigned int Statistics::getNrSamples() const {
+  return nrSamples;
+}
+
+inline std::vector< float > & Statistics::getPartials() {
+  return partials;
+}
+
+inline const std::vector< float > & Statistics::getPartials() const {
+  return partials;
+}
+
+inline void Statistics::setPartial(const unsigned int sBeam, const unsigned int dm, const unsigned int partial, const float sum, const float sumOfSquares) {
+  partials[(((((sBeam * nrDMs) + dm) * nrPartials) + partial) * 2)] = sum;
+  partials[(((((sBeam * nrDMs) + dm) * nrPartials) + partial) * 2) + 1] = sumOfSquares;
+}
+
+inline unsigned int getNrStatisticsPartials(const DedispersionConf & conf, const AstroData::Observation & observation) {
+  const unsigned int nrSamplesPerBlock = std::max(conf.getNrThreadsD0() * conf.getNrItemsD0(), 1u);
+
+  return ((observation.getNrSamplesPerBatch() / observation.getDownsampling()) + nrSamplesPerBlock - 1) / nrSamplesPerBlock;
+}
+
+inline bool isStatisticsLayout(const Statistics & statistics, const DedispersionConf & conf, const AstroData::Observation & observation, const bool subbanding) {
+  unsigned int nrDMs = observation.getNrDMs();
+
+  if ( subbanding ) {
+    nrDMs *= observation.getNrDMs(true);
+  }
+  return (statistics.getNrDMs() == nrDMs) && (statistics.getNrPartials() == getNrStatisticsPartials(conf, observation)) && (statistics.getPartials().size() == static_cast< size_t >(observation.getNrSynthesizedBeams()) * nrDMs * statistics.getNrPartials() * 2);
+}
+
+template< typename L > inline void setStatisticsPartial(Statistics & statistics, const unsigned int sBeam, const unsigned int dm, const unsigned int partial, const L * samples, const unsigned int nrSamples) {
+  double sum = 0.0;
+  double sumOfSquares = 0.0;
+
+  for ( unsigned int sample = 0; sample < nrSamples; sample++ ) {
+    const double value = static_cast< double >(samples[sample]);
+
+    sum += value;
+    sumOfSquares += value * value;
+  }
+  statistics.setPartial(sBeam, dm, partial, sum, sumOfSquares);
+}
+
+} // Dedispersion
+
@@ -0,0 +1,189 @@
+// Copyright 2017 Netherlands Institute for Radio Astronomy (ASTRON)
+// Copyright 2017 Netherlands eScience Center
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+
+#include <Observation.hpp>
+#include <utils.hpp>
+#include <Dedispersion.hpp>
+#include <ThreadPool.hpp>
+#include <DelayTable.hpp>
+#include <ActiveChannels.hpp>
+#include <DedispersionCPU.hpp>
+#include <Statistics.hpp>
+#include <Instrumentation.hpp>
+
+
+#pragma once
+
+namespace Dedispersion {
+
+// Dedispersion of a stream of batches on the CPU.
+// Every call to push() takes a batch of new samples; the samples a batch shares with the next ones, up to the maximum delay,
+// stay in a ring of batch sized blocks, the same as in split batches mode (see getNrInputBlocks()), and are never copied again.
+// The ring holds getNrBlocks() blocks, enough for a dispersed batch: the output of a push is the batch received getNrBlocks() - 1 pushes before.
+// The observation is the same as for the batch kernels in DedispersionCPU.hpp, and so is the output.
+template< typename I, typename L, typename O > class StreamingDedispersion {
+public:
+  // Single step dedispersion
+  StreamingDedispersion(ThreadPool & pool, const DedispersionConf & conf, const AstroData::Observation & observation, const ActiveChannels & activeChannels, const std::vector< unsigned int > & beamMapping, const DelayTable & delays, const unsigned int padding, const uint8_t inputBits);
+  // Both subbanding steps, as subbandDedispersion()
+  StreamingDedispersion(ThreadPool & pool, const DedispersionConf & conf, const AstroData::Observation & observation, const ActiveChannels & activeChannels, const std::vector< unsigned int > & beamMapping, const DelayTable & delaysStepOne, const DelayTable & delaysStepTwo, const unsigned int padding, const uint8_t inputBits);
+  ~StreamingDedispersion();
+
+  // Get
+  unsigned int getNrBlocks() const;
+  // Batches received since the beginning of the stream
+  unsigned int getNrBatches() const;
+  // Elements of a channel in the input of push()
+  unsigned int getNrSamplesPerChannel() const;
+  // Block where the next batch is written, laid out as the input of push(): the caller can fill it and call push(output), avoiding the copy of push(input, output)
+  I * getNextBlock();
+  // Set
+  // Format of the output of the following pushes, as the scaling argument of the batch kernels
+  void setOutputScaling(const OutputScaling & scaling);
+  // Statistics of the output of the following pushes, as the statistics argument of the batch kernels; nullptr to disable them
+  void setStatistics(Statistics * statistics);
+  // Time the copy of push(input, output) as the input stage, and the dedispersion as the CPU stage, with their bytes and operations; nullptr to disable it
+  void setInstrumentation(Instrumentation * instrumentation);
+  // Add the next batch, laid out as beam * channel * getNrSamplesPerChannel() elements; returns true if output contains a dedispersed batch
+  bool push(const std::vector< I > & input, std::vector< O > & output);
+  // Add the batch written in the block returned by getNextBlock()
+  bool push(std::vector< O > & output);
+
+private:
+  void initialize();
+
+  ThreadPool & pool;
+  DedispersionConf conf;
+  AstroData::Observation observation;
+  ActiveChannels activeChannels;
+  std::vector< unsigned int > beamMapping;
+  DelayTable delaysStepOne;
+  DelayTable delaysStepTwo;
+  bool subbanding;
+  unsigned int padding;
+  uint8_t inputBits;
+  OutputScaling scaling;
+  Statistics * statistics;
+  Instrumentation * instrumentation;
+  unsigned int nrBlocks;
+  unsigned int nrBatches;
+  unsigned int nrSamplesPerChannel;
+  unsigned int nrElementsPerBlock;
+  std::vector< I > ring;
+};
+
+
+// Implementations
+template< typename I, typename L, typename O > StreamingDedispersion< I, L, O >::StreamingDedispersion(ThreadPool & pool, const DedispersionConf & conf, const AstroData::Observation & observation, const ActiveChannels & activeChannels, const std::vector< unsigned int > & beamMapping, const DelayTable & delays, const unsigned int padding, const uint8_t inputBits) : pool(pool), conf(conf), observation(observation), activeChannels(activeChannels), beamMapping(beamMapping), delaysStepOne(delays), delaysStepTwo(delays), subbanding(false), padding(padding), inputBits(inputBits), statistics(nullptr), instrumentation(nullptr)
+{
+  initialize();
+}
+
+template< typename I, typename L, typename O > StreamingDedispersion< I, L, O >::StreamingDedispersion(ThreadPool & pool, const DedispersionConf & conf, const AstroData::Observation & observation, const ActiveChannels & activeChannels, const std::vector< unsigned int > & beamMapping, const DelayTable & delaysStepOne, const DelayTable & delaysStepTwo, const unsigned int padding, const uint8_t inputBits) : pool(pool), conf(conf), observation(observation), activeChannels(activeChannels), beamMapping(beamMapping), delaysStepOne(delaysStepOne), delaysStepTwo(delaysStepTwo), subbanding(true), padding(padding), inputBits(inputBits), statistics(nullptr), instrumentation(nullptr)
+{
+  initialize();
+}
+
+template< typename I, typename L, typename O > StreamingDedispersion< I, L, O >::~StreamingDedispersion() {}
+
+template< typename I, typename L, typename O > void StreamingDedispersion< I, L, O >::initialize()
+{
+  const unsigned int nrSamplesPerElement = (inputBits >= 8) ? 1 : 8 / inputBits;
+
+  if ( (observation.getNrSamplesPerBatch() % nrSamplesPerElement) != 0 )
+  {
+    throw std::invalid_argument("The number of samples per batch must be a multiple of the samples per byte.");
+  }
+  nrBlocks = getNrInputBlocks(observation, subbanding);
+  nrBatches = 0;
+  nrSamplesPerChannel = getNrInputBlockSamplesPerChannel< I >(observation, padding, inputBits);
+  nrElementsPerBlock = observation.getNrBeams() * observation.getNrChannels() * nrSamplesPerChannel;
+  ring.resize(nrBlocks * nrElementsPerBlock);
+}
+
+template< typename I, typename L, typename O > inline unsigned int StreamingDedispersion< I, L, O >::getNrBlocks() const
+{
+  return nrBlocks;
+}
+
+template< typename I, typename L, typename O > inline unsigned int StreamingDedispersion< I, L, O >::getNrBatches() const
+{
+  return nrBatches;
+}
+
+template< typename I, typename L, typename O > inline unsigned int StreamingDedispersion< I, L, O >::getNrSamplesPerChannel() const
+{
+  return nrSamplesPerChannel;
+}
+
+template< typename I, typename L, typename O > inline I * StreamingDedispersion< I, L, O >::getNextBlock()
+{
+  return ring.data() + ((nrBatches % nrBlocks) * nrElementsPerBlock);
+}
+
+template< typename I, typename L, typename O > inline void StreamingDedispersion< I, L, O >::setOutputScaling(const OutputScaling & scaling)
+{
+  this->scaling = scaling;
+}
+
+template< typename I, typename L, typename O > inline void StreamingDedispersion< I, L, O >::setStatistics(Statistics * statistics)
+{
+  this->statistics = statistics;
+}
+
+template< typename I, typename L, typename O > inline void StreamingDedispersion< I, L, O >::setInstrumentation(Instrumentation * instrumentation)
+{
+  this->instrumentation = instrumentation;
+}
+
+template< typename I, typename L, typename O > bool StreamingDedispersion< I, L, O >::push(const std::vector< I > & input, std::vector< O > & output)
+{
+  {
+    StageTimer timer(instrumentation, Stage::Input, nrElementsPerBlock * sizeof(I));
+
+    std::copy(input.begin(), input.begin() + nrElementsPerBlock, getNextBlock());
+  }
+  return push(output);
+}
+
+template< typename I, typename L, typename O > bool StreamingDedispersion< I, L, O >::push(std::vector< O > & output)
+{
+  nrBatches++;
+  if ( nrBatches < nrBlocks )
+  {
+    return false;
+  }
+  StageTimer timer(instrumentation, Stage::CPU, (nrElementsPerBlock * sizeof(I)) + (output.size() * sizeof(O)), getNrDedispersionOperations(observation, subbanding));
+  // The oldest block in the ring is the first of the dispersed batch
+  InputWindow< I > window = getSplitBatchesWindow(observation, ring, nrBatches % nrBlocks, padding, inputBits, subbanding);
+
+  if ( subbanding )
+  {
+    subbandDedispersion< I, L, O >(pool, conf, observation, activeChannels, beamMapping, window, output, delaysStepOne, delaysStepTwo, padding, inputBits, scaling, statistics);
+  }
+  else
+  {
+    dedispersion< I, L, O >(pool, conf, observation, activeChannels, beamMapping, window, output, delaysStepOne, padding, inputBits, scaling, statistics);
+  }
+  return true;
+}
+
+} // Dedispersion
+
@@ -0,0 +1,67 @@
+// Copyright 2017 Netherlands Institute for Radio Astronomy (ASTRON)
+// Copyright 2017 Netherlands eScience Center
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <exception>
+
+
+#pragma once
+
+namespace Dedispersion {
+
+// Persistent pool of worker threads used by the CPU engines.
+// The calling thread takes part in the computation, so a pool of N threads starts N - 1 workers.
+class ThreadPool {
+public:
+  // A value of 0 uses all the hardware threads of the machine
+  ThreadPool(const unsigned int nrThreads = 0);
+  ~ThreadPool();
+
+  // Get
+  unsigned int getNrThreads() const;
+  // Execute body(item, thread) for every item in [0, nrItems); items are handed out dynamically.
+  // The thread index is in [0, getNrThreads()) and can be used to address per-thread scratch memory.
+  // Not reentrant: body must not call parallelFor on the same pool.
+  void parallelFor(const unsigned int nrItems, const std::function< void(const unsigned int, const unsigned int) > & body);
+
+private:
+  void worker(const unsigned int thread);
+  void run(const unsigned int thread);
+
+  unsigned int nrThreads;
+  std::vector< std::thread > workers;
+  std::mutex lock;
+  std::condition_variable start;
+  std::condition_variable done;
+  const std::function< void(const unsigned int, const unsigned int) > * body;
+  unsigned int nrItems;
+  std::atomic< unsigned int > nextItem;
+  unsigned int generation;
+  unsigned int nrBusyWorkers;
+  bool stop;
+  std::exception_ptr error;
+};
+
+inline unsigned int ThreadPool::getNrThreads() const {
+  return nrThreads;
+}
+
+} // Dedispersion
+
@@ -0,0 +1,222 @@
+// Copyright 2017 Netherlands Institute for Radio Astronomy (ASTRON)
+// Copyright 2017 Netherlands eScience Center
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+
+#include <Observation.hpp>
+#include <utils.hpp>
+#include <ThreadPool.hpp>
+#include <Accumulate.hpp>
+#include <DelayTable.hpp>
+#include <ActiveChannels.hpp>
+#include <DedispersionCPU.hpp>
+
+
+#pragma once
+
+namespace Dedispersion {
+
+// Tree (Taylor) dedispersion, with piecewise-linear correction.
+// The band is divided, starting from the highest frequency, in trees of nrChannelsPerTree channels (a power of 2).
+// Inside a tree the dispersion sweep is approximated by a line, and a Taylor tree computes the sums over all the integer sweeps in log2(nrChannelsPerTree) stages.
+// For every DM, the trees are then added with the delay of their highest channel, and with the sweep across their channels, both taken from a single step DelayTable.
+// With nrChannelsPerTree equal to 1 the result is the same as brute force; larger trees are cheaper and less accurate (see getTreeDelayErrors).
+// Input and output have the same layout as dedispersion<I, L, O>.
+template< typename I, typename L, typename O > void treeDedispersion(ThreadPool & pool, const unsigned int nrChannelsPerTree, AstroData::Observation & observation, const ActiveChannels & activeChannels, const std::vector<unsigned int> & beamMapping, const std::vector< I > & input, std::vector< O > & output, const DelayTable & delays, const unsigned int padding, const uint8_t inputBits, const OutputScaling & scaling = OutputScaling());
+// Maximum absolute difference, in samples, between the delays applied by the tree and the ones of brute force dedispersion, for each DM
+std::vector< unsigned int > getTreeDelayErrors(const DelayTable & delays, const unsigned int nrChannelsPerTree);
+// Sweep, in samples, across the channels of a tree for one DM; a partial tree at the bottom of the band is extrapolated to nrChannelsPerTree channels
+unsigned int getTreeSweep(const DelayTable & delays, const unsigned int dm, const unsigned int tree, const unsigned int nrChannelsPerTree);
+// Delay applied by a tree of nrChannels channels with a given sweep to its channel number position, counted from the highest frequency
+unsigned int getTreeDelay(const unsigned int nrChannels, const unsigned int sweep, const unsigned int position);
+// A tree of 2 * nrChannels channels and a given sweep is the sum of two trees of nrChannels channels with the inner sweep, the second one delayed by the offset
+unsigned int getTreeInnerSweep(const unsigned int nrChannels, const unsigned int sweep);
+unsigned int getTreeOffset(const unsigned int nrChannels, const unsigned int sweep);
+
+
+// Implementations
+inline unsigned int getTreeInnerSweep(const unsigned int nrChannels, const unsigned int sweep)
+{
+  return ((sweep * (nrChannels - 1)) + (nrChannels - 1)) / ((2 * nrChannels) - 1);
+}
+
+inline unsigned int getTreeOffset(const unsigned int nrChannels, const unsigned int sweep)
+{
+  return ((sweep * nrChannels) + (nrChannels - 1)) / ((2 * nrChannels) - 1);
+}
+
+template< typename I, typename L, typename O > void treeDedispersion(ThreadPool & pool, const unsigned int nrChannelsPerTree, AstroData::Observation & observation, const ActiveChannels & activeChannels, const std::vector<unsigned int> & beamMapping, const std::vector< I > & input, std::vector< O > & output, const DelayTable & delays, const unsigned int padding, const uint8_t inputBits, const OutputScaling & scaling)
+{
+  if ( (nrChannelsPerTree == 0) || ((nrChannelsPerTree & (nrChannelsPerTree - 1)) != 0) )
+  {
+    throw std::invalid_argument("The number of channels per tree must be a power of 2.");
+  }
+  if ( !isOutputType< O >(scaling.getFormat()) )
+  {
+    throw std::invalid_argument("The output type does not match the output format.");
+  }
+  if ( !isIntermediateTypeLargeEnough< L >(observation, inputBits) )
+  {
+    throw std::invalid_argument("The intermediate type is too small for the number of channels and the input bits.");
+  }
+
+  const unsigned int nrSamples = observation.getNrSamplesPerBatch() / observation.getDownsampling();
+  const unsigned int nrSamplesPadded = isa::utils::pad(nrSamples, padding / sizeof(O));
+  unsigned int nrSamplesPerChannel = 0;
+  if ( inputBits >= 8 )
+  {
+    nrSamplesPerChannel = isa::utils::pad(observation.getNrSamplesPerDispersedBatch(), padding / sizeof(I));
+  }
+  else
+  {
+    nrSamplesPerChannel = isa::utils::pad(observation.getNrSamplesPerDispersedBatch() / (8 / inputBits), padding / sizeof(I));
+  }
+  const unsigned int nrTrees = (observation.getNrChannels() + nrChannelsPerTree - 1) / nrChannelsPerTree;
+  unsigned int nrStages = 0;
+  while ( (1u << nrStages) < nrChannelsPerTree )
+  {
+    nrStages++;
+  }
+
+  // Number of sweeps and samples computed by every stage of every tree; stage 0 contains the channels
+  std::vector< std::vector< unsigned int > > nrSweeps(nrTrees, std::vector< unsigned int >(nrStages + 1));
+  std::vector< std::vector< unsigned int > > nrStageSamples(nrTrees, std::vector< unsigned int >(nrStages + 1));
+  for ( unsigned int tree = 0; tree < nrTrees; tree++ )
+  {
+    unsigned int maxSweep = 0;
+    unsigned int maxOffset = 0;
+
+    for ( unsigned int dm = 0; dm < observation.getNrDMs(); dm++ )
+    {
+      maxSweep = std::max(maxSweep, getTreeSweep(delays, dm, tree, nrChannelsPerTree));
+      maxOffset = std::max(maxOffset, delays.getDelay(dm, observation.getNrChannels() - 1 - (tree * nrChannelsPerTree)));
+    }
+    nrSweeps[tree][nrStages] = maxSweep + 1;
+    nrStageSamples[tree][nrStages] = nrSamples + maxOffset;
+    for ( unsigned int stage = nrStages; stage > 0; stage-- )
+    {
+      const unsigned int nrHalfChannels = 1 << (stage - 1);
+
+      nrSweeps[tree][stage - 1] = getTreeInnerSweep(nrHalfChannels, nrSweeps[tree][stage] - 1) + 1;
+      nrStageSamples[tree][stage - 1] = nrStageSamples[tree][stage] + getTreeOffset(nrHalfChannels, nrSweeps[tree][stage] - 1);
+    }
+  }
+  // First node of each tree at every stage, a node being one sweep of one group of channels
+  std::vector< std::vector< unsigned int > > firstNode(nrStages + 1, std::vector< unsigned int >(nrTrees + 1));
+  for ( unsigned int stage = 0; stage <= nrStages; stage++ )
+  {
+    for ( unsigned int tree = 0; tree < nrTrees; tree++ )
+    {
+      firstNode[stage][tree + 1] = firstNode[stage][tree] + ((nrChannelsPerTree >> stage) * nrSweeps[tree][stage]);
+    }
+  }
+  std::vector< std::vector< L > > previous(nrTrees);
+  std::vector< std::vector< L > > current(nrTrees);
+  const unsigned int nrSamplesPerChunk = std::min(nrSamples, 2048u);
+  const unsigned int nrChunks = (nrSamples + nrSamplesPerChunk - 1) / nrSamplesPerChunk;
+  std::vector< std::vector< L > > accumulators(pool.getNrThreads(), std::vector< L >(nrSamplesPerChunk));
+
+  for ( unsigned int sBeam = 0; sBeam < observation.getNrSynthesizedBeams(); sBeam++ )
+  {
+    // Stage 0: copy the channels of the beam, zapped channels and samples after the end of the batch are 0
+    for ( unsigned int tree = 0; tree < nrTrees; tree++ )
+    {
+      current[tree].resize(nrChannelsPerTree * nrStageSamples[tree][0]);
+    }
+    pool.parallelFor(nrTrees * nrChannelsPerTree, [&](const unsigned int item, const unsigned int)
+    {
+      const unsigned int tree = item / nrChannelsPerTree;
+      const unsigned int position = item % nrChannelsPerTree;
+      const unsigned int nrChannelSamples = nrStageSamples[tree][0];
+      L * row = current[tree].data() + (position * nrChannelSamples);
+
+      std::fill(row, row + nrChannelSamples, static_cast< L >(0));
+      if ( (tree * nrChannelsPerTree) + position >= observation.getNrChannels() )
+      {
+        return;
+      }
+      const unsigned int channel = observation.getNrChannels() - 1 - ((tree * nrChannelsPerTree) + position);
+      if ( !activeChannels.isActive(sBeam, channel) )
+      {
+        return;
+      }
+      const I * channelData = input.data() + (beamMapping[(sBeam * observation.getNrChannels(padding / sizeof(unsigned int))) + channel] * observation.getNrChannels() * nrSamplesPerChannel) + (channel * nrSamplesPerChannel);
+      const unsigned int nrInputSamples = std::min(nrChannelSamples, observation.getNrSamplesPerDispersedBatch());
+      if ( inputBits >= 8 )
+      {
+        accumulate(channelData, row, nrInputSamples);
+      }
+      else
+      {
+        accumulatePacked(channelData, 0, row, nrInputSamples, inputBits);
+      }
+    });
+    // Stage s: groups of 2^s channels, each the sum of two groups of the previous stage
+    for ( unsigned int stage = 1; stage <= nrStages; stage++ )
+    {
+      const unsigned int nrHalfChannels = 1 << (stage - 1);
+
+      std::swap(previous, current);
+      for ( unsigned int tree = 0; tree < nrTrees; tree++ )
+      {
+        current[tree].resize((nrChannelsPerTree >> stage) * nrSweeps[tree][stage] * nrStageSamples[tree][stage]);
+      }
+      pool.parallelFor(firstNode[stage][nrTrees], [&](const unsigned int item, const unsigned int)
+      {
+        const unsigned int tree = std::upper_bound(firstNode[stage].begin(), firstNode[stage].end(), item) - firstNode[stage].begin() - 1;
+        const unsigned int group = (item - firstNode[stage][tree]) / nrSweeps[tree][stage];
+        const unsigned int sweep = (item - firstNode[stage][tree]) % nrSweeps[tree][stage];
+        const unsigned int innerSweep = getTreeInnerSweep(nrHalfChannels, sweep);
+        const unsigned int offset = getTreeOffset(nrHalfChannels, sweep);
+        const unsigned int nrPreviousSamples = nrStageSamples[tree][stage - 1];
+        const L * high = previous[tree].data() + ((((2 * group) * nrSweeps[tree][stage - 1]) + innerSweep) * nrPreviousSamples);
+        const L * low = previous[tree].data() + (((((2 * group) + 1) * nrSweeps[tree][stage - 1]) + innerSweep) * nrPreviousSamples) + offset;
+        L * sum = current[tree].data() + (((group * nrSweeps[tree][stage]) + sweep) * nrStageSamples[tree][stage]);
+
+        for ( unsigned int sample = 0; sample < nrStageSamples[tree][stage]; sample++ )
+        {
+          sum[sample] = high[sample] + low[sample];
+        }
+      });
+    }
+    // Add the trees with the sweep and delay of each DM, in chunks of samples that fit in cache
+    pool.parallelFor(observation.getNrDMs() * nrChunks, [&](const unsigned int item, const unsigned int thread)
+    {
+      const unsigned int dm = item / nrChunks;
+      const unsigned int firstSample = (item % nrChunks) * nrSamplesPerChunk;
+      const unsigned int nrChunkSamples = std::min(firstSample + nrSamplesPerChunk, nrSamples) - firstSample;
+      L * accumulator = accumulators[thread].data();
+
+      std::fill(accumulator, accumulator + nrChunkSamples, static_cast< L >(0));
+      for ( unsigned int tree = 0; tree < nrTrees; tree++ )
+      {
+        const unsigned int sweep = getTreeSweep(delays, dm, tree, nrChannelsPerTree);
+        const unsigned int delay = delays.getDelay(dm, observation.getNrChannels() - 1 - (tree * nrChannelsPerTree));
+
+        accumulate(current[tree].data() + (sweep * nrStageSamples[tree][nrStages]) + delay + firstSample, accumulator, nrChunkSamples);
+      }
+      for ( unsigned int sample = 0; sample < nrChunkSamples; sample++ )
+      {
+        output[(sBeam * observation.getNrDMs() * nrSamplesPadded) + (dm * nrSamplesPadded) + firstSample + sample] = convertOutput< L, O >(accumulator[sample], scaling.getFormat(), scaling.getOffset(sBeam, dm), scaling.getScale(sBeam, dm));
+      }
+    });
+  }
+}
+
+} // Dedispersion
+
@@ -0,0 +1,78 @@
+// Copyright 2017 Netherlands Institute for Radio Astronomy (ASTRON)
+// Copyright 2017 Netherlands eScience Center
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdint>
+
+
+#pragma once
+
+namespace Dedispersion {
+
+// Input with less than 8 bits per sample: sample s of a channel is stored in byte s / (8 / inputBits), starting from bit (s % (8 / inputBits)) * inputBits.
+// Unpacked samples are not sign-extended, so their value is between 0 and (2^inputBits) - 1.
+
+// Expand nrSamples samples of a packed channel, starting at firstSample, to one sample per element
+template< typename I > void unpack(const I * channel, const unsigned int firstSample, I * samples, const unsigned int nrSamples, const uint8_t inputBits);
+// Value of one sample of a packed channel
+template< typename I > I getPackedSample(const I * channel, const unsigned int sample, const uint8_t inputBits);
+// Table with the samples contained in each of the 256 values of a byte, 8 entries per value, for 1, 2 or 4 bits per sample
+const uint8_t * getUnpackTable(const uint8_t inputBits);
+// Expand nrBytes complete bytes of 1, 2 or 4 bit samples; vectorized with SSE2 where available, the remaining bytes use the table
+void unpackBytes(const uint8_t * bytes, uint8_t * samples, const unsigned int nrBytes, const uint8_t inputBits);
+
+
+// Implementations
+template< typename I > inline I getPackedSample(const I * channel, const unsigned int sample, const uint8_t inputBits)
+{
+  const unsigned int byte = sample / (8 / inputBits);
+  const uint8_t firstBit = (sample % (8 / inputBits)) * inputBits;
+
+  return static_cast< I >((static_cast< uint8_t >(channel[byte]) >> firstBit) & ((1 << inputBits) - 1));
+}
+
+template< typename I > void unpack(const I * channel, const unsigned int firstSample, I * samples, const unsigned int nrSamples, const uint8_t inputBits)
+{
+  const unsigned int nrSamplesPerByte = 8 / inputBits;
+  unsigned int sample = 0;
+
+  // Samples before the first complete byte
+  for ( ; (sample < nrSamples) && (((firstSample + sample) % nrSamplesPerByte) != 0); sample++ )
+  {
+    samples[sample] = getPackedSample(channel, firstSample + sample, inputBits);
+  }
+  // Complete bytes
+  const unsigned int nrBytes = (nrSamples - sample) / nrSamplesPerByte;
+  const I * bytes = channel + ((firstSample + sample) / nrSamplesPerByte);
+  if ( (sizeof(I) == 1) && ((inputBits == 1) || (inputBits == 2) || (inputBits == 4)) )
+  {
+    unpackBytes(reinterpret_cast< const uint8_t * >(bytes), reinterpret_cast< uint8_t * >(samples + sample), nrBytes, inputBits);
+  }
+  else
+  {
+    for ( unsigned int item = 0; item < nrBytes * nrSamplesPerByte; item++ )
+    {
+      samples[sample + item] = getPackedSample(channel, firstSample + sample + item, inputBits);
+    }
+  }
+  sample += nrBytes * nrSamplesPerByte;
+  // Samples after the last complete byte
+  for ( ; sample < nrSamples; sample++ )
+  {
+    samples[sample] = getPackedSample(channel, firstSample + sample, inputBits);
+  }
+}
+
+} // Dedispersion
+
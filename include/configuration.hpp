@@ -9,6 +9,7 @@
 typedef uint8_t inputDataType;
 const std::string inputDataName("uchar");
 const uint8_t inputBits = 8;
+// With 8 bit input, the intermediate type can also be uint16_t ("ushort") or uint32_t ("uint"), if it holds the sum of all channels
 typedef float intermediateDataType;
 const std::string intermediateDataName("float");
 typedef float outputDataType;
@@ -0,0 +1,422 @@
+// Copyright 2017 Netherlands Institute for Radio Astronomy (ASTRON)
+// Copyright 2017 Netherlands eScience Center
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstring>
+
+#include <Accumulate.hpp>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DEDISPERSION_X86
+#endif
+
+namespace Dedispersion {
+
+namespace {
+
+template< typename L > struct AccumulateUChar {
+  void (* single)(const uint8_t *, L *, const unsigned int);
+  void (* rows)(const uint8_t * const *, const unsigned int, L *, const unsigned int);
+  std::string instructionSet;
+};
+
+template< typename L > void accumulateUCharScalar(const uint8_t * input, L * accumulator, const unsigned int nrSamples) {
+  for ( unsigned int sample = 0; sample < nrSamples; sample++ ) {
+    accumulator[sample] += static_cast< L >(input[sample]);
+  }
+}
+
+template< typename L > void accumulateRowsUCharRange(const uint8_t * const * rows, const unsigned int nrRows, L * accumulator, const unsigned int firstSample, const unsigned int lastSample) {
+  for ( unsigned int sample = firstSample; sample < lastSample; sample++ ) {
+    L value = accumulator[sample];
+
+    for ( unsigned int row = 0; row < nrRows; row++ ) {
+      value += static_cast< L >(rows[row][sample]);
+    }
+    accumulator[sample] = value;
+  }
+}
+
+template< typename L > void accumulateRowsUCharScalar(const uint8_t * const * rows, const unsigned int nrRows, L * accumulator, const unsigned int nrSamples) {
+  accumulateRowsUCharRange(rows, nrRows, accumulator, 0, nrSamples);
+}
+
+// A single run is added as a set of one row
+template< typename L, void (* accumulateRowsUChar)(const uint8_t * const *, const unsigned int, L *, const unsigned int) > void accumulateUCharAsRow(const uint8_t * input, L * accumulator, const unsigned int nrSamples) {
+  accumulateRowsUChar(&input, 1, accumulator, nrSamples);
+}
+
+#ifdef DEDISPERSION_X86
+// The conversion from 8 bit integers to float is exact, and every accumulator receives a single add,
+// so the vectorized versions produce the same result as the scalar one.
+// The AVX-512 conversions use the zero-masked form only to avoid spurious uninitialized warnings from the compiler headers.
+__attribute__((target("sse4.1"))) void accumulateUCharFloatSSE(const uint8_t * input, float * accumulator, const unsigned int nrSamples) {
+  unsigned int sample = 0;
+
+  for ( ; sample + 4 <= nrSamples; sample += 4 ) {
+    int32_t packed = 0;
+    std::memcpy(&packed, input + sample, sizeof(int32_t));
+    __m128 values = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed)));
+    _mm_storeu_ps(accumulator + sample, _mm_add_ps(_mm_loadu_ps(accumulator + sample), values));
+  }
+  accumulateUCharScalar(input + sample, accumulator + sample, nrSamples - sample);
+}
+
+__attribute__((target("avx2"))) void accumulateUCharFloatAVX2(const uint8_t * input, float * accumulator, const unsigned int nrSamples) {
+  unsigned int sample = 0;
+
+  for ( ; sample + 32 <= nrSamples; sample += 32 ) {
+    for ( unsigned int item = 0; item < 32; item += 8 ) {
+      __m256 values = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast< const __m128i * >(input + sample + item))));
+      _mm256_storeu_ps(accumulator + sample + item, _mm256_add_ps(_mm256_loadu_ps(accumulator + sample + item), values));
+    }
+  }
+  for ( ; sample + 8 <= nrSamples; sample += 8 ) {
+    __m256 values = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast< const __m128i * >(input + sample))));
+    _mm256_storeu_ps(accumulator + sample, _mm256_add_ps(_mm256_loadu_ps(accumulator + sample), values));
+  }
+  accumulateUCharScalar(input + sample, accumulator + sample, nrSamples - sample);
+}
+
+__attribute__((target("avx512f"))) void accumulateUCharFloatAVX512(const uint8_t * input, float * accumulator, const unsigned int nrSamples) {
+  unsigned int sample = 0;
+
+  for ( ; sample + 64 <= nrSamples; sample += 64 ) {
+    for ( unsigned int item = 0; item < 64; item += 16 ) {
+      __m512 values = _mm512_maskz_cvtepi32_ps(0xFFFF, _mm512_maskz_cvtepu8_epi32(0xFFFF, _mm_loadu_si128(reinterpret_cast< const __m128i * >(input + sample + item))));
+      _mm512_storeu_ps(accumulator + sample + item, _mm512_add_ps(_mm512_loadu_ps(accumulator + sample + item), values));
+    }
+  }
+  for ( ; sample + 16 <= nrSamples; sample += 16 ) {
+    __m512 values = _mm512_maskz_cvtepi32_ps(0xFFFF, _mm512_maskz_cvtepu8_epi32(0xFFFF, _mm_loadu_si128(reinterpret_cast< const __m128i * >(input + sample))));
+    _mm512_storeu_ps(accumulator + sample, _mm512_add_ps(_mm512_loadu_ps(accumulator + sample), values));
+  }
+  accumulateUCharScalar(input + sample, accumulator + sample, nrSamples - sample);
+}
+
+__attribute__((target("sse4.1"))) void accumulateRowsUCharFloatSSE(const uint8_t * const * rows, const unsigned int nrRows, float * accumulator, const unsigned int nrSamples) {
+  unsigned int sample = 0;
+
+  for ( ; sample + 4 <= nrSamples; sample += 4 ) {
+    __m128 sums = _mm_loadu_ps(accumulator + sample);
+
+    for ( unsigned int row = 0; row < nrRows; row++ ) {
+      int32_t packed = 0;
+      std::memcpy(&packed, rows[row] + sample, sizeof(int32_t));
+      sums = _mm_add_ps(sums, _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed))));
+    }
+    _mm_storeu_ps(accumulator + sample, sums);
+  }
+  accumulateRowsUCharRange(rows, nrRows, accumulator, sample, nrSamples);
+}
+
+__attribute__((target("avx2"))) void accumulateRowsUCharFloatAVX2(const uint8_t * const * rows, const unsigned int nrRows, float * accumulator, const unsigned int nrSamples) {
+  unsigned int sample = 0;
+
+  for ( ; sample + 32 <= nrSamples; sample += 32 ) {
+    __m256 sums[4];
+
+    for ( unsigned int item = 0; item < 4; item++ ) {
+      sums[item] = _mm256_loadu_ps(accumulator + sample + (item * 8));
+    }
+    for ( unsigned int row = 0; row < nrRows; row++ ) {
+      for ( unsigned int item = 0; item < 4; item++ ) {
+        sums[item] = _mm256_add_ps(sums[item], _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast< const __m128i * >(rows[row] + sample + (item * 8))))));
+      }
+    }
+    for ( unsigned int item = 0; item < 4; item++ ) {
+      _mm256_storeu_ps(accumulator + sample + (item * 8), sums[item]);
+    }
+  }
+  for ( ; sample + 8 <= nrSamples; sample += 8 ) {
+    __m256 sums = _mm256_loadu_ps(accumulator + sample);
+
+    for ( unsigned int row = 0; row < nrRows; row++ ) {
+      sums = _mm256_add_ps(sums, _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast< const __m128i * >(rows[row] + sample)))));
+    }
+    _mm256_storeu_ps(accumulator + sample, sums);
+  }
+  accumulateRowsUCharRange(rows, nrRows, accumulator, sample, nrSamples);
+}
+
+__attribute__((target("avx512f"))) void accumulateRowsUCharFloatAVX512(const uint8_t * const * rows, const unsigned int nrRows, float * accumulator, const unsigned int nrSamples) {
+  unsigned int sample = 0;
+
+  for ( ; sample + 64 <= nrSamples; sample += 64 ) {
+    __m512 sums[4];
+
+    for ( unsigned int item = 0; item < 4; item++ ) {
+      sums[item] = _mm512_loadu_ps(accumulator + sample + (item * 16));
+    }
+    for ( unsigned int row = 0; row < nrRows; row++ ) {
+      for ( unsigned int item = 0; item < 4; item++ ) {
+        sums[item] = _mm512_add_ps(sums[item], _mm512_maskz_cvtepi32_ps(0xFFFF, _mm512_maskz_cvtepu8_epi32(0xFFFF, _mm_loadu_si128(reinterpret_cast< const __m128i * >(rows[row] + sample + (item * 16))))));
+      }
+    }
+    for ( unsigned int item = 0; item < 4; item++ ) {
+      _mm512_storeu_ps(accumulator + sample + (item * 16), sums[item]);
+    }
+  }
+  for ( ; sample + 16 <= nrSamples; sample += 16 ) {
+    __m512 sums = _mm512_loadu_ps(accumulator + sample);
+
+    for ( unsigned int row = 0; row < nrRows; row++ ) {
+      sums = _mm512_add_ps(sums, _mm512_maskz_cvtepi32_ps(0xFFFF, _mm512_maskz_cvtepu8_epi32(0xFFFF, _mm_loadu_si128(reinterpret_cast< const __m128i * >(rows[row] + sample)))));
+    }
+    _mm512_storeu_ps(accumulator + sample, sums);
+  }
+  accumulateRowsUCharRange(rows, nrRows, accumulator, sample, nrSamples);
+}
+
+// The integer versions wrap around in the same way as the scalar adds, so they also produce the same result.
+__attribute__((target("sse4.1"))) void accumulateRowsUCharUShortSSE(const uint8_t * const * rows, const unsigned int nrRows, uint16_t * accumulator, const unsigned int nrSamples) {
+  unsigned int sample = 0;
+
+  for ( ; sample + 8 <= nrSamples; sample += 8 ) {
+    __m128i sums = _mm_loadu_si128(reinterpret_cast< const __m128i * >(accumulator + sample));
+
+    for ( unsigned int row = 0; row < nrRows; row++ ) {
+      sums = _mm_add_epi16(sums, _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast< const __m128i * >(rows[row] + sample))));
+    }
+    _mm_storeu_si128(reinterpret_cast< __m128i * >(accumulator + sample), sums);
+  }
+  accumulateRowsUCharRange(rows, nrRows, accumulator, sample, nrSamples);
+}
+
+__attribute__((target("avx2"))) void accumulateRowsUCharUShortAVX2(const uint8_t * const * rows, const unsigned int nrRows, uint16_t * accumulator, const unsigned int nrSamples) {
+  unsigned int sample = 0;
+
+  for ( ; sample + 32 <= nrSamples; sample += 32 ) {
+    __m256i sums[2];
+
+    for ( unsigned int item = 0; item < 2; item++ ) {
+      sums[item] = _mm256_loadu_si256(reinterpret_cast< const __m256i * >(accumulator + sample + (item * 16)));
+    }
+    for ( unsigned int row = 0; row < nrRows; row++ ) {
+      for ( unsigned int item = 0; item < 2; item++ ) {
+        sums[item] = _mm256_add_epi16(sums[item], _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast< const __m128i * >(rows[row] + sample + (item * 16)))));
+      }
+    }
+    for ( unsigned int item = 0; item < 2; item++ ) {
+      _mm256_storeu_si256(reinterpret_cast< __m256i * >(accumulator + sample + (item * 16)), sums[item]);
+    }
+  }
+  for ( ; sample + 16 <= nrSamples; sample += 16 ) {
+    __m256i sums = _mm256_loadu_si256(reinterpret_cast< const __m256i * >(accumulator + sample));
+
+    for ( unsigned int row = 0; row < nrRows; row++ ) {
+      sums = _mm256_add_epi16(sums, _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast< const __m128i * >(rows[row] + sample))));
+    }
+    _mm256_storeu_si256(reinterpret_cast< __m256i * >(accumulator + sample), sums);
+  }
+  accumulateRowsUCharRange(rows, nrRows, accumulator, sample, nrSamples);
+}
+
+__attribute__((target("avx512bw"))) void accumulateRowsUCharUShortAVX512(const uint8_t * const * rows, const unsigned int nrRows, uint16_t * accumulator, const unsigned int nrSamples) {
+  unsigned int sample = 0;
+
+  for ( ; sample + 64 <= nrSamples; sample += 64 ) {
+    __m512i sums[2];
+
+    for ( unsigned int item = 0; item < 2; item++ ) {
+      sums[item] = _mm512_loadu_si512(accumulator + sample + (item * 32));
+    }
+    for ( unsigned int row = 0; row < nrRows; row++ ) {
+      for ( unsigned int item = 0; item < 2; item++ ) {
+        sums[item] = _mm512_add_epi16(sums[item], _mm512_cvtepu8_epi16(_mm256_loadu_si256(reinterpret_cast< const __m256i * >(rows[row] + sample + (item * 32)))));
+      }
+    }
+    for ( unsigned int item = 0; item < 2; item++ ) {
+      _mm512_storeu_si512(accumulator + sample + (item * 32), sums[item]);
+    }
+  }
+  for ( ; sample + 32 <= nrSamples; sample += 32 ) {
+    __m512i sums = _mm512_loadu_si512(accumulator + sample);
+
+    for ( unsigned int row = 0; row < nrRows; row++ ) {
+      sums = _mm512_add_epi16(sums, _mm512_cvtepu8_epi16(_mm256_loadu_si256(reinterpret_cast< const __m256i * >(rows[row] + sample))));
+    }
+    _mm512_storeu_si512(accumulator + sample, sums);
+  }
+  accumulateRowsUCharRange(rows, nrRows, accumulator, sample, nrSamples);
+}
+
+__attribute__((target("sse4.1"))) void accumulateRowsUCharUIntSSE(const uint8_t * const * rows, const unsigned int nrRows, uint32_t * accumulator, const unsigned int nrSamples) {
+  unsigned int sample = 0;
+
+  for ( ; sample + 4 <= nrSamples; sample += 4 ) {
+    __m128i sums = _mm_loadu_si128(reinterpret_cast< const __m128i * >(accumulator + sample));
+
+    for ( unsigned int row = 0; row < nrRows; row++ ) {
+      int32_t packed = 0;
+      std::memcpy(&packed, rows[row] + sample, sizeof(int32_t));
+      sums = _mm_add_epi32(sums, _mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed)));
+    }
+    _mm_storeu_si128(reinterpret_cast< __m128i * >(accumulator + sample), sums);
+  }
+  accumulateRowsUCharRange(rows, nrRows, accumulator, sample, nrSamples);
+}
+
+__attribute__((target("avx2"))) void accumulateRowsUCharUIntAVX2(const uint8_t * const * rows, const unsigned int nrRows, uint32_t * accumulator, const unsigned int nrSamples) {
+  unsigned int sample = 0;
+
+  for ( ; sample + 32 <= nrSamples; sample += 32 ) {
+    __m256i sums[4];
+
+    for ( unsigned int item = 0; item < 4; item++ ) {
+      sums[item] = _mm256_loadu_si256(reinterpret_cast< const __m256i * >(accumulator + sample + (item * 8)));
+    }
+    for ( unsigned int row = 0; row < nrRows; row++ ) {
+      for ( unsigned int item = 0; item < 4; item++ ) {
+        sums[item] = _mm256_add_epi32(sums[item], _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast< const __m128i * >(rows[row] + sample + (item * 8)))));
+      }
+    }
+    for ( unsigned int item = 0; item < 4; item++ ) {
+      _mm256_storeu_si256(reinterpret_cast< __m256i * >(accumulator + sample + (item * 8)), sums[item]);
+    }
+  }
+  for ( ; sample + 8 <= nrSamples; sample += 8 ) {
+    __m256i sums = _mm256_loadu_si256(reinterpret_cast< const __m256i * >(accumulator + sample));
+
+    for ( unsigned int row = 0; row < nrRows; row++ ) {
+      sums = _mm256_add_epi32(sums, _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast< const __m128i * >(rows[row] + sample))));
+    }
+    _mm256_storeu_si256(reinterpret_cast< __m256i * >(accumulator + sample), sums);
+  }
+  accumulateRowsUCharRange(rows, nrRows, accumulator, sample, nrSamples);
+}
+
+__attribute__((target("avx512f"))) void accumulateRowsUCharUIntAVX512(const uint8_t * const * rows, const unsigned int nrRows, uint32_t * accumulator, const unsigned int nrSamples) {
+  unsigned int sample = 0;
+
+  for ( ; sample + 64 <= nrSamples; sample += 64 ) {
+    __m512i sums[4];
+
+    for ( unsigned int item = 0; item < 4; item++ ) {
+      sums[item] = _mm512_loadu_si512(accumulator + sample + (item * 16));
+    }
+    for ( unsigned int row = 0; row < nrRows; row++ ) {
+      for ( unsigned int item = 0; item < 4; item++ ) {
+        sums[item] = _mm512_add_epi32(sums[item], _mm512_maskz_cvtepu8_epi32(0xFFFF, _mm_loadu_si128(reinterpret_cast< const __m128i * >(rows[row] + sample + (item * 16)))));
+      }
+    }
+    for ( unsigned int item = 0; item < 4; item++ ) {
+      _mm512_storeu_si512(accumulator + sample + (item * 16), sums[item]);
+    }
+  }
+  for ( ; sample + 16 <= nrSamples; sample += 16 ) {
+    __m512i sums = _mm512_loadu_si512(accumulator + sample);
+
+    for ( unsigned int row = 0; row < nrRows; row++ ) {
+      sums = _mm512_add_epi32(sums, _mm512_maskz_cvtepu8_epi32(0xFFFF, _mm_loadu_si128(reinterpret_cast< const __m128i * >(rows[row] + sample))));
+    }
+    _mm512_storeu_si512(accumulator + sample, sums);
+  }
+  accumulateRowsUCharRange(rows, nrRows, accumulator, sample, nrSamples);
+}
+#endif
+
+AccumulateUChar< float > selectAccumulateUCharFloat() {
+#ifdef DEDISPERSION_X86
+  __builtin_cpu_init();
+  if ( __builtin_cpu_supports("avx512f") ) {
+    return AccumulateUChar< float >{accumulateUCharFloatAVX512, accumulateRowsUCharFloatAVX512, "avx512"};
+  } else if ( __builtin_cpu_supports("avx2") ) {
+    return AccumulateUChar< float >{accumulateUCharFloatAVX2, accumulateRowsUCharFloatAVX2, "avx2"};
+  } else if ( __builtin_cpu_supports("sse4.1") ) {
+    return AccumulateUChar< float >{accumulateUCharFloatSSE, accumulateRowsUCharFloatSSE, "sse4.1"};
+  }
+#endif
+  return AccumulateUChar< float >{accumulateUCharScalar< float >, accumulateRowsUCharScalar< float >, "scalar"};
+}
+
+AccumulateUChar< uint16_t > selectAccumulateUCharUShort() {
+#ifdef DEDISPERSION_X86
+  __builtin_cpu_init();
+  if ( __builtin_cpu_supports("avx512bw") ) {
+    return AccumulateUChar< uint16_t >{accumulateUCharAsRow< uint16_t, accumulateRowsUCharUShortAVX512 >, accumulateRowsUCharUShortAVX512, "avx512"};
+  } else if ( __builtin_cpu_supports("avx2") ) {
+    return AccumulateUChar< uint16_t >{accumulateUCharAsRow< uint16_t, accumulateRowsUCharUShortAVX2 >, accumulateRowsUCharUShortAVX2, "avx2"};
+  } else if ( __builtin_cpu_supports("sse4.1") ) {
+    return AccumulateUChar< uint16_t >{accumulateUCharAsRow< uint16_t, accumulateRowsUCharUShortSSE >, accumulateRowsUCharUShortSSE, "sse4.1"};
+  }
+#endif
+  return AccumulateUChar< uint16_t >{accumulateUCharScalar< uint16_t >, accumulateRowsUCharScalar< uint16_t >, "scalar"};
+}
+
+AccumulateUChar< uint32_t > selectAccumulateUCharUInt() {
+#ifdef DEDISPERSION_X86
+  __builtin_cpu_init();
+  if ( __builtin_cpu_supports("avx512f") ) {
+    return AccumulateUChar< uint32_t >{accumulateUCharAsRow< uint32_t, accumulateRowsUCharUIntAVX512 >, accumulateRowsUCharUIntAVX512, "avx512"};
+  } else if ( __builtin_cpu_supports("avx2") ) {
+    return AccumulateUChar< uint32_t >{accumulateUCharAsRow< uint32_t, accumulateRowsUCharUIntAVX2 >, accumulateRowsUCharUIntAVX2, "avx2"};
+  } else if ( __builtin_cpu_supports("sse4.1") ) {
+    return AccumulateUChar< uint32_t >{accumulateUCharAsRow< uint32_t, accumulateRowsUCharUIntSSE >, accumulateRowsUCharUIntSSE, "sse4.1"};
+  }
+#endif
+  return AccumulateUChar< uint32_t >{accumulateUCharScalar< uint32_t >, accumulateRowsUCharScalar< uint32_t >, "scalar"};
+}
+
+const AccumulateUChar< float > & getAccumulateUCharFloat() {
+  static const AccumulateUChar< float > functions = selectAccumulateUCharFloat();
+
+  return functions;
+}
+
+const AccumulateUChar< uint16_t > & getAccumulateUCharUShort() {
+  static const AccumulateUChar< uint16_t > functions = selectAccumulateUCharUShort();
+
+  return functions;
+}
+
+const AccumulateUChar< uint32_t > & getAccumulateUCharUInt() {
+  static const AccumulateUChar< uint32_t > functions = selectAccumulateUCharUInt();
+
+  return functions;
+}
+
+} // namespace
+
+template<> void accumulate< uint8_t, float >(const uint8_t * input, float * accumulator, const unsigned int nrSamples) {
+  getAccumulateUCharFloat().single(input, accumulator, nrSamples);
+}
+
+template<> void accumulateRows< uint8_t, float >(const uint8_t * const * rows, const unsigned int nrRows, float * accumulator, const unsigned int nrSamples) {
+  getAccumulateUCharFloat().rows(rows, nrRows, accumulator, nrSamples);
+}
+
+template<> void accumulate< uint8_t, uint16_t >(const uint8_t * input, uint16_t * accumulator, const unsigned int nrSamples) {
+  getAccumulateUCharUShort().single(input, accumulator, nrSamples);
+}
+
+template<> void accumulateRows< uint8_t, uint16_t >(const uint8_t * const * rows, const unsigned int nrRows, uint16_t * accumulator, const unsigned int nrSamples) {
+  getAccumulateUCharUShort().rows(rows, nrRows, accumulator, nrSamples);
+}
+
+template<> void accumulate< uint8_t, uint32_t >(const uint8_t * input, uint32_t * accumulator, const unsigned int nrSamples) {
+  getAccumulateUCharUInt().single(input, accumulator, nrSamples);
+}
+
+template<> void accumulateRows< uint8_t, uint32_t >(const uint8_t * const * rows, const unsigned int nrRows, uint32_t * accumulator, const unsigned int nrSamples) {
+  getAccumulateUCharUInt().rows(rows, nrRows, accumulator, nrSamples);
+}
+
+std::string getAccumulateInstructionSet() {
+  return getAccumulateUCharFloat().instructionSet;
+}
+
+} // Dedispersion
+
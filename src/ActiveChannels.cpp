@@ -0,0 +1,77 @@
+// Copyright 2017 Netherlands Institute for Radio Astronomy (ASTRON)
+// Copyright 2017 Netherlands eScience Center
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+
+#include <ActiveChannels.hpp>
+
+namespace Dedispersion {
+
+ActiveChannels::ActiveChannels(const AstroData::Observation & observation, const std::vector< unsigned int > & zappedChannels, const unsigned int padding, const bool perBeam) : nrChannels(observation.getNrChannels()), nrSubbands(observation.getNrSubbands()) {
+  const unsigned int nrPaddedChannels = observation.getNrChannels(padding / sizeof(unsigned int));
+  std::vector< bool > active(nrChannels);
+
+  rowLength = getActiveChannelsRowLength(observation, padding);
+  rows.resize(observation.getNrBeams() * rowLength);
+  for ( unsigned int beam = 0; beam < observation.getNrBeams(); beam++ ) {
+    const unsigned int * mask = zappedChannels.data() + (perBeam ? beam * nrPaddedChannels : 0);
+
+    for ( unsigned int channel = 0; channel < nrChannels; channel++ ) {
+      active[channel] = mask[channel] == 0;
+    }
+    compact(beam, active);
+  }
+}
+
+ActiveChannels::ActiveChannels(const AstroData::Observation & observation, const ActiveChannels & beams, const std::vector< unsigned int > & beamMapping, const unsigned int padding) : nrChannels(beams.nrChannels), nrSubbands(beams.nrSubbands), rowLength(beams.rowLength) {
+  std::vector< bool > active(nrChannels);
+
+  rows.resize(observation.getNrSynthesizedBeams() * rowLength);
+  for ( unsigned int sBeam = 0; sBeam < observation.getNrSynthesizedBeams(); sBeam++ ) {
+    for ( unsigned int channel = 0; channel < nrChannels; channel++ ) {
+      active[channel] = beams.isActive(beamMapping[(sBeam * observation.getNrChannels(padding / sizeof(unsigned int))) + channel], channel);
+    }
+    compact(sBeam, active);
+  }
+}
+
+ActiveChannels::~ActiveChannels() {}
+
+bool ActiveChannels::isActive(const unsigned int beam, const unsigned int channel) const {
+  const unsigned int * channels = getChannels(beam);
+
+  return std::binary_search(channels, channels + getNrActiveChannels(beam), channel);
+}
+
+void ActiveChannels::compact(const unsigned int beam, const std::vector< bool > & active) {
+  unsigned int * offsets = rows.data() + (beam * rowLength);
+  unsigned int * channels = offsets + nrSubbands + 1;
+  const unsigned int nrChannelsPerSubband = nrChannels / nrSubbands;
+  unsigned int nrActiveChannels = 0;
+
+  for ( unsigned int channel = 0; channel < nrChannels; channel++ ) {
+    if ( ((channel % nrChannelsPerSubband) == 0) && ((channel / nrChannelsPerSubband) < nrSubbands) ) {
+      offsets[channel / nrChannelsPerSubband] = nrActiveChannels;
+    }
+    if ( active[channel] ) {
+      channels[nrActiveChannels] = channel;
+      nrActiveChannels++;
+    }
+  }
+  offsets[nrSubbands] = nrActiveChannels;
+}
+
+} // Dedispersion
+
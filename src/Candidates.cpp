@@ -0,0 +1,82 @@
+// Copyright 2017 Netherlands Institute for Radio Astronomy (ASTRON)
+// Copyright 2017 Netherlands eScience Center
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdexcept>
+
+#include <Candidates.hpp>
+
+namespace Dedispersion {
+
+BoxcarSearch::BoxcarSearch(const std::vector< unsigned int > & widths, const float threshold, const unsigned int nrSynthesizedBeams, const unsigned int nrDMs, const unsigned int nrSamplesPerWindow) : widths(widths), maxWidth(0), threshold(threshold), nrDMs(nrDMs), nrSamplesPerWindow(nrSamplesPerWindow), means(nrSynthesizedBeams * nrDMs, 0.0f), standardDeviations(nrSynthesizedBeams * nrDMs, 1.0f) {
+  if ( widths.empty() ) {
+    throw std::invalid_argument("The boxcar search needs at least one width.");
+  }
+  if ( nrSamplesPerWindow == 0 ) {
+    throw std::invalid_argument("The window of the candidates must be at least one sample.");
+  }
+  for ( auto width : widths ) {
+    if ( width == 0 ) {
+      throw std::invalid_argument("The width of a boxcar must be at least one sample.");
+    }
+    maxWidth = std::max(maxWidth, width);
+  }
+}
+
+BoxcarSearch::~BoxcarSearch() {}
+
+void BoxcarSearch::setNoise(const unsigned int sBeam, const unsigned int dm, const float mean, const float standardDeviation) {
+  means[(sBeam * nrDMs) + dm] = mean;
+  standardDeviations[(sBeam * nrDMs) + dm] = standardDeviation;
+}
+
+void BoxcarSearch::setNoise(const Statistics & statistics) {
+  if ( (statistics.getNrDMs() != nrDMs) || (statistics.getPartials().size() != means.size() * statistics.getNrPartials() * 2) ) {
+    throw std::invalid_argument("The statistics do not have the synthesized beams and DMs of the boxcar search.");
+  }
+  for ( unsigned int row = 0; row < means.size(); row++ ) {
+    means[row] = statistics.getMean(row / nrDMs, row % nrDMs);
+    standardDeviations[row] = statistics.getStandardDeviation(row / nrDMs, row % nrDMs);
+  }
+}
+
+void mergeCandidates(std::vector< std::vector< Candidate > > & threadCandidates, std::vector< Candidate > & candidates, const unsigned int nrSamplesPerWindow) {
+  unsigned int nrCandidates = 0;
+
+  candidates.clear();
+  for ( auto & thread : threadCandidates ) {
+    candidates.insert(candidates.end(), thread.begin(), thread.end());
+    thread.clear();
+  }
+  std::sort(candidates.begin(), candidates.end(), [](const Candidate & first, const Candidate & second) {
+    if ( first.sBeam != second.sBeam ) {
+      return first.sBeam < second.sBeam;
+    } else if ( first.dm != second.dm ) {
+      return first.dm < second.dm;
+    }
+    return first.sample < second.sample;
+  });
+  // A window crossing more tiles has a candidate from each of them
+  for ( unsigned int candidate = 0; candidate < candidates.size(); candidate++ ) {
+    if ( (nrCandidates == 0) || !isSameWindow(candidates[nrCandidates - 1], candidates[candidate], nrSamplesPerWindow) ) {
+      candidates[nrCandidates++] = candidates[candidate];
+    } else if ( candidates[candidate].snr > candidates[nrCandidates - 1].snr ) {
+      candidates[nrCandidates - 1] = candidates[candidate];
+    }
+  }
+  candidates.resize(nrCandidates);
+}
+
+} // Dedispersion
+
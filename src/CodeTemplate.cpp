@@ -0,0 +1,82 @@
+// Copyright 2017 Netherlands Institute for Radio Astronomy (ASTRON)
+// Copyright 2017 Netherlands eScience Center
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+
+#include <CodeTemplate.hpp>
+
+namespace Dedispersion {
+
+CodeTemplate::CodeTemplate(const std::string & code, const std::vector< std::string > & placeholders, const std::vector< std::string > & offsets) {
+  const std::string plus = " + ";
+  std::string text;
+  size_t position = 0;
+
+  while ( position < code.size() ) {
+    size_t next = code.find("<%", position);
+
+    if ( next == std::string::npos ) {
+      break;
+    }
+    text.append(code, position, next - position);
+    position = next;
+    // A "<%" that does not begin a placeholder is text, and the search continues after its first character
+    int placeholder = -1;
+    for ( unsigned int item = 0; item < placeholders.size(); item++ ) {
+      if ( code.compare(next + 2, placeholders[item].size() + 2, placeholders[item] + "%>") == 0 ) {
+        placeholder = item;
+        break;
+      }
+    }
+    if ( placeholder < 0 ) {
+      text.push_back(code[position]);
+      position++;
+      continue;
+    }
+    Segment segment = {std::string(), placeholder, false};
+    if ( (std::find(offsets.begin(), offsets.end(), placeholders[placeholder]) != offsets.end()) && (text.size() >= plus.size()) && (text.compare(text.size() - plus.size(), plus.size(), plus) == 0) ) {
+      text.erase(text.size() - plus.size());
+      segment.offset = true;
+    }
+    segment.text.swap(text);
+    segments.push_back(segment);
+    position += placeholders[placeholder].size() + 4;
+  }
+  text.append(code, std::min(position, code.size()), std::string::npos);
+  segments.push_back({text, -1, false});
+}
+
+CodeTemplate::~CodeTemplate() {}
+
+void CodeTemplate::expand(std::string & output, const std::vector< std::string > & values) const {
+  for ( const auto & segment : segments ) {
+    output.append(segment.text);
+    if ( segment.placeholder < 0 ) {
+      continue;
+    }
+    const std::string & value = values[segment.placeholder];
+
+    if ( segment.offset ) {
+      if ( value == "0" ) {
+        continue;
+      }
+      output.append(" + ");
+    }
+    output.append(value);
+  }
+}
+
+} // Dedispersion
+
@@ -0,0 +1,50 @@
+// Copyright 2017 Netherlands Institute for Radio Astronomy (ASTRON)
+// Copyright 2017 Netherlands eScience Center
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <DMMaxima.hpp>
+
+namespace Dedispersion {
+
+DMMaxima::DMMaxima() : nrPartials(0), nrSamples(0) {}
+
+DMMaxima::DMMaxima(const DedispersionConf & conf, const AstroData::Observation & observation, const bool subbanding) : nrPartials(getNrDMMaximaPartials(conf, observation, subbanding)), nrSamples(observation.getNrSamplesPerBatch() / observation.getDownsampling()) {
+  partials.assign(observation.getNrSynthesizedBeams() * nrPartials * nrSamples, -std::numeric_limits< float >::infinity());
+  partialDMs.assign(observation.getNrSynthesizedBeams() * nrPartials * nrSamples, 0);
+}
+
+DMMaxima::~DMMaxima() {}
+
+float DMMaxima::getMaximum(const unsigned int sBeam, const unsigned int sample) const {
+  return partials[(((sBeam * nrPartials) + getMaximumPartial(sBeam, sample)) * nrSamples) + sample];
+}
+
+unsigned int DMMaxima::getDM(const unsigned int sBeam, const unsigned int sample) const {
+  return partialDMs[(((sBeam * nrPartials) + getMaximumPartial(sBeam, sample)) * nrSamples) + sample];
+}
+
+unsigned int DMMaxima::getMaximumPartial(const unsigned int sBeam, const unsigned int sample) const {
+  unsigned int maximumPartial = 0;
+
+  // The partials are in order of DM, so the first of equal maxima has the lowest DM
+  for ( unsigned int partial = 1; partial < nrPartials; partial++ ) {
+    if ( partials[(((sBeam * nrPartials) + partial) * nrSamples) + sample] > partials[(((sBeam * nrPartials) + maximumPartial) * nrSamples) + sample] ) {
+      maximumPartial = partial;
+    }
+  }
+  return maximumPartial;
+}
+
+} // Dedispersion
+
@@ -13,6 +13,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <CodeTemplate.hpp>
 #include <Dedispersion.hpp>
 
 namespace Dedispersion {
@@ -80,6 +81,14 @@ void readTunedDedispersionConf(tunedDedispersionConf & tunedDedispersion, const
   dedispersionFile.close();
 }
 
+unsigned int getNrInputBlocks(const AstroData::Observation & observation, const bool subbanding) {
+  return (observation.getNrSamplesPerDispersedBatch(subbanding) + observation.getNrSamplesPerBatch() - 1) / observation.getNrSamplesPerBatch();
+}
+
+uint64_t getMaxDedispersedValue(const AstroData::Observation & observation, const uint8_t inputBits) {
+  return static_cast< uint64_t >(observation.getNrChannels()) * observation.getDownsampling() * ((static_cast< uint64_t >(1) << inputBits) - 1);
+}
+
 DedispersionConf::DedispersionConf() : KernelConf(), splitBatches(false), local(false), unroll(1) {}
 
 DedispersionConf::~DedispersionConf() {}
@@ -88,5 +97,187 @@ std::string DedispersionConf::print() const {
   return std::to_string(splitBatches) + " " + std::to_string(local) + " " + std::to_string(unroll) + " " + isa::OpenCL::KernelConf::print();
 }
 
+std::string getStatisticsDefinitionsOpenCL(const DedispersionConf & conf) {
+  std::string code = "__local float statisticsBuffer[" + std::to_string(2 * conf.getNrItemsD1() * conf.getNrThreadsD1() * conf.getNrThreadsD0()) + "];\n";
+
+  for ( unsigned int dm = 0; dm < conf.getNrItemsD1(); dm++ ) {
+    code += "float statisticsSumDM" + std::to_string(dm) + " = 0.0f;\n"
+      "float statisticsSquaresDM" + std::to_string(dm) + " = 0.0f;\n";
+  }
+  return code;
+}
+
+std::string getStatisticsSumOpenCL(const std::string & intermediateDataType, const std::string & value) {
+  std::string floatValue = value;
+
+  if ( intermediateDataType != "float" ) {
+    floatValue = "convert_float(" + value + ")";
+  }
+  return "statisticsSumDM<%DM_NUM%> += " + floatValue + ";\n"
+    "statisticsSquaresDM<%DM_NUM%> += " + floatValue + " * " + floatValue + ";\n";
+}
+
+std::string getStatisticsStoreOpenCL(const DedispersionConf & conf, const std::string & row, const unsigned int nrPartials) {
+  std::string nrThreadsD0_s = std::to_string(conf.getNrThreadsD0());
+  std::string nrThreadsD1_s = std::to_string(conf.getNrThreadsD1());
+  std::string code;
+
+  // Every DM item is added by a different work-item of the row
+  for ( unsigned int dm = 0; dm < conf.getNrItemsD1(); dm++ ) {
+    std::string dm_s = std::to_string(dm);
+
+    code += "statisticsBuffer[((((" + std::to_string(dm * conf.getNrThreadsD1()) + " + get_local_id(1)) * " + nrThreadsD0_s + ") + get_local_id(0)) * 2)] = statisticsSumDM" + dm_s + ";\n"
+      "statisticsBuffer[((((" + std::to_string(dm * conf.getNrThreadsD1()) + " + get_local_id(1)) * " + nrThreadsD0_s + ") + get_local_id(0)) * 2) + 1] = statisticsSquaresDM" + dm_s + ";\n";
+  }
+  code += "barrier(CLK_LOCAL_MEM_FENCE);\n"
+    "for ( unsigned int dmItem = get_local_id(0); dmItem < " + std::to_string(conf.getNrItemsD1()) + "; dmItem += " + nrThreadsD0_s + " ) {\n"
+    "float statisticsSum = 0.0f;\n"
+    "float statisticsSquares = 0.0f;\n"
+    "for ( unsigned int item = 0; item < " + nrThreadsD0_s + "; item++ ) {\n"
+    "statisticsSum += statisticsBuffer[(((((dmItem * " + nrThreadsD1_s + ") + get_local_id(1)) * " + nrThreadsD0_s + ") + item) * 2)];\n"
+    "statisticsSquares += statisticsBuffer[(((((dmItem * " + nrThreadsD1_s + ") + get_local_id(1)) * " + nrThreadsD0_s + ") + item) * 2) + 1];\n"
+    "}\n"
+    "statistics[((((" + row + ") + (dmItem * " + nrThreadsD1_s + ")) * " + std::to_string(nrPartials) + ") + get_group_id(0)) * 2] = statisticsSum;\n"
+    "statistics[(((((" + row + ") + (dmItem * " + nrThreadsD1_s + ")) * " + std::to_string(nrPartials) + ") + get_group_id(0)) * 2) + 1] = statisticsSquares;\n"
+    "}\n";
+  return code;
+}
+
+std::string getDMMaximaDefinitionsOpenCL(const DedispersionConf & conf) {
+  std::string nrBufferItems_s = std::to_string(conf.getNrThreadsD1() * conf.getNrThreadsD0() * conf.getNrItemsD0());
+  std::string code = "__local float dmMaximaBuffer[" + nrBufferItems_s + "];\n"
+    "__local unsigned int dmMaximaDMsBuffer[" + nrBufferItems_s + "];\n";
+
+  for ( unsigned int sample = 0; sample < conf.getNrItemsD0(); sample++ ) {
+    code += "float dmMaximumSample" + std::to_string(sample) + " = -INFINITY;\n"
+      "unsigned int dmMaximumDMSample" + std::to_string(sample) + " = 0;\n";
+  }
+  return code;
+}
+
+std::string getDMMaximaCompareOpenCL(const std::string & intermediateDataType, const std::string & value, const std::string & dm) {
+  std::string floatValue = value;
+
+  if ( intermediateDataType != "float" ) {
+    floatValue = "convert_float(" + value + ")";
+  }
+  // The DM items of a work-item are compared in order of DM
+  return "if ( " + floatValue + " > dmMaximumSample<%NUM%> ) {\n"
+    "dmMaximumSample<%NUM%> = " + floatValue + ";\n"
+    "dmMaximumDMSample<%NUM%> = " + dm + ";\n"
+    "}\n";
+}
+
+std::string getDMMaximaStoreOpenCL(const DedispersionConf & conf, const std::string & row, const unsigned int nrSamples) {
+  std::string nrThreadsD0_s = std::to_string(conf.getNrThreadsD0());
+  std::string nrRowItems_s = std::to_string(conf.getNrThreadsD0() * conf.getNrItemsD0());
+  std::string code;
+
+  for ( unsigned int sample = 0; sample < conf.getNrItemsD0(); sample++ ) {
+    std::string sample_s = std::to_string(sample);
+
+    code += "dmMaximaBuffer[(get_local_id(1) * " + nrRowItems_s + ") + " + std::to_string(sample * conf.getNrThreadsD0()) + " + get_local_id(0)] = dmMaximumSample" + sample_s + ";\n"
+      "dmMaximaDMsBuffer[(get_local_id(1) * " + nrRowItems_s + ") + " + std::to_string(sample * conf.getNrThreadsD0()) + " + get_local_id(0)] = dmMaximumDMSample" + sample_s + ";\n";
+  }
+  // Every sample item is reduced by a different work-item of the column; the DMs of different rows are interleaved, so equal maxima compare the DMs
+  code += "barrier(CLK_LOCAL_MEM_FENCE);\n"
+    "for ( unsigned int sampleItem = get_local_id(1); sampleItem < " + std::to_string(conf.getNrItemsD0()) + "; sampleItem += " + std::to_string(conf.getNrThreadsD1()) + " ) {\n"
+    "float dmMaximum = dmMaximaBuffer[(sampleItem * " + nrThreadsD0_s + ") + get_local_id(0)];\n"
+    "unsigned int dmMaximumDM = dmMaximaDMsBuffer[(sampleItem * " + nrThreadsD0_s + ") + get_local_id(0)];\n"
+    "for ( unsigned int item = 1; item < " + std::to_string(conf.getNrThreadsD1()) + "; item++ ) {\n"
+    "float value = dmMaximaBuffer[(item * " + nrRowItems_s + ") + (sampleItem * " + nrThreadsD0_s + ") + get_local_id(0)];\n"
+    "unsigned int valueDM = dmMaximaDMsBuffer[(item * " + nrRowItems_s + ") + (sampleItem * " + nrThreadsD0_s + ") + get_local_id(0)];\n"
+    "if ( (value > dmMaximum) || ((value == dmMaximum) && (valueDM < dmMaximumDM)) ) {\n"
+    "dmMaximum = value;\n"
+    "dmMaximumDM = valueDM;\n"
+    "}\n"
+    "}\n";
+  if ( nrSamples % (conf.getNrThreadsD0() * conf.getNrItemsD0()) != 0 ) {
+    code += "if ( (sample + (sampleItem * " + nrThreadsD0_s + ")) < " + std::to_string(nrSamples) + " ) {\n";
+  }
+  code += "output[((" + row + ") * " + std::to_string(nrSamples) + ") + sample + (sampleItem * " + nrThreadsD0_s + ")] = dmMaximum;\n"
+    "outputDMs[((" + row + ") * " + std::to_string(nrSamples) + ") + sample + (sampleItem * " + nrThreadsD0_s + ")] = dmMaximumDM;\n";
+  if ( nrSamples % (conf.getNrThreadsD0() * conf.getNrItemsD0()) != 0 ) {
+    code += "}\n";
+  }
+  code += "}\n";
+  return code;
+}
+
+std::string * expandDedispersionOpenCL(const DedispersionConf & conf, const std::string & code, const std::string & defTemplate, const std::string & defShiftTemplate, const std::string & unrolledTemplate, const std::string & shiftTemplate, const std::string & sumTemplate, const std::string & storeTemplate, const std::string & storeDefinitions, const std::string & storeReductions) {
+  // Every template is parsed once; the values are in the order of the placeholders
+  const CodeTemplate kernelCode(code, {"DEFS", "DEFS_SHIFT", "UNROLLED_LOOP", "STORES"});
+  const CodeTemplate defCode(defTemplate, {"NUM", "DM_NUM"});
+  const CodeTemplate defShiftCode(defShiftTemplate, {"DM_NUM"});
+  const CodeTemplate unrolledCode(unrolledTemplate, {"UNROLL", "SHIFTS", "SUMS"}, {"UNROLL"});
+  const CodeTemplate shiftCode(shiftTemplate, {"DM_NUM", "DM_OFFSET", "UNROLL"}, {"DM_OFFSET", "UNROLL"});
+  const CodeTemplate sumCode(sumTemplate, {"NUM", "DM_NUM", "OFFSET", "UNROLL"}, {"OFFSET", "UNROLL"});
+  const CodeTemplate storeCode(storeTemplate, {"NUM", "DM_NUM", "OFFSET", "DM_OFFSET"}, {"OFFSET", "DM_OFFSET"});
+  std::vector< std::string > samples(conf.getNrItemsD0());
+  std::vector< std::string > sampleOffsets(conf.getNrItemsD0());
+  std::vector< std::string > dms(conf.getNrItemsD1());
+  std::vector< std::string > dmOffsets(conf.getNrItemsD1());
+  std::vector< std::string > values(4);
+  std::string * kernel = new std::string();
+  std::string defs;
+  std::string defsShift;
+  std::string unrolledLoop;
+  std::string stores;
+
+  for ( unsigned int sample = 0; sample < conf.getNrItemsD0(); sample++ ) {
+    samples[sample] = std::to_string(sample);
+    sampleOffsets[sample] = std::to_string(sample * conf.getNrThreadsD0());
+  }
+  for ( unsigned int dm = 0; dm < conf.getNrItemsD1(); dm++ ) {
+    dms[dm] = std::to_string(dm);
+    dmOffsets[dm] = std::to_string(dm * conf.getNrThreadsD1());
+    values[0] = dms[dm];
+    defShiftCode.expand(defsShift, values);
+  }
+  stores = storeDefinitions;
+  for ( unsigned int sample = 0; sample < conf.getNrItemsD0(); sample++ ) {
+    for ( unsigned int dm = 0; dm < conf.getNrItemsD1(); dm++ ) {
+      values[0] = samples[sample];
+      values[1] = dms[dm];
+      defCode.expand(defs, values);
+      values[2] = sampleOffsets[sample];
+      values[3] = dmOffsets[dm];
+      storeCode.expand(stores, values);
+    }
+  }
+  stores.append(storeReductions);
+  for ( unsigned int loop = 0; loop < conf.getUnroll(); loop++ ) {
+    const std::string loop_s = std::to_string(loop);
+    std::string shifts;
+    std::string sums;
+
+    for ( unsigned int dm = 0; dm < conf.getNrItemsD1(); dm++ ) {
+      values[0] = dms[dm];
+      values[1] = dmOffsets[dm];
+      values[2] = loop_s;
+      shiftCode.expand(shifts, values);
+    }
+    for ( unsigned int sample = 0; sample < conf.getNrItemsD0(); sample++ ) {
+      for ( unsigned int dm = 0; dm < conf.getNrItemsD1(); dm++ ) {
+        values[0] = samples[sample];
+        values[1] = dms[dm];
+        values[2] = sampleOffsets[sample];
+        values[3] = loop_s;
+        sumCode.expand(sums, values);
+      }
+    }
+    values[0] = loop_s;
+    values[1].swap(shifts);
+    values[2].swap(sums);
+    unrolledCode.expand(unrolledLoop, values);
+  }
+  values[0].swap(defs);
+  values[1].swap(defsShift);
+  values[2].swap(unrolledLoop);
+  values[3].swap(stores);
+  kernelCode.expand(*kernel, values);
+  return kernel;
+}
+
 } // Dedispersion
 
@@ -0,0 +1,326 @@
+// Copyright 2017 Netherlands Institute for Radio Astronomy (ASTRON)
+// Copyright 2017 Netherlands eScience Center
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <functional>
+#include <cstdlib>
+#include <algorithm>
+
+#include <configuration.hpp>
+
+#include <ArgumentList.hpp>
+#include <Observation.hpp>
+#include <Timer.hpp>
+#include <utils.hpp>
+#include <Shifts.hpp>
+#include <DelayTable.hpp>
+#include <ActiveChannels.hpp>
+#include <ThreadPool.hpp>
+#include <Dedispersion.hpp>
+#include <DedispersionCPU.hpp>
+#include <TreeDedispersion.hpp>
+#include <FDMT.hpp>
+#include <Instrumentation.hpp>
+
+
+// Survey configuration: one batch of one beam; subbands is 0 for single step dedispersion
+struct Preset {
+  std::string name;
+  unsigned int nrChannels;
+  float minFreq;
+  float channelBandwidth;
+  float samplingTime;
+  unsigned int nrSamples;
+  unsigned int nrSubbands;
+  unsigned int nrSubbandingDMs;
+  float subbandingDMStep;
+  unsigned int nrDMs;
+  float dmStep;
+  uint8_t inputBits;
+};
+
+// Apertif/ARTS: 1536 channels of 195 kHz from 1220 MHz, 81.92 us; LOFAR: 288 subbands of 195 kHz from 119 MHz, 491.52 us
+const std::vector< Preset > presets = {
+  {"arts_single", 1536, 1220.0f, 0.1953125f, 81.92e-6f, 2048, 0, 0, 0.0f, 256, 0.2f, 8},
+  {"arts_subband", 1536, 1220.0f, 0.1953125f, 81.92e-6f, 2048, 32, 32, 6.4f, 32, 0.2f, 8},
+  {"lofar", 288, 119.0f, 0.1953125f, 491.52e-6f, 2048, 0, 0, 0.0f, 256, 0.05f, 8},
+  {"arts_1bit", 1536, 1220.0f, 0.1953125f, 81.92e-6f, 2048, 0, 0, 0.0f, 256, 0.2f, 1},
+  {"arts_2bit", 1536, 1220.0f, 0.1953125f, 81.92e-6f, 2048, 0, 0, 0.0f, 256, 0.2f, 2},
+  {"arts_4bit", 1536, 1220.0f, 0.1953125f, 81.92e-6f, 2048, 0, 0, 0.0f, 256, 0.2f, 4}
+};
+
+// Channels per tree of the tree dedispersion engine
+const unsigned int nrChannelsPerTree = 16;
+
+struct Result {
+  std::string preset;
+  std::string engine;
+  uint8_t inputBits;
+  unsigned int nrSubbandingDMs;
+  unsigned int nrDMs;
+  double time;
+  double stdDeviation;
+  double gflops;
+  double gbs;
+  double samplesPerSecond;
+  double realTimeFactor;
+  // Output of the warm-up run different from the sequential output, and largest delay error, in samples, of an approximated engine
+  uint64_t wrongSamples;
+  unsigned int delayError;
+};
+
+// Samples of output different from reference
+uint64_t compareOutput(const std::vector< outputDataType > & output, const std::vector< outputDataType > & reference, const unsigned int nrRows, const unsigned int nrSamples, const unsigned int padding) {
+  const unsigned int nrSamplesPadded = isa::utils::pad(nrSamples, padding / sizeof(outputDataType));
+  uint64_t wrongSamples = 0;
+
+  for ( unsigned int row = 0; row < nrRows; row++ ) {
+    for ( unsigned int sample = 0; sample < nrSamples; sample++ ) {
+      if ( output[(row * nrSamplesPadded) + sample] != reference[(row * nrSamplesPadded) + sample] ) {
+        wrongSamples++;
+      }
+    }
+  }
+  return wrongSamples;
+}
+
+// compare() is called once, after the warm-up run, and returns the samples of the output different from the sequential engine
+void benchmark(const Preset & preset, const std::string & engine, const AstroData::Observation & observation, const uint64_t nrOperations, const uint64_t nrBytes, const unsigned int nrIterations, const unsigned int delayError, const std::function< void() > & run, const std::function< uint64_t() > & compare, std::vector< Result > & results) {
+  isa::utils::Timer timer;
+  uint64_t wrongSamples = 0;
+
+  // Warm-up run
+  run();
+  wrongSamples = compare();
+  for ( unsigned int iteration = 0; iteration < nrIterations; iteration++ ) {
+    timer.start();
+    run();
+    timer.stop();
+  }
+  results.push_back(Result{preset.name, engine, preset.inputBits, preset.nrSubbandingDMs, observation.getNrDMs(), timer.getAverageTime(), timer.getStandardDeviation(),
+    isa::utils::giga(nrOperations) / timer.getAverageTime(), isa::utils::giga(nrBytes) / timer.getAverageTime(),
+    (static_cast< double >(observation.getNrChannels()) * observation.getNrSamplesPerBatch()) / timer.getAverageTime(), (observation.getNrSamplesPerBatch() * observation.getSamplingTime()) / timer.getAverageTime(), wrongSamples, delayError});
+  std::cout << std::setprecision(3);
+  std::cout << preset.name << " " << engine << " " << std::to_string(preset.inputBits) << " " << observation.getNrChannels() << " " << preset.nrSubbands << " " << preset.nrSubbandingDMs << " " << observation.getNrDMs() << " " << observation.getNrSamplesPerBatch() << " ";
+  std::cout << results.back().gflops << " " << results.back().gbs << " " << results.back().samplesPerSecond << " " << results.back().realTimeFactor << " ";
+  std::cout << wrongSamples << " " << delayError << " ";
+  std::cout << std::setprecision(6);
+  std::cout << timer.getAverageTime() << " " << timer.getStandardDeviation() << std::endl;
+}
+
+void singleStep(const Preset & preset, Dedispersion::ThreadPool & pool, const Dedispersion::DedispersionConf & conf, const unsigned int padding, const unsigned int nrIterations, std::vector< Result > & results) {
+  AstroData::Observation observation;
+
+  observation.setNrBeams(1);
+  observation.setNrSynthesizedBeams(1);
+  observation.setNrSamplesPerBatch(preset.nrSamples);
+  observation.setSamplingTime(preset.samplingTime);
+  observation.setFrequencyRange(1, preset.nrChannels, preset.minFreq, preset.channelBandwidth);
+  observation.setDMRange(preset.nrDMs, 0.0f, preset.dmStep);
+  std::vector< float > * shifts = Dedispersion::getShifts(observation, padding);
+  Dedispersion::DelayTable delays(observation, *shifts, padding, Dedispersion::DedispersionStep::SingleStep);
+  std::vector< unsigned int > zappedChannels(observation.getNrChannels(padding / sizeof(unsigned int)));
+  std::vector< unsigned int > beamMapping(observation.getNrSynthesizedBeams() * observation.getNrChannels(padding / sizeof(unsigned int)));
+
+  observation.setNrSamplesPerDispersedBatch(observation.getNrSamplesPerBatch() + delays.getMaxDelay());
+  Dedispersion::ActiveChannels activeChannels(observation, Dedispersion::ActiveChannels(observation, zappedChannels, padding), beamMapping, padding);
+  Dedispersion::FDMTPlan plan(observation, *shifts, delays);
+  std::vector< inputDataType > dispersedData(Dedispersion::getInputWindow(observation, std::vector< inputDataType >(), padding, preset.inputBits, false).nrSamplesPerChannel * observation.getNrBeams() * observation.getNrChannels());
+  std::vector< outputDataType > dedispersedData(observation.getNrSynthesizedBeams() * observation.getNrDMs() * observation.getNrSamplesPerBatch(false, padding / sizeof(outputDataType)));
+  // Same operations as in DedispersionTuning; for the tree and the FDMT, the ones of brute force dedispersion they replace
+  const uint64_t nrOperations = Dedispersion::getNrDedispersionOperations(observation, false);
+  // New input of the batch, and output
+  const uint64_t nrBytes = ((static_cast< uint64_t >(observation.getNrBeams()) * observation.getNrChannels() * observation.getNrSamplesPerBatch() * preset.inputBits) / 8) + (dedispersedData.size() * sizeof(outputDataType));
+
+  std::vector< outputDataType > reference;
+  const std::vector< unsigned int > treeDelayErrors = Dedispersion::getTreeDelayErrors(delays, nrChannelsPerTree);
+  const std::vector< unsigned int > fdmtDelayErrors = plan.getDelayErrors();
+  // The output of the warm-up run of every engine, compared with the sequential one
+  auto compare = [&]() {
+    return compareOutput(dedispersedData, reference, observation.getNrSynthesizedBeams() * observation.getNrDMs(), observation.getNrSamplesPerBatch(), padding);
+  };
+
+  for ( auto & value : dispersedData ) {
+    value = static_cast< inputDataType >(rand());
+  }
+  benchmark(preset, "sequential", observation, nrOperations, nrBytes, nrIterations, 0, [&]() {
+    Dedispersion::dedispersion< inputDataType, intermediateDataType, outputDataType >(observation, zappedChannels, beamMapping, dispersedData, dedispersedData, *shifts, padding, preset.inputBits);
+  }, [&]() {
+    reference = dedispersedData;
+    return 0;
+  }, results);
+  benchmark(preset, "parallel", observation, nrOperations, nrBytes, nrIterations, 0, [&]() {
+    Dedispersion::dedispersion< inputDataType, intermediateDataType, outputDataType >(pool, conf, observation, activeChannels, beamMapping, dispersedData, dedispersedData, delays, padding, preset.inputBits);
+  }, compare, results);
+  benchmark(preset, "tree", observation, nrOperations, nrBytes, nrIterations, *std::max_element(treeDelayErrors.begin(), treeDelayErrors.end()), [&]() {
+    Dedispersion::treeDedispersion< inputDataType, intermediateDataType, outputDataType >(pool, nrChannelsPerTree, observation, activeChannels, beamMapping, dispersedData, dedispersedData, delays, padding, preset.inputBits);
+  }, compare, results);
+  benchmark(preset, "fdmt", observation, nrOperations, nrBytes, nrIterations, *std::max_element(fdmtDelayErrors.begin(), fdmtDelayErrors.end()), [&]() {
+    Dedispersion::fdmt< inputDataType, intermediateDataType, outputDataType >(pool, plan, observation, activeChannels, beamMapping, dispersedData, dedispersedData, padding, preset.inputBits);
+  }, compare, results);
+  delete shifts;
+}
+
+void subbanding(const Preset & preset, Dedispersion::ThreadPool & pool, const Dedispersion::DedispersionConf & conf, const unsigned int padding, const unsigned int nrIterations, std::vector< Result > & results) {
+  AstroData::Observation observation;
+
+  observation.setNrBeams(1);
+  observation.setNrSynthesizedBeams(1);
+  observation.setNrSamplesPerBatch(preset.nrSamples);
+  observation.setSamplingTime(preset.samplingTime);
+  observation.setFrequencyRange(preset.nrSubbands, preset.nrChannels, preset.minFreq, preset.channelBandwidth);
+  observation.setDMRange(preset.nrSubbandingDMs, 0.0f, preset.subbandingDMStep, true);
+  observation.setDMRange(preset.nrDMs, 0.0f, preset.dmStep);
+  std::vector< float > * shiftsStepOne = Dedispersion::getShifts(observation, padding);
+  std::vector< float > * shiftsStepTwo = Dedispersion::getShiftsStepTwo(observation, padding);
+  Dedispersion::DelayTable delaysStepOne(observation, *shiftsStepOne, padding, Dedispersion::DedispersionStep::StepOne);
+  Dedispersion::DelayTable delaysStepTwo(observation, *shiftsStepTwo, padding, Dedispersion::DedispersionStep::StepTwo);
+  std::vector< unsigned int > zappedChannels(observation.getNrChannels(padding / sizeof(unsigned int)));
+  std::vector< unsigned int > beamMapping(observation.getNrSynthesizedBeams() * observation.getNrSubbands(padding / sizeof(unsigned int)));
+
+  observation.setNrSamplesPerBatch(observation.getNrSamplesPerBatch() + delaysStepTwo.getMaxDelay(), true);
+  observation.setNrSamplesPerDispersedBatch(observation.getNrSamplesPerBatch(true) + delaysStepOne.getMaxDelay(), true);
+  Dedispersion::ActiveChannels activeChannels(observation, zappedChannels, padding);
+  std::vector< inputDataType > dispersedData(Dedispersion::getInputWindow(observation, std::vector< inputDataType >(), padding, preset.inputBits, true).nrSamplesPerChannel * observation.getNrBeams() * observation.getNrChannels());
+  std::vector< outputDataType > subbandedData(observation.getNrBeams() * observation.getNrDMs(true) * observation.getNrSubbands() * observation.getNrSamplesPerBatch(true, padding / sizeof(outputDataType)));
+  std::vector< outputDataType > dedispersedData(observation.getNrSynthesizedBeams() * observation.getNrDMs(true) * observation.getNrDMs() * observation.getNrSamplesPerBatch(false, padding / sizeof(outputDataType)));
+  // Step one and step two, as in DedispersionTuning
+  const uint64_t nrOperations = Dedispersion::getNrDedispersionOperations(observation, true);
+  const uint64_t nrBytes = ((static_cast< uint64_t >(observation.getNrBeams()) * observation.getNrChannels() * observation.getNrSamplesPerBatch() * preset.inputBits) / 8) + (dedispersedData.size() * sizeof(outputDataType));
+
+  std::vector< outputDataType > reference;
+
+  for ( auto & value : dispersedData ) {
+    value = static_cast< inputDataType >(rand());
+  }
+  benchmark(preset, "sequential", observation, nrOperations, nrBytes, nrIterations, 0, [&]() {
+    Dedispersion::subbandDedispersionStepOne< inputDataType, intermediateDataType, outputDataType >(observation, zappedChannels, dispersedData, subbandedData, *shiftsStepOne, padding, preset.inputBits);
+    Dedispersion::subbandDedispersionStepTwo< outputDataType, intermediateDataType, outputDataType >(observation, beamMapping, subbandedData, dedispersedData, *shiftsStepTwo, padding);
+  }, [&]() {
+    reference = dedispersedData;
+    return 0;
+  }, results);
+  benchmark(preset, "parallel", observation, nrOperations, nrBytes, nrIterations, 0, [&]() {
+    Dedispersion::subbandDedispersion< inputDataType, intermediateDataType, outputDataType >(pool, conf, observation, activeChannels, beamMapping, dispersedData, dedispersedData, delaysStepOne, delaysStepTwo, padding, preset.inputBits);
+  }, [&]() {
+    return compareOutput(dedispersedData, reference, observation.getNrSynthesizedBeams() * observation.getNrDMs(true) * observation.getNrDMs(), observation.getNrSamplesPerBatch(), padding);
+  }, results);
+  delete shiftsStepOne;
+  delete shiftsStepTwo;
+}
+
+void writeJSON(const std::string & fileName, const unsigned int nrThreads, const unsigned int nrIterations, const unsigned int padding, const Dedispersion::DedispersionConf & conf, const std::vector< Result > & results) {
+  std::ofstream output(fileName);
+
+  if ( !output ) {
+    throw AstroData::FileError("Impossible to open " + fileName);
+  }
+  output << std::setprecision(9);
+  output << "{" << std::endl;
+  output << "  \"threads\": " << nrThreads << "," << std::endl;
+  output << "  \"iterations\": " << nrIterations << "," << std::endl;
+  output << "  \"padding\": " << padding << "," << std::endl;
+  output << "  \"configuration\": \"" << conf.print() << "\"," << std::endl;
+  output << "  \"results\": [" << std::endl;
+  for ( unsigned int result = 0; result < results.size(); result++ ) {
+    output << "    {\"preset\": \"" << results.at(result).preset << "\", \"engine\": \"" << results.at(result).engine << "\", \"inputBits\": " << std::to_string(results.at(result).inputBits);
+    output << ", \"subbandingDMs\": " << results.at(result).nrSubbandingDMs << ", \"DMs\": " << results.at(result).nrDMs;
+    output << ", \"time\": " << results.at(result).time << ", \"stdDeviation\": " << results.at(result).stdDeviation;
+    output << ", \"GFLOPs\": " << results.at(result).gflops << ", \"GBs\": " << results.at(result).gbs << ", \"samplesPerSecond\": " << results.at(result).samplesPerSecond << ", \"realTimeFactor\": " << results.at(result).realTimeFactor;
+    output << ", \"wrongSamples\": " << results.at(result).wrongSamples << ", \"delayError\": " << results.at(result).delayError << "}";
+    output << ((result + 1 < results.size()) ? "," : "") << std::endl;
+  }
+  output << "  ]" << std::endl;
+  output << "}" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  bool allPresets = false;
+  unsigned int nrIterations = 0;
+  unsigned int nrThreads = 0;
+  unsigned int padding = 0;
+  std::string presetName;
+  std::string jsonFile;
+  Dedispersion::DedispersionConf conf;
+
+  try {
+    isa::utils::ArgumentList args(argc, argv);
+    allPresets = args.getSwitch("-all");
+    if ( !allPresets ) {
+      presetName = args.getSwitchArgument< std::string >("-preset");
+    }
+    if ( args.getSwitch("-json") ) {
+      jsonFile = args.getSwitchArgument< std::string >("-json_file");
+    }
+    nrIterations = args.getSwitchArgument< unsigned int >("-iterations");
+    nrThreads = args.getSwitchArgument< unsigned int >("-threads");
+    padding = args.getSwitchArgument< unsigned int >("-padding");
+    // Tile sizes of the parallel CPU kernels
+    conf.setNrThreadsD0(args.getSwitchArgument< unsigned int >("-threadsD0"));
+    conf.setNrThreadsD1(args.getSwitchArgument< unsigned int >("-threadsD1"));
+    conf.setNrItemsD0(args.getSwitchArgument< unsigned int >("-itemsD0"));
+    conf.setNrItemsD1(args.getSwitchArgument< unsigned int >("-itemsD1"));
+    conf.setUnroll(args.getSwitchArgument< unsigned int >("-unroll"));
+  } catch  ( isa::utils::SwitchNotFound & err ) {
+    std::cerr << err.what() << std::endl;
+    return 1;
+  } catch ( std::exception & err ) {
+    std::cerr << "Usage: " << argv[0] << " [-all | -preset ...] [-json -json_file ...] -iterations ... -threads ... -padding ... -threadsD0 ... -threadsD1 ... -itemsD0 ... -itemsD1 ... -unroll ..." << std::endl;
+    std::cerr << "\tPresets:";
+    for ( auto preset = presets.begin(); preset != presets.end(); ++preset ) {
+      std::cerr << " " << preset->name;
+    }
+    std::cerr << std::endl;
+    return 1;
+  }
+
+  Dedispersion::ThreadPool pool(nrThreads);
+  std::vector< Result > results;
+  bool found = false;
+
+  std::cout << std::fixed << std::endl;
+  std::cout << "# preset engine inputBits nrChannels nrSubbands nrSubbandingDMs nrDMs nrSamples GFLOP/s GB/s samples/s realTimeFactor wrongSamples delayError time stdDeviation" << std::endl << std::endl;
+  try {
+    for ( auto preset = presets.begin(); preset != presets.end(); ++preset ) {
+      if ( !allPresets && (preset->name != presetName) ) {
+        continue;
+      }
+      found = true;
+      if ( preset->nrSubbands > 0 ) {
+        subbanding(*preset, pool, conf, padding, nrIterations, results);
+      } else {
+        singleStep(*preset, pool, conf, padding, nrIterations, results);
+      }
+    }
+    if ( !found ) {
+      std::cerr << "Unknown preset " << presetName << "." << std::endl;
+      return 1;
+    }
+    if ( !jsonFile.empty() ) {
+      writeJSON(jsonFile, pool.getNrThreads(), nrIterations, padding, conf, results);
+    }
+  } catch ( std::exception & err ) {
+    std::cerr << err.what() << std::endl;
+    return 1;
+  }
+  std::cout << std::endl;
+  return 0;
+}
+
@@ -0,0 +1,264 @@
+// Copyright 2017 Netherlands Institute for Radio Astronomy (ASTRON)
+// Copyright 2017 Netherlands eScience Center
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <exception>
+#include <iomanip>
+#include <cstring>
+#include <chrono>
+#include <thread>
+
+#include <configuration.hpp>
+
+#include <ArgumentList.hpp>
+#include <Observation.hpp>
+#include <ReadData.hpp>
+#include <SynthesizedBeams.hpp>
+#include <Timer.hpp>
+#include <utils.hpp>
+#include <Shifts.hpp>
+#include <DelayTable.hpp>
+#include <ActiveChannels.hpp>
+#include <ThreadPool.hpp>
+#include <DedispersionCPU.hpp>
+#include <RingBuffer.hpp>
+#include <Instrumentation.hpp>
+
+
+// Longest wait of the writer for the reader to release a block, at the end of the data
+const std::chrono::seconds drainTimeout(10);
+
+// Writer: fill a ring with batches of random input, as a data source would
+int writer(const std::string & ring, const unsigned int nrBlocks, const unsigned int nrBatches, const bool drop, const bool realTime, const AstroData::Observation & observation, const unsigned int padding, const Dedispersion::InputLayout & layout) {
+  const uint64_t nrBlockBytes = Dedispersion::getNrRingBlockBytes< inputDataType >(observation, padding, inputBits, layout);
+  const std::chrono::duration< double > batchTime(observation.getNrSamplesPerBatch() * observation.getSamplingTime());
+  // A few different blocks, so that generating the input does not slow down the writer
+  std::vector< std::vector< uint8_t > > blocks(4, std::vector< uint8_t >(nrBlockBytes));
+
+  for ( auto & block : blocks ) {
+    for ( auto & value : block ) {
+      value = static_cast< uint8_t >(rand() % 10);
+    }
+  }
+  try {
+    Dedispersion::RingWriter ringWriter(ring, nrBlocks, nrBlockBytes, Dedispersion::getRingHeader(observation, padding, inputBits, layout));
+    auto start = std::chrono::steady_clock::now();
+
+    for ( unsigned int batch = 0; batch < nrBatches; batch++ ) {
+      uint8_t * block = ringWriter.getBlock(!drop);
+
+      if ( block != nullptr ) {
+        std::memcpy(block, blocks.at(batch % blocks.size()).data(), nrBlockBytes);
+        ringWriter.commit();
+      }
+      if ( realTime ) {
+        std::this_thread::sleep_until(start + std::chrono::duration_cast< std::chrono::steady_clock::duration >((batch + 1) * batchTime));
+      }
+    }
+    std::chrono::duration< double > time = std::chrono::steady_clock::now() - start;
+    ringWriter.close();
+    std::cout << std::fixed << std::setprecision(6);
+    std::cout << "# writtenBlocks droppedBlocks time GB/s" << std::endl;
+    std::cout << ringWriter.getNrWrittenBlocks() << " " << ringWriter.getNrDroppedBlocks() << " " << time.count() << " " << isa::utils::giga(ringWriter.getNrWrittenBlocks() * nrBlockBytes) / time.count() << std::endl;
+    // The ring is removed when the reader has released all the blocks; a reader that never attached, or died, releases none
+    uint64_t occupancy = ringWriter.getOccupancy();
+    auto lastRelease = std::chrono::steady_clock::now();
+
+    while ( occupancy > 0 ) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      if ( ringWriter.getOccupancy() < occupancy ) {
+        occupancy = ringWriter.getOccupancy();
+        lastRelease = std::chrono::steady_clock::now();
+      } else if ( std::chrono::steady_clock::now() - lastRelease > drainTimeout ) {
+        std::cerr << "No block released by the reader in " << drainTimeout.count() << " seconds, " << occupancy << " blocks not read." << std::endl;
+        return 1;
+      }
+    }
+  } catch ( std::exception & err ) {
+    std::cerr << err.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+// Reader: dedisperse every batch of the ring, in place, with the parallel CPU kernels
+int reader(const std::string & ring, const unsigned int nrThreads, const Dedispersion::DedispersionConf & conf, AstroData::Observation & observation, const std::string & channelsFile, const bool printBatches, Dedispersion::Instrumentation & instrumentation, const bool printJSON) {
+  unsigned int padding = 0;
+  Dedispersion::InputLayout layout;
+
+  try {
+    Dedispersion::RingReader ringReader(ring);
+    Dedispersion::setObservation(ringReader, observation, padding, layout);
+    if ( ringReader.getHeaderValue< unsigned int >("NBIT") != inputBits ) {
+      std::cerr << "The ring has " << ringReader.getHeaderValue< unsigned int >("NBIT") << " bits per sample, not " << std::to_string(inputBits) << "." << std::endl;
+      return 1;
+    }
+    if ( (layout.getOrdering() == Dedispersion::InputOrdering::TimeMajor) && (inputBits < 8) ) {
+      std::cerr << "Time-major input needs at least 8 bits per sample." << std::endl;
+      return 1;
+    }
+    std::vector< float > * shifts = Dedispersion::getShifts(observation, padding);
+    Dedispersion::DelayTable delays(observation, *shifts, padding, Dedispersion::DedispersionStep::SingleStep);
+    std::vector< unsigned int > zappedChannels(observation.getNrChannels(padding / sizeof(unsigned int)));
+    std::vector< unsigned int > beamMapping(observation.getNrSynthesizedBeams() * observation.getNrChannels(padding / sizeof(unsigned int)));
+
+    AstroData::readZappedChannels(observation, channelsFile, zappedChannels);
+    AstroData::generateBeamMapping(observation, beamMapping, padding);
+    observation.setNrSamplesPerDispersedBatch(observation.getNrSamplesPerBatch() + delays.getMaxDelay());
+    if ( !Dedispersion::isIntermediateTypeLargeEnough< intermediateDataType >(observation, inputBits) ) {
+      std::cerr << "The intermediate type " << intermediateDataName << " can not hold the sum of " << observation.getNrChannels() << " channels of " << std::to_string(inputBits) << " bits." << std::endl;
+      return 1;
+    }
+    const unsigned int nrInputBlocks = Dedispersion::getNrInputBlocks(observation, false);
+    const double batchTime = observation.getNrSamplesPerBatch() * observation.getSamplingTime();
+    Dedispersion::ActiveChannels activeChannels(observation, Dedispersion::ActiveChannels(observation, zappedChannels, padding), beamMapping, padding);
+    Dedispersion::ThreadPool pool(nrThreads);
+    std::vector< outputDataType > dedispersedData(observation.getNrSynthesizedBeams() * observation.getNrDMs() * observation.getNrSamplesPerBatch(false, padding / sizeof(outputDataType)));
+    isa::utils::Timer timer;
+    uint64_t nrBatches = 0;
+    uint64_t maxOccupancy = 0;
+
+    if ( ringReader.getNrBlocks() < nrInputBlocks ) {
+      std::cerr << "A dispersed batch needs " << nrInputBlocks << " blocks, the ring has " << ringReader.getNrBlocks() << "." << std::endl;
+      return 1;
+    }
+    std::cout << std::fixed << std::setprecision(6);
+    if ( printBatches ) {
+      std::cout << "# batch time occupancy droppedBlocks" << std::endl;
+    }
+    // Every dispersed batch starts at the first block held; its first block is then given back to the writer
+    while ( true ) {
+      {
+        // Time waiting for the writer
+        Dedispersion::StageTimer inputTimer(&instrumentation, Dedispersion::Stage::Input, ringReader.getNrBytesPerBlock());
+
+        if ( !ringReader.acquire(nrInputBlocks) ) {
+          break;
+        }
+      }
+      Dedispersion::InputWindow< inputDataType > window = Dedispersion::getRingWindow< inputDataType >(ringReader, observation, padding, inputBits, layout);
+
+      maxOccupancy = std::max(maxOccupancy, ringReader.getOccupancy());
+      timer.start();
+      {
+        Dedispersion::StageTimer cpuTimer(&instrumentation, Dedispersion::Stage::CPU, ringReader.getNrBytesPerBlock() + (dedispersedData.size() * sizeof(outputDataType)), Dedispersion::getNrDedispersionOperations(observation, false));
+
+        Dedispersion::dedispersion< inputDataType, intermediateDataType, outputDataType >(pool, conf, observation, activeChannels, beamMapping, window, dedispersedData, delays, padding, inputBits);
+      }
+      timer.stop();
+      if ( printBatches ) {
+        std::cout << nrBatches << " " << timer.getLastRunTime() << " " << ringReader.getOccupancy() << " " << ringReader.getNrDroppedBlocks() << std::endl;
+      }
+      ringReader.release();
+      nrBatches++;
+    }
+    // The last blocks are not a whole dispersed batch
+    while ( ringReader.getNrAcquiredBlocks() > 0 ) {
+      ringReader.release();
+    }
+    delete shifts;
+    std::cout << "# batches time stdDeviation realTimeFactor maxOccupancy ringBlocks writtenBlocks droppedBlocks" << std::endl;
+    std::cout << nrBatches << " " << timer.getAverageTime() << " " << timer.getStandardDeviation() << " " << ((nrBatches > 0) ? batchTime / timer.getAverageTime() : 0.0) << " " << maxOccupancy << " " << ringReader.getNrBlocks() << " " << ringReader.getNrWrittenBlocks() << " " << ringReader.getNrDroppedBlocks() << std::endl;
+    if ( instrumentation.isEnabled() ) {
+      std::cout << (printJSON ? instrumentation.printJSON() + "\n" : instrumentation.print());
+    }
+  } catch ( std::exception & err ) {
+    std::cerr << err.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  bool writerMode = false;
+  bool readerMode = false;
+  bool drop = false;
+  bool realTime = false;
+  bool printBatches = false;
+  bool printJSON = false;
+  unsigned int padding = 0;
+  unsigned int nrBlocks = 0;
+  unsigned int nrBatches = 0;
+  unsigned int nrThreads = 0;
+  std::string ring;
+  std::string channelsFile;
+  Dedispersion::InputLayout inputLayout;
+  Dedispersion::Instrumentation instrumentation(false);
+  Dedispersion::DedispersionConf conf;
+  AstroData::Observation observation;
+
+  try {
+    isa::utils::ArgumentList args(argc, argv);
+    writerMode = args.getSwitch("-writer");
+    readerMode = args.getSwitch("-reader");
+    if ( writerMode == readerMode ) {
+      std::cerr << "Mutually exclusive modes, select one: -writer -reader" << std::endl;
+      return 1;
+    }
+    // Name of the shared memory, e.g. /dedispersion
+    ring = args.getSwitchArgument< std::string >("-ring");
+    if ( writerMode ) {
+      // Without -drop a full ring stops the writer until the reader releases a block; with -drop the block is dropped
+      drop = args.getSwitch("-drop");
+      // One block per batch of sampling time, instead of as fast as possible
+      realTime = args.getSwitch("-real_time");
+      nrBlocks = args.getSwitchArgument< unsigned int >("-blocks");
+      nrBatches = args.getSwitchArgument< unsigned int >("-batches");
+      padding = args.getSwitchArgument< unsigned int >("-padding");
+      if ( args.getSwitch("-time_major") ) {
+        inputLayout.setOrdering(Dedispersion::InputOrdering::TimeMajor);
+      }
+      inputLayout.setReversedFrequency(args.getSwitch("-reversed_frequency"));
+      observation.setNrBeams(args.getSwitchArgument< unsigned int >("-beams"));
+      observation.setNrSamplesPerBatch(args.getSwitchArgument< unsigned int >("-samples"));
+      observation.setSamplingTime(args.getSwitchArgument< float >("-sampling_time"));
+      observation.setFrequencyRange(1, args.getSwitchArgument< unsigned int >("-channels"), args.getSwitchArgument< float >("-min_freq"), args.getSwitchArgument< float >("-channel_bandwidth"));
+    } else {
+      // The format of the input is in the header of the ring
+      printBatches = args.getSwitch("-print_batches");
+      // Time waiting for the writer and dedispersing, printed at the end as text or JSON
+      instrumentation.setEnabled(args.getSwitch("-instrumentation"));
+      printJSON = args.getSwitch("-instrumentation_json");
+      if ( printJSON ) {
+        instrumentation.setEnabled(true);
+      }
+      nrThreads = args.getSwitchArgument< unsigned int >("-threads");
+      channelsFile = args.getSwitchArgument< std::string >("-zapped_channels");
+      conf.setNrThreadsD0(args.getSwitchArgument< unsigned int >("-threadsD0"));
+      conf.setNrThreadsD1(args.getSwitchArgument< unsigned int >("-threadsD1"));
+      conf.setNrItemsD0(args.getSwitchArgument< unsigned int >("-itemsD0"));
+      conf.setNrItemsD1(args.getSwitchArgument< unsigned int >("-itemsD1"));
+      conf.setUnroll(args.getSwitchArgument< unsigned int >("-unroll"));
+      observation.setNrSynthesizedBeams(args.getSwitchArgument< unsigned int >("-synthesized_beams"));
+      observation.setDMRange(args.getSwitchArgument< unsigned int >("-dms"), args.getSwitchArgument< float >("-dm_first"), args.getSwitchArgument< float >("-dm_step"));
+    }
+  } catch  ( isa::utils::SwitchNotFound & err ) {
+    std::cerr << err.what() << std::endl;
+    return 1;
+  } catch ( std::exception & err ) {
+    std::cerr << "Usage: " << argv[0] << " [-writer | -reader] -ring ..." << std::endl;
+    std::cerr << "\t-writer [-drop] [-real_time] -blocks ... -batches ... -padding ... [-time_major] [-reversed_frequency] -beams ... -channels ... -min_freq ... -channel_bandwidth ... -samples ... -sampling_time ..." << std::endl;
+    std::cerr << "\t-reader [-print_batches] [-instrumentation | -instrumentation_json] -threads ... -zapped_channels ... -threadsD0 ... -threadsD1 ... -itemsD0 ... -itemsD1 ... -unroll ... -synthesized_beams ... -dms ... -dm_first ... -dm_step ..." << std::endl;
+    return 1;
+  }
+
+  if ( writerMode ) {
+    return writer(ring, nrBlocks, nrBatches, drop, realTime, observation, padding, inputLayout);
+  }
+  return reader(ring, nrThreads, conf, observation, channelsFile, printBatches, instrumentation, printJSON);
+}
+
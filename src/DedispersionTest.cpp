@@ -21,6 +21,8 @@
 #include <iomanip>
 #include <limits>
 #include <ctime>
+#include <cstring>
+#include <cmath>
 
 #include <configuration.hpp>
 
@@ -32,11 +34,41 @@
 #include <Kernel.hpp>
 #include <utils.hpp>
 #include <Shifts.hpp>
+#include <DelayTable.hpp>
+#include <ActiveChannels.hpp>
 #include <Dedispersion.hpp>
+#include <ThreadPool.hpp>
+#include <DedispersionCPU.hpp>
+#include <StreamingDedispersion.hpp>
+#include <TreeDedispersion.hpp>
+#include <FDMT.hpp>
+#include <Statistics.hpp>
+#include <DMMaxima.hpp>
+#include <Candidates.hpp>
+#include <Filterbank.hpp>
+#include <KernelCache.hpp>
+#include <Instrumentation.hpp>
+
+// CPU mode: the parallel CPU engines compared with the sequential templates, for every number of input bits, intermediate type and input layout, with and without split batches
+int testCPU(Dedispersion::ThreadPool & pool, const Dedispersion::DedispersionConf & conf, AstroData::Observation & observation, const std::string & channelsFile, const unsigned int padding);
+template< typename L > uint64_t testCPUEngines(Dedispersion::ThreadPool & pool, const Dedispersion::DedispersionConf & conf, AstroData::Observation & observation, const std::vector< unsigned int > & zappedChannels, const std::vector< unsigned int > & beamMappingSingleStep, const std::vector< unsigned int > & beamMappingStepTwo, const std::vector< uint8_t > & samples, const unsigned int nrSamplesPerChannel, const std::vector< float > & shiftsSingleStep, const std::vector< float > & shiftsStepOne, const std::vector< float > & shiftsStepTwo, const Dedispersion::DelayTable & delaysSingleStep, const Dedispersion::DelayTable & delaysStepOne, const Dedispersion::DelayTable & delaysStepTwo, const unsigned int padding, const uint8_t inputBits, const std::string & intermediateName);
+// Input of the CPU kernels in a layout, from nrSamplesPerChannel unpacked samples of every beam and channel starting at firstSample; with split batches, the dispersed batch starts in the last block of the ring
+Dedispersion::InputWindow< uint8_t > getCPUInput(const AstroData::Observation & observation, const std::vector< uint8_t > & samples, const unsigned int nrSamplesPerChannel, const unsigned int firstSample, const bool subbanding, const Dedispersion::InputLayout & layout, const bool splitBatches, const unsigned int padding, const uint8_t inputBits, std::vector< uint8_t > & input);
+// Single step output with the delays of every DM and channel, as applied by tree dedispersion and the FDMT; samples after the end of the dispersed batch are 0
+std::vector< float > getDelayedOutput(const AstroData::Observation & observation, const std::vector< unsigned int > & zappedChannels, const std::vector< unsigned int > & beamMapping, const std::vector< uint8_t > & samples, const unsigned int nrSamplesPerChannel, const std::vector< std::vector< unsigned int > > & delays, const unsigned int padding);
+// Wrong samples in nrRows rows of nrSamples samples, with nrSamplesPadded elements per row
+template< typename T > uint64_t compareCPUOutput(const std::vector< T > & output, const std::vector< T > & reference, const unsigned int nrRows, const unsigned int nrSamples, const unsigned int nrSamplesPadded);
+// Statistics of an output, with the same blocks of samples as the CPU kernels
+Dedispersion::Statistics getCPUStatistics(const Dedispersion::DedispersionConf & conf, const AstroData::Observation & observation, const bool subbanding, const std::vector< float > & output, const unsigned int padding);
+// Wrong partials; float sums are only approximately the same
+uint64_t compareCPUStatistics(const Dedispersion::Statistics & statistics, const Dedispersion::Statistics & reference);
+// Wrong maxima of the reference output; a different DM is correct if its sample is the same as the maximum
+uint64_t compareCPUMaxima(const Dedispersion::DMMaxima & maxima, const std::vector< float > & reference, const unsigned int nrSynthesizedBeams, const unsigned int nrDMs, const unsigned int nrSamples, const unsigned int padding);
+// Wrong candidates, with the boxcars of search computed on the reference output
+uint64_t compareCPUCandidates(const std::vector< Dedispersion::Candidate > & candidates, const Dedispersion::BoxcarSearch & search, const std::vector< float > & reference, const unsigned int nrSynthesizedBeams, const unsigned int nrDMs, const unsigned int nrSamples, const unsigned int padding);
 
 
 int main(int argc, char *argv[]) {
-  // TODO: implement split_batches mode
   // TODO: implement a way to test external beam drivers
   unsigned int padding = 0;
   bool printCode = false;
@@ -44,10 +76,27 @@ int main(int argc, char *argv[]) {
   bool random = false;
   bool singleStep = false;
   bool stepOne = false;
+  bool downsample = false;
+  bool reducedOutput = false;
+  bool statistics = false;
+  bool dmMaxima = false;
+  bool printJSON = false;
+  bool cpu = false;
+  unsigned int nrThreads = 0;
+  Dedispersion::Instrumentation instrumentation(false);
+  Dedispersion::OutputFormat outputFormat = Dedispersion::OutputFormat::Float;
+  Dedispersion::InputLayout inputLayout;
+  Dedispersion::KernelCache kernelCache;
   unsigned int clPlatformID = 0;
   unsigned int clDeviceID = 0;
   uint64_t wrongSamples = 0;
+  uint64_t wrongStatistics = 0;
+  uint64_t wrongMaxima = 0;
   std::string channelsFile;
+  bool sigprocInput = false;
+  bool rawInput = false;
+  std::string inputFile;
+  unsigned int inputBatch = 0;
   Dedispersion::DedispersionConf conf;
   AstroData::Observation observation;
 
@@ -56,26 +105,64 @@ int main(int argc, char *argv[]) {
     printCode = args.getSwitch("-print_code");
     printResults = args.getSwitch("-print_results");
     random = args.getSwitch("-random");
+    // Time of the transfers, the kernel and the sequential reference, printed at the end as text or JSON
+    instrumentation.setEnabled(args.getSwitch("-instrumentation"));
+    printJSON = args.getSwitch("-instrumentation_json");
+    if ( printJSON ) {
+      instrumentation.setEnabled(true);
+    }
     singleStep = args.getSwitch("-single_step");
     stepOne = args.getSwitch("-step_one");
     bool stepTwo = args.getSwitch("-step_two");
-    if ( (static_cast< unsigned int >(singleStep) + static_cast< unsigned int >(stepOne) + static_cast< unsigned int >(stepTwo)) != 1 ) {
-      std::cerr << "Mutually exclusive modes, select one: -single_step -step_one -step_two" << std::endl;
+    // The CPU engines instead of an OpenCL kernel, for all the input bits, intermediate types and input layouts
+    cpu = args.getSwitch("-cpu");
+    if ( (static_cast< unsigned int >(singleStep) + static_cast< unsigned int >(stepOne) + static_cast< unsigned int >(stepTwo) + static_cast< unsigned int >(cpu)) != 1 ) {
+      std::cerr << "Mutually exclusive modes, select one: -single_step -step_one -step_two -cpu" << std::endl;
       return 1;
     }
-    clPlatformID = args.getSwitchArgument< unsigned int >("-opencl_platform");
-    clDeviceID = args.getSwitchArgument< unsigned int >("-opencl_device");
-    if ( singleStep || stepOne ) {
+    if ( cpu ) {
+      nrThreads = args.getSwitchArgument< unsigned int >("-threads");
+    } else {
+      clPlatformID = args.getSwitchArgument< unsigned int >("-opencl_platform");
+      clDeviceID = args.getSwitchArgument< unsigned int >("-opencl_device");
+    }
+    if ( singleStep || stepOne || cpu ) {
       channelsFile = args.getSwitchArgument< std::string >("-zapped_channels");
     }
     padding = args.getSwitchArgument< unsigned int >("-padding");
     // Kernel configuration
+    conf.setSplitBatches(args.getSwitch("-split_batches"));
     conf.setLocalMem(args.getSwitch("-local"));
     conf.setNrThreadsD0(args.getSwitchArgument< unsigned int >("-threadsD0"));
     conf.setNrThreadsD1(args.getSwitchArgument< unsigned int >("-threadsD1"));
     conf.setNrItemsD0(args.getSwitchArgument< unsigned int >("-itemsD0"));
     conf.setNrItemsD1(args.getSwitchArgument< unsigned int >("-itemsD1"));
     conf.setUnroll(args.getSwitchArgument< unsigned int >("-unroll"));
+    // Reduced precision output of single step and step two
+    reducedOutput = args.getSwitch("-reduced_output");
+    if ( reducedOutput ) {
+      outputFormat = Dedispersion::getOutputFormat(args.getSwitchArgument< std::string >("-output_format"));
+    }
+    // Per-DM statistics of the output of single step and step two
+    statistics = args.getSwitch("-statistics");
+    // Maximum over the DMs of every sample, instead of the output of single step and step two
+    dmMaxima = args.getSwitch("-dm_maxima");
+    // Layout of the input of single step and step one
+    if ( args.getSwitch("-time_major") ) {
+      inputLayout.setOrdering(Dedispersion::InputOrdering::TimeMajor);
+    }
+    inputLayout.setReversedFrequency(args.getSwitch("-reversed_frequency"));
+    // Compiled kernels are stored on disk, and loaded instead of compiled again the next time
+    if ( args.getSwitch("-kernel_cache") ) {
+      kernelCache = Dedispersion::KernelCache(args.getSwitchArgument< std::string >("-cache_directory"));
+    }
+    // Input of single step and step one read from a file instead of generated: a SIGPROC filterbank, or a raw dump in the format of the command line
+    sigprocInput = args.getSwitch("-filterbank");
+    rawInput = args.getSwitch("-raw");
+    if ( sigprocInput || rawInput ) {
+      inputFile = args.getSwitchArgument< std::string >("-input_file");
+      inputBatch = args.getSwitchArgument< unsigned int >("-input_batch");
+    }
     // Observation configuration
     observation.setNrBeams(args.getSwitchArgument< unsigned int >("-beams"));
     observation.setNrSamplesPerBatch(args.getSwitchArgument< unsigned int >("-samples"));
@@ -84,6 +171,11 @@ int main(int argc, char *argv[]) {
       observation.setNrSynthesizedBeams(args.getSwitchArgument< unsigned int >("-synthesized_beams"));
       observation.setFrequencyRange(1, args.getSwitchArgument< unsigned int >("-channels"), args.getSwitchArgument< float >("-min_freq"), args.getSwitchArgument< float >("-channel_bandwidth"));
       observation.setDMRange(args.getSwitchArgument< unsigned int >("-dms"), args.getSwitchArgument< float >("-dm_first"), args.getSwitchArgument< float >("-dm_step"));
+      // Fused downsampling: the input has the raw time resolution
+      downsample = args.getSwitch("-downsample");
+      if ( downsample ) {
+        observation.setDownsampling(args.getSwitchArgument< unsigned int >("-downsampling"));
+      }
     } else if ( stepOne ) {
       observation.setFrequencyRange(args.getSwitchArgument< unsigned int >("-subbands"), args.getSwitchArgument< unsigned int >("-channels"), args.getSwitchArgument< float >("-min_freq"), args.getSwitchArgument< float >("-channel_bandwidth"));
       observation.setDMRange(args.getSwitchArgument< unsigned int >("-subbanding_dms"), args.getSwitchArgument< float >("-subbanding_dm_first"), args.getSwitchArgument< float >("-subbanding_dm_step"), true);
@@ -92,15 +184,85 @@ int main(int argc, char *argv[]) {
       observation.setFrequencyRange(args.getSwitchArgument< unsigned int >("-subbands"), args.getSwitchArgument< unsigned int >("-channels"), args.getSwitchArgument< float >("-min_freq"), args.getSwitchArgument< float >("-channel_bandwidth"));
       observation.setDMRange(args.getSwitchArgument< unsigned int >("-subbanding_dms"), 0.0f, 0.0f, true);
       observation.setDMRange(args.getSwitchArgument< unsigned int >("-dms"), args.getSwitchArgument< float >("-dm_first"), args.getSwitchArgument< float >("-dm_step"));
+    } else if ( cpu ) {
+      // The same observation for single step and subbanding
+      observation.setNrSynthesizedBeams(args.getSwitchArgument< unsigned int >("-synthesized_beams"));
+      observation.setFrequencyRange(args.getSwitchArgument< unsigned int >("-subbands"), args.getSwitchArgument< unsigned int >("-channels"), args.getSwitchArgument< float >("-min_freq"), args.getSwitchArgument< float >("-channel_bandwidth"));
+      observation.setDMRange(args.getSwitchArgument< unsigned int >("-subbanding_dms"), args.getSwitchArgument< float >("-subbanding_dm_first"), args.getSwitchArgument< float >("-subbanding_dm_step"), true);
+      observation.setDMRange(args.getSwitchArgument< unsigned int >("-dms"), args.getSwitchArgument< float >("-dm_first"), args.getSwitchArgument< float >("-dm_step"));
     }
   } catch  ( isa::utils::SwitchNotFound & err ) {
     std::cerr << err.what() << std::endl;
     return 1;
   }catch ( std::exception & err ) {
-    std::cerr << "Usage: " << argv[0] << " [-print_code] [-print_results] [-random] [-single_step | -step_one | -step_two] -opencl_platform ... -opencl_device ... -padding ... [-local] -threadsD0 ... -threadsD1 ... -itemsD0 ... -itemsD1 ... -unroll ... -beams ... -channels ... -min_freq ... -channel_bandwidth ... -samples ... -sampling_time ..." << std::endl;
-    std::cerr << "\t-single_step -zapped_channels ... -synthesized_beams ... -dms ... -dm_first ... -dm_step ..." << std::endl;
+    std::cerr << "Usage: " << argv[0] << " [-print_code] [-print_results] [-random] [-instrumentation | -instrumentation_json] [-single_step | -step_one | -step_two | -cpu] -opencl_platform ... -opencl_device ... -padding ... [-split_batches] [-local] [-reduced_output -output_format float|half|ushort|uchar] [-statistics] [-dm_maxima] [-time_major] [-reversed_frequency] [-kernel_cache -cache_directory ...] [-filterbank | -raw -input_file ... -input_batch ...] -threadsD0 ... -threadsD1 ... -itemsD0 ... -itemsD1 ... -unroll ... -beams ... -channels ... -min_freq ... -channel_bandwidth ... -samples ... -sampling_time ..." << std::endl;
+    std::cerr << "\t-single_step -zapped_channels ... -synthesized_beams ... -dms ... -dm_first ... -dm_step ... [-downsample -downsampling ...]" << std::endl;
     std::cerr << "\t-step_one -zapped_channels ... -subbands ... -subbanding_dms ... -subbanding_dm_first ... -subbanding_dm_step ..." << std::endl;
     std::cerr << "\t-step_two -synthesized_beams ... -subbands ... -subbanding_dms ... -dms ... -dm_first ... -dm_step ..." << std::endl;
+    std::cerr << "\t-cpu -threads ... -zapped_channels ... -synthesized_beams ... -subbands ... -subbanding_dms ... -subbanding_dm_first ... -subbanding_dm_step ... -dms ... -dm_first ... -dm_step ... (instead of -opencl_platform and -opencl_device)" << std::endl;
+    return 1;
+  }
+
+  if ( cpu ) {
+    // Input bits, intermediate types, input layouts and split batches are all tested, independently of configuration.hpp and of the switches
+    Dedispersion::ThreadPool pool(nrThreads);
+
+    return testCPU(pool, conf, observation, channelsFile, padding);
+  }
+
+  if ( stepOne && reducedOutput ) {
+    std::cerr << "The output of step one is the input of step two, and can not have a reduced precision." << std::endl;
+    return 1;
+  }
+  if ( stepOne && statistics ) {
+    std::cerr << "The statistics are computed on the dedispersed output, not on the output of step one." << std::endl;
+    return 1;
+  }
+  if ( (stepOne || reducedOutput) && dmMaxima ) {
+    std::cerr << "The DM maxima are float values of the dedispersed output, not of the output of step one or of a reduced output." << std::endl;
+    return 1;
+  }
+  // The file is mapped, and its batch read in place by the device when possible; the layout of the kernels is the one of the file
+  Dedispersion::Filterbank * filterbank = nullptr;
+  if ( sigprocInput && rawInput ) {
+    std::cerr << "Mutually exclusive input files, select one: -filterbank -raw" << std::endl;
+    return 1;
+  } else if ( sigprocInput || rawInput ) {
+    if ( !(singleStep || stepOne) ) {
+      std::cerr << "The input file is the input of single step and step one." << std::endl;
+      return 1;
+    }
+    try {
+      if ( sigprocInput ) {
+        filterbank = new Dedispersion::Filterbank(inputFile);
+        filterbank->setObservation(observation);
+      } else {
+        filterbank = new Dedispersion::Filterbank(inputFile, observation, inputBits, inputLayout.getReversedFrequency());
+      }
+    } catch ( std::exception & err ) {
+      std::cerr << err.what() << std::endl;
+      return 1;
+    }
+    if ( filterbank->getHeader().nrBits != inputBits ) {
+      std::cerr << "The input file has " << filterbank->getHeader().nrBits << " bits per sample, not " << std::to_string(inputBits) << "." << std::endl;
+      return 1;
+    }
+    if ( observation.getNrBeams() != 1 ) {
+      std::cerr << "The input file holds the channels of a single beam." << std::endl;
+      return 1;
+    }
+    inputLayout = filterbank->getLayout();
+  }
+  if ( !(singleStep || stepOne) && !inputLayout.isDefault() ) {
+    std::cerr << "The input layout is the one of the input of single step and step one." << std::endl;
+    return 1;
+  }
+  if ( (inputLayout.getOrdering() == Dedispersion::InputOrdering::TimeMajor) && (inputBits < 8) ) {
+    std::cerr << "Time-major input needs at least 8 bits per sample." << std::endl;
+    return 1;
+  }
+  if ( (singleStep || stepOne) && !Dedispersion::isIntermediateTypeLargeEnough< intermediateDataType >(observation, inputBits) ) {
+    std::cerr << "The intermediate type " << intermediateDataName << " can not hold the sum of " << observation.getNrChannels() << " channels of " << std::to_string(inputBits) << " bits." << std::endl;
     return 1;
   }
 
@@ -117,6 +279,9 @@ int main(int argc, char *argv[]) {
   std::vector< float > * shiftsSingleStep = Dedispersion::getShifts(observation, padding);
   std::vector< float > * shiftsStepOne = Dedispersion::getShifts(observation, padding);
   std::vector< float > * shiftsStepTwo = Dedispersion::getShiftsStepTwo(observation, padding);
+  Dedispersion::DelayTable delaysSingleStep(observation, *shiftsSingleStep, padding, Dedispersion::DedispersionStep::SingleStep);
+  Dedispersion::DelayTable delaysStepOne(observation, *shiftsStepOne, padding, Dedispersion::DedispersionStep::StepOne);
+  Dedispersion::DelayTable delaysStepTwo(observation, *shiftsStepTwo, padding, Dedispersion::DedispersionStep::StepTwo);
   std::vector<unsigned int> zappedChannels(observation.getNrChannels(padding / sizeof(unsigned int)));
   std::vector<unsigned int> beamMappingSingleStep(observation.getNrSynthesizedBeams() * observation.getNrChannels(padding / sizeof(unsigned int)));
   std::vector<unsigned int> beamMappingStepTwo(observation.getNrSynthesizedBeams() * observation.getNrSubbands(padding / sizeof(unsigned int)));
@@ -126,7 +291,7 @@ int main(int argc, char *argv[]) {
   }
   if ( singleStep )
   {
-    observation.setNrSamplesPerDispersedBatch(static_cast<unsigned int>(std::ceil(observation.getNrSamplesPerBatch() + (shiftsSingleStep->at(0) * (observation.getFirstDM() + ((observation.getNrDMs() - 1) * observation.getDMStep()))))));
+    observation.setNrSamplesPerDispersedBatch(observation.getNrSamplesPerBatch() + (delaysSingleStep.getMaxDelay() * observation.getDownsampling()));
     if ( inputBits >= 8 )
     {
       dispersedData.resize(observation.getNrBeams() * observation.getNrChannels() * observation.getNrSamplesPerDispersedBatch(false, padding / sizeof(inputDataType)));
@@ -136,14 +301,14 @@ int main(int argc, char *argv[]) {
     else
     {
       dispersedData.resize(observation.getNrBeams() * observation.getNrChannels() * isa::utils::pad(observation.getNrSamplesPerDispersedBatch() / (8 / inputBits), padding / sizeof(inputDataType)));
-      dedispersedData.resize(observation.getNrSynthesizedBeams() * observation.getNrDMs() * isa::utils::pad(observation.getNrSamplesPerBatch() / (8 / inputBits), padding / sizeof(outputDataType)));
-      dedispersedData_c.resize(observation.getNrSynthesizedBeams() * observation.getNrDMs() * isa::utils::pad(observation.getNrSamplesPerBatch() / (8 / inputBits), padding / sizeof(outputDataType)));
+      dedispersedData.resize(observation.getNrSynthesizedBeams() * observation.getNrDMs() * observation.getNrSamplesPerBatch(false, padding / sizeof(outputDataType)));
+      dedispersedData_c.resize(observation.getNrSynthesizedBeams() * observation.getNrDMs() * observation.getNrSamplesPerBatch(false, padding / sizeof(outputDataType)));
     }
   }
   else if ( stepOne )
   {
-    observation.setNrSamplesPerBatch(static_cast<unsigned int>(std::ceil(observation.getNrSamplesPerBatch() + (shiftsStepTwo->at(0) * (observation.getFirstDM() + ((observation.getNrDMs() - 1) * observation.getDMStep()))))), true);
-    observation.setNrSamplesPerDispersedBatch(static_cast<unsigned int>(std::ceil(observation.getNrSamplesPerBatch(true) + (shiftsStepOne->at(0) * (observation.getFirstDM(true) + ((observation.getNrDMs(true) - 1) * observation.getDMStep(true)))))), true);    
+    observation.setNrSamplesPerBatch(observation.getNrSamplesPerBatch() + delaysStepTwo.getMaxDelay(), true);
+    observation.setNrSamplesPerDispersedBatch(observation.getNrSamplesPerBatch(true) + delaysStepOne.getMaxDelay(), true);
     if ( inputBits >= 8 )
     {
       dispersedData.resize(observation.getNrBeams() * observation.getNrChannels() * observation.getNrSamplesPerDispersedBatch(true, padding / sizeof(inputDataType)));
@@ -153,46 +318,137 @@ int main(int argc, char *argv[]) {
     else
     {
       dispersedData.resize(observation.getNrBeams() * observation.getNrChannels() * isa::utils::pad(observation.getNrSamplesPerDispersedBatch(true) / (8 / inputBits), padding / sizeof(inputDataType)));
-      subbandedData.resize(observation.getNrBeams() * observation.getNrDMs(true) * observation.getNrSubbands() * isa::utils::pad(observation.getNrSamplesPerBatch(true) / (8 / inputBits), padding / sizeof(outputDataType)));
-      subbandedData_c.resize(observation.getNrBeams() * observation.getNrDMs(true) * observation.getNrSubbands() * isa::utils::pad(observation.getNrSamplesPerBatch(true) / (8 / inputBits), padding / sizeof(outputDataType)));
+      subbandedData.resize(observation.getNrBeams() * observation.getNrDMs(true) * observation.getNrSubbands() * observation.getNrSamplesPerBatch(true, padding / sizeof(outputDataType)));
+      subbandedData_c.resize(observation.getNrBeams() * observation.getNrDMs(true) * observation.getNrSubbands() * observation.getNrSamplesPerBatch(true, padding / sizeof(outputDataType)));
     }
   }
   else
   {
-    observation.setNrSamplesPerBatch(static_cast<unsigned int>(std::ceil(observation.getNrSamplesPerBatch() + (shiftsStepTwo->at(0) * (observation.getFirstDM() + ((observation.getNrDMs() - 1) * observation.getDMStep()))))), true);
+    observation.setNrSamplesPerBatch(observation.getNrSamplesPerBatch() + delaysStepTwo.getMaxDelay(), true);
     subbandedData.resize(observation.getNrBeams() * observation.getNrDMs(true) * observation.getNrSubbands() * observation.getNrSamplesPerBatch(true, padding / sizeof(outputDataType)));
     dedispersedData.resize(observation.getNrSynthesizedBeams() * observation.getNrDMs(true) * observation.getNrDMs() * observation.getNrSamplesPerBatch(false, padding / sizeof(outputDataType)));
     dedispersedData_c.resize(observation.getNrSynthesizedBeams() * observation.getNrDMs(true) * observation.getNrDMs() * observation.getNrSamplesPerBatch(false, padding / sizeof(outputDataType)));
   }
 
+  // Split batches: the input on the device is a ring of blocks, and the dispersed batch starts in the last block, so that the kernel wraps around the end of the ring
+  unsigned int nrInputBlocks = 0;
+  unsigned int nrElementsPerInputBlock = 0;
+  unsigned int firstInputBlock = 0;
+  if ( singleStep || stepOne ) {
+    nrInputBlocks = Dedispersion::getNrInputBlocks(observation, stepOne);
+    nrElementsPerInputBlock = observation.getNrBeams() * observation.getNrChannels() * Dedispersion::getNrInputBlockSamplesPerChannel< inputDataType >(observation, padding, inputBits);
+    firstInputBlock = nrInputBlocks - 1;
+  }
+  // Input layout: the test data are generated channel-major, for the sequential code, and arranged in the layout of the kernel on the device
+  unsigned int nrInputChannelsPerSample = Dedispersion::getNrInputChannelsPerSample< inputDataType >(observation, padding);
+  unsigned int nrInputSamplesPerChannel = 0;
+  unsigned int nrBlockSamplesPerChannel = 0;
+  unsigned int nrInputElements = dispersedData.size();
+  if ( singleStep || stepOne ) {
+    nrInputSamplesPerChannel = dispersedData.size() / (observation.getNrBeams() * observation.getNrChannels());
+    nrBlockSamplesPerChannel = Dedispersion::getNrInputBlockSamplesPerChannel< inputDataType >(observation, padding, inputBits);
+    if ( inputLayout.getOrdering() == Dedispersion::InputOrdering::TimeMajor ) {
+      nrInputSamplesPerChannel = observation.getNrSamplesPerDispersedBatch(stepOne);
+      nrBlockSamplesPerChannel = observation.getNrSamplesPerBatch();
+      nrInputElements = observation.getNrBeams() * Dedispersion::getNrInputBeamElements(inputLayout, observation.getNrChannels(), nrInputChannelsPerSample, nrInputSamplesPerChannel);
+      nrElementsPerInputBlock = observation.getNrBeams() * Dedispersion::getNrInputBeamElements(inputLayout, observation.getNrChannels(), nrInputChannelsPerSample, nrBlockSamplesPerChannel);
+    }
+  }
+
+  // Reduced output: every DM maps a different part of the range of the test data to the format, so that some of the samples saturate
+  std::vector< uint8_t > reducedData;
+  Dedispersion::OutputScaling outputScaling;
+  if ( reducedOutput ) {
+    unsigned int nrOutputDMs = observation.getNrDMs();
+    float maximum = 0.0f;
+
+    if ( singleStep ) {
+      maximum = static_cast< float >(observation.getNrChannels() * observation.getDownsampling() * ((inputBits >= 8) ? 10 : (inputBits - 1)));
+    } else {
+      nrOutputDMs = observation.getNrDMs(true) * observation.getNrDMs();
+      maximum = static_cast< float >(observation.getNrSubbands() * 10);
+    }
+    outputScaling = Dedispersion::OutputScaling(outputFormat, observation.getNrSynthesizedBeams(), nrOutputDMs);
+    for ( unsigned int sBeam = 0; sBeam < observation.getNrSynthesizedBeams(); sBeam++ ) {
+      for ( unsigned int dm = 0; dm < nrOutputDMs; dm++ ) {
+        outputScaling.setRange(sBeam, dm, 0.0f, (maximum * ((dm % 4) + 1)) / 4.0f);
+      }
+    }
+    reducedData.resize(observation.getNrSynthesizedBeams() * nrOutputDMs * isa::utils::pad(observation.getNrSamplesPerBatch() / observation.getDownsampling(), padding / Dedispersion::getOutputFormatSize< outputDataType >(outputFormat)) * Dedispersion::getOutputFormatSize< outputDataType >(outputFormat));
+  }
+  // Only the integer formats have offsets and scales as kernel arguments
+  bool scaledOutput = reducedOutput && (outputFormat == Dedispersion::OutputFormat::UShort || outputFormat == Dedispersion::OutputFormat::UChar);
+  Dedispersion::Statistics outputStatistics;
+  if ( statistics ) {
+    outputStatistics = Dedispersion::Statistics(conf, observation, !singleStep);
+  }
+  Dedispersion::DMMaxima outputMaxima;
+  if ( dmMaxima ) {
+    outputMaxima = Dedispersion::DMMaxima(conf, observation, !singleStep);
+  }
+
   // Allocate device memory
-  cl::Buffer shiftsSingleStep_d;
-  cl::Buffer shiftsStepOne_d;
-  cl::Buffer shiftsStepTwo_d;
-  cl::Buffer zappedChannels_d;
+  cl::Buffer delaysSingleStep_d;
+  cl::Buffer delaysStepOne_d;
+  cl::Buffer delaysStepTwo_d;
+  cl::Buffer activeChannels_d;
   cl::Buffer dispersedData_d;
   cl::Buffer subbandedData_d;
   cl::Buffer dedispersedData_d;
   cl::Buffer beamMappingSingleStep_d;
   cl::Buffer beamMappingStepTwo_d;
+  cl::Buffer offsets_d;
+  cl::Buffer scales_d;
+  cl::Buffer statistics_d;
+  cl::Buffer dmMaximaDMs_d;
   try {
     if ( singleStep ) {
-      shiftsSingleStep_d = cl::Buffer(*(openCLRunTime.context), CL_MEM_READ_ONLY, shiftsSingleStep->size() * sizeof(float), 0, 0);
-      zappedChannels_d = cl::Buffer(*(openCLRunTime.context), CL_MEM_READ_ONLY, zappedChannels.size() * sizeof(unsigned int), 0, 0);
-      dispersedData_d = cl::Buffer(*(openCLRunTime.context), CL_MEM_READ_ONLY, dispersedData.size() * sizeof(inputDataType), 0, 0);
-      dedispersedData_d = cl::Buffer(*(openCLRunTime.context), CL_MEM_WRITE_ONLY, dedispersedData.size() * sizeof(outputDataType), 0, 0);
+      delaysSingleStep_d = cl::Buffer(*(openCLRunTime.context), CL_MEM_READ_ONLY, delaysSingleStep.getTable().size() * sizeof(unsigned int), 0, 0);
+      activeChannels_d = cl::Buffer(*(openCLRunTime.context), CL_MEM_READ_ONLY, observation.getNrSynthesizedBeams() * Dedispersion::getActiveChannelsRowLength(observation, padding) * sizeof(unsigned int), 0, 0);
+      if ( conf.getSplitBatches() ) {
+        dispersedData_d = cl::Buffer(*(openCLRunTime.context), CL_MEM_READ_ONLY, nrInputBlocks * nrElementsPerInputBlock * sizeof(inputDataType), 0, 0);
+      } else {
+        dispersedData_d = cl::Buffer(*(openCLRunTime.context), CL_MEM_READ_ONLY, nrInputElements * sizeof(inputDataType), 0, 0);
+      }
+      if ( dmMaxima ) {
+        dedispersedData_d = cl::Buffer(*(openCLRunTime.context), CL_MEM_WRITE_ONLY, outputMaxima.getPartials().size() * sizeof(float), 0, 0);
+      } else if ( reducedOutput ) {
+        dedispersedData_d = cl::Buffer(*(openCLRunTime.context), CL_MEM_WRITE_ONLY, reducedData.size(), 0, 0);
+      } else {
+        dedispersedData_d = cl::Buffer(*(openCLRunTime.context), CL_MEM_WRITE_ONLY, dedispersedData.size() * sizeof(outputDataType), 0, 0);
+      }
       beamMappingSingleStep_d = cl::Buffer(*(openCLRunTime.context), CL_MEM_READ_ONLY, beamMappingSingleStep.size() * sizeof(unsigned int), 0, 0);
     } else if ( stepOne ) {
-      shiftsStepOne_d = cl::Buffer(*(openCLRunTime.context), CL_MEM_READ_ONLY, shiftsStepOne->size() * sizeof(float), 0, 0);
-      zappedChannels_d = cl::Buffer(*(openCLRunTime.context), CL_MEM_READ_ONLY, zappedChannels.size() * sizeof(unsigned int), 0, 0);
-      dispersedData_d = cl::Buffer(*(openCLRunTime.context), CL_MEM_READ_ONLY, dispersedData.size() * sizeof(inputDataType), 0, 0);
+      delaysStepOne_d = cl::Buffer(*(openCLRunTime.context), CL_MEM_READ_ONLY, delaysStepOne.getTable().size() * sizeof(unsigned int), 0, 0);
+      activeChannels_d = cl::Buffer(*(openCLRunTime.context), CL_MEM_READ_ONLY, observation.getNrBeams() * Dedispersion::getActiveChannelsRowLength(observation, padding) * sizeof(unsigned int), 0, 0);
+      if ( conf.getSplitBatches() ) {
+        dispersedData_d = cl::Buffer(*(openCLRunTime.context), CL_MEM_READ_ONLY, nrInputBlocks * nrElementsPerInputBlock * sizeof(inputDataType), 0, 0);
+      } else {
+        dispersedData_d = cl::Buffer(*(openCLRunTime.context), CL_MEM_READ_ONLY, nrInputElements * sizeof(inputDataType), 0, 0);
+      }
       subbandedData_d = cl::Buffer(*(openCLRunTime.context), CL_MEM_WRITE_ONLY, subbandedData.size() * sizeof(outputDataType), 0, 0);
     } else {
-      shiftsStepTwo_d = cl::Buffer(*(openCLRunTime.context), CL_MEM_READ_ONLY, shiftsStepTwo->size() * sizeof(float), 0, 0);
+      delaysStepTwo_d = cl::Buffer(*(openCLRunTime.context), CL_MEM_READ_ONLY, delaysStepTwo.getTable().size() * sizeof(unsigned int), 0, 0);
       subbandedData_d = cl::Buffer(*(openCLRunTime.context), CL_MEM_READ_ONLY, subbandedData.size() * sizeof(outputDataType), 0, 0);
-      dedispersedData_d = cl::Buffer(*(openCLRunTime.context), CL_MEM_WRITE_ONLY, dedispersedData.size() * sizeof(outputDataType), 0, 0);
+      if ( dmMaxima ) {
+        dedispersedData_d = cl::Buffer(*(openCLRunTime.context), CL_MEM_WRITE_ONLY, outputMaxima.getPartials().size() * sizeof(float), 0, 0);
+      } else if ( reducedOutput ) {
+        dedispersedData_d = cl::Buffer(*(openCLRunTime.context), CL_MEM_WRITE_ONLY, reducedData.size(), 0, 0);
+      } else {
+        dedispersedData_d = cl::Buffer(*(openCLRunTime.context), CL_MEM_WRITE_ONLY, dedispersedData.size() * sizeof(outputDataType), 0, 0);
+      }
       beamMappingStepTwo_d = cl::Buffer(*(openCLRunTime.context), CL_MEM_READ_ONLY, beamMappingStepTwo.size() * sizeof(unsigned int), 0, 0);
     }
+    if ( scaledOutput ) {
+      offsets_d = cl::Buffer(*(openCLRunTime.context), CL_MEM_READ_ONLY, outputScaling.getOffsets().size() * sizeof(float), 0, 0);
+      scales_d = cl::Buffer(*(openCLRunTime.context), CL_MEM_READ_ONLY, outputScaling.getScales().size() * sizeof(float), 0, 0);
+    }
+    if ( statistics ) {
+      statistics_d = cl::Buffer(*(openCLRunTime.context), CL_MEM_WRITE_ONLY, outputStatistics.getPartials().size() * sizeof(float), 0, 0);
+    }
+    if ( dmMaxima ) {
+      dmMaximaDMs_d = cl::Buffer(*(openCLRunTime.context), CL_MEM_WRITE_ONLY, outputMaxima.getPartialDMs().size() * sizeof(unsigned int), 0, 0);
+    }
   } catch ( cl::Error & err ) {
     std::cerr << "OpenCL error allocating memory: " << std::to_string(err.err()) << "." << std::endl;
     return 1;
@@ -205,13 +461,10 @@ int main(int argc, char *argv[]) {
       for ( unsigned int channel = 0; channel < observation.getNrChannels(); channel++ ) {
         for ( unsigned int sample = 0; sample < observation.getNrSamplesPerDispersedBatch(); sample++ ) {
           if ( inputBits >= 8 ) {
-            if ( conf.getSplitBatches() ) {
+            if ( random ) {
+              dispersedData[(beam * observation.getNrChannels() * observation.getNrSamplesPerDispersedBatch(false, padding / sizeof(inputDataType))) + (channel * observation.getNrSamplesPerDispersedBatch(false, padding / sizeof(inputDataType))) + sample] = static_cast< inputDataType >(rand() % 10);
             } else {
-              if ( random ) {
-                dispersedData[(beam * observation.getNrChannels() * observation.getNrSamplesPerDispersedBatch(false, padding / sizeof(inputDataType))) + (channel * observation.getNrSamplesPerDispersedBatch(false, padding / sizeof(inputDataType))) + sample] = static_cast< inputDataType >(rand() % 10);
-              } else {
-                dispersedData[(beam * observation.getNrChannels() * observation.getNrSamplesPerDispersedBatch(false, padding / sizeof(inputDataType))) + (channel * observation.getNrSamplesPerDispersedBatch(false, padding / sizeof(inputDataType))) + sample] = static_cast< inputDataType >(10);
-              }
+              dispersedData[(beam * observation.getNrChannels() * observation.getNrSamplesPerDispersedBatch(false, padding / sizeof(inputDataType))) + (channel * observation.getNrSamplesPerDispersedBatch(false, padding / sizeof(inputDataType))) + sample] = static_cast< inputDataType >(10);
             }
           } else {
             unsigned int byte = 0;
@@ -224,24 +477,15 @@ int main(int argc, char *argv[]) {
             } else {
               value = inputBits - 1;
             }
-            if ( conf.getSplitBatches() ) {
-            } else {
-              byte = sample / (8 / inputBits);
-              firstBit = (sample % (8 / inputBits)) * inputBits;
-              buffer = dispersedData[(beam * observation.getNrChannels() * isa::utils::pad(observation.getNrSamplesPerDispersedBatch() / (8 / inputBits), padding / sizeof(inputDataType))) + (channel * isa::utils::pad(observation.getNrSamplesPerDispersedBatch() / (8 / inputBits), padding / sizeof(inputDataType))) + byte];
-            }
+            byte = sample / (8 / inputBits);
+            firstBit = (sample % (8 / inputBits)) * inputBits;
+            buffer = dispersedData[(beam * observation.getNrChannels() * isa::utils::pad(observation.getNrSamplesPerDispersedBatch() / (8 / inputBits), padding / sizeof(inputDataType))) + (channel * isa::utils::pad(observation.getNrSamplesPerDispersedBatch() / (8 / inputBits), padding / sizeof(inputDataType))) + byte];
 
             for ( unsigned int bit = 0; bit < inputBits; bit++ ) {
-              if ( conf.getSplitBatches() ) {
-              } else {
-                isa::utils::setBit(buffer, isa::utils::getBit(value, bit), firstBit + bit);
-              }
+              isa::utils::setBit(buffer, isa::utils::getBit(value, bit), firstBit + bit);
             }
 
-            if ( conf.getSplitBatches() ) {
-            } else {
-              dispersedData[(beam * observation.getNrChannels() * isa::utils::pad(observation.getNrSamplesPerDispersedBatch() / (8 / inputBits), padding / sizeof(inputDataType))) + (channel * isa::utils::pad(observation.getNrSamplesPerDispersedBatch() / (8 / inputBits), padding / sizeof(inputDataType))) + byte] = buffer;
-            }
+            dispersedData[(beam * observation.getNrChannels() * isa::utils::pad(observation.getNrSamplesPerDispersedBatch() / (8 / inputBits), padding / sizeof(inputDataType))) + (channel * isa::utils::pad(observation.getNrSamplesPerDispersedBatch() / (8 / inputBits), padding / sizeof(inputDataType))) + byte] = buffer;
           }
         }
       }
@@ -252,13 +496,10 @@ int main(int argc, char *argv[]) {
       for ( unsigned int channel = 0; channel < observation.getNrChannels(); channel++ ) {
         for ( unsigned int sample = 0; sample < observation.getNrSamplesPerDispersedBatch(true); sample++ ) {
           if ( inputBits >= 8 ) {
-            if ( conf.getSplitBatches() ) {
+            if ( random ) {
+              dispersedData[(beam * observation.getNrChannels() * observation.getNrSamplesPerDispersedBatch(true, padding / sizeof(inputDataType))) + (channel * observation.getNrSamplesPerDispersedBatch(true, padding / sizeof(inputDataType))) + sample] = static_cast< inputDataType >(rand() % 10);
             } else {
-              if ( random ) {
-                dispersedData[(beam * observation.getNrChannels() * observation.getNrSamplesPerDispersedBatch(true, padding / sizeof(inputDataType))) + (channel * observation.getNrSamplesPerDispersedBatch(true, padding / sizeof(inputDataType))) + sample] = static_cast< inputDataType >(rand() % 10);
-              } else {
-                dispersedData[(beam * observation.getNrChannels() * observation.getNrSamplesPerDispersedBatch(true, padding / sizeof(inputDataType))) + (channel * observation.getNrSamplesPerDispersedBatch(true, padding / sizeof(inputDataType))) + sample] = static_cast< inputDataType >(10);
-              }
+              dispersedData[(beam * observation.getNrChannels() * observation.getNrSamplesPerDispersedBatch(true, padding / sizeof(inputDataType))) + (channel * observation.getNrSamplesPerDispersedBatch(true, padding / sizeof(inputDataType))) + sample] = static_cast< inputDataType >(10);
             }
           } else {
             unsigned int byte = 0;
@@ -271,24 +512,15 @@ int main(int argc, char *argv[]) {
             } else {
               value = inputBits - 1;
             }
-            if ( conf.getSplitBatches() ) {
-            } else {
-              byte = sample / (8 / inputBits);
-              firstBit = (sample % (8 / inputBits)) * inputBits;
-              buffer = dispersedData[(beam * observation.getNrChannels() * isa::utils::pad(observation.getNrSamplesPerDispersedBatch(true) / (8 / inputBits), padding / sizeof(inputDataType))) + (channel * isa::utils::pad(observation.getNrSamplesPerDispersedBatch(true) / (8 / inputBits), padding / sizeof(inputDataType))) + byte];
-            }
+            byte = sample / (8 / inputBits);
+            firstBit = (sample % (8 / inputBits)) * inputBits;
+            buffer = dispersedData[(beam * observation.getNrChannels() * isa::utils::pad(observation.getNrSamplesPerDispersedBatch(true) / (8 / inputBits), padding / sizeof(inputDataType))) + (channel * isa::utils::pad(observation.getNrSamplesPerDispersedBatch(true) / (8 / inputBits), padding / sizeof(inputDataType))) + byte];
 
             for ( unsigned int bit = 0; bit < inputBits; bit++ ) {
-              if ( conf.getSplitBatches() ) {
-              } else {
-                isa::utils::setBit(buffer, isa::utils::getBit(value, bit), firstBit + bit);
-              }
+              isa::utils::setBit(buffer, isa::utils::getBit(value, bit), firstBit + bit);
             }
 
-            if ( conf.getSplitBatches() ) {
-            } else {
-              dispersedData[(beam * observation.getNrChannels() * isa::utils::pad(observation.getNrSamplesPerDispersedBatch(true) / (8 / inputBits), padding / sizeof(inputDataType))) + (channel * isa::utils::pad(observation.getNrSamplesPerDispersedBatch(true) / (8 / inputBits), padding / sizeof(inputDataType))) + byte] = buffer;
-            }
+            dispersedData[(beam * observation.getNrChannels() * isa::utils::pad(observation.getNrSamplesPerDispersedBatch(true) / (8 / inputBits), padding / sizeof(inputDataType))) + (channel * isa::utils::pad(observation.getNrSamplesPerDispersedBatch(true) / (8 / inputBits), padding / sizeof(inputDataType))) + byte] = buffer;
           }
         }
       }
@@ -310,22 +542,121 @@ int main(int argc, char *argv[]) {
     AstroData::generateBeamMapping(observation, beamMappingStepTwo, padding, true);
   }
 
+  // Input read from the file: the channel-major copy is only the input of the sequential code
+  if ( filterbank != nullptr ) {
+    Dedispersion::InputWindow< inputDataType > window;
+
+    try {
+      window = Dedispersion::getFilterbankWindow< inputDataType >(*filterbank, observation, inputBatch, stepOne);
+    } catch ( std::exception & err ) {
+      std::cerr << err.what() << std::endl;
+      return 1;
+    }
+    for ( unsigned int channel = 0; channel < observation.getNrChannels(); channel++ ) {
+      Dedispersion::gatherInput(window, Dedispersion::getInputChannel(window, observation, 0, channel), 0, observation.getNrSamplesPerDispersedBatch(stepOne), dispersedData.data() + (channel * (dispersedData.size() / observation.getNrChannels())));
+    }
+  }
+
+  // Compact the zapped channels, per synthesized beam for single step, per beam for step one
+  std::vector<unsigned int> activeChannels;
+  if ( singleStep ) {
+    activeChannels = Dedispersion::ActiveChannels(observation, Dedispersion::ActiveChannels(observation, zappedChannels, padding), beamMappingSingleStep, padding).getRows();
+  } else if ( stepOne ) {
+    activeChannels = Dedispersion::ActiveChannels(observation, zappedChannels, padding).getRows();
+  }
+
   // Copy data from host to device H2D
   try {
+    // The transfers of the input, or of the output of step one, are complete when the timer stops
+    Dedispersion::StageTimer transferTimer(&instrumentation, Dedispersion::Stage::HostToDevice, (singleStep || stepOne) ? nrInputElements * sizeof(inputDataType) : subbandedData.size() * sizeof(outputDataType));
+
     if ( singleStep ) {
-      openCLRunTime.queues->at(clDeviceID)[0].enqueueWriteBuffer(shiftsSingleStep_d, CL_FALSE, 0, shiftsSingleStep->size() * sizeof(float), reinterpret_cast< void * >(shiftsSingleStep->data()), 0, 0);
-      openCLRunTime.queues->at(clDeviceID)[0].enqueueWriteBuffer(zappedChannels_d, CL_FALSE, 0, zappedChannels.size() * sizeof(unsigned int), reinterpret_cast< void * >(zappedChannels.data()), 0, 0);
-      openCLRunTime.queues->at(clDeviceID)[0].enqueueWriteBuffer(dispersedData_d, CL_FALSE, 0, dispersedData.size() * sizeof(inputDataType), reinterpret_cast< void * >(dispersedData.data()), 0, 0);
+      openCLRunTime.queues->at(clDeviceID)[0].enqueueWriteBuffer(delaysSingleStep_d, CL_FALSE, 0, delaysSingleStep.getTable().size() * sizeof(unsigned int), reinterpret_cast< const void * >(delaysSingleStep.getTable().data()), 0, 0);
+      openCLRunTime.queues->at(clDeviceID)[0].enqueueWriteBuffer(activeChannels_d, CL_FALSE, 0, activeChannels.size() * sizeof(unsigned int), reinterpret_cast< void * >(activeChannels.data()), 0, 0);
       openCLRunTime.queues->at(clDeviceID)[0].enqueueWriteBuffer(beamMappingSingleStep_d, CL_FALSE, 0, beamMappingSingleStep.size() * sizeof(unsigned int), reinterpret_cast< void * >(beamMappingSingleStep.data()), 0, 0);
     } else if ( stepOne ) {
-      openCLRunTime.queues->at(clDeviceID)[0].enqueueWriteBuffer(shiftsStepOne_d, CL_FALSE, 0, shiftsStepOne->size() * sizeof(float), reinterpret_cast< void * >(shiftsStepOne->data()), 0, 0);
-      openCLRunTime.queues->at(clDeviceID)[0].enqueueWriteBuffer(zappedChannels_d, CL_FALSE, 0, zappedChannels.size() * sizeof(unsigned int), reinterpret_cast< void * >(zappedChannels.data()), 0, 0);
-      openCLRunTime.queues->at(clDeviceID)[0].enqueueWriteBuffer(dispersedData_d, CL_FALSE, 0, dispersedData.size() * sizeof(inputDataType), reinterpret_cast< void * >(dispersedData.data()), 0, 0);
+      openCLRunTime.queues->at(clDeviceID)[0].enqueueWriteBuffer(delaysStepOne_d, CL_FALSE, 0, delaysStepOne.getTable().size() * sizeof(unsigned int), reinterpret_cast< const void * >(delaysStepOne.getTable().data()), 0, 0);
+      openCLRunTime.queues->at(clDeviceID)[0].enqueueWriteBuffer(activeChannels_d, CL_FALSE, 0, activeChannels.size() * sizeof(unsigned int), reinterpret_cast< void * >(activeChannels.data()), 0, 0);
     } else {
-      openCLRunTime.queues->at(clDeviceID)[0].enqueueWriteBuffer(shiftsStepTwo_d, CL_FALSE, 0, shiftsStepTwo->size() * sizeof(float), reinterpret_cast< void * >(shiftsStepTwo->data()), 0, 0);
+      openCLRunTime.queues->at(clDeviceID)[0].enqueueWriteBuffer(delaysStepTwo_d, CL_FALSE, 0, delaysStepTwo.getTable().size() * sizeof(unsigned int), reinterpret_cast< const void * >(delaysStepTwo.getTable().data()), 0, 0);
       openCLRunTime.queues->at(clDeviceID)[0].enqueueWriteBuffer(subbandedData_d, CL_FALSE, 0, subbandedData.size() * sizeof(outputDataType), reinterpret_cast< void * >(subbandedData.data()), 0, 0);
       openCLRunTime.queues->at(clDeviceID)[0].enqueueWriteBuffer(beamMappingStepTwo_d, CL_FALSE, 0, beamMappingStepTwo.size() * sizeof(unsigned int), reinterpret_cast< void * >(beamMappingStepTwo.data()), 0, 0);
     }
+    if ( scaledOutput ) {
+      openCLRunTime.queues->at(clDeviceID)[0].enqueueWriteBuffer(offsets_d, CL_FALSE, 0, outputScaling.getOffsets().size() * sizeof(float), reinterpret_cast< const void * >(outputScaling.getOffsets().data()), 0, 0);
+      openCLRunTime.queues->at(clDeviceID)[0].enqueueWriteBuffer(scales_d, CL_FALSE, 0, outputScaling.getScales().size() * sizeof(float), reinterpret_cast< const void * >(outputScaling.getScales().data()), 0, 0);
+    }
+    if ( (filterbank != nullptr) && !conf.getSplitBatches() && (filterbank->getHeader().nrChannels == nrInputChannelsPerSample) ) {
+      // The rows of the file are the rows of the time-major input: a CPU device reads the batch in place, the others get it straight from the mapping
+      const uint8_t * batch = filterbank->getSamples(static_cast< uint64_t >(inputBatch) * observation.getNrSamplesPerBatch());
+
+      if ( (openCLRunTime.devices->at(clDeviceID).getInfo< CL_DEVICE_TYPE >() & CL_DEVICE_TYPE_CPU) != 0 ) {
+        dispersedData_d = cl::Buffer(*(openCLRunTime.context), CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR, nrInputElements * sizeof(inputDataType), const_cast< uint8_t * >(batch), 0);
+      } else {
+        openCLRunTime.queues->at(clDeviceID)[0].enqueueWriteBuffer(dispersedData_d, CL_FALSE, 0, nrInputElements * sizeof(inputDataType), reinterpret_cast< const void * >(batch), 0, 0);
+      }
+    } else if ( (singleStep || stepOne) && !inputLayout.isDefault() ) {
+      // The whole input, or the whole ring of blocks, in the layout of the kernel
+      unsigned int nrElementsPerBatch = observation.getNrSamplesPerBatch();
+      unsigned int nrElementsPerDispersedBatch = observation.getNrSamplesPerDispersedBatch(stepOne);
+      std::vector< inputDataType > layoutData(conf.getSplitBatches() ? nrInputBlocks * nrElementsPerInputBlock : nrInputElements);
+
+      if ( inputBits < 8 ) {
+        nrElementsPerBatch /= (8 / inputBits);
+        nrElementsPerDispersedBatch /= (8 / inputBits);
+      }
+      for ( unsigned int beam = 0; beam < observation.getNrBeams(); beam++ ) {
+        for ( unsigned int channel = 0; channel < observation.getNrChannels(); channel++ ) {
+          unsigned int row = channel;
+
+          if ( inputLayout.getReversedFrequency() ) {
+            row = observation.getNrChannels() - 1 - channel;
+          }
+          for ( unsigned int element = 0; element < nrElementsPerDispersedBatch; element++ ) {
+            uint64_t index = 0;
+            unsigned int position = element;
+            unsigned int nrSamplesPerChannel = nrInputSamplesPerChannel;
+
+            if ( conf.getSplitBatches() ) {
+              index = static_cast< uint64_t >((firstInputBlock + (element / nrElementsPerBatch)) % nrInputBlocks) * nrElementsPerInputBlock;
+              position = element % nrElementsPerBatch;
+              nrSamplesPerChannel = nrBlockSamplesPerChannel;
+            }
+            if ( inputLayout.getOrdering() == Dedispersion::InputOrdering::TimeMajor ) {
+              index += (beam * nrSamplesPerChannel * nrInputChannelsPerSample) + (position * nrInputChannelsPerSample) + row;
+            } else {
+              index += (((beam * observation.getNrChannels()) + row) * nrSamplesPerChannel) + position;
+            }
+            layoutData[index] = dispersedData[(((beam * observation.getNrChannels()) + channel) * (dispersedData.size() / (observation.getNrBeams() * observation.getNrChannels()))) + element];
+          }
+        }
+      }
+      openCLRunTime.queues->at(clDeviceID)[0].enqueueWriteBuffer(dispersedData_d, CL_TRUE, 0, layoutData.size() * sizeof(inputDataType), reinterpret_cast< void * >(layoutData.data()), 0, 0);
+    } else if ( (singleStep || stepOne) && conf.getSplitBatches() ) {
+      // One transfer per block, as when a new batch arrives
+      unsigned int nrElementsPerBatch = observation.getNrSamplesPerBatch();
+      unsigned int nrElementsPerDispersedBatch = observation.getNrSamplesPerDispersedBatch(stepOne);
+      unsigned int nrElementsPerChannel = Dedispersion::getNrInputBlockSamplesPerChannel< inputDataType >(observation, padding, inputBits);
+      std::vector< inputDataType > inputBlock(nrElementsPerInputBlock);
+
+      if ( inputBits < 8 ) {
+        nrElementsPerBatch /= (8 / inputBits);
+        nrElementsPerDispersedBatch /= (8 / inputBits);
+      }
+      for ( unsigned int block = 0; block < nrInputBlocks; block++ ) {
+        unsigned int nrBlockElements = std::min(nrElementsPerBatch, nrElementsPerDispersedBatch - (block * nrElementsPerBatch));
+
+        for ( unsigned int row = 0; row < observation.getNrBeams() * observation.getNrChannels(); row++ ) {
+          std::copy(dispersedData.begin() + (row * (dispersedData.size() / (observation.getNrBeams() * observation.getNrChannels()))) + (block * nrElementsPerBatch), dispersedData.begin() + (row * (dispersedData.size() / (observation.getNrBeams() * observation.getNrChannels()))) + (block * nrElementsPerBatch) + nrBlockElements, inputBlock.begin() + (row * nrElementsPerChannel));
+        }
+        openCLRunTime.queues->at(clDeviceID)[0].enqueueWriteBuffer(dispersedData_d, CL_TRUE, ((firstInputBlock + block) % nrInputBlocks) * nrElementsPerInputBlock * sizeof(inputDataType), nrElementsPerInputBlock * sizeof(inputDataType), reinterpret_cast< void * >(inputBlock.data()), 0, 0);
+      }
+    } else if ( singleStep || stepOne ) {
+      openCLRunTime.queues->at(clDeviceID)[0].enqueueWriteBuffer(dispersedData_d, CL_FALSE, 0, dispersedData.size() * sizeof(inputDataType), reinterpret_cast< void * >(dispersedData.data()), 0, 0);
+    }
+    if ( instrumentation.isEnabled() ) {
+      openCLRunTime.queues->at(clDeviceID)[0].finish();
+    }
   } catch ( cl::Error & err ) {
     std::cerr << "OpenCL error H2D transfer: " << std::to_string(err.err()) << "." << std::endl;
     return 1;
@@ -336,22 +667,22 @@ int main(int argc, char *argv[]) {
   cl::Kernel * kernel;
 
   if ( singleStep ) {
-    code = Dedispersion::getDedispersionOpenCL< inputDataType, outputDataType >(conf, padding, inputBits, inputDataName, intermediateDataName, outputDataName, observation, *shiftsSingleStep);
+    code = Dedispersion::getDedispersionOpenCL< inputDataType, outputDataType >(conf, padding, inputBits, inputDataName, intermediateDataName, outputDataName, observation, delaysSingleStep, downsample, outputFormat, statistics, dmMaxima, inputLayout);
   } else if ( stepOne ) {
-    code = Dedispersion::getSubbandDedispersionStepOneOpenCL< inputDataType, outputDataType >(conf, padding, inputBits, inputDataName, intermediateDataName, outputDataName, observation, *shiftsStepOne);
+    code = Dedispersion::getSubbandDedispersionStepOneOpenCL< inputDataType, outputDataType >(conf, padding, inputBits, inputDataName, intermediateDataName, outputDataName, observation, delaysStepOne, false, inputLayout);
   } else {
-    code = Dedispersion::getSubbandDedispersionStepTwoOpenCL< outputDataType >(conf, padding, outputDataName, observation, *shiftsStepTwo);
+    code = Dedispersion::getSubbandDedispersionStepTwoOpenCL< outputDataType >(conf, padding, outputDataName, observation, delaysStepTwo, outputFormat, statistics, dmMaxima);
   }
   if ( printCode ) {
     std::cout << *code << std::endl;
   }
   try {
     if ( singleStep ) {
-      kernel = isa::OpenCL::compile("dedispersion", *code, "-cl-mad-enable -Werror", *(openCLRunTime.context), openCLRunTime.devices->at(clDeviceID));
+      kernel = kernelCache.compile("dedispersion", *code, "-cl-mad-enable -Werror", *(openCLRunTime.context), openCLRunTime.devices->at(clDeviceID));
     } else if ( stepOne ) {
-      kernel = isa::OpenCL::compile("dedispersionStepOne", *code, "-cl-mad-enable -Werror", *(openCLRunTime.context), openCLRunTime.devices->at(clDeviceID));
+      kernel = kernelCache.compile("dedispersionStepOne", *code, "-cl-mad-enable -Werror", *(openCLRunTime.context), openCLRunTime.devices->at(clDeviceID));
     } else {
-      kernel = isa::OpenCL::compile("dedispersionStepTwo", *code, "-cl-mad-enable -Werror", *(openCLRunTime.context), openCLRunTime.devices->at(clDeviceID));
+      kernel = kernelCache.compile("dedispersionStepTwo", *code, "-cl-mad-enable -Werror", *(openCLRunTime.context), openCLRunTime.devices->at(clDeviceID));
     }
   } catch ( isa::OpenCL::OpenCLError & err ) {
     std::cerr << err.what() << std::endl;
@@ -364,7 +695,7 @@ int main(int argc, char *argv[]) {
     cl::NDRange local;
 
     if ( singleStep ) {
-      global = cl::NDRange(isa::utils::pad(observation.getNrSamplesPerBatch() / conf.getNrItemsD0(), conf.getNrThreadsD0()), observation.getNrDMs() / conf.getNrItemsD1(), observation.getNrSynthesizedBeams());
+      global = cl::NDRange(isa::utils::pad((observation.getNrSamplesPerBatch() / observation.getDownsampling()) / conf.getNrItemsD0(), conf.getNrThreadsD0()), observation.getNrDMs() / conf.getNrItemsD1(), observation.getNrSynthesizedBeams());
       local = cl::NDRange(conf.getNrThreadsD0(), conf.getNrThreadsD1(), 1);
     } else if ( stepOne ) {
       global = cl::NDRange(isa::utils::pad(observation.getNrSamplesPerBatch(true) / conf.getNrItemsD0(), conf.getNrThreadsD0()), observation.getNrDMs(true) / conf.getNrItemsD1(), observation.getNrBeams() * observation.getNrSubbands());
@@ -375,48 +706,195 @@ int main(int argc, char *argv[]) {
     }
 
     if ( singleStep ) {
+      kernel->setArg(0, dispersedData_d);
+      kernel->setArg(1, dedispersedData_d);
+      kernel->setArg(2, beamMappingSingleStep_d);
+      kernel->setArg(3, activeChannels_d);
+      kernel->setArg(4, delaysSingleStep_d);
+      kernel->setArg(5, 0);
       if ( conf.getSplitBatches() ) {
-      } else {
-        kernel->setArg(0, dispersedData_d);
-        kernel->setArg(1, dedispersedData_d);
-        kernel->setArg(2, beamMappingSingleStep_d);
-        kernel->setArg(3, zappedChannels_d);
-        kernel->setArg(4, shiftsSingleStep_d);
-        kernel->setArg(5, 0);
+        kernel->setArg(6, firstInputBlock);
+      }
+      if ( scaledOutput ) {
+        kernel->setArg(conf.getSplitBatches() ? 7 : 6, offsets_d);
+        kernel->setArg(conf.getSplitBatches() ? 8 : 7, scales_d);
+      }
+      if ( statistics ) {
+        kernel->setArg(6 + (conf.getSplitBatches() ? 1 : 0) + (scaledOutput ? 2 : 0), statistics_d);
+      }
+      if ( dmMaxima ) {
+        kernel->setArg(6 + (conf.getSplitBatches() ? 1 : 0) + (statistics ? 1 : 0), dmMaximaDMs_d);
       }
     } else if ( stepOne ) {
       kernel->setArg(0, dispersedData_d);
       kernel->setArg(1, subbandedData_d);
-      kernel->setArg(2, zappedChannels_d);
-      kernel->setArg(3, shiftsStepOne_d);
+      kernel->setArg(2, activeChannels_d);
+      kernel->setArg(3, delaysStepOne_d);
+      if ( conf.getSplitBatches() ) {
+        kernel->setArg(4, firstInputBlock);
+      }
     } else {
       kernel->setArg(0, subbandedData_d);
       kernel->setArg(1, dedispersedData_d);
       kernel->setArg(2, beamMappingStepTwo_d);
-      kernel->setArg(3, shiftsStepTwo_d);
+      kernel->setArg(3, delaysStepTwo_d);
       kernel->setArg(4, 0);
+      if ( scaledOutput ) {
+        kernel->setArg(5, offsets_d);
+        kernel->setArg(6, scales_d);
+      }
+      if ( statistics ) {
+        kernel->setArg(scaledOutput ? 7 : 5, statistics_d);
+      }
+      if ( dmMaxima ) {
+        kernel->setArg(statistics ? 6 : 5, dmMaximaDMs_d);
+      }
     }
-    openCLRunTime.queues->at(clDeviceID)[0].enqueueNDRangeKernel(*kernel, cl::NullRange, global, local);
-    if ( singleStep ) {
-      if ( conf.getSplitBatches() ) {
-      } else {
+    cl::Event kernelEvent;
+    // Operations as in DedispersionTuning
+    uint64_t nrOperations = Dedispersion::getNrDedispersionOperations(observation, false);
+
+    if ( stepOne ) {
+      nrOperations = static_cast< uint64_t >(observation.getNrBeams()) * observation.getNrDMs(true) * (observation.getNrChannels() - observation.getNrZappedChannels()) * observation.getNrSamplesPerBatch(true);
+    } else if ( !singleStep ) {
+      nrOperations = static_cast< uint64_t >(observation.getNrSynthesizedBeams()) * observation.getNrDMs(true) * observation.getNrDMs() * observation.getNrSubbands() * observation.getNrSamplesPerBatch();
+    }
+    openCLRunTime.queues->at(clDeviceID)[0].enqueueNDRangeKernel(*kernel, cl::NullRange, global, local, nullptr, &kernelEvent);
+    if ( instrumentation.isEnabled() ) {
+      // Otherwise the kernel runs while the sequential reference is computed
+      kernelEvent.wait();
+      if ( !instrumentation.add(Dedispersion::Stage::Kernel, kernelEvent, 0, nrOperations) ) {
+        std::cerr << "No kernel time: the OpenCL queue has no profiling." << std::endl;
+      }
+    }
+    {
+      Dedispersion::StageTimer referenceTimer(&instrumentation, Dedispersion::Stage::CPU, 0, nrOperations);
+
+      if ( singleStep && downsample ) {
+        std::vector< intermediateDataType > downsampledData(observation.getNrBeams() * observation.getNrChannels() * observation.getNrSamplesPerDispersedBatch(false, padding / sizeof(intermediateDataType)));
+
+        Dedispersion::downsample< inputDataType, intermediateDataType >(observation, dispersedData, downsampledData, padding, inputBits, false);
+        Dedispersion::dedispersion< intermediateDataType, intermediateDataType, outputDataType >(observation, zappedChannels, beamMappingSingleStep, downsampledData, dedispersedData_c, *shiftsSingleStep, padding, 8);
+      } else if ( singleStep ) {
         Dedispersion::dedispersion< inputDataType, intermediateDataType, outputDataType >(observation, zappedChannels, beamMappingSingleStep, dispersedData, dedispersedData_c, *shiftsSingleStep, padding, inputBits);
+      } else if ( stepOne ) {
+        Dedispersion::subbandDedispersionStepOne< inputDataType, intermediateDataType, outputDataType >(observation, zappedChannels, dispersedData, subbandedData_c, *shiftsStepOne, padding, inputBits);
+      } else {
+        Dedispersion::subbandDedispersionStepTwo< outputDataType, intermediateDataType, outputDataType >(observation, beamMappingStepTwo, subbandedData, dedispersedData_c, *shiftsStepTwo, padding);
       }
-      openCLRunTime.queues->at(clDeviceID)[0].enqueueReadBuffer(dedispersedData_d, CL_TRUE, 0, dedispersedData.size() * sizeof(outputDataType), reinterpret_cast< void * >(dedispersedData.data()));
-    } else if ( stepOne ) {
-      Dedispersion::subbandDedispersionStepOne< inputDataType, intermediateDataType, outputDataType >(observation, zappedChannels, dispersedData, subbandedData_c, *shiftsStepOne, padding, inputBits);
+    }
+    // The output read back from the device
+    uint64_t nrOutputBytes = dedispersedData.size() * sizeof(outputDataType);
+
+    if ( stepOne ) {
+      nrOutputBytes = subbandedData.size() * sizeof(outputDataType);
+    } else if ( dmMaxima ) {
+      nrOutputBytes = outputMaxima.getPartials().size() * (sizeof(float) + sizeof(unsigned int));
+    } else if ( reducedOutput ) {
+      nrOutputBytes = reducedData.size();
+    }
+    if ( statistics ) {
+      nrOutputBytes += outputStatistics.getPartials().size() * sizeof(float);
+    }
+    Dedispersion::StageTimer readTimer(&instrumentation, Dedispersion::Stage::DeviceToHost, nrOutputBytes);
+
+    if ( stepOne ) {
       openCLRunTime.queues->at(clDeviceID)[0].enqueueReadBuffer(subbandedData_d, CL_TRUE, 0, subbandedData.size() * sizeof(outputDataType), reinterpret_cast< void * >(subbandedData.data()));
-    } else {
-      Dedispersion::subbandDedispersionStepTwo< outputDataType, intermediateDataType, outputDataType >(observation, beamMappingStepTwo, subbandedData, dedispersedData_c, *shiftsStepTwo, padding);
+    }
+    if ( dmMaxima ) {
+      openCLRunTime.queues->at(clDeviceID)[0].enqueueReadBuffer(dedispersedData_d, CL_TRUE, 0, outputMaxima.getPartials().size() * sizeof(float), reinterpret_cast< void * >(outputMaxima.getPartials().data()));
+      openCLRunTime.queues->at(clDeviceID)[0].enqueueReadBuffer(dmMaximaDMs_d, CL_TRUE, 0, outputMaxima.getPartialDMs().size() * sizeof(unsigned int), reinterpret_cast< void * >(outputMaxima.getPartialDMs().data()));
+    } else if ( reducedOutput ) {
+      openCLRunTime.queues->at(clDeviceID)[0].enqueueReadBuffer(dedispersedData_d, CL_TRUE, 0, reducedData.size(), reinterpret_cast< void * >(reducedData.data()));
+    } else if ( !stepOne ) {
       openCLRunTime.queues->at(clDeviceID)[0].enqueueReadBuffer(dedispersedData_d, CL_TRUE, 0, dedispersedData.size() * sizeof(outputDataType), reinterpret_cast< void * >(dedispersedData.data()));
     }
+    if ( statistics ) {
+      openCLRunTime.queues->at(clDeviceID)[0].enqueueReadBuffer(statistics_d, CL_TRUE, 0, outputStatistics.getPartials().size() * sizeof(float), reinterpret_cast< void * >(outputStatistics.getPartials().data()));
+    }
   } catch ( cl::Error & err ) {
     std::cerr << "OpenCL error kernel execution: " << std::to_string(err.err()) << "." << std::endl;
     return 1;
   }
 
   // Compare results
-  if ( singleStep ) {
+  if ( dmMaxima ) {
+    // The maximum of the sequential output; a different DM is correct if its sample is the same as the maximum
+    unsigned int nrOutputDMs = singleStep ? observation.getNrDMs() : observation.getNrDMs(true) * observation.getNrDMs();
+    unsigned int nrSamples = observation.getNrSamplesPerBatch() / observation.getDownsampling();
+    unsigned int nrSamplesPadded = isa::utils::pad(nrSamples, padding / sizeof(outputDataType));
+
+    for ( unsigned int syntBeam = 0; syntBeam < observation.getNrSynthesizedBeams(); syntBeam++ ) {
+      if ( printResults ) {
+        std::cout << "sBeam: " << syntBeam << std::endl;
+      }
+      for ( unsigned int sample = 0; sample < nrSamples; sample++ ) {
+        outputDataType maximum = dedispersedData_c[(syntBeam * nrOutputDMs * nrSamplesPadded) + sample];
+        unsigned int dm = outputMaxima.getDM(syntBeam, sample);
+
+        for ( unsigned int referenceDM = 1; referenceDM < nrOutputDMs; referenceDM++ ) {
+          maximum = std::max(maximum, dedispersedData_c[(syntBeam * nrOutputDMs * nrSamplesPadded) + (referenceDM * nrSamplesPadded) + sample]);
+        }
+        if ( (dm >= nrOutputDMs) || !isa::utils::same(outputMaxima.getMaximum(syntBeam, sample), static_cast< float >(maximum)) || !isa::utils::same(dedispersedData_c[(syntBeam * nrOutputDMs * nrSamplesPadded) + (dm * nrSamplesPadded) + sample], maximum) ) {
+          wrongMaxima++;
+        }
+        if ( printResults ) {
+          std::cout << outputMaxima.getMaximum(syntBeam, sample) << "@" << dm << "," << maximum << " ";
+        }
+      }
+      if ( printResults ) {
+        std::cout << std::endl;
+      }
+    }
+    if ( wrongMaxima > 0 ) {
+      std::cout << "Wrong maxima: " << wrongMaxima << " (" << (wrongMaxima * 100.0) / (static_cast< uint64_t >(observation.getNrSynthesizedBeams()) * nrSamples) << "%)." << std::endl;
+    }
+  } else if ( reducedOutput ) {
+    // The sequential output converted on the host, as in convertOutput()
+    unsigned int nrOutputDMs = singleStep ? observation.getNrDMs() : observation.getNrDMs(true) * observation.getNrDMs();
+    unsigned int nrSamples = observation.getNrSamplesPerBatch() / observation.getDownsampling();
+    unsigned int formatSize = Dedispersion::getOutputFormatSize< outputDataType >(outputFormat);
+
+    for ( unsigned int syntBeam = 0; syntBeam < observation.getNrSynthesizedBeams(); syntBeam++ ) {
+      if ( printResults ) {
+        std::cout << "Synthesized Beam: " << syntBeam << std::endl;
+      }
+      for ( unsigned int dm = 0; dm < nrOutputDMs; dm++ ) {
+        if ( printResults ) {
+          std::cout << "DM: " << dm << " = ";
+        }
+        for ( unsigned int sample = 0; sample < nrSamples; sample++ ) {
+          outputDataType reference = dedispersedData_c[(syntBeam * nrOutputDMs * isa::utils::pad(nrSamples, padding / sizeof(outputDataType))) + (dm * isa::utils::pad(nrSamples, padding / sizeof(outputDataType))) + sample];
+          unsigned int element = (syntBeam * nrOutputDMs * isa::utils::pad(nrSamples, padding / formatSize)) + (dm * isa::utils::pad(nrSamples, padding / formatSize)) + sample;
+          unsigned int value = 0;
+          unsigned int expected = 0;
+
+          if ( formatSize == sizeof(uint8_t) ) {
+            value = reducedData[element];
+            expected = Dedispersion::convertOutput< outputDataType, uint8_t >(reference, outputFormat, outputScaling.getOffset(syntBeam, dm), outputScaling.getScale(syntBeam, dm));
+          } else {
+            uint16_t buffer = 0;
+
+            std::memcpy(&buffer, reducedData.data() + (element * sizeof(uint16_t)), sizeof(uint16_t));
+            value = buffer;
+            expected = Dedispersion::convertOutput< outputDataType, uint16_t >(reference, outputFormat, outputScaling.getOffset(syntBeam, dm), outputScaling.getScale(syntBeam, dm));
+          }
+          if ( value != expected ) {
+            wrongSamples++;
+          }
+          if ( printResults ) {
+            std::cout << value << "," << expected << " ";
+          }
+        }
+        if ( printResults ) {
+          std::cout << std::endl;
+        }
+      }
+      if ( printResults ) {
+        std::cout << std::endl;
+      }
+    }
+  } else if ( singleStep ) {
     for ( unsigned int syntBeam = 0; syntBeam < observation.getNrSynthesizedBeams(); syntBeam++ ) {
       if ( printResults ) {
         std::cout << "Synthesized Beam: " << syntBeam << std::endl;
@@ -425,12 +903,12 @@ int main(int argc, char *argv[]) {
         if ( printResults ) {
           std::cout << "DM: " << dm << " = ";
         }
-        for ( unsigned int sample = 0; sample < observation.getNrSamplesPerBatch(); sample++ ) {
-          if ( !isa::utils::same(dedispersedData[(syntBeam * observation.getNrDMs() * observation.getNrSamplesPerBatch(false, padding / sizeof(outputDataType))) + (dm * observation.getNrSamplesPerBatch(false, padding / sizeof(outputDataType))) + sample], dedispersedData_c[(syntBeam * observation.getNrDMs() * observation.getNrSamplesPerBatch(false, padding / sizeof(outputDataType))) + (dm * observation.getNrSamplesPerBatch(false, padding / sizeof(outputDataType))) + sample]) ) {
+        for ( unsigned int sample = 0; sample < observation.getNrSamplesPerBatch() / observation.getDownsampling(); sample++ ) {
+          if ( !isa::utils::same(dedispersedData[(syntBeam * observation.getNrDMs() * isa::utils::pad(observation.getNrSamplesPerBatch() / observation.getDownsampling(), padding / sizeof(outputDataType))) + (dm * isa::utils::pad(observation.getNrSamplesPerBatch() / observation.getDownsampling(), padding / sizeof(outputDataType))) + sample], dedispersedData_c[(syntBeam * observation.getNrDMs() * isa::utils::pad(observation.getNrSamplesPerBatch() / observation.getDownsampling(), padding / sizeof(outputDataType))) + (dm * isa::utils::pad(observation.getNrSamplesPerBatch() / observation.getDownsampling(), padding / sizeof(outputDataType))) + sample]) ) {
             wrongSamples++;
           }
           if ( printResults ) {
-            std::cout << dedispersedData[(syntBeam * observation.getNrDMs() * observation.getNrSamplesPerBatch(false, padding / sizeof(outputDataType))) + (dm * observation.getNrSamplesPerBatch(false, padding / sizeof(outputDataType))) + sample] << "," << dedispersedData_c[(syntBeam * observation.getNrDMs() * observation.getNrSamplesPerBatch(false, padding / sizeof(outputDataType))) + (dm * observation.getNrSamplesPerBatch(false, padding / sizeof(outputDataType))) + sample] << " ";
+            std::cout << dedispersedData[(syntBeam * observation.getNrDMs() * isa::utils::pad(observation.getNrSamplesPerBatch() / observation.getDownsampling(), padding / sizeof(outputDataType))) + (dm * isa::utils::pad(observation.getNrSamplesPerBatch() / observation.getDownsampling(), padding / sizeof(outputDataType))) + sample] << "," << dedispersedData_c[(syntBeam * observation.getNrDMs() * isa::utils::pad(observation.getNrSamplesPerBatch() / observation.getDownsampling(), padding / sizeof(outputDataType))) + (dm * isa::utils::pad(observation.getNrSamplesPerBatch() / observation.getDownsampling(), padding / sizeof(outputDataType))) + sample] << " ";
           }
         }
         if ( printResults ) {
@@ -453,6 +931,7 @@ int main(int argc, char *argv[]) {
         for ( unsigned int subband = 0; subband < observation.getNrSubbands(); subband++ ) {
           for ( unsigned int sample = 0; sample < observation.getNrSamplesPerBatch(true); sample++ ) {
             if ( !isa::utils::same(subbandedData[(beam * observation.getNrDMs(true) * observation.getNrSubbands() * observation.getNrSamplesPerBatch(true, padding / sizeof(outputDataType))) + (dm * observation.getNrSubbands() * observation.getNrSamplesPerBatch(true, padding / sizeof(outputDataType))) + (subband * observation.getNrSamplesPerBatch(true, padding / sizeof(outputDataType))) + sample], subbandedData_c[(beam * observation.getNrDMs(true) * observation.getNrSubbands() * observation.getNrSamplesPerBatch(true, padding / sizeof(outputDataType))) + (dm * observation.getNrSubbands() * observation.getNrSamplesPerBatch(true, padding / sizeof(outputDataType))) + (subband * observation.getNrSamplesPerBatch(true, padding / sizeof(outputDataType))) + sample]) ) {
+              wrongSamples++;
             }
             if ( printResults) {
               std::cout << subbandedData[(beam * observation.getNrDMs(true) * observation.getNrSubbands() * observation.getNrSamplesPerBatch(true, padding / sizeof(outputDataType))) + (dm * observation.getNrSubbands() * observation.getNrSamplesPerBatch(true, padding / sizeof(outputDataType))) + (subband * observation.getNrSamplesPerBatch(true, padding / sizeof(outputDataType))) + sample] << "," << subbandedData_c[(beam * observation.getNrDMs(true) * observation.getNrSubbands() * observation.getNrSamplesPerBatch(true, padding / sizeof(outputDataType))) + (dm * observation.getNrSubbands() * observation.getNrSamplesPerBatch(true, padding / sizeof(outputDataType))) + (subband * observation.getNrSamplesPerBatch(true, padding / sizeof(outputDataType))) + sample] << " ";
@@ -497,18 +976,461 @@ int main(int argc, char *argv[]) {
     }
   }
 
+  if ( statistics ) {
+    // The partials of the sequential output, with the same blocks of samples as the kernel; float sums are only approximately the same
+    unsigned int nrOutputDMs = singleStep ? observation.getNrDMs() : observation.getNrDMs(true) * observation.getNrDMs();
+    unsigned int nrSamples = observation.getNrSamplesPerBatch() / observation.getDownsampling();
+    unsigned int nrSamplesPerBlock = conf.getNrThreadsD0() * conf.getNrItemsD0();
+    Dedispersion::Statistics referenceStatistics(conf, observation, !singleStep);
+
+    for ( unsigned int syntBeam = 0; syntBeam < observation.getNrSynthesizedBeams(); syntBeam++ ) {
+      for ( unsigned int dm = 0; dm < nrOutputDMs; dm++ ) {
+        for ( unsigned int partial = 0; partial < referenceStatistics.getNrPartials(); partial++ ) {
+          Dedispersion::setStatisticsPartial(referenceStatistics, syntBeam, dm, partial, dedispersedData_c.data() + (((syntBeam * nrOutputDMs) + dm) * isa::utils::pad(nrSamples, padding / sizeof(outputDataType))) + (partial * nrSamplesPerBlock), std::min(nrSamplesPerBlock, nrSamples - (partial * nrSamplesPerBlock)));
+        }
+      }
+    }
+    for ( unsigned int item = 0; item < referenceStatistics.getPartials().size(); item++ ) {
+      float reference = referenceStatistics.getPartials()[item];
+
+      if ( std::abs(outputStatistics.getPartials()[item] - reference) > 1.0e-04f * std::max(std::abs(reference), 1.0f) ) {
+        wrongStatistics++;
+      }
+    }
+    if ( wrongStatistics > 0 ) {
+      std::cout << "Wrong statistics: " << wrongStatistics << " (" << (wrongStatistics * 100.0) / referenceStatistics.getPartials().size() << "%)." << std::endl;
+    }
+  }
+
   if ( wrongSamples > 0 ) {
     if ( singleStep ) {
-      std::cout << "Wrong samples: " << wrongSamples << " (" << (wrongSamples * 100.0) / (static_cast< uint64_t >(observation.getNrSynthesizedBeams()) * observation.getNrDMs() * observation.getNrSamplesPerBatch()) << "%)." << std::endl;
+      std::cout << "Wrong samples: " << wrongSamples << " (" << (wrongSamples * 100.0) / (static_cast< uint64_t >(observation.getNrSynthesizedBeams()) * observation.getNrDMs() * (observation.getNrSamplesPerBatch() / observation.getDownsampling())) << "%)." << std::endl;
     } else if ( stepOne ) {
       std::cout << "Wrong samples: " << wrongSamples << " (" << (wrongSamples * 100.0) / (static_cast< uint64_t >(observation.getNrBeams()) * observation.getNrDMs(true) * observation.getNrSubbands() * observation.getNrSamplesPerBatch(true)) << "%)." << std::endl;
     } else {
       std::cout << "Wrong samples: " << wrongSamples << " (" << (wrongSamples * 100.0) / (static_cast< uint64_t >(observation.getNrSynthesizedBeams()) * observation.getNrDMs(true) * observation.getNrDMs() * observation.getNrSamplesPerBatch()) << "%)." << std::endl;
     }
-  } else {
+  } else if ( (wrongStatistics == 0) && (wrongMaxima == 0) ) {
     std::cout << "TEST PASSED." << std::endl;
   }
+  if ( instrumentation.isEnabled() ) {
+    std::cout << (printJSON ? instrumentation.printJSON() + "\n" : instrumentation.print());
+  }
+
+  return 0;
+}
+
+int testCPU(Dedispersion::ThreadPool & pool, const Dedispersion::DedispersionConf & conf, AstroData::Observation & observation, const std::string & channelsFile, const unsigned int padding) {
+  uint64_t wrongSamples = 0;
+  std::vector< float > * shiftsSingleStep = Dedispersion::getShifts(observation, padding);
+  std::vector< float > * shiftsStepOne = Dedispersion::getShifts(observation, padding);
+  std::vector< float > * shiftsStepTwo = Dedispersion::getShiftsStepTwo(observation, padding);
+  Dedispersion::DelayTable delaysSingleStep(observation, *shiftsSingleStep, padding, Dedispersion::DedispersionStep::SingleStep);
+  Dedispersion::DelayTable delaysStepOne(observation, *shiftsStepOne, padding, Dedispersion::DedispersionStep::StepOne);
+  Dedispersion::DelayTable delaysStepTwo(observation, *shiftsStepTwo, padding, Dedispersion::DedispersionStep::StepTwo);
+  std::vector< unsigned int > zappedChannels(observation.getNrChannels(padding / sizeof(unsigned int)));
+  std::vector< unsigned int > beamMappingSingleStep(observation.getNrSynthesizedBeams() * observation.getNrChannels(padding / sizeof(unsigned int)));
+  std::vector< unsigned int > beamMappingStepTwo(observation.getNrSynthesizedBeams() * observation.getNrSubbands(padding / sizeof(unsigned int)));
+
+  if ( (observation.getNrSamplesPerBatch() % 8) != 0 ) {
+    std::cerr << "The CPU mode needs a number of samples multiple of 8, the samples in a byte of 1 bit input." << std::endl;
+    return 1;
+  }
+  AstroData::readZappedChannels(observation, channelsFile, zappedChannels);
+  AstroData::generateBeamMapping(observation, beamMappingSingleStep, padding);
+  AstroData::generateBeamMapping(observation, beamMappingStepTwo, padding, true);
+  // The dispersed batches are whole bytes of 1 bit samples
+  observation.setNrSamplesPerDispersedBatch(isa::utils::pad(observation.getNrSamplesPerBatch() + delaysSingleStep.getMaxDelay(), 8));
+  observation.setNrSamplesPerBatch(observation.getNrSamplesPerBatch() + delaysStepTwo.getMaxDelay(), true);
+  observation.setNrSamplesPerDispersedBatch(isa::utils::pad(observation.getNrSamplesPerBatch(true) + delaysStepOne.getMaxDelay(), 8), true);
+
+  // Tree dedispersion and the FDMT approximate the delays of the DelayTable; their outputs are compared with the delays they apply
+  for ( unsigned int nrChannelsPerTree = 4; nrChannelsPerTree <= observation.getNrChannels(); nrChannelsPerTree *= 4 ) {
+    std::vector< unsigned int > errors = Dedispersion::getTreeDelayErrors(delaysSingleStep, nrChannelsPerTree);
+
+    std::cout << "Tree dedispersion, " << nrChannelsPerTree << " channels per tree: delay error up to " << *std::max_element(errors.begin(), errors.end()) << " samples." << std::endl;
+  }
+  {
+    Dedispersion::FDMTPlan plan(observation, *shiftsSingleStep, delaysSingleStep);
+    std::vector< unsigned int > errors = plan.getDelayErrors();
+
+    std::cout << "FDMT: delay error up to " << *std::max_element(errors.begin(), errors.end()) << " samples." << std::endl;
+  }
 
+  // Unpacked samples of every beam and channel, enough for a dispersed batch and for the first two batches of a stream
+  unsigned int nrSamplesPerChannel = (std::max(Dedispersion::getNrInputBlocks(observation, false), Dedispersion::getNrInputBlocks(observation, true)) + 1) * observation.getNrSamplesPerBatch();
+  std::vector< uint8_t > samples(observation.getNrBeams() * observation.getNrChannels() * nrSamplesPerChannel);
+
+  srand(time(0));
+  for ( uint8_t inputBits : std::vector< uint8_t >{8, 4, 2, 1} ) {
+    for ( unsigned int sample = 0; sample < samples.size(); sample++ ) {
+      samples[sample] = static_cast< uint8_t >(rand() % (1 << inputBits));
+    }
+    wrongSamples += testCPUEngines< float >(pool, conf, observation, zappedChannels, beamMappingSingleStep, beamMappingStepTwo, samples, nrSamplesPerChannel, *shiftsSingleStep, *shiftsStepOne, *shiftsStepTwo, delaysSingleStep, delaysStepOne, delaysStepTwo, padding, inputBits, "float");
+    wrongSamples += testCPUEngines< uint16_t >(pool, conf, observation, zappedChannels, beamMappingSingleStep, beamMappingStepTwo, samples, nrSamplesPerChannel, *shiftsSingleStep, *shiftsStepOne, *shiftsStepTwo, delaysSingleStep, delaysStepOne, delaysStepTwo, padding, inputBits, "ushort");
+    wrongSamples += testCPUEngines< uint32_t >(pool, conf, observation, zappedChannels, beamMappingSingleStep, beamMappingStepTwo, samples, nrSamplesPerChannel, *shiftsSingleStep, *shiftsStepOne, *shiftsStepTwo, delaysSingleStep, delaysStepOne, delaysStepTwo, padding, inputBits, "uint");
+  }
+  delete shiftsSingleStep;
+  delete shiftsStepOne;
+  delete shiftsStepTwo;
+
+  if ( wrongSamples == 0 ) {
+    std::cout << "TEST PASSED." << std::endl;
+  }
   return 0;
 }
 
+template< typename L > uint64_t testCPUEngines(Dedispersion::ThreadPool & pool, const Dedispersion::DedispersionConf & conf, AstroData::Observation & observation, const std::vector< unsigned int > & zappedChannels, const std::vector< unsigned int > & beamMappingSingleStep, const std::vector< unsigned int > & beamMappingStepTwo, const std::vector< uint8_t > & samples, const unsigned int nrSamplesPerChannel, const std::vector< float > & shiftsSingleStep, const std::vector< float > & shiftsStepOne, const std::vector< float > & shiftsStepTwo, const Dedispersion::DelayTable & delaysSingleStep, const Dedispersion::DelayTable & delaysStepOne, const Dedispersion::DelayTable & delaysStepTwo, const unsigned int padding, const uint8_t inputBits, const std::string & intermediateName) {
+  const std::string test = std::to_string(inputBits) + " bit input, " + intermediateName + " intermediate type";
+  const unsigned int nrSamples = observation.getNrSamplesPerBatch();
+  const unsigned int nrSamplesPadded = isa::utils::pad(nrSamples, padding / sizeof(float));
+  const unsigned int nrSubbandedSamplesPadded = isa::utils::pad(observation.getNrSamplesPerBatch(true), padding / sizeof(L));
+  const unsigned int nrSubbandingDMs = observation.getNrDMs(true) * observation.getNrDMs();
+  const unsigned int nrOutputRows = observation.getNrSynthesizedBeams() * observation.getNrDMs();
+  const unsigned int nrSubbandingOutputRows = observation.getNrSynthesizedBeams() * nrSubbandingDMs;
+  const unsigned int nrSubbandedRows = observation.getNrBeams() * observation.getNrDMs(true) * observation.getNrSubbands();
+  uint64_t wrongSamples = 0;
+
+  if ( !Dedispersion::isIntermediateTypeLargeEnough< L >(observation, inputBits) ) {
+    std::cout << "Skipped " << test << ": the intermediate type can not hold the sum of " << observation.getNrChannels() << " channels." << std::endl;
+    return 0;
+  }
+  // Every engine with its wrong results
+  auto check = [&](const std::string & engine, const uint64_t nrWrong, const uint64_t nrResults) {
+    if ( nrWrong > 0 ) {
+      std::cout << engine << ", " << test << ": " << nrWrong << " wrong (" << (nrWrong * 100.0) / nrResults << "%)." << std::endl;
+    }
+    wrongSamples += nrWrong;
+  };
+  // Output of the sequential templates for the dispersed batch starting at firstSample; with subbanding, subbanded is the output of step one
+  auto getReference = [&](const unsigned int firstSample, const bool subbanding, std::vector< L > & subbanded) {
+    std::vector< uint8_t > input;
+    std::vector< float > output((subbanding ? nrSubbandingOutputRows : nrOutputRows) * nrSamplesPadded);
+
+    getCPUInput(observation, samples, nrSamplesPerChannel, firstSample, subbanding, Dedispersion::InputLayout(), false, padding, inputBits, input);
+    if ( subbanding ) {
+      subbanded.resize(nrSubbandedRows * nrSubbandedSamplesPadded);
+      Dedispersion::subbandDedispersionStepOne< uint8_t, L, L >(observation, zappedChannels, input, subbanded, shiftsStepOne, padding, inputBits);
+      Dedispersion::subbandDedispersionStepTwo< L, L, float >(observation, beamMappingStepTwo, subbanded, output, shiftsStepTwo, padding);
+    } else {
+      Dedispersion::dedispersion< uint8_t, L, float >(observation, zappedChannels, beamMappingSingleStep, input, output, shiftsSingleStep, padding, inputBits);
+    }
+    return output;
+  };
+  std::vector< L > subbandedReference;
+  std::vector< float > reference = getReference(0, false, subbandedReference);
+  std::vector< float > subbandingReference = getReference(0, true, subbandedReference);
+  Dedispersion::Statistics referenceStatistics = getCPUStatistics(conf, observation, false, reference, padding);
+  Dedispersion::Statistics subbandingReferenceStatistics = getCPUStatistics(conf, observation, true, subbandingReference, padding);
+  // Windows of 5 samples cross the tiles; subbanding keeps the candidates of every sample
+  Dedispersion::BoxcarSearch search({1, 2, 4, 8}, 2.0f, observation.getNrSynthesizedBeams(), observation.getNrDMs(), 5);
+  Dedispersion::BoxcarSearch subbandingSearch({1, 2, 4, 8}, 2.0f, observation.getNrSynthesizedBeams(), nrSubbandingDMs);
+  Dedispersion::ActiveChannels beamChannels(observation, zappedChannels, padding);
+  Dedispersion::ActiveChannels activeChannels(observation, beamChannels, beamMappingSingleStep, padding);
+  std::vector< Dedispersion::InputLayout > layouts = {Dedispersion::InputLayout(Dedispersion::InputOrdering::ChannelMajor, false), Dedispersion::InputLayout(Dedispersion::InputOrdering::ChannelMajor, true)};
+  std::vector< uint8_t > input;
+  std::vector< float > output;
+
+  search.setNoise(referenceStatistics);
+  subbandingSearch.setNoise(subbandingReferenceStatistics);
+  if ( inputBits >= 8 ) {
+    layouts.push_back(Dedispersion::InputLayout(Dedispersion::InputOrdering::TimeMajor, false));
+    layouts.push_back(Dedispersion::InputLayout(Dedispersion::InputOrdering::TimeMajor, true));
+  }
+  // The kernels reading an InputWindow, in every layout, with the whole dispersed batch and with the ring of blocks of split batches
+  for ( const auto & layout : layouts ) {
+    for ( bool splitBatches : {false, true} ) {
+      const std::string variant = std::string((layout.getOrdering() == Dedispersion::InputOrdering::TimeMajor) ? "time-major" : "channel-major") + (layout.getReversedFrequency() ? " reversed frequency" : "") + (splitBatches ? " split batches" : "") + " input";
+      Dedispersion::InputWindow< uint8_t > window = getCPUInput(observation, samples, nrSamplesPerChannel, 0, false, layout, splitBatches, padding, inputBits, input);
+      Dedispersion::Statistics statistics(conf, observation, false);
+      Dedispersion::DMMaxima maxima(conf, observation, false);
+      std::vector< Dedispersion::Candidate > candidates;
+
+      output.assign(reference.size(), 0.0f);
+      Dedispersion::dedispersion< uint8_t, L, float >(pool, conf, observation, activeChannels, beamMappingSingleStep, window, output, delaysSingleStep, padding, inputBits, Dedispersion::OutputScaling(), &statistics);
+      check("Dedispersion, " + variant, compareCPUOutput(output, reference, nrOutputRows, nrSamples, nrSamplesPadded), static_cast< uint64_t >(nrOutputRows) * nrSamples);
+      check("Dedispersion statistics, " + variant, compareCPUStatistics(statistics, referenceStatistics), referenceStatistics.getPartials().size());
+      Dedispersion::dedispersionDMMaxima< uint8_t, L >(pool, conf, observation, activeChannels, beamMappingSingleStep, window, maxima, delaysSingleStep, padding, inputBits);
+      check("Dedispersion DM maxima, " + variant, compareCPUMaxima(maxima, reference, observation.getNrSynthesizedBeams(), observation.getNrDMs(), nrSamples, padding), static_cast< uint64_t >(observation.getNrSynthesizedBeams()) * nrSamples);
+      Dedispersion::dedispersionCandidates< uint8_t, L >(pool, conf, observation, activeChannels, beamMappingSingleStep, window, search, candidates, delaysSingleStep, padding, inputBits);
+      check("Dedispersion candidates, " + variant, compareCPUCandidates(candidates, search, reference, observation.getNrSynthesizedBeams(), observation.getNrDMs(), nrSamples, padding), static_cast< uint64_t >(nrOutputRows) * nrSamples);
+
+      std::vector< L > subbanded(subbandedReference.size());
+      Dedispersion::Statistics subbandingStatistics(conf, observation, true);
+      Dedispersion::DMMaxima subbandingMaxima(conf, observation, true);
+
+      window = getCPUInput(observation, samples, nrSamplesPerChannel, 0, true, layout, splitBatches, padding, inputBits, input);
+      Dedispersion::subbandDedispersionStepOne< uint8_t, L, L >(pool, conf, observation, beamChannels, window, subbanded, delaysStepOne, padding, inputBits);
+      check("Step one, " + variant, compareCPUOutput(subbanded, subbandedReference, nrSubbandedRows, observation.getNrSamplesPerBatch(true), nrSubbandedSamplesPadded), static_cast< uint64_t >(nrSubbandedRows) * observation.getNrSamplesPerBatch(true));
+      output.assign(subbandingReference.size(), 0.0f);
+      Dedispersion::subbandDedispersion< uint8_t, L, float >(pool, conf, observation, beamChannels, beamMappingStepTwo, window, output, delaysStepOne, delaysStepTwo, padding, inputBits, Dedispersion::OutputScaling(), &subbandingStatistics);
+      check("Subband dedispersion, " + variant, compareCPUOutput(output, subbandingReference, nrSubbandingOutputRows, nrSamples, nrSamplesPadded), static_cast< uint64_t >(nrSubbandingOutputRows) * nrSamples);
+      check("Subband dedispersion statistics, " + variant, compareCPUStatistics(subbandingStatistics, subbandingReferenceStatistics), subbandingReferenceStatistics.getPartials().size());
+      Dedispersion::subbandDedispersionDMMaxima< uint8_t, L >(pool, conf, observation, beamChannels, beamMappingStepTwo, window, subbandingMaxima, delaysStepOne, delaysStepTwo, padding, inputBits);
+      check("Subband dedispersion DM maxima, " + variant, compareCPUMaxima(subbandingMaxima, subbandingReference, observation.getNrSynthesizedBeams(), nrSubbandingDMs, nrSamples, padding), static_cast< uint64_t >(observation.getNrSynthesizedBeams()) * nrSamples);
+      Dedispersion::subbandDedispersionCandidates< uint8_t, L >(pool, conf, observation, beamChannels, beamMappingStepTwo, window, subbandingSearch, candidates, delaysStepOne, delaysStepTwo, padding, inputBits);
+      check("Subband dedispersion candidates, " + variant, compareCPUCandidates(candidates, subbandingSearch, subbandingReference, observation.getNrSynthesizedBeams(), nrSubbandingDMs, nrSamples, padding), static_cast< uint64_t >(nrSubbandingOutputRows) * nrSamples);
+    }
+  }
+
+  // Step two, from the output of the sequential step one
+  {
+    Dedispersion::Statistics statistics(conf, observation, true);
+
+    output.assign(subbandingReference.size(), 0.0f);
+    Dedispersion::subbandDedispersionStepTwo< L, L, float >(pool, conf, observation, beamMappingStepTwo, subbandedReference, output, delaysStepTwo, padding, Dedispersion::OutputScaling(), &statistics);
+    check("Step two", compareCPUOutput(output, subbandingReference, nrSubbandingOutputRows, nrSamples, nrSamplesPadded), static_cast< uint64_t >(nrSubbandingOutputRows) * nrSamples);
+    check("Step two statistics", compareCPUStatistics(statistics, subbandingReferenceStatistics), subbandingReferenceStatistics.getPartials().size());
+  }
+
+  // Tree dedispersion and the FDMT, with the delays they apply; with one channel per tree, the delays are the ones of the DelayTable
+  getCPUInput(observation, samples, nrSamplesPerChannel, 0, false, Dedispersion::InputLayout(), false, padding, inputBits, input);
+  for ( unsigned int nrChannelsPerTree = 1; nrChannelsPerTree <= observation.getNrChannels(); nrChannelsPerTree *= 4 ) {
+    std::vector< std::vector< unsigned int > > delays(observation.getNrDMs(), std::vector< unsigned int >(observation.getNrChannels()));
+
+    for ( unsigned int dm = 0; dm < observation.getNrDMs(); dm++ ) {
+      for ( unsigned int channel = 0; channel < observation.getNrChannels(); channel++ ) {
+        unsigned int position = observation.getNrChannels() - 1 - channel;
+        unsigned int tree = position / nrChannelsPerTree;
+
+        delays[dm][channel] = delaysSingleStep.getDelay(dm, observation.getNrChannels() - 1 - (tree * nrChannelsPerTree)) + Dedispersion::getTreeDelay(nrChannelsPerTree, Dedispersion::getTreeSweep(delaysSingleStep, dm, tree, nrChannelsPerTree), position % nrChannelsPerTree);
+      }
+    }
+    output.assign(reference.size(), 0.0f);
+    Dedispersion::treeDedispersion< uint8_t, L, float >(pool, nrChannelsPerTree, observation, activeChannels, beamMappingSingleStep, input, output, delaysSingleStep, padding, inputBits);
+    check("Tree dedispersion, " + std::to_string(nrChannelsPerTree) + " channels per tree", compareCPUOutput(output, getDelayedOutput(observation, zappedChannels, beamMappingSingleStep, samples, nrSamplesPerChannel, delays, padding), nrOutputRows, nrSamples, nrSamplesPadded), static_cast< uint64_t >(nrOutputRows) * nrSamples);
+  }
+  {
+    Dedispersion::FDMTPlan plan(observation, shiftsSingleStep, delaysSingleStep);
+    std::vector< std::vector< unsigned int > > delays(observation.getNrDMs());
+
+    for ( unsigned int dm = 0; dm < observation.getNrDMs(); dm++ ) {
+      delays[dm] = plan.getChannelDelays(plan.getDMDelay(dm));
+    }
+    output.assign(reference.size(), 0.0f);
+    Dedispersion::fdmt< uint8_t, L, float >(pool, plan, observation, activeChannels, beamMappingSingleStep, input, output, padding, inputBits);
+    check("FDMT", compareCPUOutput(output, getDelayedOutput(observation, zappedChannels, beamMappingSingleStep, samples, nrSamplesPerChannel, delays, padding), nrOutputRows, nrSamples, nrSamplesPadded), static_cast< uint64_t >(nrOutputRows) * nrSamples);
+  }
+
+  // Streaming: the first two batches of a stream are the output of the last two of getNrBlocks() + 1 pushes
+  auto testStream = [&](Dedispersion::StreamingDedispersion< uint8_t, L, float > & stream, const bool subbanding, const std::string & engine) {
+    const unsigned int nrSamplesPerElement = (inputBits >= 8) ? 1 : 8 / inputBits;
+    const unsigned int nrRows = subbanding ? nrSubbandingOutputRows : nrOutputRows;
+    std::vector< L > subbanded;
+
+    output.assign(nrRows * nrSamplesPadded, 0.0f);
+    for ( unsigned int batch = 0; batch <= stream.getNrBlocks(); batch++ ) {
+      uint8_t * block = stream.getNextBlock();
+
+      std::fill(block, block + (observation.getNrBeams() * observation.getNrChannels() * stream.getNrSamplesPerChannel()), 0);
+      for ( unsigned int row = 0; row < observation.getNrBeams() * observation.getNrChannels(); row++ ) {
+        for ( unsigned int sample = 0; sample < nrSamples; sample++ ) {
+          block[(row * stream.getNrSamplesPerChannel()) + (sample / nrSamplesPerElement)] |= samples[(row * nrSamplesPerChannel) + (batch * nrSamples) + sample] << ((sample % nrSamplesPerElement) * inputBits);
+        }
+      }
+      if ( stream.push(output) ) {
+        check(engine + ", batch " + std::to_string(batch + 1 - stream.getNrBlocks()), compareCPUOutput(output, getReference((batch + 1 - stream.getNrBlocks()) * nrSamples, subbanding, subbanded), nrRows, nrSamples, nrSamplesPadded), static_cast< uint64_t >(nrRows) * nrSamples);
+      }
+    }
+  };
+  {
+    Dedispersion::StreamingDedispersion< uint8_t, L, float > stream(pool, conf, observation, activeChannels, beamMappingSingleStep, delaysSingleStep, padding, inputBits);
+
+    testStream(stream, false, "Streaming dedispersion");
+  }
+  {
+    Dedispersion::StreamingDedispersion< uint8_t, L, float > stream(pool, conf, observation, beamChannels, beamMappingStepTwo, delaysStepOne, delaysStepTwo, padding, inputBits);
+
+    testStream(stream, true, "Streaming subband dedispersion");
+  }
+  return wrongSamples;
+}
+
+Dedispersion::InputWindow< uint8_t > getCPUInput(const AstroData::Observation & observation, const std::vector< uint8_t > & samples, const unsigned int nrSamplesPerChannel, const unsigned int firstSample, const bool subbanding, const Dedispersion::InputLayout & layout, const bool splitBatches, const unsigned int padding, const uint8_t inputBits, std::vector< uint8_t > & input) {
+  const unsigned int nrSamplesPerElement = (inputBits >= 8) ? 1 : 8 / inputBits;
+  const unsigned int firstBlock = Dedispersion::getNrInputBlocks(observation, subbanding) - 1;
+  Dedispersion::InputWindow< uint8_t > window;
+
+  // The geometry of the window, then the input it reads
+  if ( splitBatches ) {
+    window = Dedispersion::getSplitBatchesWindow(observation, input, firstBlock, padding, inputBits, subbanding, layout);
+    input.assign(window.nrBlocks * window.nrElementsPerBlock, 0);
+  } else {
+    window = Dedispersion::getInputWindow(observation, input, padding, inputBits, subbanding, layout);
+    input.assign(observation.getNrBeams() * Dedispersion::getNrInputBeamElements(layout, observation.getNrChannels(), window.nrChannelsPerSample, window.nrSamplesPerChannel), 0);
+  }
+  window.data = input.data();
+  for ( unsigned int beam = 0; beam < observation.getNrBeams(); beam++ ) {
+    for ( unsigned int channel = 0; channel < observation.getNrChannels(); channel++ ) {
+      unsigned int row = layout.getReversedFrequency() ? observation.getNrChannels() - 1 - channel : channel;
+
+      for ( unsigned int sample = 0; sample < observation.getNrSamplesPerDispersedBatch(subbanding); sample++ ) {
+        uint64_t index = 0;
+        unsigned int position = sample / nrSamplesPerElement;
+
+        if ( splitBatches ) {
+          index = static_cast< uint64_t >((firstBlock + (sample / observation.getNrSamplesPerBatch())) % window.nrBlocks) * window.nrElementsPerBlock;
+          position = (sample % observation.getNrSamplesPerBatch()) / nrSamplesPerElement;
+        }
+        if ( window.nrChannelsPerSample > 0 ) {
+          index += (beam * window.nrSamplesPerChannel * window.nrChannelsPerSample) + (position * window.nrChannelsPerSample) + row;
+        } else {
+          index += (((beam * observation.getNrChannels()) + row) * window.nrSamplesPerChannel) + position;
+        }
+        input[index] |= samples[(((beam * observation.getNrChannels()) + channel) * nrSamplesPerChannel) + firstSample + sample] << ((sample % nrSamplesPerElement) * inputBits);
+      }
+    }
+  }
+  return window;
+}
+
+std::vector< float > getDelayedOutput(const AstroData::Observation & observation, const std::vector< unsigned int > & zappedChannels, const std::vector< unsigned int > & beamMapping, const std::vector< uint8_t > & samples, const unsigned int nrSamplesPerChannel, const std::vector< std::vector< unsigned int > > & delays, const unsigned int padding) {
+  const unsigned int nrSamplesPadded = isa::utils::pad(observation.getNrSamplesPerBatch(), padding / sizeof(float));
+  std::vector< float > output(observation.getNrSynthesizedBeams() * observation.getNrDMs() * nrSamplesPadded);
+
+  for ( unsigned int sBeam = 0; sBeam < observation.getNrSynthesizedBeams(); sBeam++ ) {
+    for ( unsigned int dm = 0; dm < observation.getNrDMs(); dm++ ) {
+      for ( unsigned int sample = 0; sample < observation.getNrSamplesPerBatch(); sample++ ) {
+        uint64_t dedispersedSample = 0;
+
+        for ( unsigned int channel = 0; channel < observation.getNrChannels(); channel++ ) {
+          unsigned int beam = beamMapping[(sBeam * observation.getNrChannels(padding / sizeof(unsigned int))) + channel];
+
+          if ( (zappedChannels[channel] != 0) || (sample + delays[dm][channel] >= observation.getNrSamplesPerDispersedBatch()) ) {
+            continue;
+          }
+          dedispersedSample += samples[(((beam * observation.getNrChannels()) + channel) * nrSamplesPerChannel) + sample + delays[dm][channel]];
+        }
+        output[(((sBeam * observation.getNrDMs()) + dm) * nrSamplesPadded) + sample] = static_cast< float >(dedispersedSample);
+      }
+    }
+  }
+  return output;
+}
+
+template< typename T > uint64_t compareCPUOutput(const std::vector< T > & output, const std::vector< T > & reference, const unsigned int nrRows, const unsigned int nrSamples, const unsigned int nrSamplesPadded) {
+  uint64_t wrongSamples = 0;
+
+  // The samples are sums of integers, exact in every intermediate type, so the outputs are identical
+  for ( unsigned int row = 0; row < nrRows; row++ ) {
+    for ( unsigned int sample = 0; sample < nrSamples; sample++ ) {
+      if ( output[(row * nrSamplesPadded) + sample] != reference[(row * nrSamplesPadded) + sample] ) {
+        wrongSamples++;
+      }
+    }
+  }
+  return wrongSamples;
+}
+
+Dedispersion::Statistics getCPUStatistics(const Dedispersion::DedispersionConf & conf, const AstroData::Observation & observation, const bool subbanding, const std::vector< float > & output, const unsigned int padding) {
+  const unsigned int nrDMs = subbanding ? observation.getNrDMs(true) * observation.getNrDMs() : observation.getNrDMs();
+  const unsigned int nrSamples = observation.getNrSamplesPerBatch();
+  const unsigned int nrSamplesPerBlock = Dedispersion::getNrSamplesPerTile(conf);
+  Dedispersion::Statistics statistics(conf, observation, subbanding);
+
+  for ( unsigned int sBeam = 0; sBeam < observation.getNrSynthesizedBeams(); sBeam++ ) {
+    for ( unsigned int dm = 0; dm < nrDMs; dm++ ) {
+      for ( unsigned int partial = 0; partial < statistics.getNrPartials(); partial++ ) {
+        Dedispersion::setStatisticsPartial(statistics, sBeam, dm, partial, output.data() + (((sBeam * nrDMs) + dm) * isa::utils::pad(nrSamples, padding / sizeof(float))) + (partial * nrSamplesPerBlock), std::min(nrSamplesPerBlock, nrSamples - (partial * nrSamplesPerBlock)));
+      }
+    }
+  }
+  return statistics;
+}
+
+uint64_t compareCPUStatistics(const Dedispersion::Statistics & statistics, const Dedispersion::Statistics & reference) {
+  uint64_t wrongStatistics = 0;
+
+  for ( unsigned int item = 0; item < reference.getPartials().size(); item++ ) {
+    if ( std::abs(statistics.getPartials()[item] - reference.getPartials()[item]) > 1.0e-04f * std::max(std::abs(reference.getPartials()[item]), 1.0f) ) {
+      wrongStatistics++;
+    }
+  }
+  return wrongStatistics;
+}
+
+uint64_t compareCPUMaxima(const Dedispersion::DMMaxima & maxima, const std::vector< float > & reference, const unsigned int nrSynthesizedBeams, const unsigned int nrDMs, const unsigned int nrSamples, const unsigned int padding) {
+  const unsigned int nrSamplesPadded = isa::utils::pad(nrSamples, padding / sizeof(float));
+  uint64_t wrongMaxima = 0;
+
+  for ( unsigned int sBeam = 0; sBeam < nrSynthesizedBeams; sBeam++ ) {
+    for ( unsigned int sample = 0; sample < nrSamples; sample++ ) {
+      float maximum = reference[(sBeam * nrDMs * nrSamplesPadded) + sample];
+      unsigned int dm = maxima.getDM(sBeam, sample);
+
+      for ( unsigned int referenceDM = 1; referenceDM < nrDMs; referenceDM++ ) {
+        maximum = std::max(maximum, reference[(((sBeam * nrDMs) + referenceDM) * nrSamplesPadded) + sample]);
+      }
+      if ( (dm >= nrDMs) || (maxima.getMaximum(sBeam, sample) != maximum) || (reference[(((sBeam * nrDMs) + dm) * nrSamplesPadded) + sample] != maximum) ) {
+        wrongMaxima++;
+      }
+    }
+  }
+  return wrongMaxima;
+}
+
+uint64_t compareCPUCandidates(const std::vector< Dedispersion::Candidate > & candidates, const Dedispersion::BoxcarSearch & search, const std::vector< float > & reference, const unsigned int nrSynthesizedBeams, const unsigned int nrDMs, const unsigned int nrSamples, const unsigned int padding) {
+  const unsigned int nrSamplesPadded = isa::utils::pad(nrSamples, padding / sizeof(float));
+  // For every first sample, 1 + the index of its candidate, or 0
+  std::vector< unsigned int > found(static_cast< uint64_t >(nrSynthesizedBeams) * nrDMs * nrSamples);
+  uint64_t wrongCandidates = 0;
+  uint64_t nrMatches = 0;
+
+  for ( unsigned int item = 0; item < candidates.size(); item++ ) {
+    const Dedispersion::Candidate & candidate = candidates[item];
+
+    if ( (candidate.sBeam >= nrSynthesizedBeams) || (candidate.dm >= nrDMs) || (candidate.sample >= nrSamples) ) {
+      wrongCandidates++;
+      continue;
+    }
+    found[(((candidate.sBeam * nrDMs) + candidate.dm) * nrSamples) + candidate.sample] = item + 1;
+  }
+  for ( unsigned int sBeam = 0; sBeam < nrSynthesizedBeams; sBeam++ ) {
+    for ( unsigned int dm = 0; dm < nrDMs; dm++ ) {
+      const float * samples = reference.data() + (((sBeam * nrDMs) + dm) * nrSamplesPadded);
+      std::vector< Dedispersion::Candidate > referenceCandidates;
+
+      for ( unsigned int sample = 0; sample < nrSamples; sample++ ) {
+        unsigned int width = 0;
+        float snr = 0.0f;
+
+        for ( auto boxcar : search.getWidths() ) {
+          double sum = 0.0;
+
+          if ( sample + boxcar > nrSamples ) {
+            continue;
+          }
+          for ( unsigned int item = 0; item < boxcar; item++ ) {
+            sum += samples[sample + item];
+          }
+          float boxcarSNR = static_cast< float >((sum - (boxcar * static_cast< double >(search.getMean(sBeam, dm)))) / (search.getStandardDeviation(sBeam, dm) * std::sqrt(static_cast< double >(boxcar))));
+
+          if ( (width == 0) || (boxcarSNR > snr) ) {
+            width = boxcar;
+            snr = boxcarSNR;
+          }
+        }
+        if ( (width == 0) || (snr < search.getThreshold()) ) {
+          continue;
+        }
+        // The best candidate of a window, the first one with the same SNR
+        if ( referenceCandidates.empty() || ((referenceCandidates.back().sample / search.getNrSamplesPerWindow()) != (sample / search.getNrSamplesPerWindow())) ) {
+          referenceCandidates.push_back({sBeam, dm, sample, width, snr});
+        } else if ( snr > referenceCandidates.back().snr ) {
+          referenceCandidates.back() = {sBeam, dm, sample, width, snr};
+        }
+      }
+      for ( const auto & candidate : referenceCandidates ) {
+        unsigned int item = found[(((sBeam * nrDMs) + dm) * nrSamples) + candidate.sample];
+
+        if ( (item == 0) || (candidates[item - 1].width != candidate.width) || (std::abs(candidates[item - 1].snr - candidate.snr) > 1.0e-04f * std::max(std::abs(candidate.snr), 1.0f)) ) {
+          wrongCandidates++;
+        } else {
+          nrMatches++;
+        }
+      }
+    }
+  }
+  // Candidates without a reference
+  return wrongCandidates + (candidates.size() - nrMatches);
+}
@@ -21,6 +21,7 @@
 #include <iomanip>
 #include <limits>
 #include <ctime>
+#include <memory>
 
 #include <configuration.hpp>
 
@@ -32,19 +33,36 @@
 #include <InitializeOpenCL.hpp>
 #include <Kernel.hpp>
 #include <Shifts.hpp>
+#include <DelayTable.hpp>
+#include <ActiveChannels.hpp>
 #include <Dedispersion.hpp>
+#include <Statistics.hpp>
+#include <DMMaxima.hpp>
+#include <Filterbank.hpp>
+#include <KernelCache.hpp>
+#include <KernelPipeline.hpp>
 #include <Timer.hpp>
 
-void initializeDeviceMemorySingleStep(cl::Context & clContext, cl::CommandQueue * clQueue, std::vector< float > * shifts, cl::Buffer * shifts_d, std::vector<unsigned int> & zappedChannels, cl::Buffer * zappedChannels_d, std::vector<unsigned int> & beamMapping, cl::Buffer * beamMapping_d, const unsigned int dispersedData_size, cl::Buffer * dispersedData_d, const unsigned int dedispersedData_size, cl::Buffer * dedispersedData_d);
-void initializeDeviceMemoryStepOne(cl::Context & v, cl::CommandQueue * clQueue, std::vector< float > * shiftsStepOne, cl::Buffer * shiftsStepOne_d, std::vector<unsigned int> & zappedChannels, cl::Buffer * zappedChannels_d, const unsigned int dispersedData_size, cl::Buffer * dispersedData_d, const unsigned int subbandedData_size, cl::Buffer * subbandedData_d);
-void initializeDeviceMemoryStepTwo(cl::Context & clContext, cl::CommandQueue * clQueue, std::vector< float > * shiftsStepTwo, cl::Buffer * shiftsStepTwo_d, std::vector<unsigned int> & beamMapping, cl::Buffer * beamMapping_d, const unsigned int subbandedData_size, cl::Buffer * subbandedData_d, const unsigned int dedispersedData_size, cl::Buffer * dedispersedData_d);
+void initializeDeviceMemorySingleStep(cl::Context & clContext, cl::CommandQueue * clQueue, const Dedispersion::DelayTable & delays, cl::Buffer * delays_d, std::vector<unsigned int> & activeChannels, cl::Buffer * activeChannels_d, std::vector<unsigned int> & beamMapping, cl::Buffer * beamMapping_d, const unsigned int dispersedData_size, cl::Buffer * dispersedData_d, const unsigned int dedispersedData_size, cl::Buffer * dedispersedData_d);
+void initializeDeviceMemoryStepOne(cl::Context & v, cl::CommandQueue * clQueue, const Dedispersion::DelayTable & delaysStepOne, cl::Buffer * delaysStepOne_d, std::vector<unsigned int> & activeChannels, cl::Buffer * activeChannels_d, const unsigned int dispersedData_size, cl::Buffer * dispersedData_d, const unsigned int subbandedData_size, cl::Buffer * subbandedData_d);
+void initializeDeviceMemoryStepTwo(cl::Context & clContext, cl::CommandQueue * clQueue, const Dedispersion::DelayTable & delaysStepTwo, cl::Buffer * delaysStepTwo_d, std::vector<unsigned int> & beamMapping, cl::Buffer * beamMapping_d, const unsigned int subbandedData_size, cl::Buffer * subbandedData_d, const unsigned int dedispersedData_size, cl::Buffer * dedispersedData_d);
+void initializeDeviceMemoryOutputScaling(cl::Context & clContext, cl::CommandQueue * clQueue, const Dedispersion::OutputScaling & outputScaling, cl::Buffer * offsets_d, cl::Buffer * scales_d);
 
 int main(int argc, char * argv[]) {
-  // TODO: implement split_batches mode
   bool singleStep = false;
   bool stepOne = false;
   bool initializeDeviceMemory = true;
   bool bestMode = false;
+  bool splitBatches = false;
+  bool downsample = false;
+  bool reducedOutput = false;
+  bool statistics = false;
+  bool dmMaxima = false;
+  Dedispersion::OutputFormat outputFormat = Dedispersion::OutputFormat::Float;
+  Dedispersion::InputLayout inputLayout;
+  Dedispersion::KernelCache kernelCache;
+  unsigned int nrCompileThreads = 0;
+  unsigned int compileQueue = 1;
   unsigned int padding = 0;
   unsigned int nrIterations = 0;
   unsigned int clPlatformID = 0;
@@ -60,6 +78,10 @@ int main(int argc, char * argv[]) {
   unsigned int maxUnroll = 0;
   double bestGFLOPs = 0.0;
   std::string channelsFile;
+  bool sigprocInput = false;
+  bool rawInput = false;
+  std::string inputFile;
+  unsigned int inputBatch = 0;
   AstroData::Observation observation;
   std::vector<Dedispersion::DedispersionConf> confs;
   Dedispersion::DedispersionConf bestConf;
@@ -72,6 +94,37 @@ int main(int argc, char * argv[]) {
     clPlatformID = args.getSwitchArgument< unsigned int >("-opencl_platform");
     clDeviceID = args.getSwitchArgument< unsigned int >("-opencl_device");
     bestMode = args.getSwitch("-best");
+    splitBatches = args.getSwitch("-split_batches");
+    downsample = args.getSwitch("-downsample");
+    reducedOutput = args.getSwitch("-reduced_output");
+    if ( reducedOutput ) {
+      outputFormat = Dedispersion::getOutputFormat(args.getSwitchArgument< std::string >("-output_format"));
+    }
+    statistics = args.getSwitch("-statistics");
+    dmMaxima = args.getSwitch("-dm_maxima");
+    if ( args.getSwitch("-time_major") ) {
+      inputLayout.setOrdering(Dedispersion::InputOrdering::TimeMajor);
+    }
+    inputLayout.setReversedFrequency(args.getSwitch("-reversed_frequency"));
+    // Compiled kernels are stored on disk, and loaded instead of compiled again the next time
+    if ( args.getSwitch("-kernel_cache") ) {
+      kernelCache = Dedispersion::KernelCache(args.getSwitchArgument< std::string >("-cache_directory"));
+    }
+    // The next configurations are generated and compiled by host threads while the current one runs on the device
+    if ( args.getSwitch("-pipeline") ) {
+      nrCompileThreads = args.getSwitchArgument< unsigned int >("-compile_threads");
+      compileQueue = args.getSwitchArgument< unsigned int >("-compile_queue");
+      if ( (nrCompileThreads == 0) || (compileQueue < nrCompileThreads) ) {
+        std::cerr << "The pipeline needs at least one compile thread, and a queue at least as long as the number of compile threads." << std::endl;
+        return 1;
+      }
+    }
+    sigprocInput = args.getSwitch("-filterbank");
+    rawInput = args.getSwitch("-raw");
+    if ( sigprocInput || rawInput ) {
+      inputFile = args.getSwitchArgument< std::string >("-input_file");
+      inputBatch = args.getSwitchArgument< unsigned int >("-input_batch");
+    }
     singleStep = args.getSwitch("-single_step");
     stepOne = args.getSwitch("-step_one");
     bool stepTwo = args.getSwitch("-step_two");
@@ -97,6 +150,10 @@ int main(int argc, char * argv[]) {
     observation.setNrBeams(args.getSwitchArgument< unsigned int >("-beams"));
     observation.setNrSamplesPerBatch(args.getSwitchArgument< unsigned int >("-samples"));
     observation.setSamplingTime(args.getSwitchArgument<float>("-sampling_time"));
+    if ( downsample ) {
+      // Fused downsampling: the input has the raw time resolution
+      observation.setDownsampling(args.getSwitchArgument< unsigned int >("-downsampling"));
+    }
     if ( singleStep ) {
       observation.setNrSynthesizedBeams(args.getSwitchArgument< unsigned int >("-synthesized_beams"));
       observation.setFrequencyRange(1, args.getSwitchArgument< unsigned int >("-channels"), args.getSwitchArgument< float >("-min_freq"), args.getSwitchArgument< float >("-channel_bandwidth"));
@@ -112,7 +169,7 @@ int main(int argc, char * argv[]) {
       observation.setDMRange(args.getSwitchArgument< unsigned int >("-dms"), args.getSwitchArgument< float >("-dm_first"), args.getSwitchArgument< float >("-dm_step"));
     }
   } catch ( isa::utils::EmptyCommandLine & err ) {
-    std::cerr << argv[0] << " -iterations ... -opencl_platform ... -opencl_device ... [-best] [-single_step | -step_one | -step_two] -padding ... -vector ... -min_threads ... -max_threads ... -max_columns ... -max_rows ... -max_items ... -max_sample_items ... -max_dm_items ... -max_unroll ... -beams ... -samples ... -sampling_time ... -min_freq ... -channel_bandwidth ... -channels ... " << std::endl;
+    std::cerr << argv[0] << " -iterations ... -opencl_platform ... -opencl_device ... [-best] [-split_batches] [-downsample -downsampling ...] [-reduced_output -output_format float|half|ushort|uchar] [-statistics] [-dm_maxima] [-time_major] [-reversed_frequency] [-kernel_cache -cache_directory ...] [-pipeline -compile_threads ... -compile_queue ...] [-filterbank | -raw -input_file ... -input_batch ...] [-single_step | -step_one | -step_two] -padding ... -vector ... -min_threads ... -max_threads ... -max_columns ... -max_rows ... -max_items ... -max_sample_items ... -max_dm_items ... -max_unroll ... -beams ... -samples ... -sampling_time ... -min_freq ... -channel_bandwidth ... -channels ... " << std::endl;
     std::cerr << "\t-single_step -zapped_channels ... -synthesized_beams ... -dms ... -dm_first ... -dm_step ..." << std::endl;
     std::cerr << "\t-step_one -zapped_channels ... -subbands ... -subbanding_dms ... -subbanding_dm_first ... -subbanding_dm_step ... -dms ... -dm_first ... -dm_step ..." << std::endl;
     std::cerr << "\t-step_two -synthesized_beams ... -subbands ... -subbanding_dms ... -dms ... -dm_first ... -dm_step ..." << std::endl;
@@ -122,10 +179,73 @@ int main(int argc, char * argv[]) {
     return 1;
   }
 
+  if ( stepOne && reducedOutput ) {
+    std::cerr << "The output of step one is the input of step two, and can not have a reduced precision." << std::endl;
+    return 1;
+  }
+  if ( stepOne && statistics ) {
+    std::cerr << "The statistics are computed on the dedispersed output, not on the output of step one." << std::endl;
+    return 1;
+  }
+  if ( (stepOne || reducedOutput) && dmMaxima ) {
+    std::cerr << "The DM maxima are float values of the dedispersed output, not of the output of step one or of a reduced output." << std::endl;
+    return 1;
+  }
+  // The input of the kernels is a batch of the file, read in place by the device when possible, instead of the uninitialized buffer
+  Dedispersion::Filterbank * filterbank = nullptr;
+  if ( sigprocInput && rawInput ) {
+    std::cerr << "Mutually exclusive input files, select one: -filterbank -raw" << std::endl;
+    return 1;
+  } else if ( sigprocInput || rawInput ) {
+    if ( !(singleStep || stepOne) || splitBatches ) {
+      std::cerr << "The input file is the input of single step and step one, without split batches." << std::endl;
+      return 1;
+    }
+    try {
+      if ( sigprocInput ) {
+        filterbank = new Dedispersion::Filterbank(inputFile);
+        filterbank->setObservation(observation);
+      } else {
+        filterbank = new Dedispersion::Filterbank(inputFile, observation, inputBits, inputLayout.getReversedFrequency());
+      }
+    } catch ( std::exception & err ) {
+      std::cerr << err.what() << std::endl;
+      return 1;
+    }
+    if ( filterbank->getHeader().nrBits != inputBits ) {
+      std::cerr << "The input file has " << filterbank->getHeader().nrBits << " bits per sample, not " << std::to_string(inputBits) << "." << std::endl;
+      return 1;
+    }
+    if ( observation.getNrBeams() != 1 ) {
+      std::cerr << "The input file holds the channels of a single beam." << std::endl;
+      return 1;
+    }
+    if ( filterbank->getHeader().nrChannels != Dedispersion::getNrInputChannelsPerSample< inputDataType >(observation, padding) ) {
+      std::cerr << "The rows of the input file are not padded to " << padding << " bytes." << std::endl;
+      return 1;
+    }
+    inputLayout = filterbank->getLayout();
+  }
+  if ( !(singleStep || stepOne) && !inputLayout.isDefault() ) {
+    std::cerr << "The input layout is the one of the input of single step and step one." << std::endl;
+    return 1;
+  }
+  if ( (inputLayout.getOrdering() == Dedispersion::InputOrdering::TimeMajor) && (inputBits < 8) ) {
+    std::cerr << "Time-major input needs at least 8 bits per sample." << std::endl;
+    return 1;
+  }
+  if ( (singleStep || stepOne) && !Dedispersion::isIntermediateTypeLargeEnough< intermediateDataType >(observation, inputBits) ) {
+    std::cerr << "The intermediate type " << intermediateDataName << " can not hold the sum of " << observation.getNrChannels() << " channels of " << std::to_string(inputBits) << " bits." << std::endl;
+    return 1;
+  }
+
   // Allocate host memory
   std::vector< float > * shiftsSingleStep = Dedispersion::getShifts(observation, padding);
   std::vector< float > * shiftsStepOne = Dedispersion::getShifts(observation, padding);
   std::vector< float > * shiftsStepTwo = Dedispersion::getShiftsStepTwo(observation, padding);
+  Dedispersion::DelayTable delaysSingleStep(observation, *shiftsSingleStep, padding, Dedispersion::DedispersionStep::SingleStep);
+  Dedispersion::DelayTable delaysStepOne(observation, *shiftsStepOne, padding, Dedispersion::DedispersionStep::StepOne);
+  Dedispersion::DelayTable delaysStepTwo(observation, *shiftsStepTwo, padding, Dedispersion::DedispersionStep::StepTwo);
   std::vector<unsigned int> zappedChannels(observation.getNrChannels(padding / sizeof(unsigned int)));
   std::vector<unsigned int> beamMappingSingleStep(observation.getNrSynthesizedBeams() * observation.getNrChannels(padding / sizeof(unsigned int)));
   std::vector<unsigned int> beamMappingStepTwo(observation.getNrSynthesizedBeams() * observation.getNrSubbands(padding / sizeof(unsigned int)));
@@ -135,16 +255,21 @@ int main(int argc, char * argv[]) {
   }
   if ( singleStep )
   {
-    observation.setNrSamplesPerDispersedBatch(static_cast<unsigned int>(std::ceil(observation.getNrSamplesPerBatch() + (shiftsSingleStep->at(0) * (observation.getFirstDM() + ((observation.getNrDMs() - 1) * observation.getDMStep()))))));
+    observation.setNrSamplesPerDispersedBatch(observation.getNrSamplesPerBatch() + (delaysSingleStep.getMaxDelay() * observation.getDownsampling()));
   }
   else if ( stepOne )
   {
-    observation.setNrSamplesPerBatch(static_cast<unsigned int>(std::ceil(observation.getNrSamplesPerBatch() + (shiftsStepTwo->at(0) * (observation.getFirstDM() + ((observation.getNrDMs() - 1) * observation.getDMStep()))))), true);
-    observation.setNrSamplesPerDispersedBatch(static_cast<unsigned int>(std::ceil(observation.getNrSamplesPerBatch(true) + (shiftsStepOne->at(0) * (observation.getFirstDM(true) + ((observation.getNrDMs(true) - 1) * observation.getDMStep(true)))))), true);
+    observation.setNrSamplesPerBatch(observation.getNrSamplesPerBatch() + (delaysStepTwo.getMaxDelay() * observation.getDownsampling()), true);
+    observation.setNrSamplesPerDispersedBatch(observation.getNrSamplesPerBatch(true) + (delaysStepOne.getMaxDelay() * observation.getDownsampling()), true);
   }
   else
   {
-    observation.setNrSamplesPerBatch(static_cast<unsigned int>(std::ceil(observation.getNrSamplesPerBatch() + (shiftsStepTwo->at(0) * (observation.getFirstDM() + ((observation.getNrDMs() - 1) * observation.getDMStep()))))), true);
+    observation.setNrSamplesPerBatch(observation.getNrSamplesPerBatch() + delaysStepTwo.getMaxDelay(), true);
+  }
+
+  if ( (filterbank != nullptr) && ((static_cast< uint64_t >(inputBatch) * observation.getNrSamplesPerBatch()) + observation.getNrSamplesPerDispersedBatch(stepOne) > filterbank->getNrSamples()) ) {
+    std::cerr << "The batch is not in the input file." << std::endl;
+    return 1;
   }
 
   // Generate test data
@@ -153,24 +278,49 @@ int main(int argc, char * argv[]) {
   } else if ( !stepOne ) {
     AstroData::generateBeamMapping(observation, beamMappingStepTwo, padding, true);
   }
+  // Offsets are 0 and scales 1; the reduced output is never larger than the output buffer of outputDataType
+  Dedispersion::OutputScaling outputScaling;
+  if ( reducedOutput && singleStep ) {
+    outputScaling = Dedispersion::OutputScaling(outputFormat, observation.getNrSynthesizedBeams(), observation.getNrDMs());
+  } else if ( reducedOutput ) {
+    outputScaling = Dedispersion::OutputScaling(outputFormat, observation.getNrSynthesizedBeams(), observation.getNrDMs(true) * observation.getNrDMs());
+  }
+  // Only the integer formats have offsets and scales as kernel arguments
+  bool scaledOutput = reducedOutput && (outputFormat == Dedispersion::OutputFormat::UShort || outputFormat == Dedispersion::OutputFormat::UChar);
+  // Compact the zapped channels, per synthesized beam for single step, per beam for step one
+  std::vector<unsigned int> activeChannels;
+  if ( singleStep ) {
+    activeChannels = Dedispersion::ActiveChannels(observation, Dedispersion::ActiveChannels(observation, zappedChannels, padding), beamMappingSingleStep, padding).getRows();
+  } else if ( stepOne ) {
+    activeChannels = Dedispersion::ActiveChannels(observation, zappedChannels, padding).getRows();
+  }
 
   unsigned int dispersedData_size;
   unsigned int subbandedData_size;
   unsigned int dedispersedData_size;
   isa::OpenCL::OpenCLRunTime openCLRunTime;
-  cl::Buffer shiftsSingleStep_d;
-  cl::Buffer shiftsStepOne_d;
-  cl::Buffer shiftsStepTwo_d;
-  cl::Buffer zappedChannels_d;
+  cl::Buffer delaysSingleStep_d;
+  cl::Buffer delaysStepOne_d;
+  cl::Buffer delaysStepTwo_d;
+  cl::Buffer activeChannels_d;
   cl::Buffer beamMappingSingleStep_d;
   cl::Buffer beamMappingStepTwo_d;
   cl::Buffer dispersedData_d;
   cl::Buffer subbandedData_d;
   cl::Buffer dedispersedData_d;
+  cl::Buffer offsets_d;
+  cl::Buffer scales_d;
+  cl::Buffer statistics_d;
+  cl::Buffer dmMaximaDMs_d;
 
   if ( singleStep )
   {
-    if ( inputBits >= 8 )
+    if ( splitBatches )
+    {
+      // Ring of blocks, see Dedispersion::getNrInputBlocks()
+      dispersedData_size = Dedispersion::getNrInputBlocks(observation, false) * observation.getNrBeams() * observation.getNrChannels() * Dedispersion::getNrInputBlockSamplesPerChannel< inputDataType >(observation, padding, inputBits);
+    }
+    else if ( inputBits >= 8 )
     {
       dispersedData_size = observation.getNrBeams() * observation.getNrChannels() * observation.getNrSamplesPerDispersedBatch(false, padding / sizeof(inputDataType));
     }
@@ -182,7 +332,11 @@ int main(int argc, char * argv[]) {
   }
   else if ( stepOne )
   {
-    if ( inputBits >= 8 )
+    if ( splitBatches )
+    {
+      dispersedData_size = Dedispersion::getNrInputBlocks(observation, true) * observation.getNrBeams() * observation.getNrChannels() * Dedispersion::getNrInputBlockSamplesPerChannel< inputDataType >(observation, padding, inputBits);
+    }
+    else if ( inputBits >= 8 )
     {
       dispersedData_size = observation.getNrBeams() * observation.getNrChannels() * observation.getNrSamplesPerDispersedBatch(true, padding / sizeof(inputDataType));
     }
@@ -198,6 +352,21 @@ int main(int argc, char * argv[]) {
     dedispersedData_size = observation.getNrSynthesizedBeams() * observation.getNrDMs(true) * observation.getNrDMs() * observation.getNrSamplesPerBatch(false, padding / sizeof(outputDataType));
   }
 
+  if ( (singleStep || stepOne) && (inputLayout.getOrdering() == Dedispersion::InputOrdering::TimeMajor) )
+  {
+    // Rows of padded channels, one per sample
+    unsigned int nrInputChannelsPerSample = Dedispersion::getNrInputChannelsPerSample< inputDataType >(observation, padding);
+
+    if ( splitBatches )
+    {
+      dispersedData_size = Dedispersion::getNrInputBlocks(observation, stepOne) * observation.getNrBeams() * Dedispersion::getNrInputBeamElements(inputLayout, observation.getNrChannels(), nrInputChannelsPerSample, observation.getNrSamplesPerBatch());
+    }
+    else
+    {
+      dispersedData_size = observation.getNrBeams() * Dedispersion::getNrInputBeamElements(inputLayout, observation.getNrChannels(), nrInputChannelsPerSample, observation.getNrSamplesPerDispersedBatch(stepOne));
+    }
+  }
+
   for ( unsigned int threadsD0 = minThreads; threadsD0 <= maxColumns; threadsD0 *= 2 ) {
     for ( unsigned int threadsD1 = 1; threadsD1 <= maxRows; threadsD1++ ) {
       if ( threadsD0 * threadsD1 > maxThreads ) {
@@ -207,11 +376,11 @@ int main(int argc, char * argv[]) {
       }
       for ( unsigned int itemsD0 = 1; itemsD0 <= maxSampleItems; itemsD0++ ) {
         if ( singleStep ) {
-          if ( (observation.getNrSamplesPerBatch() % itemsD0) != 0 ) {
+          if ( ((observation.getNrSamplesPerBatch() / observation.getDownsampling()) % itemsD0) != 0 ) {
             continue;
           }
         } else if ( stepOne ) {
-          if ( (observation.getNrSamplesPerBatch(true) % itemsD0) != 0 ) {
+          if ( ((observation.getNrSamplesPerBatch(true) / observation.getDownsampling()) % itemsD0) != 0 ) {
             continue;
           }
         } else {
@@ -263,6 +432,10 @@ int main(int argc, char * argv[]) {
             conf.setUnroll(unroll);
             localConf.setUnroll(unroll);
             localConf.setLocalMem(true);
+            if ( singleStep || stepOne ) {
+              conf.setSplitBatches(splitBatches);
+              localConf.setSplitBatches(splitBatches);
+            }
 
             nrItems = conf.getNrItemsD1() + (conf.getNrItemsD0() * conf.getNrItemsD1());
             localNrItems = nrItems;
@@ -280,6 +453,10 @@ int main(int argc, char * argv[]) {
               nrItems += 4;
               localNrItems += 4;
             }
+            if ( conf.getSplitBatches() ) {
+              nrItems += 1;
+              localNrItems += 1;
+            }
 
             if ( nrItems <= maxItems ) {
               confs.push_back(conf);
@@ -298,63 +475,117 @@ int main(int argc, char * argv[]) {
     std::cout << "# nrBeams nrSynthesizedBeams nrSubbandingDMs nrDMs nrSubbands nrChannels nrZappedChannels nrSamplesSubbanding nrSamples *configuration* GFLOP/s time stdDeviation COV" << std::endl << std::endl;
   }
 
-  for ( auto conf = confs.begin(); conf != confs.end(); ++conf  ) {
-    // Generate kernel
+  // Generate and compile the kernel of a configuration; called by the threads of the pipeline
+  auto compile = [&](const unsigned int configuration) {
+    std::string * code = 0;
+    cl::Kernel * kernel = 0;
+
+    if ( singleStep ) {
+      code = Dedispersion::getDedispersionOpenCL< inputDataType, outputDataType >(confs[configuration], padding, inputBits, inputDataName, intermediateDataName, outputDataName, observation, delaysSingleStep, downsample, outputFormat, statistics, dmMaxima, inputLayout);
+    } else if ( stepOne ) {
+      code = Dedispersion::getSubbandDedispersionStepOneOpenCL< inputDataType, outputDataType >(confs[configuration], padding, inputBits, inputDataName, intermediateDataName, outputDataName, observation, delaysStepOne, downsample, inputLayout);
+    } else {
+      code = Dedispersion::getSubbandDedispersionStepTwoOpenCL< outputDataType >(confs[configuration], padding, outputDataName, observation, delaysStepTwo, outputFormat, statistics, dmMaxima);
+    }
+    try {
+      if ( singleStep ) {
+        kernel = kernelCache.compile("dedispersion", *code, "-cl-mad-enable -Werror", *(openCLRunTime.context), openCLRunTime.devices->at(clDeviceID));
+      } else if ( stepOne ) {
+        kernel = kernelCache.compile("dedispersionStepOne", *code, "-cl-mad-enable -Werror", *(openCLRunTime.context), openCLRunTime.devices->at(clDeviceID));
+      } else {
+        kernel = kernelCache.compile("dedispersionStepTwo", *code, "-cl-mad-enable -Werror", *(openCLRunTime.context), openCLRunTime.devices->at(clDeviceID));
+      }
+    } catch ( isa::OpenCL::OpenCLError & err ) {
+      delete code;
+      throw;
+    }
+    delete code;
+    return kernel;
+  };
+  std::unique_ptr< Dedispersion::KernelPipeline > pipeline;
+
+  for ( unsigned int configuration = 0; configuration < confs.size(); configuration++ ) {
+    auto conf = confs.begin() + configuration;
     double gflops = 0.0;
     isa::utils::Timer timer;
     cl::Kernel * kernel;
-    std::string * code = 0;
 
     if ( initializeDeviceMemory ) {
+      // The kernels compiled ahead belong to the context that is replaced
+      pipeline.reset();
       isa::OpenCL::initializeOpenCL(clPlatformID, 1, openCLRunTime);
       try {
         if ( singleStep ) {
-          initializeDeviceMemorySingleStep(*(openCLRunTime.context), &(openCLRunTime.queues->at(clDeviceID)[0]), shiftsSingleStep, &shiftsSingleStep_d, zappedChannels, &zappedChannels_d, beamMappingSingleStep, &beamMappingSingleStep_d, dispersedData_size, &dispersedData_d, dedispersedData_size, &dedispersedData_d);
+          initializeDeviceMemorySingleStep(*(openCLRunTime.context), &(openCLRunTime.queues->at(clDeviceID)[0]), delaysSingleStep, &delaysSingleStep_d, activeChannels, &activeChannels_d, beamMappingSingleStep, &beamMappingSingleStep_d, dispersedData_size, &dispersedData_d, dedispersedData_size, &dedispersedData_d);
         } else if ( stepOne ) {
-          initializeDeviceMemoryStepOne(*(openCLRunTime.context), &(openCLRunTime.queues->at(clDeviceID)[0]), shiftsStepOne, &shiftsStepOne_d, zappedChannels, &zappedChannels_d, dispersedData_size, &dispersedData_d, subbandedData_size, &subbandedData_d);
+          initializeDeviceMemoryStepOne(*(openCLRunTime.context), &(openCLRunTime.queues->at(clDeviceID)[0]), delaysStepOne, &delaysStepOne_d, activeChannels, &activeChannels_d, dispersedData_size, &dispersedData_d, subbandedData_size, &subbandedData_d);
         } else {
-          initializeDeviceMemoryStepTwo(*(openCLRunTime.context), &(openCLRunTime.queues->at(clDeviceID)[0]), shiftsStepTwo, &shiftsStepTwo_d, beamMappingStepTwo, &beamMappingStepTwo_d, subbandedData_size, &subbandedData_d, dedispersedData_size, &dedispersedData_d);
+          initializeDeviceMemoryStepTwo(*(openCLRunTime.context), &(openCLRunTime.queues->at(clDeviceID)[0]), delaysStepTwo, &delaysStepTwo_d, beamMappingStepTwo, &beamMappingStepTwo_d, subbandedData_size, &subbandedData_d, dedispersedData_size, &dedispersedData_d);
+        }
+        if ( scaledOutput ) {
+          initializeDeviceMemoryOutputScaling(*(openCLRunTime.context), &(openCLRunTime.queues->at(clDeviceID)[0]), outputScaling, &offsets_d, &scales_d);
         }
       } catch ( cl::Error & err ) {
         std::cerr << "Error in device memory allocation: ";
         std::cerr << std::to_string(err.err()) << "." << std::endl;
         return -1;
       }
+      if ( filterbank != nullptr ) {
+        // The rows of the file are the rows of the time-major input: a CPU device reads the batch in place, the others get it straight from the mapping
+        const uint8_t * batch = filterbank->getSamples(static_cast< uint64_t >(inputBatch) * observation.getNrSamplesPerBatch());
+
+        try {
+          if ( (openCLRunTime.devices->at(clDeviceID).getInfo< CL_DEVICE_TYPE >() & CL_DEVICE_TYPE_CPU) != 0 ) {
+            dispersedData_d = cl::Buffer(*(openCLRunTime.context), CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR, dispersedData_size * sizeof(inputDataType), const_cast< uint8_t * >(batch), 0);
+          } else {
+            openCLRunTime.queues->at(clDeviceID)[0].enqueueWriteBuffer(dispersedData_d, CL_TRUE, 0, dispersedData_size * sizeof(inputDataType), reinterpret_cast< const void * >(batch), 0, 0);
+          }
+        } catch ( cl::Error & err ) {
+          std::cerr << "Error reading the input file: ";
+          std::cerr << std::to_string(err.err()) << "." << std::endl;
+          return -1;
+        }
+      }
       initializeDeviceMemory = false;
+      pipeline.reset(new Dedispersion::KernelPipeline(configuration, confs.size(), compile, nrCompileThreads, compileQueue));
+    }
+    if ( statistics || dmMaxima ) {
+      // The number of partials depends on the configuration; the maxima are stored in the output buffer, that is larger than them
+      try {
+        if ( statistics ) {
+          statistics_d = cl::Buffer(*(openCLRunTime.context), CL_MEM_WRITE_ONLY, Dedispersion::Statistics(*conf, observation, !singleStep).getPartials().size() * sizeof(float), 0, 0);
+        }
+        if ( dmMaxima ) {
+          dmMaximaDMs_d = cl::Buffer(*(openCLRunTime.context), CL_MEM_WRITE_ONLY, Dedispersion::DMMaxima(*conf, observation, !singleStep).getPartialDMs().size() * sizeof(unsigned int), 0, 0);
+        }
+      } catch ( cl::Error & err ) {
+        std::cerr << "Error in device memory allocation: ";
+        std::cerr << std::to_string(err.err()) << "." << std::endl;
+        return -1;
+      }
     }
     if ( singleStep ) {
-      code = Dedispersion::getDedispersionOpenCL< inputDataType, outputDataType >(*conf, padding, inputBits, inputDataName, intermediateDataName, outputDataName, observation, *shiftsSingleStep);
       gflops = isa::utils::giga(static_cast< uint64_t >(observation.getNrSynthesizedBeams()) * observation.getNrDMs() * (observation.getNrChannels() - observation.getNrZappedChannels()) * observation.getNrSamplesPerBatch());
     } else if ( stepOne ) {
-      code = Dedispersion::getSubbandDedispersionStepOneOpenCL< inputDataType, outputDataType >(*conf, padding, inputBits, inputDataName, intermediateDataName, outputDataName, observation, *shiftsStepOne);
       gflops = isa::utils::giga(static_cast< uint64_t >(observation.getNrBeams()) * observation.getNrDMs(true) * (observation.getNrChannels() - observation.getNrZappedChannels()) * observation.getNrSamplesPerBatch(true));
     } else {
-      code = Dedispersion::getSubbandDedispersionStepTwoOpenCL< outputDataType >(*conf, padding, outputDataName, observation, *shiftsStepTwo);
       gflops = isa::utils::giga(static_cast< uint64_t >(observation.getNrSynthesizedBeams()) * observation.getNrDMs(true) * observation.getNrDMs() * observation.getNrSubbands() * observation.getNrSamplesPerBatch());
     }
     try {
-      if ( singleStep ) {
-        kernel = isa::OpenCL::compile("dedispersion", *code, "-cl-mad-enable -Werror", *(openCLRunTime.context), openCLRunTime.devices->at(clDeviceID));
-      } else if ( stepOne ) {
-        kernel = isa::OpenCL::compile("dedispersionStepOne", *code, "-cl-mad-enable -Werror", *(openCLRunTime.context), openCLRunTime.devices->at(clDeviceID));
-      } else {
-        kernel = isa::OpenCL::compile("dedispersionStepTwo", *code, "-cl-mad-enable -Werror", *(openCLRunTime.context), openCLRunTime.devices->at(clDeviceID));
-      }
+      kernel = pipeline->next();
     } catch ( isa::OpenCL::OpenCLError & err ) {
       std::cerr << err.what() << std::endl;
-      delete code;
       continue;
     }
-    delete code;
 
     cl::NDRange global;
     cl::NDRange local;
 
     if ( singleStep ) {
-      global = cl::NDRange(isa::utils::pad(observation.getNrSamplesPerBatch() / (*conf).getNrItemsD0(), (*conf).getNrThreadsD0()), observation.getNrDMs() / (*conf).getNrItemsD1(), observation.getNrSynthesizedBeams());
+      global = cl::NDRange(isa::utils::pad((observation.getNrSamplesPerBatch() / observation.getDownsampling()) / (*conf).getNrItemsD0(), (*conf).getNrThreadsD0()), observation.getNrDMs() / (*conf).getNrItemsD1(), observation.getNrSynthesizedBeams());
       local = cl::NDRange((*conf).getNrThreadsD0(), (*conf).getNrThreadsD1(), 1);
     } else if ( stepOne ) {
-      global = cl::NDRange(isa::utils::pad(observation.getNrSamplesPerBatch(true) / (*conf).getNrItemsD0(), (*conf).getNrThreadsD0()), observation.getNrDMs(true) / (*conf).getNrItemsD1(), observation.getNrBeams() * observation.getNrSubbands());
+      global = cl::NDRange(isa::utils::pad((observation.getNrSamplesPerBatch(true) / observation.getDownsampling()) / (*conf).getNrItemsD0(), (*conf).getNrThreadsD0()), observation.getNrDMs(true) / (*conf).getNrItemsD1(), observation.getNrBeams() * observation.getNrSubbands());
       local = cl::NDRange((*conf).getNrThreadsD0(), (*conf).getNrThreadsD1(), 1);
     } else {
       global = cl::NDRange(isa::utils::pad(observation.getNrSamplesPerBatch() / (*conf).getNrItemsD0(), (*conf).getNrThreadsD0()), observation.getNrDMs() / (*conf).getNrItemsD1(), observation.getNrSynthesizedBeams() * observation.getNrDMs(true));
@@ -365,20 +596,46 @@ int main(int argc, char * argv[]) {
       kernel->setArg(0, dispersedData_d);
       kernel->setArg(1, dedispersedData_d);
       kernel->setArg(2, beamMappingSingleStep_d);
-      kernel->setArg(3, zappedChannels_d);
-      kernel->setArg(4, shiftsSingleStep_d);
+      kernel->setArg(3, activeChannels_d);
+      kernel->setArg(4, delaysSingleStep_d);
       kernel->setArg(5, 0);
+      if ( (*conf).getSplitBatches() ) {
+        kernel->setArg(6, 0);
+      }
+      if ( scaledOutput ) {
+        kernel->setArg((*conf).getSplitBatches() ? 7 : 6, offsets_d);
+        kernel->setArg((*conf).getSplitBatches() ? 8 : 7, scales_d);
+      }
+      if ( statistics ) {
+        kernel->setArg(6 + ((*conf).getSplitBatches() ? 1 : 0) + (scaledOutput ? 2 : 0), statistics_d);
+      }
+      if ( dmMaxima ) {
+        kernel->setArg(6 + ((*conf).getSplitBatches() ? 1 : 0) + (statistics ? 1 : 0), dmMaximaDMs_d);
+      }
     } else if ( stepOne ) {
       kernel->setArg(0, dispersedData_d);
       kernel->setArg(1, subbandedData_d);
-      kernel->setArg(2, zappedChannels_d);
-      kernel->setArg(3, shiftsStepOne_d);
+      kernel->setArg(2, activeChannels_d);
+      kernel->setArg(3, delaysStepOne_d);
+      if ( (*conf).getSplitBatches() ) {
+        kernel->setArg(4, 0);
+      }
     } else {
       kernel->setArg(0, subbandedData_d);
       kernel->setArg(1, dedispersedData_d);
       kernel->setArg(2, beamMappingStepTwo_d);
-      kernel->setArg(3, shiftsStepTwo_d);
+      kernel->setArg(3, delaysStepTwo_d);
       kernel->setArg(4, 0);
+      if ( scaledOutput ) {
+        kernel->setArg(5, offsets_d);
+        kernel->setArg(6, scales_d);
+      }
+      if ( statistics ) {
+        kernel->setArg(scaledOutput ? 7 : 5, statistics_d);
+      }
+      if ( dmMaxima ) {
+        kernel->setArg(statistics ? 6 : 5, dmMaximaDMs_d);
+      }
     }
 
     try {
@@ -441,15 +698,15 @@ int main(int argc, char * argv[]) {
   return 0;
 }
 
-void initializeDeviceMemorySingleStep(cl::Context & clContext, cl::CommandQueue * clQueue, std::vector< float > * shiftsSingleStep, cl::Buffer * shiftsSingleStep_d, std::vector<unsigned int> & zappedChannels, cl::Buffer * zappedChannels_d, std::vector<unsigned int> & beamMappingSingleStep, cl::Buffer * beamMappingSingleStep_d, const unsigned int dispersedData_size, cl::Buffer * dispersedData_d, const unsigned int dedispersedData_size, cl::Buffer * dedispersedData_d) {
+void initializeDeviceMemorySingleStep(cl::Context & clContext, cl::CommandQueue * clQueue, const Dedispersion::DelayTable & delaysSingleStep, cl::Buffer * delaysSingleStep_d, std::vector<unsigned int> & activeChannels, cl::Buffer * activeChannels_d, std::vector<unsigned int> & beamMappingSingleStep, cl::Buffer * beamMappingSingleStep_d, const unsigned int dispersedData_size, cl::Buffer * dispersedData_d, const unsigned int dedispersedData_size, cl::Buffer * dedispersedData_d) {
   try {
-    *shiftsSingleStep_d = cl::Buffer(clContext, CL_MEM_READ_ONLY, shiftsSingleStep->size() * sizeof(float), 0, 0);
-    *zappedChannels_d = cl::Buffer(clContext, CL_MEM_READ_ONLY, zappedChannels.size() * sizeof(unsigned int), 0, 0);
+    *delaysSingleStep_d = cl::Buffer(clContext, CL_MEM_READ_ONLY, delaysSingleStep.getTable().size() * sizeof(unsigned int), 0, 0);
+    *activeChannels_d = cl::Buffer(clContext, CL_MEM_READ_ONLY, activeChannels.size() * sizeof(unsigned int), 0, 0);
     *beamMappingSingleStep_d = cl::Buffer(clContext, CL_MEM_READ_ONLY, beamMappingSingleStep.size() * sizeof(unsigned int), 0, 0);
     *dispersedData_d = cl::Buffer(clContext, CL_MEM_READ_ONLY, dispersedData_size * sizeof(inputDataType), 0, 0);
     *dedispersedData_d = cl::Buffer(clContext, CL_MEM_READ_WRITE, dedispersedData_size * sizeof(outputDataType), 0, 0);
-    clQueue->enqueueWriteBuffer(*shiftsSingleStep_d, CL_FALSE, 0, shiftsSingleStep->size() * sizeof(float), reinterpret_cast< void * >(shiftsSingleStep->data()));
-    clQueue->enqueueWriteBuffer(*zappedChannels_d, CL_FALSE, 0, zappedChannels.size() * sizeof(unsigned int), reinterpret_cast< void * >(zappedChannels.data()));
+    clQueue->enqueueWriteBuffer(*delaysSingleStep_d, CL_FALSE, 0, delaysSingleStep.getTable().size() * sizeof(unsigned int), reinterpret_cast< const void * >(delaysSingleStep.getTable().data()));
+    clQueue->enqueueWriteBuffer(*activeChannels_d, CL_FALSE, 0, activeChannels.size() * sizeof(unsigned int), reinterpret_cast< void * >(activeChannels.data()));
     clQueue->enqueueWriteBuffer(*beamMappingSingleStep_d, CL_FALSE, 0, beamMappingSingleStep.size() * sizeof(unsigned int), reinterpret_cast< void * >(beamMappingSingleStep.data()));
     clQueue->finish();
   } catch ( cl::Error & err ) {
@@ -458,14 +715,14 @@ void initializeDeviceMemorySingleStep(cl::Context & clContext, cl::CommandQueue
   }
 }
 
-void initializeDeviceMemoryStepOne(cl::Context & clContext, cl::CommandQueue * clQueue, std::vector< float > * shiftsStepOne, cl::Buffer * shiftsStepOne_d, std::vector<unsigned int> & zappedChannels, cl::Buffer * zappedChannels_d, const unsigned int dispersedData_size, cl::Buffer * dispersedData_d, const unsigned int subbandedData_size, cl::Buffer * subbandedData_d) {
+void initializeDeviceMemoryStepOne(cl::Context & clContext, cl::CommandQueue * clQueue, const Dedispersion::DelayTable & delaysStepOne, cl::Buffer * delaysStepOne_d, std::vector<unsigned int> & activeChannels, cl::Buffer * activeChannels_d, const unsigned int dispersedData_size, cl::Buffer * dispersedData_d, const unsigned int subbandedData_size, cl::Buffer * subbandedData_d) {
   try {
-    *shiftsStepOne_d = cl::Buffer(clContext, CL_MEM_READ_ONLY, shiftsStepOne->size() * sizeof(float), 0, 0);
-    *zappedChannels_d = cl::Buffer(clContext, CL_MEM_READ_ONLY, zappedChannels.size() * sizeof(unsigned int), 0, 0);
+    *delaysStepOne_d = cl::Buffer(clContext, CL_MEM_READ_ONLY, delaysStepOne.getTable().size() * sizeof(unsigned int), 0, 0);
+    *activeChannels_d = cl::Buffer(clContext, CL_MEM_READ_ONLY, activeChannels.size() * sizeof(unsigned int), 0, 0);
     *subbandedData_d = cl::Buffer(clContext, CL_MEM_READ_WRITE, subbandedData_size * sizeof(outputDataType), 0, 0);
     *dispersedData_d = cl::Buffer(clContext, CL_MEM_READ_ONLY, dispersedData_size * sizeof(inputDataType), 0, 0);
-    clQueue->enqueueWriteBuffer(*shiftsStepOne_d, CL_FALSE, 0, shiftsStepOne->size() * sizeof(float), reinterpret_cast< void * >(shiftsStepOne->data()));
-    clQueue->enqueueWriteBuffer(*zappedChannels_d, CL_FALSE, 0, zappedChannels.size() * sizeof(unsigned int), reinterpret_cast< void * >(zappedChannels.data()));
+    clQueue->enqueueWriteBuffer(*delaysStepOne_d, CL_FALSE, 0, delaysStepOne.getTable().size() * sizeof(unsigned int), reinterpret_cast< const void * >(delaysStepOne.getTable().data()));
+    clQueue->enqueueWriteBuffer(*activeChannels_d, CL_FALSE, 0, activeChannels.size() * sizeof(unsigned int), reinterpret_cast< void * >(activeChannels.data()));
     clQueue->finish();
   } catch ( cl::Error & err ) {
     std::cerr << "OpenCL error: " << std::to_string(err.err()) << "." << std::endl;
@@ -473,13 +730,13 @@ void initializeDeviceMemoryStepOne(cl::Context & clContext, cl::CommandQueue * c
   }
 }
 
-void initializeDeviceMemoryStepTwo(cl::Context & clContext, cl::CommandQueue * clQueue, std::vector< float > * shiftsStepTwo, cl::Buffer * shiftsStepTwo_d, std::vector<unsigned int> & beamMappingStepTwo, cl::Buffer * beamMappingStepTwo_d, const unsigned int subbandedData_size, cl::Buffer * subbandedData_d, const unsigned int dedispersedData_size, cl::Buffer * dedispersedData_d) {
+void initializeDeviceMemoryStepTwo(cl::Context & clContext, cl::CommandQueue * clQueue, const Dedispersion::DelayTable & delaysStepTwo, cl::Buffer * delaysStepTwo_d, std::vector<unsigned int> & beamMappingStepTwo, cl::Buffer * beamMappingStepTwo_d, const unsigned int subbandedData_size, cl::Buffer * subbandedData_d, const unsigned int dedispersedData_size, cl::Buffer * dedispersedData_d) {
   try {
-    *shiftsStepTwo_d = cl::Buffer(clContext, CL_MEM_READ_ONLY, shiftsStepTwo->size() * sizeof(float), 0, 0);
+    *delaysStepTwo_d = cl::Buffer(clContext, CL_MEM_READ_ONLY, delaysStepTwo.getTable().size() * sizeof(unsigned int), 0, 0);
     *beamMappingStepTwo_d = cl::Buffer(clContext, CL_MEM_READ_ONLY, beamMappingStepTwo.size() * sizeof(unsigned int), 0, 0);
     *subbandedData_d = cl::Buffer(clContext, CL_MEM_READ_ONLY, subbandedData_size * sizeof(outputDataType), 0, 0);
     *dedispersedData_d = cl::Buffer(clContext, CL_MEM_READ_WRITE, dedispersedData_size * sizeof(outputDataType), 0, 0);
-    clQueue->enqueueWriteBuffer(*shiftsStepTwo_d, CL_FALSE, 0, shiftsStepTwo->size() * sizeof(float), reinterpret_cast< void * >(shiftsStepTwo->data()));
+    clQueue->enqueueWriteBuffer(*delaysStepTwo_d, CL_FALSE, 0, delaysStepTwo.getTable().size() * sizeof(unsigned int), reinterpret_cast< const void * >(delaysStepTwo.getTable().data()));
     clQueue->enqueueWriteBuffer(*beamMappingStepTwo_d, CL_FALSE, 0, beamMappingStepTwo.size() * sizeof(unsigned int), reinterpret_cast< void * >(beamMappingStepTwo.data()));
     clQueue->finish();
   } catch ( cl::Error & err ) {
@@ -488,3 +745,16 @@ void initializeDeviceMemoryStepTwo(cl::Context & clContext, cl::CommandQueue * c
   }
 }
 
+void initializeDeviceMemoryOutputScaling(cl::Context & clContext, cl::CommandQueue * clQueue, const Dedispersion::OutputScaling & outputScaling, cl::Buffer * offsets_d, cl::Buffer * scales_d) {
+  try {
+    *offsets_d = cl::Buffer(clContext, CL_MEM_READ_ONLY, outputScaling.getOffsets().size() * sizeof(float), 0, 0);
+    *scales_d = cl::Buffer(clContext, CL_MEM_READ_ONLY, outputScaling.getScales().size() * sizeof(float), 0, 0);
+    clQueue->enqueueWriteBuffer(*offsets_d, CL_FALSE, 0, outputScaling.getOffsets().size() * sizeof(float), reinterpret_cast< const void * >(outputScaling.getOffsets().data()));
+    clQueue->enqueueWriteBuffer(*scales_d, CL_FALSE, 0, outputScaling.getScales().size() * sizeof(float), reinterpret_cast< const void * >(outputScaling.getScales().data()));
+    clQueue->finish();
+  } catch ( cl::Error & err ) {
+    std::cerr << "OpenCL error: " << std::to_string(err.err()) << "." << std::endl;
+    throw;
+  }
+}
+
@@ -0,0 +1,88 @@
+// Copyright 2017 Netherlands Institute for Radio Astronomy (ASTRON)
+// Copyright 2017 Netherlands eScience Center
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+
+#include <DelayTable.hpp>
+
+namespace Dedispersion {
+
+namespace {
+
+// Least common multiple, in bytes, of two alignments
+unsigned int getCommonAlignment(const unsigned int first, const unsigned int second) {
+  unsigned int a = first;
+  unsigned int b = second;
+
+  while ( b != 0 ) {
+    unsigned int remainder = a % b;
+
+    a = b;
+    b = remainder;
+  }
+  return (first / a) * second;
+}
+
+} // namespace
+
+DelayTable::DelayTable(const AstroData::Observation & observation, const std::vector< float > & shifts, const unsigned int padding, const DedispersionStep step) : maxDelay(0) {
+  if ( step == DedispersionStep::StepOne ) {
+    nrDMs = observation.getNrDMs(true);
+    nrChannels = observation.getNrChannels();
+  } else if ( step == DedispersionStep::StepTwo ) {
+    nrDMs = observation.getNrDMs();
+    nrChannels = observation.getNrSubbands();
+  } else {
+    nrDMs = observation.getNrDMs();
+    nrChannels = observation.getNrChannels();
+  }
+  // Every row starts on a cache line, the alignment of the table, and is a multiple of the padding of the device
+  nrPaddedChannels = isa::utils::pad(nrChannels, getCommonAlignment(std::max(padding, 1u), cacheLine) / sizeof(unsigned int));
+  table.resize(nrDMs * nrPaddedChannels);
+  // The same expressions as the sequential templates of Dedispersion.hpp; the OpenCL kernels read their delays from this table instead of computing them
+  for ( unsigned int dm = 0; dm < nrDMs; dm++ ) {
+    for ( unsigned int channel = 0; channel < nrChannels; channel++ ) {
+      unsigned int delay = 0;
+
+      if ( step == DedispersionStep::StepOne ) {
+        unsigned int subband = channel / observation.getNrChannelsPerSubband();
+
+        delay = static_cast< unsigned int >((observation.getFirstDM(true) + (dm * observation.getDMStep(true))) * (shifts[channel] - shifts[((subband + 1) * observation.getNrChannelsPerSubband()) - 1]));
+      } else {
+        delay = static_cast< unsigned int >((observation.getFirstDM() + (dm * observation.getDMStep())) * shifts[channel]);
+      }
+      table[(dm * nrPaddedChannels) + channel] = delay;
+      maxDelay = std::max(maxDelay, delay);
+    }
+  }
+}
+
+DelayTable::~DelayTable() {}
+
+unsigned int DelayTable::getMaxDelayDifference(const unsigned int nrDMsPerBlock) const {
+  unsigned int difference = 0;
+
+  for ( unsigned int firstDM = 0; firstDM < nrDMs; firstDM += nrDMsPerBlock ) {
+    unsigned int lastDM = std::min(firstDM + nrDMsPerBlock, nrDMs) - 1;
+
+    for ( unsigned int channel = 0; channel < nrChannels; channel++ ) {
+      difference = std::max(difference, getDelay(lastDM, channel) - getDelay(firstDM, channel));
+    }
+  }
+  return difference;
+}
+
+} // Dedispersion
+
@@ -0,0 +1,133 @@
+// Copyright 2017 Netherlands Institute for Radio Astronomy (ASTRON)
+// Copyright 2017 Netherlands eScience Center
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdlib>
+
+#include <FDMT.hpp>
+
+namespace Dedispersion {
+
+FDMTPlan::FDMTPlan(const AstroData::Observation & observation, const std::vector< float > & shifts, const DelayTable & delays) : delays(delays) {
+  unsigned int maxDelay = 0;
+
+  dmDelays.resize(observation.getNrDMs());
+  for ( unsigned int dm = 0; dm < observation.getNrDMs(); dm++ ) {
+    dmDelays[dm] = delays.getDelay(dm, 0);
+    maxDelay = std::max(maxDelay, dmDelays[dm]);
+  }
+  // Build the stages bottom-up, merging pairs of adjacent nodes
+  stages.push_back(std::vector< FDMTNode >(observation.getNrChannels()));
+  for ( unsigned int channel = 0; channel < observation.getNrChannels(); channel++ ) {
+    FDMTNode & node = stages[0][channel];
+
+    node = FDMTNode();
+    node.firstChannel = channel;
+    node.lastChannel = channel;
+  }
+  while ( stages.back().size() > 1 ) {
+    const std::vector< FDMTNode > & previousNodes = stages.back();
+    std::vector< FDMTNode > nodes((previousNodes.size() + 1) / 2);
+
+    for ( unsigned int item = 0; item < nodes.size(); item++ ) {
+      FDMTNode & node = nodes[item];
+
+      node = FDMTNode();
+      node.low = 2 * item;
+      node.firstChannel = previousNodes[node.low].firstChannel;
+      node.lastChannel = previousNodes[node.low].lastChannel;
+      if ( (2 * item) + 1 < previousNodes.size() ) {
+        node.merge = true;
+        node.high = (2 * item) + 1;
+        node.lastChannel = previousNodes[node.high].lastChannel;
+        float span = shifts[node.firstChannel] - shifts[node.lastChannel];
+        node.highRatio = (shifts[previousNodes[node.high].firstChannel] - shifts[node.lastChannel]) / span;
+        node.offsetRatio = (shifts[previousNodes[node.low].lastChannel] - shifts[node.lastChannel]) / span;
+        node.lowRatio = (shifts[node.firstChannel] - shifts[previousNodes[node.low].lastChannel]) / span;
+      }
+    }
+    stages.push_back(nodes);
+  }
+  // Delays and samples needed by every node, top-down; the splits are monotonic, so the maximum delay of a node gives the maximum of its children
+  stages.back()[0].nrDelays = maxDelay + 1;
+  stages.back()[0].nrSamples = observation.getNrSamplesPerBatch() / observation.getDownsampling();
+  for ( unsigned int stage = stages.size() - 1; stage > 0; stage-- ) {
+    for ( unsigned int item = 0; item < stages[stage].size(); item++ ) {
+      const FDMTNode & node = stages[stage][item];
+      FDMTNode & low = stages[stage - 1][node.low];
+
+      if ( node.merge ) {
+        FDMTNode & high = stages[stage - 1][node.high];
+
+        high.nrDelays = getFDMTDelay(node.nrDelays - 1, node.highRatio) + 1;
+        high.nrSamples = node.nrSamples;
+        low.nrDelays = getFDMTDelay(node.nrDelays - 1, node.lowRatio) + 1;
+        low.nrSamples = node.nrSamples + getFDMTDelay(node.nrDelays - 1, node.offsetRatio);
+      } else {
+        low.nrDelays = node.nrDelays;
+        low.nrSamples = node.nrSamples;
+      }
+    }
+  }
+  nrDelays.resize(stages.size());
+  nrElements.resize(stages.size());
+  for ( unsigned int stage = 0; stage < stages.size(); stage++ ) {
+    for ( unsigned int item = 0; item < stages[stage].size(); item++ ) {
+      FDMTNode & node = stages[stage][item];
+
+      node.firstDelay = nrDelays[stage];
+      node.firstElement = nrElements[stage];
+      nrDelays[stage] += node.nrDelays;
+      nrElements[stage] += node.nrDelays * node.nrSamples;
+    }
+  }
+}
+
+FDMTPlan::~FDMTPlan() {}
+
+std::vector< unsigned int > FDMTPlan::getChannelDelays(const unsigned int delay) const {
+  std::vector< unsigned int > channelDelays(stages[0].size());
+
+  getChannelDelays(stages.size() - 1, 0, delay, 0, channelDelays);
+  return channelDelays;
+}
+
+void FDMTPlan::getChannelDelays(const unsigned int stage, const unsigned int node, const unsigned int delay, const unsigned int offset, std::vector< unsigned int > & channelDelays) const {
+  const FDMTNode & current = stages[stage][node];
+
+  if ( stage == 0 ) {
+    channelDelays[current.firstChannel] = offset;
+  } else if ( !current.merge ) {
+    getChannelDelays(stage - 1, current.low, delay, offset, channelDelays);
+  } else {
+    getChannelDelays(stage - 1, current.high, getFDMTDelay(delay, current.highRatio), offset, channelDelays);
+    getChannelDelays(stage - 1, current.low, getFDMTDelay(delay, current.lowRatio), offset + getFDMTDelay(delay, current.offsetRatio), channelDelays);
+  }
+}
+
+std::vector< unsigned int > FDMTPlan::getDelayErrors() const {
+  std::vector< unsigned int > errors(dmDelays.size());
+
+  for ( unsigned int dm = 0; dm < dmDelays.size(); dm++ ) {
+    std::vector< unsigned int > channelDelays = getChannelDelays(dmDelays[dm]);
+
+    for ( unsigned int channel = 0; channel < channelDelays.size(); channel++ ) {
+      errors[dm] = std::max(errors[dm], static_cast< unsigned int >(std::abs(static_cast< int >(channelDelays[channel]) - static_cast< int >(delays.getDelay(dm, channel)))));
+    }
+  }
+  return errors;
+}
+
+} // Dedispersion
+
@@ -0,0 +1,172 @@
+// Copyright 2017 Netherlands Institute for Radio Astronomy (ASTRON)
+// Copyright 2017 Netherlands eScience Center
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <ReadData.hpp>
+#include <Filterbank.hpp>
+
+namespace Dedispersion {
+
+Filterbank::Filterbank(const std::string & fileName) : data(nullptr), size(0), header({0, 0, 1, 0.0, 0.0, 0.0, 0}) {
+  map(fileName);
+  try {
+    readHeader();
+  } catch ( ... ) {
+    munmap(data, size);
+    throw;
+  }
+}
+
+Filterbank::Filterbank(const std::string & fileName, const AstroData::Observation & observation, const uint8_t inputBits, const bool reversedFrequency) : data(nullptr), size(0), header({observation.getNrChannels(), inputBits, 1, observation.getSamplingTime(), observation.getMinFreq(), observation.getChannelBandwidth(), 0}) {
+  if ( reversedFrequency ) {
+    header.firstFrequency = observation.getMaxFreq();
+    header.channelBandwidth = -header.channelBandwidth;
+  }
+  map(fileName);
+}
+
+Filterbank::~Filterbank() {
+  munmap(data, size);
+}
+
+void Filterbank::setObservation(AstroData::Observation & observation) const {
+  double minFrequency = header.firstFrequency;
+
+  if ( header.channelBandwidth < 0.0 ) {
+    minFrequency += (header.nrChannels - 1) * header.channelBandwidth;
+  }
+  observation.setFrequencyRange(observation.getNrSubbands(), header.nrChannels, static_cast< float >(minFrequency), static_cast< float >(std::fabs(header.channelBandwidth)));
+  observation.setSamplingTime(static_cast< float >(header.samplingTime));
+}
+
+void Filterbank::prefetch(const uint64_t sample, const uint64_t nrSamples) const {
+  advise(sample, nrSamples, MADV_WILLNEED);
+}
+
+void Filterbank::release(const uint64_t sample, const uint64_t nrSamples) const {
+  advise(sample, nrSamples, MADV_DONTNEED);
+}
+
+void Filterbank::map(const std::string & fileName) {
+  struct stat status;
+  int file = open(fileName.c_str(), O_RDONLY);
+  void * mapping = MAP_FAILED;
+
+  if ( file < 0 ) {
+    throw AstroData::FileError("Impossible to open " + fileName);
+  }
+  if ( (fstat(file, &status) == 0) && (status.st_size > 0) ) {
+    size = status.st_size;
+    mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, file, 0);
+  }
+  // The mapping keeps the file open
+  close(file);
+  if ( mapping == MAP_FAILED ) {
+    throw AstroData::FileError("Impossible to map " + fileName);
+  }
+  data = reinterpret_cast< uint8_t * >(mapping);
+  // The batches are read in order: a larger readahead, and pages behind the batches can be dropped first
+  madvise(data, size, MADV_SEQUENTIAL);
+}
+
+void Filterbank::readHeader() {
+  uint64_t position = 0;
+  // Keywords are a 32 bit length followed by the characters
+  auto readString = [&]() {
+    int32_t length = 0;
+
+    if ( position + sizeof(int32_t) > size ) {
+      throw AstroData::FileError("Truncated SIGPROC header.");
+    }
+    std::memcpy(&length, data + position, sizeof(int32_t));
+    position += sizeof(int32_t);
+    if ( (length < 0) || (position + length > size) ) {
+      throw AstroData::FileError("Truncated SIGPROC header.");
+    }
+    position += length;
+    return std::string(reinterpret_cast< const char * >(data + position - length), length);
+  };
+  auto readValue = [&](void * value, const uint64_t bytes) {
+    if ( position + bytes > size ) {
+      throw AstroData::FileError("Truncated SIGPROC header.");
+    }
+    std::memcpy(value, data + position, bytes);
+    position += bytes;
+  };
+
+  if ( readString() != "HEADER_START" ) {
+    throw AstroData::FileError("Not a SIGPROC filterbank file.");
+  }
+  for ( std::string keyword = readString(); keyword != "HEADER_END"; keyword = readString() ) {
+    int32_t integer = 0;
+    double real = 0.0;
+
+    if ( keyword == "nchans" ) {
+      readValue(&integer, sizeof(int32_t));
+      header.nrChannels = integer;
+    } else if ( keyword == "nbits" ) {
+      readValue(&integer, sizeof(int32_t));
+      header.nrBits = integer;
+    } else if ( keyword == "nifs" ) {
+      readValue(&integer, sizeof(int32_t));
+      header.nrIFs = integer;
+    } else if ( keyword == "tsamp" ) {
+      readValue(&header.samplingTime, sizeof(double));
+    } else if ( keyword == "fch1" ) {
+      readValue(&header.firstFrequency, sizeof(double));
+    } else if ( keyword == "foff" ) {
+      readValue(&header.channelBandwidth, sizeof(double));
+    } else if ( keyword == "telescope_id" || keyword == "machine_id" || keyword == "data_type" || keyword == "barycentric" || keyword == "pulsarcentric" || keyword == "nsamples" || keyword == "nbeams" || keyword == "ibeam" ) {
+      readValue(&integer, sizeof(int32_t));
+    } else if ( keyword == "tstart" || keyword == "refdm" || keyword == "az_start" || keyword == "za_start" || keyword == "src_raj" || keyword == "src_dej" || keyword == "period" || keyword == "fchannel" ) {
+      readValue(&real, sizeof(double));
+    } else if ( keyword == "source_name" || keyword == "rawdatafile" ) {
+      readString();
+    } else if ( keyword == "signed" ) {
+      readValue(&integer, sizeof(int8_t));
+    } else if ( keyword != "FREQUENCY_START" && keyword != "FREQUENCY_END" ) {
+      throw AstroData::FileError("Unknown SIGPROC keyword " + keyword + ".");
+    }
+  }
+  header.headerSize = position;
+  if ( (header.nrChannels == 0) || (header.nrBits == 0) || (header.nrIFs != 1) ) {
+    throw AstroData::FileError("The SIGPROC header does not describe a filterbank of a single IF.");
+  }
+  if ( ((header.nrChannels * header.nrBits) % 8) != 0 ) {
+    throw AstroData::FileError("The rows of the filterbank are not a whole number of bytes.");
+  }
+}
+
+void Filterbank::advise(const uint64_t sample, const uint64_t nrSamples, const int advice) const {
+  const uint64_t pageSize = sysconf(_SC_PAGESIZE);
+  uint64_t first = header.headerSize + (sample * getNrBytesPerSample());
+  uint64_t last = std::min(first + (nrSamples * getNrBytesPerSample()), size);
+
+  // madvise() works on whole pages
+  first = (first / pageSize) * pageSize;
+  if ( first < last ) {
+    madvise(data + first, last - first, advice);
+  }
+}
+
+} // Dedispersion
+
@@ -0,0 +1,55 @@
+// Copyright 2017 Netherlands Institute for Radio Astronomy (ASTRON)
+// Copyright 2017 Netherlands eScience Center
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdexcept>
+
+#include <InputLayout.hpp>
+
+namespace Dedispersion {
+
+InputLayout::InputLayout() : ordering(InputOrdering::ChannelMajor), reversedFrequency(false) {}
+
+InputLayout::InputLayout(const InputOrdering ordering, const bool reversedFrequency) : ordering(ordering), reversedFrequency(reversedFrequency) {}
+
+InputLayout::~InputLayout() {}
+
+InputOrdering getInputOrdering(const std::string & name) {
+  if ( name == "channel" ) {
+    return InputOrdering::ChannelMajor;
+  } else if ( name == "time" ) {
+    return InputOrdering::TimeMajor;
+  }
+  throw std::invalid_argument("Unknown input ordering " + name + ", select one: channel time");
+}
+
+std::string getInputChannelOpenCL(const InputLayout & layout, const unsigned int nrChannels) {
+  if ( layout.getReversedFrequency() ) {
+    return "(" + std::to_string(nrChannels - 1) + " - channel)";
+  }
+  return "channel";
+}
+
+std::string getInputIndexOpenCL(const InputLayout & layout, const unsigned int nrChannels, const unsigned int nrChannelsPerSample, const unsigned int nrSamplesPerChannel, const std::string & beam, const std::string & sample) {
+  std::string index = "(" + beam + " * " + std::to_string(getNrInputBeamElements(layout, nrChannels, nrChannelsPerSample, nrSamplesPerChannel)) + ") + ";
+
+  // In time-major input consecutive samples of a channel are a sample row apart
+  if ( layout.getOrdering() == InputOrdering::TimeMajor ) {
+    return index + "(" + sample + " * " + std::to_string(nrChannelsPerSample) + ") + " + getInputChannelOpenCL(layout, nrChannels);
+  }
+  return index + "(" + getInputChannelOpenCL(layout, nrChannels) + " * " + std::to_string(nrSamplesPerChannel) + ") + " + sample;
+}
+
+} // Dedispersion
+
@@ -0,0 +1,140 @@
+// Copyright 2017 Netherlands Institute for Radio Astronomy (ASTRON)
+// Copyright 2017 Netherlands eScience Center
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <sstream>
+#include <iomanip>
+#include <limits>
+
+#include <Instrumentation.hpp>
+
+namespace Dedispersion {
+
+Instrumentation::Instrumentation(const bool enabled) : enabled(enabled) {
+  reset();
+}
+
+Instrumentation::~Instrumentation() {}
+
+StageCounters Instrumentation::getCounters(const Stage stage) const {
+  const unsigned int index = static_cast< unsigned int >(stage);
+  StageCounters counters = {nrCalls[index], time[index], minTime[index], maxTime[index], nrBytes[index], nrOperations[index]};
+
+  if ( counters.nrCalls == 0 ) {
+    counters.minTime = 0;
+  }
+  return counters;
+}
+
+void Instrumentation::add(const Stage stage, const uint64_t time, const uint64_t nrBytes, const uint64_t nrOperations) {
+  const unsigned int index = static_cast< unsigned int >(stage);
+
+  if ( !enabled ) {
+    return;
+  }
+  nrCalls[index].fetch_add(1, std::memory_order_relaxed);
+  this->time[index].fetch_add(time, std::memory_order_relaxed);
+  this->nrBytes[index].fetch_add(nrBytes, std::memory_order_relaxed);
+  this->nrOperations[index].fetch_add(nrOperations, std::memory_order_relaxed);
+  // Another thread can change the extremes between the load and the exchange
+  uint64_t extreme = minTime[index].load(std::memory_order_relaxed);
+  while ( (time < extreme) && !minTime[index].compare_exchange_weak(extreme, time, std::memory_order_relaxed) ) {}
+  extreme = maxTime[index].load(std::memory_order_relaxed);
+  while ( (time > extreme) && !maxTime[index].compare_exchange_weak(extreme, time, std::memory_order_relaxed) ) {}
+}
+
+bool Instrumentation::add(const Stage stage, const cl::Event & event, const uint64_t nrBytes, const uint64_t nrOperations) {
+  uint64_t start = 0;
+  uint64_t end = 0;
+
+  if ( !enabled ) {
+    return true;
+  }
+  try {
+    start = event.getProfilingInfo< CL_PROFILING_COMMAND_START >();
+    end = event.getProfilingInfo< CL_PROFILING_COMMAND_END >();
+  } catch ( cl::Error & err ) {
+    return false;
+  }
+  add(stage, end - start, nrBytes, nrOperations);
+  return true;
+}
+
+void Instrumentation::reset() {
+  for ( unsigned int stage = 0; stage < nrStages; stage++ ) {
+    nrCalls[stage] = 0;
+    time[stage] = 0;
+    minTime[stage] = std::numeric_limits< uint64_t >::max();
+    maxTime[stage] = 0;
+    nrBytes[stage] = 0;
+    nrOperations[stage] = 0;
+  }
+}
+
+std::string Instrumentation::print() const {
+  std::ostringstream output;
+
+  output << std::fixed;
+  output << "# stage calls time minTime maxTime bytes operations GB/s GFLOP/s" << std::endl;
+  for ( unsigned int stage = 0; stage < nrStages; stage++ ) {
+    const StageCounters counters = getCounters(static_cast< Stage >(stage));
+    const double seconds = counters.time * 1.0e-09;
+
+    output << getStageName(static_cast< Stage >(stage)) << " " << counters.nrCalls << " ";
+    output << std::setprecision(9) << seconds << " " << counters.minTime * 1.0e-09 << " " << counters.maxTime * 1.0e-09 << " ";
+    output << counters.nrBytes << " " << counters.nrOperations << " ";
+    output << std::setprecision(3) << ((seconds > 0.0) ? (counters.nrBytes * 1.0e-09) / seconds : 0.0) << " " << ((seconds > 0.0) ? (counters.nrOperations * 1.0e-09) / seconds : 0.0) << std::endl;
+  }
+  return output.str();
+}
+
+std::string Instrumentation::printJSON() const {
+  std::ostringstream output;
+
+  output << "{\"stages\": [";
+  for ( unsigned int stage = 0; stage < nrStages; stage++ ) {
+    const StageCounters counters = getCounters(static_cast< Stage >(stage));
+
+    output << ((stage > 0) ? ", " : "") << "{\"stage\": \"" << getStageName(static_cast< Stage >(stage)) << "\", \"calls\": " << counters.nrCalls;
+    output << ", \"time\": " << counters.time << ", \"minTime\": " << counters.minTime << ", \"maxTime\": " << counters.maxTime;
+    output << ", \"bytes\": " << counters.nrBytes << ", \"operations\": " << counters.nrOperations << "}";
+  }
+  output << "]}";
+  return output.str();
+}
+
+std::string getStageName(const Stage stage) {
+  switch ( stage ) {
+    case Stage::Input:
+      return "input";
+    case Stage::HostToDevice:
+      return "H2D";
+    case Stage::Kernel:
+      return "kernel";
+    case Stage::DeviceToHost:
+      return "D2H";
+    default:
+      return "CPU";
+  }
+}
+
+uint64_t getNrDedispersionOperations(const AstroData::Observation & observation, const bool subbanding) {
+  if ( subbanding ) {
+    return (static_cast< uint64_t >(observation.getNrBeams()) * observation.getNrDMs(true) * (observation.getNrChannels() - observation.getNrZappedChannels()) * observation.getNrSamplesPerBatch(true)) + (static_cast< uint64_t >(observation.getNrSynthesizedBeams()) * observation.getNrDMs(true) * observation.getNrDMs() * observation.getNrSubbands() * observation.getNrSamplesPerBatch());
+  }
+  return static_cast< uint64_t >(observation.getNrSynthesizedBeams()) * observation.getNrDMs() * (observation.getNrChannels() - observation.getNrZappedChannels()) * observation.getNrSamplesPerBatch();
+}
+
+} // Dedispersion
+
@@ -0,0 +1,191 @@
+// Copyright 2017 Netherlands Institute for Radio Astronomy (ASTRON)
+// Copyright 2017 Netherlands eScience Center
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstdio>
+#include <cerrno>
+#include <thread>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <ReadData.hpp>
+#include <KernelCache.hpp>
+
+namespace Dedispersion {
+
+const std::string kernelCacheMagic = "DEDISPERSION_KERNEL_CACHE 1\n";
+
+// An entry is the magic, then the size and the bytes of the key and of the binary
+bool readEntry(const std::string & fileName, const std::string & key, std::vector< unsigned char > & binary) {
+  std::ifstream file(fileName, std::ios::binary);
+  std::string magic(kernelCacheMagic.size(), '\0');
+  uint64_t size = 0;
+
+  if ( !file ) {
+    return false;
+  }
+  file.read(&magic[0], magic.size());
+  if ( !file || (magic != kernelCacheMagic) ) {
+    return false;
+  }
+  file.read(reinterpret_cast< char * >(&size), sizeof(uint64_t));
+  if ( !file || (size != key.size()) ) {
+    return false;
+  }
+  std::string entryKey(size, '\0');
+  file.read(&entryKey[0], size);
+  if ( !file || (entryKey != key) ) {
+    return false;
+  }
+  file.read(reinterpret_cast< char * >(&size), sizeof(uint64_t));
+  if ( !file || (size == 0) ) {
+    return false;
+  }
+  binary.resize(size);
+  file.read(reinterpret_cast< char * >(binary.data()), size);
+  return static_cast< bool >(file);
+}
+
+// Written to a temporary file and renamed, so that other processes and threads never read a partial entry
+void writeEntry(const std::string & fileName, const std::string & key, const std::vector< unsigned char > & binary) {
+  const std::string temporaryName = fileName + ".tmp" + std::to_string(getpid()) + "_" + std::to_string(std::hash< std::thread::id >()(std::this_thread::get_id()));
+  std::ofstream file(temporaryName, std::ios::binary);
+  uint64_t size = key.size();
+
+  file.write(kernelCacheMagic.c_str(), kernelCacheMagic.size());
+  file.write(reinterpret_cast< const char * >(&size), sizeof(uint64_t));
+  file.write(key.c_str(), key.size());
+  size = binary.size();
+  file.write(reinterpret_cast< const char * >(&size), sizeof(uint64_t));
+  file.write(reinterpret_cast< const char * >(binary.data()), binary.size());
+  file.close();
+  if ( !file || (std::rename(temporaryName.c_str(), fileName.c_str()) != 0) ) {
+    // The kernel is compiled again the next time
+    std::remove(temporaryName.c_str());
+  }
+}
+
+// Binary of a program built for one device
+std::vector< unsigned char > getBinary(const cl::Program & program) {
+  size_t size = 0;
+  std::vector< unsigned char > binary;
+  unsigned char * binaries[1];
+
+  if ( (clGetProgramInfo(program(), CL_PROGRAM_BINARY_SIZES, sizeof(size_t), &size, nullptr) != CL_SUCCESS) || (size == 0) ) {
+    return binary;
+  }
+  binary.resize(size);
+  binaries[0] = binary.data();
+  if ( clGetProgramInfo(program(), CL_PROGRAM_BINARIES, sizeof(unsigned char *), binaries, nullptr) != CL_SUCCESS ) {
+    binary.clear();
+  }
+  return binary;
+}
+
+KernelCache::KernelCache(const std::string & directory) : directory(directory), nrHits(0), nrMisses(0) {
+  if ( !directory.empty() && (mkdir(directory.c_str(), S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH) != 0) && (errno != EEXIST) ) {
+    throw AstroData::FileError("Impossible to create the kernel cache " + directory + ".");
+  }
+}
+
+KernelCache::KernelCache(const KernelCache & cache) : directory(cache.directory), nrHits(cache.nrHits.load()), nrMisses(cache.nrMisses.load()) {}
+
+KernelCache::~KernelCache() {}
+
+KernelCache & KernelCache::operator=(const KernelCache & cache) {
+  directory = cache.directory;
+  nrHits = cache.nrHits.load();
+  nrMisses = cache.nrMisses.load();
+  return *this;
+}
+
+cl::Kernel * KernelCache::compile(const std::string & name, const std::string & code, const std::string & options, cl::Context & context, cl::Device & device) {
+  if ( !isEnabled() ) {
+    return isa::OpenCL::compile(name, code, options, context, device);
+  }
+  const std::string key = getKernelCacheKey(name, code, options, device);
+  std::ostringstream fileName;
+  std::vector< unsigned char > binary;
+  cl_device_id deviceID = device();
+  cl_int status = CL_SUCCESS;
+
+  fileName << directory << "/" << name << "_" << std::hex << std::setfill('0') << std::setw(16) << getHash(key) << ".bin";
+  if ( readEntry(fileName.str(), key, binary) ) {
+    const unsigned char * binaries[1] = {binary.data()};
+    size_t size = binary.size();
+    cl_program clProgram = clCreateProgramWithBinary(context(), 1, &deviceID, &size, binaries, nullptr, &status);
+
+    if ( status == CL_SUCCESS ) {
+      // A binary the driver does not accept anymore is compiled again from source
+      try {
+        cl::Program program(clProgram);
+
+        program.build(std::vector< cl::Device >(1, device), options.c_str());
+        nrHits++;
+        return new cl::Kernel(program, name.c_str());
+      } catch ( cl::Error & err ) {}
+    } else if ( clProgram != nullptr ) {
+      // Not owned by a cl::Program
+      clReleaseProgram(clProgram);
+    }
+  }
+  nrMisses++;
+  const char * source = code.c_str();
+  size_t length = code.size();
+  cl_program clProgram = clCreateProgramWithSource(context(), 1, &source, &length, &status);
+
+  if ( status != CL_SUCCESS ) {
+    if ( clProgram != nullptr ) {
+      clReleaseProgram(clProgram);
+    }
+    throw isa::OpenCL::OpenCLError("ERROR: \"" + name + "\" impossible to create the program, error " + std::to_string(status) + ".");
+  }
+  cl::Program program(clProgram);
+
+  // A failed build is not compiled again: the error has the build log of this build, as without the cache
+  try {
+    program.build(std::vector< cl::Device >(1, device), options.c_str());
+  } catch ( cl::Error & err ) {
+    throw isa::OpenCL::OpenCLError("ERROR: \"" + name + "\" " + std::to_string(err.err()) + " " + program.getBuildInfo< CL_PROGRAM_BUILD_LOG >(device));
+  }
+  binary = getBinary(program);
+  if ( !binary.empty() ) {
+    writeEntry(fileName.str(), key, binary);
+  }
+  try {
+    return new cl::Kernel(program, name.c_str());
+  } catch ( cl::Error & err ) {
+    throw isa::OpenCL::OpenCLError("ERROR: impossible to create the kernel \"" + name + "\", error " + std::to_string(err.err()) + ".");
+  }
+}
+
+std::string getKernelCacheKey(const std::string & name, const std::string & code, const std::string & options, const cl::Device & device) {
+  return name + "\n" + device.getInfo< CL_DEVICE_NAME >() + "\n" + device.getInfo< CL_DRIVER_VERSION >() + "\n" + device.getInfo< CL_DEVICE_VERSION >() + "\n" + options + "\n" + code;
+}
+
+uint64_t getHash(const std::string & text) {
+  uint64_t hash = 14695981039346656037ULL;
+
+  for ( auto character : text ) {
+    hash ^= static_cast< unsigned char >(character);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+} // Dedispersion
+
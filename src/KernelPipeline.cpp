@@ -0,0 +1,91 @@
+// Copyright 2017 Netherlands Institute for Radio Astronomy (ASTRON)
+// Copyright 2017 Netherlands eScience Center
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdexcept>
+
+#include <KernelPipeline.hpp>
+
+namespace Dedispersion {
+
+KernelPipeline::KernelPipeline(const unsigned int first, const unsigned int nrItems, const std::function< cl::Kernel * (const unsigned int) > & compile, const unsigned int nrThreads, const unsigned int depth) : compile(compile), nrItems(nrItems), depth(depth), nextItem(first), nextResult(first), stop(false) {
+  if ( depth < nrThreads ) {
+    throw std::invalid_argument("The depth of the pipeline is smaller than its number of threads.");
+  }
+  for ( unsigned int thread = 0; thread < nrThreads; thread++ ) {
+    workers.push_back(std::thread(&KernelPipeline::worker, this));
+  }
+}
+
+KernelPipeline::~KernelPipeline() {
+  {
+    std::lock_guard< std::mutex > guard(lock);
+    stop = true;
+  }
+  taken.notify_all();
+  for ( auto worker = workers.begin(); worker != workers.end(); ++worker ) {
+    worker->join();
+  }
+  for ( auto result = results.begin(); result != results.end(); ++result ) {
+    delete result->second.kernel;
+  }
+}
+
+cl::Kernel * KernelPipeline::next() {
+  if ( workers.empty() ) {
+    return compile(nextResult++);
+  }
+  Result result;
+  {
+    std::unique_lock< std::mutex > guard(lock);
+    const unsigned int item = nextResult;
+
+    compiled.wait(guard, [this, item]{ return results.find(item) != results.end(); });
+    result = results[item];
+    results.erase(item);
+    nextResult++;
+  }
+  taken.notify_all();
+  if ( result.error ) {
+    std::rethrow_exception(result.error);
+  }
+  return result.kernel;
+}
+
+void KernelPipeline::worker() {
+  std::unique_lock< std::mutex > guard(lock);
+
+  while ( true ) {
+    // Items are taken in order, and no further than depth items after the next one to return
+    taken.wait(guard, [this]{ return stop || (nextItem >= nrItems) || (nextItem < nextResult + depth); });
+    if ( stop || (nextItem >= nrItems) ) {
+      return;
+    }
+    const unsigned int item = nextItem++;
+    Result result = {0, std::exception_ptr()};
+
+    guard.unlock();
+    try {
+      result.kernel = compile(item);
+    } catch ( ... ) {
+      result.error = std::current_exception();
+    }
+    guard.lock();
+    results[item] = result;
+    compiled.notify_all();
+  }
+}
+
+} // Dedispersion
+
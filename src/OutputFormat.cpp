@@ -0,0 +1,96 @@
+// Copyright 2017 Netherlands Institute for Radio Astronomy (ASTRON)
+// Copyright 2017 Netherlands eScience Center
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdexcept>
+
+#include <OutputFormat.hpp>
+
+namespace Dedispersion {
+
+OutputScaling::OutputScaling() : format(OutputFormat::Float), nrDMs(0) {}
+
+OutputScaling::OutputScaling(const OutputFormat format, const unsigned int nrSynthesizedBeams, const unsigned int nrDMs) : format(format), nrDMs(nrDMs) {
+  if ( (format == OutputFormat::UShort) || (format == OutputFormat::UChar) ) {
+    offsets.assign(nrSynthesizedBeams * nrDMs, 0.0f);
+    scales.assign(nrSynthesizedBeams * nrDMs, 1.0f);
+  }
+}
+
+OutputScaling::~OutputScaling() {}
+
+void OutputScaling::setScaling(const unsigned int sBeam, const unsigned int dm, const float offset, const float scale) {
+  if ( offsets.empty() ) {
+    return;
+  }
+  offsets[(sBeam * nrDMs) + dm] = offset;
+  scales[(sBeam * nrDMs) + dm] = scale;
+}
+
+void OutputScaling::setRange(const unsigned int sBeam, const unsigned int dm, const float minimum, const float maximum) {
+  if ( maximum > minimum ) {
+    setScaling(sBeam, dm, minimum, getOutputFormatMaximum(format) / (maximum - minimum));
+  } else {
+    setScaling(sBeam, dm, minimum, 1.0f);
+  }
+}
+
+OutputFormat getOutputFormat(const std::string & name) {
+  if ( name == "float" ) {
+    return OutputFormat::Float;
+  } else if ( name == "half" ) {
+    return OutputFormat::Half;
+  } else if ( name == "ushort" ) {
+    return OutputFormat::UShort;
+  } else if ( name == "uchar" ) {
+    return OutputFormat::UChar;
+  }
+  throw std::invalid_argument("Unknown output format " + name + ", select one: float half ushort uchar");
+}
+
+std::string getOutputFormatName(const OutputFormat format, const std::string & outputDataType) {
+  switch ( format ) {
+    case OutputFormat::Half:
+      return "half";
+    case OutputFormat::UShort:
+      return "ushort";
+    case OutputFormat::UChar:
+      return "uchar";
+    default:
+      return outputDataType;
+  }
+}
+
+std::string getOutputStoreOpenCL(const OutputFormat format, const std::string & intermediateDataType, const std::string & outputDataType, const std::string & index, const std::string & value, const std::string & row) {
+  std::string floatValue = value;
+
+  if ( intermediateDataType != "float" ) {
+    floatValue = "convert_float(" + value + ")";
+  }
+  switch ( format ) {
+    case OutputFormat::Half:
+      return "vstore_half(" + floatValue + ", " + index + ", output);\n";
+    case OutputFormat::UShort:
+    case OutputFormat::UChar:
+      return "output[" + index + "] = convert_" + getOutputFormatName(format, outputDataType) + "_sat_rte((" + floatValue + " - offsets[" + row + "]) * scales[" + row + "]);\n";
+    default:
+      break;
+  }
+  if ( intermediateDataType == outputDataType ) {
+    return "output[" + index + "] = " + value + ";\n";
+  }
+  return "output[" + index + "] = convert_" + outputDataType + "(" + value + ");\n";
+}
+
+} // Dedispersion
@@ -0,0 +1,263 @@
+// Copyright 2017 Netherlands Institute for Radio Astronomy (ASTRON)
+// Copyright 2017 Netherlands eScience Center
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+#include <fcntl.h>
+#include <unistd.h>
+#include <semaphore.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <ReadData.hpp>
+#include <RingBuffer.hpp>
+
+namespace Dedispersion {
+
+// Beginning of the shared memory, followed by the data blocks at dataOffset
+struct RingControl {
+  uint64_t magic;
+  unsigned int nrBlocks;
+  uint64_t nrBytesPerBlock;
+  uint64_t dataOffset;
+  // Blocks the writer can fill, and blocks the reader can acquire
+  sem_t freeBlocks;
+  sem_t fullBlocks;
+  std::atomic< uint64_t > nrWrittenBlocks;
+  std::atomic< uint64_t > nrReadBlocks;
+  std::atomic< uint64_t > nrDroppedBlocks;
+  std::atomic< bool > endOfData;
+  char header[nrRingHeaderBytes];
+};
+
+const uint64_t ringMagic = 0x44454449535052ULL;
+
+// sem_wait() is interrupted by signals
+void waitSemaphore(sem_t * semaphore) {
+  while ( sem_wait(semaphore) != 0 ) {
+    if ( errno != EINTR ) {
+      throw std::runtime_error("Impossible to wait on the ring: " + std::string(std::strerror(errno)));
+    }
+  }
+}
+
+RingWriter::RingWriter(const std::string & name, const unsigned int nrBlocks, const uint64_t nrBytesPerBlock, const std::string & header) : name(name), control(nullptr), data(nullptr), size(0) {
+  const uint64_t pageSize = sysconf(_SC_PAGESIZE);
+  const uint64_t dataOffset = ((sizeof(RingControl) + pageSize - 1) / pageSize) * pageSize;
+  void * mapping = MAP_FAILED;
+
+  if ( (nrBlocks == 0) || (nrBytesPerBlock == 0) ) {
+    throw std::invalid_argument("A ring needs at least one block of one byte.");
+  }
+  if ( header.size() >= nrRingHeaderBytes ) {
+    throw std::invalid_argument("The ring header is longer than " + std::to_string(nrRingHeaderBytes - 1) + " characters.");
+  }
+  // Blocks start at page boundaries
+  size = dataOffset + (nrBlocks * (((nrBytesPerBlock + pageSize - 1) / pageSize) * pageSize));
+  int file = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, S_IRUSR | S_IWUSR);
+  if ( file < 0 ) {
+    throw AstroData::FileError("Impossible to create the ring " + name + ": " + std::strerror(errno));
+  }
+  if ( ftruncate(file, size) == 0 ) {
+    mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+  }
+  ::close(file);
+  if ( mapping == MAP_FAILED ) {
+    shm_unlink(name.c_str());
+    throw AstroData::FileError("Impossible to map the ring " + name + ".");
+  }
+  control = new (mapping) RingControl();
+  data = reinterpret_cast< uint8_t * >(mapping) + dataOffset;
+  control->nrBlocks = nrBlocks;
+  control->nrBytesPerBlock = ((nrBytesPerBlock + pageSize - 1) / pageSize) * pageSize;
+  control->dataOffset = dataOffset;
+  // Fails with more blocks than SEM_VALUE_MAX, or without process-shared semaphores
+  const bool freeBlocksReady = sem_init(&control->freeBlocks, 1, nrBlocks) == 0;
+  if ( !freeBlocksReady || (sem_init(&control->fullBlocks, 1, 0) != 0) ) {
+    const std::string error = std::strerror(errno);
+
+    if ( freeBlocksReady ) {
+      sem_destroy(&control->freeBlocks);
+    }
+    munmap(mapping, size);
+    shm_unlink(name.c_str());
+    throw AstroData::FileError("Impossible to initialize the semaphores of the ring " + name + ": " + error);
+  }
+  control->nrWrittenBlocks = 0;
+  control->nrReadBlocks = 0;
+  control->nrDroppedBlocks = 0;
+  control->endOfData = false;
+  std::memcpy(control->header, header.c_str(), header.size() + 1);
+  // A reader attaching now finds the ring ready
+  std::atomic_thread_fence(std::memory_order_release);
+  control->magic = ringMagic;
+}
+
+RingWriter::~RingWriter() {
+  // The reader keeps its own mapping
+  munmap(control, size);
+  shm_unlink(name.c_str());
+}
+
+unsigned int RingWriter::getNrBlocks() const {
+  return control->nrBlocks;
+}
+
+uint64_t RingWriter::getNrBytesPerBlock() const {
+  return control->nrBytesPerBlock;
+}
+
+uint64_t RingWriter::getNrWrittenBlocks() const {
+  return control->nrWrittenBlocks;
+}
+
+uint64_t RingWriter::getNrDroppedBlocks() const {
+  return control->nrDroppedBlocks;
+}
+
+uint64_t RingWriter::getOccupancy() const {
+  return control->nrWrittenBlocks - control->nrReadBlocks;
+}
+
+uint8_t * RingWriter::getBlock(const bool wait) {
+  if ( wait ) {
+    waitSemaphore(&control->freeBlocks);
+  } else if ( sem_trywait(&control->freeBlocks) != 0 ) {
+    control->nrDroppedBlocks++;
+    return nullptr;
+  }
+  return data + ((control->nrWrittenBlocks % control->nrBlocks) * control->nrBytesPerBlock);
+}
+
+void RingWriter::commit() {
+  control->nrWrittenBlocks++;
+  sem_post(&control->fullBlocks);
+}
+
+void RingWriter::close() {
+  control->endOfData = true;
+  sem_post(&control->fullBlocks);
+}
+
+RingReader::RingReader(const std::string & name) : control(nullptr), data(nullptr), size(0), nrAcquiredBlocks(0), nrReleasedBlocks(0) {
+  struct stat status;
+  void * mapping = MAP_FAILED;
+  int file = shm_open(name.c_str(), O_RDWR, 0);
+
+  if ( file < 0 ) {
+    throw AstroData::FileError("Impossible to open the ring " + name + ": " + std::strerror(errno));
+  }
+  if ( (fstat(file, &status) == 0) && (static_cast< uint64_t >(status.st_size) >= sizeof(RingControl)) ) {
+    size = status.st_size;
+    mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+  }
+  ::close(file);
+  if ( mapping == MAP_FAILED ) {
+    throw AstroData::FileError("Impossible to map the ring " + name + ".");
+  }
+  control = reinterpret_cast< RingControl * >(mapping);
+  if ( control->magic != ringMagic ) {
+    munmap(mapping, size);
+    throw AstroData::FileError(name + " is not a ring, or it is not ready.");
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);
+  data = reinterpret_cast< const uint8_t * >(mapping) + control->dataOffset;
+  header = std::string(control->header, strnlen(control->header, nrRingHeaderBytes));
+  // Blocks written before attaching are read first
+  nrAcquiredBlocks = control->nrReadBlocks;
+  nrReleasedBlocks = control->nrReadBlocks;
+}
+
+RingReader::~RingReader() {
+  munmap(control, size);
+}
+
+unsigned int RingReader::getNrBlocks() const {
+  return control->nrBlocks;
+}
+
+uint64_t RingReader::getNrBytesPerBlock() const {
+  return control->nrBytesPerBlock;
+}
+
+uint64_t RingReader::getNrWrittenBlocks() const {
+  return control->nrWrittenBlocks;
+}
+
+uint64_t RingReader::getNrDroppedBlocks() const {
+  return control->nrDroppedBlocks;
+}
+
+uint64_t RingReader::getOccupancy() const {
+  return control->nrWrittenBlocks - control->nrReadBlocks;
+}
+
+bool RingReader::acquire(const unsigned int nrBlocks) {
+  if ( nrBlocks > getNrBlocks() ) {
+    throw std::invalid_argument("The ring has less than " + std::to_string(nrBlocks) + " blocks.");
+  }
+  while ( (nrAcquiredBlocks - nrReleasedBlocks) < nrBlocks ) {
+    waitSemaphore(&control->fullBlocks);
+    if ( nrAcquiredBlocks < control->nrWrittenBlocks ) {
+      nrAcquiredBlocks++;
+    } else if ( control->endOfData ) {
+      // Wake the next call too
+      sem_post(&control->fullBlocks);
+      return false;
+    }
+  }
+  return true;
+}
+
+void RingReader::release() {
+  if ( nrReleasedBlocks == nrAcquiredBlocks ) {
+    throw std::invalid_argument("The reader holds no blocks.");
+  }
+  nrReleasedBlocks++;
+  control->nrReadBlocks++;
+  sem_post(&control->freeBlocks);
+}
+
+std::string getRingHeader(const AstroData::Observation & observation, const unsigned int padding, const uint8_t inputBits, const InputLayout & layout) {
+  std::ostringstream header;
+
+  header << std::setprecision(9);
+  header << "NBEAM " << observation.getNrBeams() << "\n";
+  header << "NCHAN " << observation.getNrChannels() << "\n";
+  header << "NBIT " << static_cast< unsigned int >(inputBits) << "\n";
+  header << "MIN_FREQ " << observation.getMinFreq() << "\n";
+  header << "CHANNEL_BW " << observation.getChannelBandwidth() << "\n";
+  header << "SAMPLING_TIME " << observation.getSamplingTime() << "\n";
+  header << "BLOCK_SAMPLES " << observation.getNrSamplesPerBatch() << "\n";
+  header << "PADDING " << padding << "\n";
+  header << "ORDER " << ((layout.getOrdering() == InputOrdering::TimeMajor) ? "time" : "channel") << "\n";
+  header << "REVERSED_FREQ " << layout.getReversedFrequency() << "\n";
+  return header.str();
+}
+
+void setObservation(const RingReader & reader, AstroData::Observation & observation, unsigned int & padding, InputLayout & layout) {
+  observation.setNrBeams(reader.getHeaderValue< unsigned int >("NBEAM"));
+  observation.setFrequencyRange(observation.getNrSubbands(), reader.getHeaderValue< unsigned int >("NCHAN"), reader.getHeaderValue< float >("MIN_FREQ"), reader.getHeaderValue< float >("CHANNEL_BW"));
+  observation.setSamplingTime(reader.getHeaderValue< float >("SAMPLING_TIME"));
+  observation.setNrSamplesPerBatch(reader.getHeaderValue< unsigned int >("BLOCK_SAMPLES"));
+  padding = reader.getHeaderValue< unsigned int >("PADDING");
+  layout.setOrdering(getInputOrdering(reader.getHeaderValue< std::string >("ORDER")));
+  layout.setReversedFrequency(reader.getHeaderValue< bool >("REVERSED_FREQ"));
+}
+
+} // Dedispersion
+
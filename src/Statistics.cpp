@@ -0,0 +1,63 @@
+// Copyright 2017 Netherlands Institute for Radio Astronomy (ASTRON)
+// Copyright 2017 Netherlands eScience Center
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+
+#include <Statistics.hpp>
+
+namespace Dedispersion {
+
+Statistics::Statistics() : nrDMs(0), nrPartials(0), nrSamples(0) {}
+
+Statistics::Statistics(const DedispersionConf & conf, const AstroData::Observation & observation, const bool subbanding) : nrDMs(observation.getNrDMs()), nrPartials(getNrStatisticsPartials(conf, observation)), nrSamples(observation.getNrSamplesPerBatch() / observation.getDownsampling()) {
+  if ( subbanding ) {
+    nrDMs = observation.getNrDMs(true) * observation.getNrDMs();
+  }
+  partials.assign(observation.getNrSynthesizedBeams() * nrDMs * nrPartials * 2, 0.0f);
+}
+
+Statistics::~Statistics() {}
+
+double Statistics::getSum(const unsigned int sBeam, const unsigned int dm) const {
+  double sum = 0.0;
+
+  for ( unsigned int partial = 0; partial < nrPartials; partial++ ) {
+    sum += partials[((((sBeam * nrDMs) + dm) * nrPartials) + partial) * 2];
+  }
+  return sum;
+}
+
+double Statistics::getSumOfSquares(const unsigned int sBeam, const unsigned int dm) const {
+  double sumOfSquares = 0.0;
+
+  for ( unsigned int partial = 0; partial < nrPartials; partial++ ) {
+    sumOfSquares += partials[(((((sBeam * nrDMs) + dm) * nrPartials) + partial) * 2) + 1];
+  }
+  return sumOfSquares;
+}
+
+float Statistics::getMean(const unsigned int sBeam, const unsigned int dm) const {
+  return getSum(sBeam, dm) / nrSamples;
+}
+
+float Statistics::getStandardDeviation(const unsigned int sBeam, const unsigned int dm) const {
+  const double mean = getSum(sBeam, dm) / nrSamples;
+
+  // Rounding can make the variance of a constant series slightly negative
+  return std::sqrt(std::max((getSumOfSquares(sBeam, dm) / nrSamples) - (mean * mean), 0.0));
+}
+
+} // Dedispersion
+
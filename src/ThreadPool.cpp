@@ -0,0 +1,105 @@
+// Copyright 2017 Netherlands Institute for Radio Astronomy (ASTRON)
+// Copyright 2017 Netherlands eScience Center
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <ThreadPool.hpp>
+
+namespace Dedispersion {
+
+ThreadPool::ThreadPool(const unsigned int nrThreads) : nrThreads(nrThreads), body(0), nrItems(0), nextItem(0), generation(0), nrBusyWorkers(0), stop(false) {
+  if ( this->nrThreads == 0 ) {
+    this->nrThreads = std::thread::hardware_concurrency();
+  }
+  if ( this->nrThreads == 0 ) {
+    this->nrThreads = 1;
+  }
+  for ( unsigned int thread = 1; thread < this->nrThreads; thread++ ) {
+    workers.push_back(std::thread(&ThreadPool::worker, this, thread));
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard< std::mutex > guard(lock);
+    stop = true;
+  }
+  start.notify_all();
+  for ( auto worker = workers.begin(); worker != workers.end(); ++worker ) {
+    worker->join();
+  }
+}
+
+void ThreadPool::parallelFor(const unsigned int nrItems, const std::function< void(const unsigned int, const unsigned int) > & body) {
+  if ( nrItems == 0 ) {
+    return;
+  }
+  {
+    std::lock_guard< std::mutex > guard(lock);
+    this->body = &body;
+    this->nrItems = nrItems;
+    nextItem = 0;
+    nrBusyWorkers = workers.size();
+    error = std::exception_ptr();
+    generation++;
+  }
+  start.notify_all();
+  run(0);
+  {
+    std::unique_lock< std::mutex > guard(lock);
+    done.wait(guard, [this]{ return nrBusyWorkers == 0; });
+    this->body = 0;
+  }
+  if ( error ) {
+    std::rethrow_exception(error);
+  }
+}
+
+void ThreadPool::worker(const unsigned int thread) {
+  unsigned int seenGeneration = 0;
+
+  while ( true ) {
+    {
+      std::unique_lock< std::mutex > guard(lock);
+      start.wait(guard, [this, seenGeneration]{ return stop || (generation != seenGeneration); });
+      if ( stop ) {
+        return;
+      }
+      seenGeneration = generation;
+    }
+    run(thread);
+    {
+      std::lock_guard< std::mutex > guard(lock);
+      nrBusyWorkers--;
+    }
+    done.notify_one();
+  }
+}
+
+void ThreadPool::run(const unsigned int thread) {
+  try {
+    for ( unsigned int item = nextItem++; item < nrItems; item = nextItem++ ) {
+      (*body)(item, thread);
+    }
+  } catch ( ... ) {
+    std::lock_guard< std::mutex > guard(lock);
+    if ( !error ) {
+      error = std::current_exception();
+    }
+    // Stop handing out work
+    nextItem = nrItems;
+  }
+}
+
+} // Dedispersion
+
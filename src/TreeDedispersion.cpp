@@ -0,0 +1,63 @@
+// Copyright 2017 Netherlands Institute for Radio Astronomy (ASTRON)
+// Copyright 2017 Netherlands eScience Center
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdlib>
+
+#include <TreeDedispersion.hpp>
+
+namespace Dedispersion {
+
+std::vector< unsigned int > getTreeDelayErrors(const DelayTable & delays, const unsigned int nrChannelsPerTree) {
+  std::vector< unsigned int > errors(delays.getNrDMs());
+
+  for ( unsigned int dm = 0; dm < delays.getNrDMs(); dm++ ) {
+    for ( unsigned int channel = 0; channel < delays.getNrChannels(); channel++ ) {
+      unsigned int position = delays.getNrChannels() - 1 - channel;
+      unsigned int tree = position / nrChannelsPerTree;
+      int treeDelay = delays.getDelay(dm, delays.getNrChannels() - 1 - (tree * nrChannelsPerTree)) + getTreeDelay(nrChannelsPerTree, getTreeSweep(delays, dm, tree, nrChannelsPerTree), position % nrChannelsPerTree);
+
+      errors[dm] = std::max(errors[dm], static_cast< unsigned int >(std::abs(treeDelay - static_cast< int >(delays.getDelay(dm, channel)))));
+    }
+  }
+  return errors;
+}
+
+unsigned int getTreeSweep(const DelayTable & delays, const unsigned int dm, const unsigned int tree, const unsigned int nrChannelsPerTree) {
+  unsigned int highChannel = delays.getNrChannels() - 1 - (tree * nrChannelsPerTree);
+  unsigned int nrTreeChannels = std::min(nrChannelsPerTree, highChannel + 1);
+  unsigned int sweep = delays.getDelay(dm, highChannel - (nrTreeChannels - 1)) - delays.getDelay(dm, highChannel);
+
+  if ( nrTreeChannels == nrChannelsPerTree ) {
+    return sweep;
+  } else if ( nrTreeChannels == 1 ) {
+    return 0;
+  }
+  return ((sweep * (nrChannelsPerTree - 1)) + ((nrTreeChannels - 1) / 2)) / (nrTreeChannels - 1);
+}
+
+unsigned int getTreeDelay(const unsigned int nrChannels, const unsigned int sweep, const unsigned int position) {
+  if ( nrChannels == 1 ) {
+    return 0;
+  }
+  unsigned int nrHalfChannels = nrChannels / 2;
+
+  if ( position < nrHalfChannels ) {
+    return getTreeDelay(nrHalfChannels, getTreeInnerSweep(nrHalfChannels, sweep), position);
+  }
+  return getTreeOffset(nrHalfChannels, sweep) + getTreeDelay(nrHalfChannels, getTreeInnerSweep(nrHalfChannels, sweep), position - nrHalfChannels);
+}
+
+} // Dedispersion
+
@@ -0,0 +1,152 @@
+// Copyright 2017 Netherlands Institute for Radio Astronomy (ASTRON)
+// Copyright 2017 Netherlands eScience Center
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <array>
+
+#include <Unpack.hpp>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define DEDISPERSION_SSE2
+#endif
+
+namespace Dedispersion {
+
+namespace {
+
+typedef std::array< uint8_t, 256 * 8 > UnpackTable;
+
+UnpackTable buildUnpackTable(const uint8_t inputBits) {
+  UnpackTable table = UnpackTable();
+
+  for ( unsigned int value = 0; value < 256; value++ ) {
+    for ( unsigned int item = 0; item < 8u / inputBits; item++ ) {
+      table[(value * 8) + item] = (value >> (item * inputBits)) & ((1u << inputBits) - 1);
+    }
+  }
+  return table;
+}
+
+#ifdef DEDISPERSION_SSE2
+// Sample k of every byte of a vector of 16 bytes
+inline __m128i getSamples(const __m128i bytes, const int firstBit, const __m128i mask) {
+  return _mm_and_si128(_mm_srli_epi16(bytes, firstBit), mask);
+}
+
+// 16 bytes at a time: the samples with the same position in their byte are extracted from all the bytes at once, and then interleaved
+unsigned int unpackBytesSSE2(const uint8_t * bytes, uint8_t * samples, const unsigned int nrBytes, const uint8_t inputBits) {
+  unsigned int byte = 0;
+
+  if ( inputBits == 4 ) {
+    const __m128i mask = _mm_set1_epi8(0x0F);
+
+    for ( ; byte + 16 <= nrBytes; byte += 16 ) {
+      const __m128i values = _mm_loadu_si128(reinterpret_cast< const __m128i * >(bytes + byte));
+      const __m128i s0 = getSamples(values, 0, mask);
+      const __m128i s1 = getSamples(values, 4, mask);
+      __m128i * output = reinterpret_cast< __m128i * >(samples + (byte * 2));
+
+      _mm_storeu_si128(output, _mm_unpacklo_epi8(s0, s1));
+      _mm_storeu_si128(output + 1, _mm_unpackhi_epi8(s0, s1));
+    }
+  } else if ( inputBits == 2 ) {
+    const __m128i mask = _mm_set1_epi8(0x03);
+
+    for ( ; byte + 16 <= nrBytes; byte += 16 ) {
+      const __m128i values = _mm_loadu_si128(reinterpret_cast< const __m128i * >(bytes + byte));
+      const __m128i s0 = getSamples(values, 0, mask);
+      const __m128i s1 = getSamples(values, 2, mask);
+      const __m128i s2 = getSamples(values, 4, mask);
+      const __m128i s3 = getSamples(values, 6, mask);
+      const __m128i s01Low = _mm_unpacklo_epi8(s0, s1);
+      const __m128i s01High = _mm_unpackhi_epi8(s0, s1);
+      const __m128i s23Low = _mm_unpacklo_epi8(s2, s3);
+      const __m128i s23High = _mm_unpackhi_epi8(s2, s3);
+      __m128i * output = reinterpret_cast< __m128i * >(samples + (byte * 4));
+
+      _mm_storeu_si128(output, _mm_unpacklo_epi16(s01Low, s23Low));
+      _mm_storeu_si128(output + 1, _mm_unpackhi_epi16(s01Low, s23Low));
+      _mm_storeu_si128(output + 2, _mm_unpacklo_epi16(s01High, s23High));
+      _mm_storeu_si128(output + 3, _mm_unpackhi_epi16(s01High, s23High));
+    }
+  } else if ( inputBits == 1 ) {
+    const __m128i mask = _mm_set1_epi8(0x01);
+
+    for ( ; byte + 16 <= nrBytes; byte += 16 ) {
+      const __m128i values = _mm_loadu_si128(reinterpret_cast< const __m128i * >(bytes + byte));
+      __m128i pairs[8];
+      __m128i quads[8];
+      __m128i * output = reinterpret_cast< __m128i * >(samples + (byte * 8));
+
+      for ( unsigned int item = 0; item < 4; item++ ) {
+        const __m128i even = getSamples(values, 2 * item, mask);
+        const __m128i odd = getSamples(values, (2 * item) + 1, mask);
+
+        pairs[item] = _mm_unpacklo_epi8(even, odd);
+        pairs[item + 4] = _mm_unpackhi_epi8(even, odd);
+      }
+      // Pairs of samples 0-1, 2-3, 4-5 and 6-7 of bytes 0 to 7, followed by the ones of bytes 8 to 15
+      for ( unsigned int half = 0; half < 2; half++ ) {
+        quads[half * 4] = _mm_unpacklo_epi16(pairs[half * 4], pairs[(half * 4) + 1]);
+        quads[(half * 4) + 1] = _mm_unpackhi_epi16(pairs[half * 4], pairs[(half * 4) + 1]);
+        quads[(half * 4) + 2] = _mm_unpacklo_epi16(pairs[(half * 4) + 2], pairs[(half * 4) + 3]);
+        quads[(half * 4) + 3] = _mm_unpackhi_epi16(pairs[(half * 4) + 2], pairs[(half * 4) + 3]);
+      }
+      for ( unsigned int quarter = 0; quarter < 4; quarter++ ) {
+        const unsigned int low = ((quarter / 2) * 4) + (quarter % 2);
+
+        _mm_storeu_si128(output + (2 * quarter), _mm_unpacklo_epi32(quads[low], quads[low + 2]));
+        _mm_storeu_si128(output + (2 * quarter) + 1, _mm_unpackhi_epi32(quads[low], quads[low + 2]));
+      }
+    }
+  }
+  return byte;
+}
+#endif // DEDISPERSION_SSE2
+
+} // namespace
+
+const uint8_t * getUnpackTable(const uint8_t inputBits) {
+  static const UnpackTable oneBit = buildUnpackTable(1);
+  static const UnpackTable twoBits = buildUnpackTable(2);
+  static const UnpackTable fourBits = buildUnpackTable(4);
+
+  if ( inputBits == 1 ) {
+    return oneBit.data();
+  } else if ( inputBits == 2 ) {
+    return twoBits.data();
+  }
+  return fourBits.data();
+}
+
+void unpackBytes(const uint8_t * bytes, uint8_t * samples, const unsigned int nrBytes, const uint8_t inputBits) {
+  const unsigned int nrSamplesPerByte = 8 / inputBits;
+  const uint8_t * table = getUnpackTable(inputBits);
+  unsigned int byte = 0;
+
+#ifdef DEDISPERSION_SSE2
+  byte = unpackBytesSSE2(bytes, samples, nrBytes, inputBits);
+#endif
+  for ( ; byte < nrBytes; byte++ ) {
+    const uint8_t * values = table + (static_cast< unsigned int >(bytes[byte]) * 8);
+
+    for ( unsigned int item = 0; item < nrSamplesPerByte; item++ ) {
+      samples[(byte * nrSamplesPerByte) + item] = values[item];
+    }
+  }
+}
+
+} // Dedispersion
+